@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2021 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Connection startup benchmark.  The client issues fi_connect on N MSG
+ * endpoints back to back, then waits for all of them to report
+ * FI_CONNECTED.  The server accepts requests as they arrive.  Both sides
+ * report the wall time needed to bring up every connection, which
+ * measures how well the provider overlaps concurrent handshakes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_endpoint.h>
+#include <rdma/fi_cm.h>
+
+#include <shared.h>
+
+static int conn_cnt = 64;
+static struct fid_ep **eps;
+
+static int open_ep(struct fi_info *info, struct fid_ep **new_ep)
+{
+	int ret;
+
+	ret = fi_endpoint(domain, info, new_ep, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_endpoint", ret);
+		return ret;
+	}
+
+	FT_EP_BIND(*new_ep, eq, 0);
+	FT_EP_BIND(*new_ep, txcq, FI_TRANSMIT | FI_RECV);
+
+	ret = fi_enable(*new_ep);
+	if (ret) {
+		FT_PRINTERR("fi_enable", ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int open_domain_res(struct fi_info *info)
+{
+	int ret;
+
+	ret = fi_domain(fabric, info, &domain, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_domain", ret);
+		return ret;
+	}
+
+	cq_attr.format = FI_CQ_FORMAT_CONTEXT;
+	cq_attr.wait_obj = FI_WAIT_NONE;
+	cq_attr.size = info->tx_attr->size + info->rx_attr->size;
+	ret = fi_cq_open(domain, &cq_attr, &txcq, &txcq);
+	if (ret) {
+		FT_PRINTERR("fi_cq_open", ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+static int read_cm_event(uint32_t *event, struct fi_eq_cm_entry *entry)
+{
+	ssize_t rd;
+
+	rd = fi_eq_sread(eq, event, entry, sizeof(*entry), -1, 0);
+	if (rd != sizeof(*entry)) {
+		FT_PROCESS_EQ_ERR(rd, eq, "fi_eq_sread", "cm event");
+		return rd ? (int) rd : -FI_EOTHER;
+	}
+
+	return 0;
+}
+
+static int server_run(void)
+{
+	struct fi_eq_cm_entry entry;
+	uint32_t event;
+	int accepted = 0, connected = 0;
+	int ret;
+
+	ret = ft_start_server();
+	if (ret)
+		return ret;
+
+	while (connected < conn_cnt) {
+		ret = read_cm_event(&event, &entry);
+		if (ret)
+			return ret;
+
+		switch (event) {
+		case FI_CONNREQ:
+			if (!accepted) {
+				ft_start();
+				ret = open_domain_res(entry.info);
+				if (ret)
+					goto err;
+			}
+
+			if (accepted == conn_cnt) {
+				FT_ERR("Unexpected connection request");
+				ret = -FI_EOTHER;
+				goto err;
+			}
+
+			ret = open_ep(entry.info, &eps[accepted]);
+			if (ret)
+				goto err;
+
+			ret = fi_accept(eps[accepted], NULL, 0);
+			if (ret) {
+				FT_PRINTERR("fi_accept", ret);
+				goto err;
+			}
+			accepted++;
+			fi_freeinfo(entry.info);
+			break;
+		case FI_CONNECTED:
+			connected++;
+			break;
+		default:
+			FT_ERR("Unexpected CM event %d", event);
+			return -FI_EOTHER;
+		}
+	}
+	ft_stop();
+
+	return 0;
+err:
+	fi_reject(pep, entry.info->handle, NULL, 0);
+	fi_freeinfo(entry.info);
+	return ret;
+}
+
+static int client_run(void)
+{
+	struct fi_eq_cm_entry entry;
+	uint32_t event;
+	int i, connected = 0;
+	int ret;
+
+	ret = ft_getinfo(hints, &fi);
+	if (ret)
+		return ret;
+
+	ret = fi_fabric(fi->fabric_attr, &fabric, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_fabric", ret);
+		return ret;
+	}
+
+	ret = fi_eq_open(fabric, &eq_attr, &eq, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_eq_open", ret);
+		return ret;
+	}
+
+	ret = open_domain_res(fi);
+	if (ret)
+		return ret;
+
+	ft_start();
+	for (i = 0; i < conn_cnt; i++) {
+		ret = open_ep(fi, &eps[i]);
+		if (ret)
+			return ret;
+
+		ret = fi_connect(eps[i], fi->dest_addr, NULL, 0);
+		if (ret) {
+			FT_PRINTERR("fi_connect", ret);
+			return ret;
+		}
+	}
+
+	while (connected < conn_cnt) {
+		ret = read_cm_event(&event, &entry);
+		if (ret)
+			return ret;
+
+		if (event != FI_CONNECTED) {
+			FT_ERR("Unexpected CM event %d", event);
+			return -FI_EOTHER;
+		}
+		connected++;
+	}
+	ft_stop();
+
+	return 0;
+}
+
+static void show_startup_perf(void)
+{
+	int64_t elapsed = get_elapsed(&start, &end, MICRO);
+
+	printf("%-12s%12s%14s%14s\n", "endpoints", "time",
+	       "usec/conn", "conn/sec");
+	printf("%-12d%11.3fs%14.2f%14.2f\n", conn_cnt, elapsed / 1000000.0,
+	       (float) elapsed / conn_cnt,
+	       elapsed ? conn_cnt * 1000000.0 / elapsed : 0.0);
+}
+
+static void free_eps(void)
+{
+	int i;
+
+	if (!eps)
+		return;
+
+	for (i = 0; i < conn_cnt; i++)
+		FT_CLOSE_FID(eps[i]);
+	free(eps);
+}
+
+static int run(void)
+{
+	int ret;
+
+	eps = calloc(conn_cnt, sizeof(*eps));
+	if (!eps)
+		return -FI_ENOMEM;
+
+	ret = opts.dst_addr ? client_run() : server_run();
+	if (ret)
+		return ret;
+
+	show_startup_perf();
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "n:h" CS_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'n':
+			conn_cnt = atoi(optarg);
+			if (conn_cnt <= 0) {
+				FT_ERR("Invalid endpoint count %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Connection startup time for MSG endpoints.");
+			FT_PRINT_OPTS_USAGE("-n <count>",
+				"number of endpoints to connect (default 64)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_MSG;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+
+	ret = run();
+
+	free_eps();
+	ft_free_res();
+	return ft_exit_code(ret);
+}
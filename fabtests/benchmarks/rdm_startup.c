@@ -0,0 +1,349 @@
+/*
+ * Copyright (c) 2021 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Time to first message for RDM endpoints.  The client opens N fresh
+ * endpoints, none of which has talked to the server yet, and each sends
+ * its address to the server.  The server answers every request from its
+ * single endpoint.  The client reports the wall time until all N
+ * endpoints have their reply, and the server the time until it has
+ * answered them all.  For connection-oriented providers this covers
+ * connection setup together with the first message on it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_cm.h>
+#include <rdma/fi_tagged.h>
+
+#include <shared.h>
+
+#define STARTUP_REQ_TAG		(1ULL << 60)
+#define STARTUP_RESP_TAG	(2ULL << 60)
+#define STARTUP_NAME_LEN	64
+
+struct startup_msg {
+	size_t addrlen;
+	char addr[STARTUP_NAME_LEN];
+};
+
+static int ep_cnt = 64;
+static struct fid_ep **eps;
+static struct fid_cq *startup_cq;
+static struct startup_msg *msgs;
+static struct fi_context *ctxs;
+
+/* See wait_comps in rdm_tagged_depth.c */
+static int read_comp(struct fid_cq *cq, struct fi_cq_tagged_entry *comp)
+{
+	int ret;
+
+	for (;;) {
+		ret = fi_cq_read(cq, comp, 1);
+		if (ret > 0) {
+			if (cq == rxcq && comp->op_context == &rx_ctx) {
+				rx_cq_cntr++;
+				continue;
+			}
+			return 0;
+		} else if (ret == -FI_EAVAIL) {
+			return ft_cq_readerr(cq);
+		} else if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("fi_cq_read", ret);
+			return ret;
+		}
+	}
+}
+
+static int post_trecv(struct fid_ep *rx_ep, void *buf, uint64_t tag,
+		      void *ctx)
+{
+	int ret;
+
+	do {
+		ret = fi_trecv(rx_ep, buf, sizeof(struct startup_msg), NULL,
+			       FI_ADDR_UNSPEC, tag, 0, ctx);
+	} while (ret == -FI_EAGAIN);
+
+	if (ret)
+		FT_PRINTERR("fi_trecv", ret);
+	return ret;
+}
+
+static int post_tsend(struct fid_ep *tx_ep, struct fid_cq *cq, void *buf,
+		      fi_addr_t addr, uint64_t tag, void *ctx)
+{
+	int ret;
+
+	do {
+		ret = fi_tsend(tx_ep, buf, sizeof(struct startup_msg), NULL,
+			       addr, tag, ctx);
+		if (ret == -FI_EAGAIN)
+			(void) fi_cq_read(cq, NULL, 0);
+	} while (ret == -FI_EAGAIN);
+
+	if (ret)
+		FT_PRINTERR("fi_tsend", ret);
+	return ret;
+}
+
+static int open_client_eps(void)
+{
+	int i, ret;
+
+	cq_attr.format = FI_CQ_FORMAT_TAGGED;
+	cq_attr.wait_obj = FI_WAIT_NONE;
+	cq_attr.size = 2 * ep_cnt;
+	ret = fi_cq_open(domain, &cq_attr, &startup_cq, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_cq_open", ret);
+		return ret;
+	}
+
+	for (i = 0; i < ep_cnt; i++) {
+		ret = fi_endpoint(domain, fi, &eps[i], NULL);
+		if (ret) {
+			FT_PRINTERR("fi_endpoint", ret);
+			return ret;
+		}
+
+		FT_EP_BIND(eps[i], av, 0);
+		FT_EP_BIND(eps[i], startup_cq, FI_TRANSMIT | FI_RECV);
+
+		ret = fi_enable(eps[i]);
+		if (ret) {
+			FT_PRINTERR("fi_enable", ret);
+			return ret;
+		}
+
+		msgs[i].addrlen = sizeof(msgs[i].addr);
+		ret = fi_getname(&eps[i]->fid, msgs[i].addr, &msgs[i].addrlen);
+		if (ret) {
+			FT_PRINTERR("fi_getname", ret);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static int client_run(void)
+{
+	struct fi_cq_tagged_entry comp;
+	int i, ret;
+
+	ret = open_client_eps();
+	if (ret)
+		return ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	ft_start();
+	for (i = 0; i < ep_cnt; i++) {
+		ret = post_trecv(eps[i], &msgs[ep_cnt + i], STARTUP_RESP_TAG,
+				 &ctxs[ep_cnt + i]);
+		if (ret)
+			return ret;
+
+		ret = post_tsend(eps[i], startup_cq, &msgs[i], remote_fi_addr,
+				 STARTUP_REQ_TAG, &ctxs[i]);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < 2 * ep_cnt; i++) {
+		ret = read_comp(startup_cq, &comp);
+		if (ret)
+			return ret;
+	}
+	ft_stop();
+
+	return 0;
+}
+
+static int server_run(void)
+{
+	struct fi_cq_tagged_entry comp;
+	struct startup_msg *msg;
+	fi_addr_t *addrs;
+	size_t idx;
+	int answered = 0, received = 0, i, ret;
+
+	addrs = calloc(ep_cnt, sizeof(*addrs));
+	if (!addrs)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < ep_cnt; i++) {
+		ret = post_trecv(ep, &msgs[i], STARTUP_REQ_TAG, &ctxs[i]);
+		if (ret)
+			goto out;
+	}
+
+	ret = ft_sync();
+	if (ret)
+		goto out;
+
+	ft_start();
+	while (received < ep_cnt) {
+		ret = read_comp(rxcq, &comp);
+		if (ret)
+			goto out;
+
+		idx = (struct fi_context *) comp.op_context - ctxs;
+		msg = &msgs[idx];
+		ret = fi_av_insert(av, msg->addr, 1, &addrs[received], 0, NULL);
+		if (ret != 1) {
+			FT_PRINTERR("fi_av_insert", ret);
+			ret = ret < 0 ? ret : -FI_EOTHER;
+			goto out;
+		}
+
+		ret = post_tsend(ep, txcq, msg, addrs[received],
+				 STARTUP_RESP_TAG, &ctxs[ep_cnt + received]);
+		if (ret)
+			goto out;
+		received++;
+	}
+
+	while (answered < ep_cnt) {
+		ret = read_comp(txcq, &comp);
+		if (ret)
+			goto out;
+		answered++;
+	}
+	ft_stop();
+
+out:
+	free(addrs);
+	return ret;
+}
+
+static void show_startup_perf(void)
+{
+	int64_t elapsed = get_elapsed(&start, &end, MICRO);
+
+	printf("%-12s%12s%14s%14s\n", "endpoints", "time",
+	       "usec/ep", "ep/sec");
+	printf("%-12d%11.3fs%14.2f%14.2f\n", ep_cnt, elapsed / 1000000.0,
+	       (float) elapsed / ep_cnt,
+	       elapsed ? ep_cnt * 1000000.0 / elapsed : 0.0);
+}
+
+static void free_eps(void)
+{
+	int i;
+
+	if (eps) {
+		for (i = 0; i < ep_cnt; i++)
+			FT_CLOSE_FID(eps[i]);
+		free(eps);
+	}
+	FT_CLOSE_FID(startup_cq);
+	free(msgs);
+	free(ctxs);
+}
+
+static int run(void)
+{
+	int ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	eps = calloc(ep_cnt, sizeof(*eps));
+	msgs = calloc(2 * ep_cnt, sizeof(*msgs));
+	ctxs = calloc(2 * ep_cnt, sizeof(*ctxs));
+	if (!eps || !msgs || !ctxs)
+		return -FI_ENOMEM;
+
+	ret = opts.dst_addr ? client_run() : server_run();
+	if (ret)
+		return ret;
+
+	show_startup_perf();
+	return ft_finalize();
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "n:h" CS_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'n':
+			ep_cnt = atoi(optarg);
+			if (ep_cnt <= 0) {
+				FT_ERR("Invalid endpoint count %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Time to first message for RDM "
+				   "endpoints.");
+			FT_PRINT_OPTS_USAGE("-n <count>",
+				"number of client endpoints (default 64)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	/* The server inserts every client endpoint */
+	opts.av_size = ep_cnt + 1;
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_TAGGED;
+	hints->mode = FI_CONTEXT;
+	/* Messages are sent from unregistered buffers */
+	hints->domain_attr->mr_mode = opts.mr_mode & ~FI_MR_LOCAL;
+
+	ret = run();
+
+	free_eps();
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -0,0 +1,414 @@
+/*
+ * Copyright (c) 2021 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Tag matching queue depth sweep.  Before each measurement the server
+ * posts receives whose tags are never sent, so every incoming message
+ * has to be matched past them.  With -U the client sends messages the
+ * server never receives instead, deepening the unexpected queue that
+ * every posted receive is checked against.  The message rate is then
+ * measured with a windowed stream of tagged sends, and the depth is
+ * increased by powers of four up to the requested maximum.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_tagged.h>
+
+#include <shared.h>
+
+#define DEPTH_MSG_TAG		(1ULL << 60)
+#define DEPTH_ACK_TAG		(2ULL << 60)
+#define DEPTH_FILLER_TAG	(3ULL << 60)
+#define DEPTH_FILLER_IGNORE	((1ULL << 60) - 1)
+
+static int max_depth = 512;
+static int unexp_mode;
+static int cur_depth;
+static struct fi_context *filler_ctx;
+static struct fi_context *win_ctx;
+static struct fi_context ack_ctx;
+
+/*
+ * The control receive pre-posted by the common code may complete while
+ * we wait for our own receives, if the peer has already moved on to
+ * ft_sync or ft_finalize.  Credit it to the common counter instead.
+ */
+static int wait_comps(struct fid_cq *cq, int count)
+{
+	struct fi_cq_tagged_entry comp;
+	int ret;
+
+	while (count > 0) {
+		ret = fi_cq_read(cq, &comp, 1);
+		if (ret > 0) {
+			if (cq == rxcq && comp.op_context == &rx_ctx)
+				rx_cq_cntr++;
+			else
+				count--;
+		} else if (ret == -FI_EAVAIL) {
+			return ft_cq_readerr(cq);
+		} else if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("fi_cq_read", ret);
+			return ret;
+		}
+	}
+	return 0;
+}
+
+static int post_trecv(uint64_t tag, uint64_t ignore, void *ctx)
+{
+	int ret;
+
+	do {
+		ret = fi_trecv(ep, rx_buf, opts.transfer_size, mr_desc,
+			       remote_fi_addr, tag, ignore, ctx);
+		if (ret == -FI_EAGAIN)
+			(void) fi_cq_read(rxcq, NULL, 0);
+	} while (ret == -FI_EAGAIN);
+
+	if (ret)
+		FT_PRINTERR("fi_trecv", ret);
+	return ret;
+}
+
+static int post_tsend(uint64_t tag, void *ctx)
+{
+	int ret;
+
+	do {
+		ret = fi_tsend(ep, tx_buf, opts.transfer_size, mr_desc,
+			       remote_fi_addr, tag, ctx);
+		if (ret == -FI_EAGAIN)
+			(void) fi_cq_read(txcq, NULL, 0);
+	} while (ret == -FI_EAGAIN);
+
+	if (ret)
+		FT_PRINTERR("fi_tsend", ret);
+	return ret;
+}
+
+/* Grow the queue under test from cur_depth to depth entries */
+static int add_fillers(int depth)
+{
+	int cnt, ret;
+
+	if (!unexp_mode) {
+		for (; !opts.dst_addr && cur_depth < depth; cur_depth++) {
+			ret = post_trecv(DEPTH_FILLER_TAG | cur_depth, 0,
+					 &filler_ctx[cur_depth]);
+			if (ret)
+				return ret;
+		}
+		cur_depth = depth;
+		return 0;
+	}
+
+	/* Bound the sends in flight so the tx CQ cannot overrun */
+	while (opts.dst_addr && cur_depth < depth) {
+		for (cnt = 0; cnt < opts.window_size && cur_depth < depth;
+		     cnt++, cur_depth++) {
+			ret = post_tsend(DEPTH_FILLER_TAG | cur_depth,
+					 &filler_ctx[cur_depth]);
+			if (ret)
+				return ret;
+		}
+
+		ret = wait_comps(txcq, cnt);
+		if (ret)
+			return ret;
+	}
+	cur_depth = depth;
+	return 0;
+}
+
+static int remove_fillers(void)
+{
+	struct fi_cq_err_entry err_entry;
+	struct fi_cq_tagged_entry comp;
+	int i, ret;
+
+	if (unexp_mode) {
+		if (opts.dst_addr)
+			return 0;
+
+		for (i = 0; i < cur_depth; i++) {
+			ret = post_trecv(DEPTH_FILLER_TAG, DEPTH_FILLER_IGNORE,
+					 &filler_ctx[i]);
+			if (ret)
+				return ret;
+		}
+		return wait_comps(rxcq, cur_depth);
+	}
+
+	if (opts.dst_addr)
+		return 0;
+
+	for (i = 0; i < cur_depth; i++) {
+		ret = fi_cancel(&ep->fid, &filler_ctx[i]);
+		if (ret) {
+			FT_PRINTERR("fi_cancel", ret);
+			return ret;
+		}
+	}
+
+	for (i = 0; i < cur_depth; ) {
+		ret = fi_cq_read(rxcq, &comp, 1);
+		if (ret == -FI_EAGAIN)
+			continue;
+		if (ret > 0 && comp.op_context == &rx_ctx) {
+			rx_cq_cntr++;
+			continue;
+		}
+		if (ret != -FI_EAVAIL) {
+			FT_ERR("Cancelled receive completed: %d", ret);
+			return ret < 0 ? ret : -FI_EOTHER;
+		}
+
+		memset(&err_entry, 0, sizeof(err_entry));
+		ret = fi_cq_readerr(rxcq, &err_entry, 0);
+		if (ret != 1 || err_entry.err != FI_ECANCELED) {
+			FT_ERR("Unexpected error cancelling receive: %d",
+			       err_entry.err);
+			return -FI_EOTHER;
+		}
+		i++;
+	}
+	return 0;
+}
+
+static int post_window_recvs(void)
+{
+	int i, ret;
+
+	for (i = 0; i < opts.window_size; i++) {
+		ret = post_trecv(DEPTH_MSG_TAG, 0, &win_ctx[i]);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int measure(void)
+{
+	int i, j, ret;
+
+	if (!opts.dst_addr) {
+		ret = post_window_recvs();
+		if (ret)
+			return ret;
+	}
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	ft_start();
+	for (i = 0; i < opts.iterations; i++) {
+		if (opts.dst_addr) {
+			ret = post_trecv(DEPTH_ACK_TAG, 0, &ack_ctx);
+			if (ret)
+				return ret;
+
+			for (j = 0; j < opts.window_size; j++) {
+				ret = post_tsend(DEPTH_MSG_TAG, &win_ctx[j]);
+				if (ret)
+					return ret;
+			}
+
+			ret = wait_comps(txcq, opts.window_size);
+			if (ret)
+				return ret;
+
+			ret = wait_comps(rxcq, 1);
+		} else {
+			ret = wait_comps(rxcq, opts.window_size);
+			if (ret)
+				return ret;
+
+			/* The next window is posted before the ack releases
+			 * the client, so it never arrives unexpected. */
+			if (i + 1 < opts.iterations) {
+				ret = post_window_recvs();
+				if (ret)
+					return ret;
+			}
+
+			ret = post_tsend(DEPTH_ACK_TAG, &ack_ctx);
+			if (ret)
+				return ret;
+
+			ret = wait_comps(txcq, 1);
+		}
+		if (ret)
+			return ret;
+	}
+	ft_stop();
+
+	return 0;
+}
+
+static void show_depth_perf(void)
+{
+	static int header = 1;
+	int64_t elapsed = get_elapsed(&start, &end, MICRO);
+	long long msgs = (long long) opts.iterations * opts.window_size;
+	char str[FT_STR_LEN];
+
+	if (header) {
+		printf("%-10s%-8s%-8s%10s%12s%13s\n", "depth", "bytes",
+		       "msgs", "time", "usec/msg", "Mmsgs/sec");
+		header = 0;
+	}
+
+	printf("%-10d", cur_depth);
+	printf("%-8s", size_str(str, opts.transfer_size));
+	printf("%-8s", cnt_str(str, msgs));
+	printf("%9.2fs%12.3f%13.3f\n", elapsed / 1000000.0,
+	       (float) elapsed / msgs, msgs / (1.0 * elapsed));
+}
+
+static int run(void)
+{
+	int depth, limit, ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	/* Room for the fillers, one window and the control receive */
+	limit = (int) fi->rx_attr->size - (int) opts.window_size - 1;
+	if (max_depth > limit) {
+		printf("Limiting depth to %d by receive queue size %zu\n",
+		       limit, fi->rx_attr->size);
+		max_depth = limit;
+	}
+
+	filler_ctx = calloc(MAX(max_depth, 1), sizeof(*filler_ctx));
+	win_ctx = calloc(opts.window_size, sizeof(*win_ctx));
+	if (!filler_ctx || !win_ctx) {
+		ret = -FI_ENOMEM;
+		goto out;
+	}
+
+	for (depth = 0; ; depth = depth ? depth * 4 : 1) {
+		if (depth > max_depth)
+			depth = max_depth;
+
+		ret = add_fillers(depth);
+		if (ret)
+			goto out;
+
+		ret = measure();
+		if (ret)
+			goto out;
+
+		show_depth_perf();
+		if (depth == max_depth)
+			break;
+	}
+
+	ret = remove_fillers();
+	if (ret)
+		goto out;
+
+	ret = ft_finalize();
+out:
+	free(filler_ctx);
+	free(win_ctx);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.iterations = 100;
+	opts.transfer_size = 4;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "D:UW:h" CS_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'D':
+			max_depth = atoi(optarg);
+			if (max_depth < 0) {
+				FT_ERR("Invalid depth %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'U':
+			unexp_mode = 1;
+			break;
+		case 'W':
+			opts.window_size = atoi(optarg);
+			if (opts.window_size <= 0) {
+				FT_ERR("Invalid window size %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Tagged message rate versus matching "
+				   "queue depth for RDM endpoints.");
+			FT_PRINT_OPTS_USAGE("-D <depth>",
+				"maximum queue depth (default 512)");
+			FT_PRINT_OPTS_USAGE("-U",
+				"deepen the unexpected queue instead of the "
+				"posted receive queue");
+			FT_PRINT_OPTS_USAGE("-W <count>",
+				"messages per window (default 64)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_TAGGED;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->threading = FI_THREAD_DOMAIN;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
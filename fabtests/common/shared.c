@@ -2410,6 +2410,24 @@ int ft_cq_readerr(struct fid_cq *cq)
 	return ret;
 }
 
+/*
+ * Reads what completions are available without waiting.  Returns the number
+ * read, or a negative error once it has been reported.
+ */
+int ft_cq_read_comps(struct fid_cq *cq, void *comps, size_t count)
+{
+	int ret;
+
+	ret = fi_cq_read(cq, comps, count);
+	if (ret > 0 || ret == -FI_EAGAIN)
+		return ret > 0 ? ret : 0;
+	if (ret == -FI_EAVAIL)
+		return ft_cq_readerr(cq);
+
+	FT_PRINTERR("fi_cq_read", ret);
+	return ret;
+}
+
 void eq_readerr(struct fid_eq *eq, const char *eq_str)
 {
 	struct fi_eq_err_entry eq_err;
@@ -2984,6 +3002,45 @@ int ft_check_buf(void *buf, int size)
 	return 0;
 }
 
+/*
+ * Size and contents of message number msg in tests that vary them per
+ * message.  Both are derived from msg alone, so that the two sides agree on
+ * them without exchanging anything.
+ */
+size_t ft_pattern_size(int msg, size_t min, size_t max)
+{
+	return min + ((uint32_t) msg * 2654435761U) % (max - min + 1);
+}
+
+static uint8_t ft_pattern_byte(int msg, size_t off)
+{
+	return (uint8_t) (msg * 31 + off);
+}
+
+void ft_fill_pattern(void *buf, size_t size, int msg)
+{
+	uint8_t *data = buf;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		data[i] = ft_pattern_byte(msg, i);
+}
+
+int ft_check_pattern(const void *buf, size_t size, int msg)
+{
+	const uint8_t *data = buf;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		if (data[i] != ft_pattern_byte(msg, i)) {
+			FT_ERR("Message %d: byte %zu is 0x%x, expected 0x%x",
+			       msg, i, data[i], ft_pattern_byte(msg, i));
+			return -FI_EIO;
+		}
+	}
+	return 0;
+}
+
 uint64_t ft_init_cq_data(struct fi_info *info)
 {
 	if (info->domain_attr->cq_data_size >= sizeof(uint64_t)) {
@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2021 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Checks FI_PROGRESS_AUTO data progress at the target.  After the two sides
+ * sync, the server stays away from its CQ for a while, as a compute bound
+ * application would, while the client sends it a message that takes many
+ * packets.  With auto progress the provider receives the message and
+ * acknowledges it in the background, so the send completes well before the
+ * server returns to its CQ.  fi_getinfo fails with FI_ENODATA, and the test
+ * is skipped, for providers that do not offer auto progress.  Providers
+ * that offer it without progressing data are excluded in runfabtests.sh.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+
+#include <shared.h>
+
+static int busy_ms = 1000;
+
+static int client_run(void)
+{
+	int64_t elapsed_ms;
+	int ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	ft_start();
+	ret = ft_tx(ep, remote_fi_addr, opts.transfer_size, &tx_ctx);
+	if (ret)
+		return ret;
+	ft_stop();
+
+	elapsed_ms = get_elapsed(&start, &end, MILLI);
+	printf("%-12s%12s%14s\n", "size", "busy", "send time");
+	printf("%-12zu%10dms%12ldms\n", opts.transfer_size, busy_ms,
+	       (long) elapsed_ms);
+
+	if (elapsed_ms >= busy_ms) {
+		FT_ERR("Send completed only after the server polled its CQ");
+		/* The message arrived, so let the server finish too */
+		ft_finalize();
+		return -FI_EOTHER;
+	}
+	return 0;
+}
+
+static int server_run(void)
+{
+	int ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	/* The receive for the message was posted by ft_sync */
+	usleep(busy_ms * 1000);
+
+	return ft_rx(ep, opts.transfer_size);
+}
+
+static int run(void)
+{
+	int ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	ret = opts.dst_addr ? client_run() : server_run();
+	if (ret)
+		return ret;
+
+	return ft_finalize();
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.options |= FT_OPT_SIZE;
+	opts.transfer_size = 1 << 20;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "W:h" CS_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'W':
+			busy_ms = atoi(optarg);
+			if (busy_ms <= 0) {
+				FT_ERR("Invalid busy time %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Check that an RDM send completes "
+				   "while the target does not poll its CQ.");
+			FT_PRINT_OPTS_USAGE("-W <ms>", "time the server stays "
+				"away from its CQ (default 1000)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_MSG;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->mr_mode = opts.mr_mode;
+	hints->domain_attr->data_progress = FI_PROGRESS_AUTO;
+
+	ret = run();
+
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2021 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Sends bursts of small tagged messages, posting all but the last message
+ * of each burst with FI_MORE, so that a provider may coalesce them into
+ * fewer packets.  Every other message carries remote CQ data and sizes
+ * range from zero up to the transfer size.  The server posts its receives
+ * a burst at a time, so part of each burst arrives unexpected, and checks
+ * that every message completes on its own with the right tag, data and
+ * contents.  Reports the message rate.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_tagged.h>
+
+#include <shared.h>
+
+#define COALESCE_TAG	(1ULL << 60)
+
+static int burst = 16;
+static int use_more = 1;
+static struct fi_context *ctxs;
+static char *slot_buf;
+
+static size_t msg_size(int msg)
+{
+	return ft_pattern_size(msg, 0, opts.transfer_size);
+}
+
+static uint64_t msg_data(int msg)
+{
+	return (uint32_t) (msg * 7 + 1);
+}
+
+static char *slot_addr(int slot)
+{
+	return slot_buf + (size_t) slot * opts.transfer_size;
+}
+
+static int check_msg(int msg, int slot, struct fi_cq_tagged_entry *comp)
+{
+	uint64_t tag = COALESCE_TAG | msg;
+
+	if (comp->len != msg_size(msg)) {
+		FT_ERR("Message %d: received %zu bytes, expected %zu",
+		       msg, comp->len, msg_size(msg));
+		return -FI_EIO;
+	}
+
+	if (comp->tag != tag) {
+		FT_ERR("Message %d: tag 0x%" PRIx64 ", expected 0x%" PRIx64,
+		       msg, comp->tag, tag);
+		return -FI_EIO;
+	}
+
+	if (msg & 1) {
+		if (!(comp->flags & FI_REMOTE_CQ_DATA) ||
+		    comp->data != msg_data(msg)) {
+			FT_ERR("Message %d: missing or wrong remote CQ data",
+			       msg);
+			return -FI_EIO;
+		}
+	} else if (comp->flags & FI_REMOTE_CQ_DATA) {
+		FT_ERR("Message %d: unexpected remote CQ data", msg);
+		return -FI_EIO;
+	}
+
+	return ft_check_pattern(slot_addr(slot), comp->len, msg);
+}
+
+static int post_send(int msg, int slot, uint64_t flags)
+{
+	struct fi_msg_tagged tmsg;
+	struct iovec iov;
+	int ret;
+
+	ft_fill_pattern(slot_addr(slot), msg_size(msg), msg);
+
+	iov.iov_base = slot_addr(slot);
+	iov.iov_len = msg_size(msg);
+	tmsg.msg_iov = &iov;
+	tmsg.desc = NULL;
+	tmsg.iov_count = 1;
+	tmsg.addr = remote_fi_addr;
+	tmsg.tag = COALESCE_TAG | msg;
+	tmsg.ignore = 0;
+	tmsg.context = &ctxs[slot];
+	tmsg.data = msg_data(msg);
+
+	if (msg & 1)
+		flags |= FI_REMOTE_CQ_DATA;
+
+	do {
+		ret = fi_tsendmsg(ep, &tmsg, flags | FI_COMPLETION);
+		if (ret == -FI_EAGAIN)
+			(void) fi_cq_read(txcq, NULL, 0);
+	} while (ret == -FI_EAGAIN);
+
+	if (ret)
+		FT_PRINTERR("fi_tsendmsg", ret);
+	return ret;
+}
+
+/* Waits for the completions of a burst, checking received messages */
+static int wait_comps(struct fid_cq *cq, int first, int count, int recv)
+{
+	struct fi_cq_tagged_entry comp;
+	int done = 0, slot, ret;
+
+	while (done < count) {
+		ret = ft_cq_read_comps(cq, &comp, 1);
+		if (ret < 0)
+			return ret;
+		if (!ret)
+			continue;
+
+		/* Buffer posted by ft_init_fabric for ft_sync */
+		if (comp.op_context == &rx_ctx) {
+			rx_cq_cntr++;
+			continue;
+		}
+
+		if (recv) {
+			slot = (struct fi_context *) comp.op_context - ctxs;
+			ret = check_msg(first + slot, slot, &comp);
+			if (ret)
+				return ret;
+		}
+		done++;
+	}
+	return 0;
+}
+
+static int client_run(void)
+{
+	int msg, cnt, i, ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	ft_start();
+	for (msg = 0; msg < opts.iterations; msg += cnt) {
+		cnt = MIN(burst, opts.iterations - msg);
+		for (i = 0; i < cnt; i++) {
+			ret = post_send(msg + i, i, use_more && i < cnt - 1 ?
+					FI_MORE : 0);
+			if (ret)
+				return ret;
+		}
+
+		ret = wait_comps(txcq, msg, cnt, 0);
+		if (ret)
+			return ret;
+	}
+	ft_stop();
+
+	return 0;
+}
+
+static int server_run(void)
+{
+	int msg, cnt, i, ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	ft_start();
+	for (msg = 0; msg < opts.iterations; msg += cnt) {
+		cnt = MIN(burst, opts.iterations - msg);
+		for (i = 0; i < cnt; i++) {
+			do {
+				ret = fi_trecv(ep, slot_addr(i),
+					       opts.transfer_size, NULL,
+					       FI_ADDR_UNSPEC,
+					       COALESCE_TAG | (msg + i), 0,
+					       &ctxs[i]);
+				if (ret == -FI_EAGAIN)
+					(void) fi_cq_read(rxcq, NULL, 0);
+			} while (ret == -FI_EAGAIN);
+			if (ret) {
+				FT_PRINTERR("fi_trecv", ret);
+				return ret;
+			}
+		}
+
+		ret = wait_comps(rxcq, msg, cnt, 1);
+		if (ret)
+			return ret;
+	}
+	ft_stop();
+
+	return 0;
+}
+
+static void show_coalesce_perf(void)
+{
+	int64_t elapsed = get_elapsed(&start, &end, MICRO);
+
+	printf("%-12s%12s%12s%14s%14s\n", "messages", "max size", "burst",
+	       "time", "msgs/sec");
+	printf("%-12d%12zu%12d%13.3fs%14.0f\n", opts.iterations,
+	       opts.transfer_size, burst, elapsed / 1000000.0,
+	       elapsed ? opts.iterations * 1000000.0 / elapsed : 0.0);
+}
+
+static int run(void)
+{
+	int ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	burst = MIN((size_t) burst, opts.dst_addr ?
+		    fi->tx_attr->size : fi->rx_attr->size);
+	ctxs = calloc(burst, sizeof(*ctxs));
+	slot_buf = calloc(burst, opts.transfer_size);
+	if (!ctxs || !slot_buf)
+		return -FI_ENOMEM;
+
+	ret = opts.dst_addr ? client_run() : server_run();
+	if (ret)
+		return ret;
+
+	show_coalesce_perf();
+	return ft_finalize();
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.transfer_size = 64;
+	opts.iterations = 10000;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "W:nh" CS_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'W':
+			burst = atoi(optarg);
+			if (burst <= 0) {
+				FT_ERR("Invalid burst size %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'n':
+			use_more = 0;
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Send bursts of small tagged "
+				   "messages with FI_MORE and check each one.");
+			FT_PRINT_OPTS_USAGE("-W <count>", "messages per burst "
+				"(default 16)");
+			FT_PRINT_OPTS_USAGE("-n", "post without FI_MORE");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_TAGGED;
+	hints->mode = FI_CONTEXT;
+	hints->domain_attr->cq_data_size = 4;
+	/* Messages are sent from unregistered buffers */
+	hints->domain_attr->mr_mode = opts.mr_mode & ~FI_MR_LOCAL;
+
+	ret = run();
+
+	free(ctxs);
+	free(slot_buf);
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2021 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Floods one receiver from many senders.  The client opens N endpoints,
+ * each of which sends the same number of tagged messages to the server as
+ * fast as the provider accepts them.  The server only drives progress for
+ * a while before posting any receive, so everything that arrives in the
+ * meantime is unexpected.  It then receives all messages and checks that
+ * none was lost.  Both sides report the elapsed time and their peak
+ * resident set size, which shows how much memory the provider lets
+ * unexpected messages take.  With -M, the server fails if its peak resident
+ * set grew by more than the given amount during the flood, to check that a
+ * provider with flow control bounds it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <sys/resource.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_tagged.h>
+
+#include <shared.h>
+
+#define FLOOD_TAG	(1ULL << 60)
+
+static int ep_cnt = 16;
+static int wait_ms = 1000;
+static long max_growth_kb;
+static long base_rss_kb;
+static struct fid_ep **eps;
+static struct fid_cq *flood_cq;
+static struct fi_context *ctxs;
+static char *flood_buf;
+
+static long peak_rss_kb(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+static int open_client_eps(void)
+{
+	int i, ret;
+
+	cq_attr.format = FI_CQ_FORMAT_TAGGED;
+	cq_attr.wait_obj = FI_WAIT_NONE;
+	cq_attr.size = ep_cnt * fi->tx_attr->size;
+	ret = fi_cq_open(domain, &cq_attr, &flood_cq, NULL);
+	if (ret) {
+		FT_PRINTERR("fi_cq_open", ret);
+		return ret;
+	}
+
+	for (i = 0; i < ep_cnt; i++) {
+		ret = fi_endpoint(domain, fi, &eps[i], NULL);
+		if (ret) {
+			FT_PRINTERR("fi_endpoint", ret);
+			return ret;
+		}
+
+		FT_EP_BIND(eps[i], av, 0);
+		FT_EP_BIND(eps[i], flood_cq, FI_TRANSMIT | FI_RECV);
+
+		ret = fi_enable(eps[i]);
+		if (ret) {
+			FT_PRINTERR("fi_enable", ret);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static int client_run(void)
+{
+	struct fi_cq_tagged_entry comps[16];
+	int total = ep_cnt * opts.iterations;
+	int posted = 0, completed = 0, i, ret;
+
+	ret = open_client_eps();
+	if (ret)
+		return ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	ft_start();
+	while (posted < total) {
+		i = posted % ep_cnt;
+		ret = fi_tsend(eps[i], flood_buf, opts.transfer_size, NULL,
+			       remote_fi_addr, FLOOD_TAG, &ctxs[posted]);
+		if (!ret) {
+			posted++;
+			continue;
+		}
+		if (ret != -FI_EAGAIN) {
+			FT_PRINTERR("fi_tsend", ret);
+			return ret;
+		}
+
+		ret = ft_cq_read_comps(flood_cq, comps, ARRAY_SIZE(comps));
+		if (ret < 0)
+			return ret;
+		completed += ret;
+	}
+
+	while (completed < total) {
+		ret = ft_cq_read_comps(flood_cq, comps, ARRAY_SIZE(comps));
+		if (ret < 0)
+			return ret;
+		completed += ret;
+	}
+	ft_stop();
+
+	return 0;
+}
+
+static int server_run(void)
+{
+	struct fi_cq_tagged_entry comps[16];
+	int total = ep_cnt * opts.iterations;
+	size_t window = MIN(fi->rx_attr->size, (size_t) total);
+	int posted = 0, received = 0, i, ret;
+	struct timespec now;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	base_rss_kb = peak_rss_kb();
+	ft_start();
+	do {
+		(void) fi_cq_read(rxcq, NULL, 0);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+	} while (get_elapsed(&start, &now, MILLI) < wait_ms);
+
+	while (received < total) {
+		while (posted < total && posted - received < (int) window) {
+			i = posted % window;
+			ret = fi_trecv(ep, flood_buf + i * opts.transfer_size,
+				       opts.transfer_size, NULL, FI_ADDR_UNSPEC,
+				       FLOOD_TAG, 0, &ctxs[posted]);
+			if (ret == -FI_EAGAIN)
+				break;
+			if (ret) {
+				FT_PRINTERR("fi_trecv", ret);
+				return ret;
+			}
+			posted++;
+		}
+
+		ret = ft_cq_read_comps(rxcq, comps, ARRAY_SIZE(comps));
+		if (ret < 0)
+			return ret;
+
+		for (i = 0; i < ret; i++) {
+			/* Buffer posted by ft_init_fabric for ft_sync */
+			if (comps[i].op_context == &rx_ctx) {
+				rx_cq_cntr++;
+				continue;
+			}
+			if (comps[i].len != opts.transfer_size) {
+				FT_ERR("Received %zu bytes, expected %zu",
+				       comps[i].len, opts.transfer_size);
+				return -FI_EIO;
+			}
+			received++;
+		}
+	}
+	ft_stop();
+
+	return 0;
+}
+
+static int check_rss_growth(void)
+{
+	long growth = peak_rss_kb() - base_rss_kb;
+
+	if (max_growth_kb && growth > max_growth_kb) {
+		FT_ERR("Peak RSS grew by %ldKB during the flood, limit %ldKB",
+		       growth, max_growth_kb);
+		return -FI_ENOMEM;
+	}
+	return 0;
+}
+
+static void show_flood_perf(void)
+{
+	int64_t elapsed = get_elapsed(&start, &end, MICRO);
+
+	printf("%-12s%12s%12s%14s%14s\n", "endpoints", "messages", "size",
+	       "time", "peak RSS");
+	printf("%-12d%12d%12zu%13.3fs%12ldKB\n", ep_cnt,
+	       ep_cnt * opts.iterations, opts.transfer_size,
+	       elapsed / 1000000.0, peak_rss_kb());
+}
+
+static void free_eps(void)
+{
+	int i;
+
+	if (eps) {
+		for (i = 0; i < ep_cnt; i++)
+			FT_CLOSE_FID(eps[i]);
+		free(eps);
+	}
+	FT_CLOSE_FID(flood_cq);
+	free(ctxs);
+	free(flood_buf);
+}
+
+static int run(void)
+{
+	int ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	eps = calloc(ep_cnt, sizeof(*eps));
+	ctxs = calloc((size_t) ep_cnt * opts.iterations, sizeof(*ctxs));
+	flood_buf = calloc(fi->rx_attr->size, opts.transfer_size);
+	if (!eps || !ctxs || !flood_buf)
+		return -FI_ENOMEM;
+
+	ret = opts.dst_addr ? client_run() : server_run();
+	if (ret)
+		return ret;
+
+	show_flood_perf();
+	ret = ft_finalize();
+	if (ret)
+		return ret;
+
+	return opts.dst_addr ? 0 : check_rss_growth();
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "n:W:M:h" CS_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'n':
+			ep_cnt = atoi(optarg);
+			if (ep_cnt <= 0) {
+				FT_ERR("Invalid endpoint count %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'W':
+			wait_ms = atoi(optarg);
+			break;
+		case 'M':
+			max_growth_kb = atol(optarg) * 1024;
+			if (max_growth_kb <= 0) {
+				FT_ERR("Invalid memory limit %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Flood one RDM endpoint with "
+				   "unexpected messages from many endpoints.");
+			FT_PRINT_OPTS_USAGE("-n <count>",
+				"number of client endpoints (default 16)");
+			FT_PRINT_OPTS_USAGE("-W <ms>", "time the server waits "
+				"before posting receives (default 1000)");
+			FT_PRINT_OPTS_USAGE("-M <MB>", "fail if the server's "
+				"peak RSS grows by more during the flood");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	/* The server's AV also holds every client endpoint */
+	opts.av_size = ep_cnt + 1;
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_TAGGED;
+	hints->mode = FI_CONTEXT;
+	/* Messages are sent from unregistered buffers */
+	hints->domain_attr->mr_mode = opts.mr_mode & ~FI_MR_LOCAL;
+
+	ret = run();
+
+	free_eps();
+	ft_free_res();
+	return ft_exit_code(ret);
+}
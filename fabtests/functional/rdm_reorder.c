@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2021 Intel Corporation.  All rights reserved.
+ *
+ * This software is available to you under the BSD license
+ * below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Keeps a window of tagged messages of varying size in flight from the
+ * client to the server and checks that each one arrives intact and in the
+ * order it was sent.  Message sizes range from one byte up to the transfer
+ * size, so a reliability layer has to reassemble multi-packet messages
+ * interleaved with single packet ones.  Run it over a provider that
+ * reorders or drops packets, for example udp with FI_UDP_REORDER_RATE or
+ * FI_UDP_DROP_RATE set under ofi_rxd, to stress the receive window.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include <rdma/fi_errno.h>
+#include <rdma/fi_tagged.h>
+
+#include <shared.h>
+
+#define REORDER_TAG	(1ULL << 60)
+
+static struct fi_context *ctxs;
+static int *slot_msg;
+static int *free_slots;
+static int free_cnt;
+static char *slot_buf;
+
+static char *slot_addr(int slot)
+{
+	return slot_buf + (size_t) slot * opts.transfer_size;
+}
+
+static size_t msg_size(int msg)
+{
+	return ft_pattern_size(msg, 1, opts.transfer_size);
+}
+
+static int check_msg(int slot, size_t len)
+{
+	int msg = slot_msg[slot];
+
+	if (len != msg_size(msg)) {
+		FT_ERR("Message %d: received %zu bytes, expected %zu",
+		       msg, len, msg_size(msg));
+		return -FI_EIO;
+	}
+	return ft_check_pattern(slot_addr(slot), len, msg);
+}
+
+static int client_run(void)
+{
+	struct fi_cq_tagged_entry comps[16];
+	int posted = 0, completed = 0, slot, i, ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	ft_start();
+	while (completed < opts.iterations) {
+		while (posted < opts.iterations && free_cnt) {
+			slot = free_slots[free_cnt - 1];
+			ft_fill_pattern(slot_addr(slot), msg_size(posted),
+					posted);
+			ret = fi_tsend(ep, slot_addr(slot), msg_size(posted),
+				       NULL, remote_fi_addr, REORDER_TAG,
+				       &ctxs[slot]);
+			if (ret == -FI_EAGAIN)
+				break;
+			if (ret) {
+				FT_PRINTERR("fi_tsend", ret);
+				return ret;
+			}
+			free_cnt--;
+			posted++;
+		}
+
+		ret = ft_cq_read_comps(txcq, comps, ARRAY_SIZE(comps));
+		if (ret < 0)
+			return ret;
+
+		for (i = 0; i < ret; i++) {
+			slot = (struct fi_context *) comps[i].op_context - ctxs;
+			free_slots[free_cnt++] = slot;
+			completed++;
+		}
+	}
+	ft_stop();
+
+	return 0;
+}
+
+static int server_run(void)
+{
+	struct fi_cq_tagged_entry comps[16];
+	int posted = 0, received = 0, slot, cnt, i, ret;
+
+	ret = ft_sync();
+	if (ret)
+		return ret;
+
+	ft_start();
+	while (received < opts.iterations) {
+		while (posted < opts.iterations && free_cnt) {
+			slot = free_slots[free_cnt - 1];
+			ret = fi_trecv(ep, slot_addr(slot), opts.transfer_size,
+				       NULL, FI_ADDR_UNSPEC, REORDER_TAG, 0,
+				       &ctxs[slot]);
+			if (ret == -FI_EAGAIN)
+				break;
+			if (ret) {
+				FT_PRINTERR("fi_trecv", ret);
+				return ret;
+			}
+			slot_msg[slot] = posted;
+			free_cnt--;
+			posted++;
+		}
+
+		cnt = ft_cq_read_comps(rxcq, comps, ARRAY_SIZE(comps));
+		if (cnt < 0)
+			return cnt;
+
+		for (i = 0; i < cnt; i++) {
+			/* Buffer posted by ft_init_fabric for ft_sync */
+			if (comps[i].op_context == &rx_ctx) {
+				rx_cq_cntr++;
+				continue;
+			}
+			slot = (struct fi_context *) comps[i].op_context - ctxs;
+			ret = check_msg(slot, comps[i].len);
+			if (ret)
+				return ret;
+			free_slots[free_cnt++] = slot;
+			received++;
+		}
+	}
+	ft_stop();
+
+	return 0;
+}
+
+static void show_reorder_perf(void)
+{
+	int64_t elapsed = get_elapsed(&start, &end, MICRO);
+
+	printf("%-12s%12s%12s%14s\n", "messages", "max size", "window",
+	       "time");
+	printf("%-12d%12zu%12d%13.3fs\n", opts.iterations, opts.transfer_size,
+	       opts.window_size, elapsed / 1000000.0);
+}
+
+static void free_slots_res(void)
+{
+	free(ctxs);
+	free(slot_msg);
+	free(free_slots);
+	free(slot_buf);
+}
+
+static int run(void)
+{
+	int i, ret;
+
+	ret = ft_init_fabric();
+	if (ret)
+		return ret;
+
+	opts.window_size = MIN((size_t) opts.window_size, opts.dst_addr ?
+			       fi->tx_attr->size : fi->rx_attr->size);
+	ctxs = calloc(opts.window_size, sizeof(*ctxs));
+	slot_msg = calloc(opts.window_size, sizeof(*slot_msg));
+	free_slots = calloc(opts.window_size, sizeof(*free_slots));
+	slot_buf = calloc(opts.window_size, opts.transfer_size);
+	if (!ctxs || !slot_msg || !free_slots || !slot_buf)
+		return -FI_ENOMEM;
+
+	for (i = 0; i < opts.window_size; i++)
+		free_slots[free_cnt++] = i;
+
+	ret = opts.dst_addr ? client_run() : server_run();
+	if (ret)
+		return ret;
+
+	show_reorder_perf();
+	return ft_finalize();
+}
+
+int main(int argc, char **argv)
+{
+	int op, ret;
+
+	opts = INIT_OPTS;
+	opts.transfer_size = 4096;
+
+	hints = fi_allocinfo();
+	if (!hints)
+		return EXIT_FAILURE;
+
+	while ((op = getopt(argc, argv, "W:h" CS_OPTS INFO_OPTS)) != -1) {
+		switch (op) {
+		default:
+			ft_parseinfo(op, optarg, hints, &opts);
+			ft_parsecsopts(op, optarg, &opts);
+			break;
+		case 'W':
+			opts.window_size = atoi(optarg);
+			if (opts.window_size <= 0) {
+				FT_ERR("Invalid window size %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case '?':
+		case 'h':
+			ft_csusage(argv[0], "Check that RDM messages of mixed "
+				   "sizes arrive intact and in order.");
+			FT_PRINT_OPTS_USAGE("-W <count>", "messages in flight "
+				"(default 64)");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (optind < argc)
+		opts.dst_addr = argv[optind];
+
+	hints->ep_attr->type = FI_EP_RDM;
+	hints->caps = FI_TAGGED;
+	hints->mode = FI_CONTEXT;
+	hints->tx_attr->msg_order = FI_ORDER_SAS;
+	hints->rx_attr->msg_order = FI_ORDER_SAS;
+	/* Messages are sent from unregistered buffers */
+	hints->domain_attr->mr_mode = opts.mr_mode & ~FI_MR_LOCAL;
+
+	ret = run();
+
+	free_slots_res();
+	ft_free_res();
+	return ft_exit_code(ret);
+}
@@ -221,6 +221,9 @@ void ft_csusage(char *name, char *desc);
 
 void ft_fill_buf(void *buf, int size);
 int ft_check_buf(void *buf, int size);
+size_t ft_pattern_size(int msg, size_t min, size_t max);
+void ft_fill_pattern(void *buf, size_t size, int msg);
+int ft_check_pattern(const void *buf, size_t size, int msg);
 int ft_check_opts(uint64_t flags);
 uint64_t ft_init_cq_data(struct fi_info *info);
 int ft_sock_listen(char *node, char *service);
@@ -459,6 +462,7 @@ int check_compare_atomic_op(struct fid_ep *endpoint, enum fi_op op,
 			    enum fi_datatype datatype, size_t *count);
 
 int ft_cq_readerr(struct fid_cq *cq);
+int ft_cq_read_comps(struct fid_cq *cq, void *comps, size_t count);
 int ft_get_rx_comp(uint64_t total);
 int ft_get_tx_comp(uint64_t total);
 int ft_recvmsg(struct fid_ep *ep, fi_addr_t fi_addr,
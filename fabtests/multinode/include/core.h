@@ -69,6 +69,10 @@ struct pm_job_info {
 	size_t		name_len;
 	fi_addr_t	*fi_addrs;
 	enum multi_xfer transfer_method;
+
+	/* If set, called while waiting on the OOB socket so that peers that
+	 * need this rank to progress, e.g. for acks, are not stalled */
+	void		(*progress)(void);
 };
 
 struct multinode_xfer_state {
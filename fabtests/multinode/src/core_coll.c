@@ -119,6 +119,13 @@ static int wait_for_comp(void *ctx)
 	return err;
 }
 
+/* Peers may still need our acks while we wait in pm_barrier */
+static void coll_progress(void)
+{
+	(void) fi_cq_read(txcq, NULL, 0);
+	(void) fi_cq_read(rxcq, NULL, 0);
+}
+
 static int coll_setup()
 {
 	int err;
@@ -463,7 +470,8 @@ static inline int setup_hints()
 	hints->mode = FI_CONTEXT;
 	hints->domain_attr->control_progress = FI_PROGRESS_MANUAL;
 	hints->domain_attr->data_progress = FI_PROGRESS_MANUAL;
-	hints->fabric_attr->prov_name = strdup("tcp");
+	if (!hints->fabric_attr->prov_name)
+		hints->fabric_attr->prov_name = strdup("tcp");
 	return FI_SUCCESS;
 }
 
@@ -551,6 +559,8 @@ int multinode_run_tests(int argc, char **argv)
 	if (ret)
 		return ret;
 
+	pm_job.progress = coll_progress;
+
 	for (i = 0; i < NUM_TESTS && !ret; i++) {
 		FT_DEBUG("Running Test: %s \n", tests[i].name);
 
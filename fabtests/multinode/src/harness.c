@@ -38,6 +38,7 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -74,6 +75,17 @@ static inline ssize_t socket_send(int sock, void *buf, size_t len, int flags)
 	return len;
 }
 
+static inline void socket_wait(int sock)
+{
+	struct pollfd fds = {
+		.fd = sock,
+		.events = POLLIN,
+	};
+
+	while (!poll(&fds, 1, 1))
+		pm_job.progress();
+}
+
 static inline int socket_recv(int sock, void *buf, size_t len, int flags)
 {
 	ssize_t ret;
@@ -81,6 +93,9 @@ static inline int socket_recv(int sock, void *buf, size_t len, int flags)
 	uint8_t *ptr = (uint8_t *) buf;
 
 	do {
+		if (pm_job.progress)
+			socket_wait(sock);
+
 		ret = recv(sock, (void *) &ptr[m], len-m, flags);
 		if (ret <= 0)
 			return -1;
@@ -123,6 +123,10 @@ functional_tests=(
 	"fi_unexpected_msg -e rdm -i 10"
 	"fi_unexpected_msg -e msg -S -i 10"
 	"fi_unexpected_msg -e rdm -S -i 10"
+	"fi_rdm_flood"
+	"fi_rdm_reorder"
+	"fi_rdm_auto_progress"
+	"fi_rdm_coalesce"
 	"fi_inj_complete -e msg"
 	"fi_inj_complete -e rdm"
 	"fi_inj_complete -e dgram"
@@ -138,6 +142,7 @@ short_tests=(
 	"fi_msg_pingpong -I 5 -v"
 	"fi_msg_bw -I 5"
 	"fi_msg_bw -I 5 -v"
+	"fi_msg_startup -n 16"
 	"fi_rma_bw -e msg -o write -I 5"
 	"fi_rma_bw -e msg -o read -I 5"
 	"fi_rma_bw -e msg -o writedata -I 5"
@@ -154,6 +159,9 @@ short_tests=(
 	"fi_rdm_tagged_pingpong -I 5 -v"
 	"fi_rdm_tagged_bw -I 5"
 	"fi_rdm_tagged_bw -I 5 -v"
+	"fi_rdm_tagged_depth -I 5 -D 64"
+	"fi_rdm_tagged_depth -I 5 -D 64 -U"
+	"fi_rdm_startup -n 16"
 	"fi_dgram_pingpong -I 5"
 )
 
@@ -206,6 +214,13 @@ multinode_tests=(
 	"fi_multinode_coll"
 )
 
+# Collectives over a multicast group, with datagrams dropped so that the
+# NACK repair path runs
+rxd_mcast_env="FI_OFI_RXD_MCAST_ADDR=fi_sockaddr_in://239.255.0.1:47000 FI_UDP_DROP_RATE=5"
+
+# Flood with rxm flow control on, which must bound the receiver's memory
+rxm_credits_env="FI_OFI_RXM_FLOW_CTRL_CREDITS=64"
+
 function errcho {
 	>&2 echo $*
 }
@@ -416,6 +431,7 @@ function cs_test {
 	local test=$1
 	local s_ret=0
 	local c_ret=0
+	local test_env="${2:+env $2}"
 	local test_exe="${test} -p \"${PROV}\""
 	local start_time
 	local end_time
@@ -431,7 +447,7 @@ function cs_test {
 		s_arg="-s $S_INTERFACE"
 	fi
 	s_cmd="${BIN_PATH}${test_exe} ${S_ARGS} $s_arg"
-	${SERVER_CMD} "${EXPORT_ENV} $s_cmd" &> $s_outp &
+	${SERVER_CMD} "${EXPORT_ENV} ${test_env} $s_cmd" &> $s_outp &
 	s_pid=$!
 	sleep 1
 
@@ -441,7 +457,7 @@ function cs_test {
 		c_arg="-s $C_INTERFACE $S_INTERFACE"
 	fi
 	c_cmd="${BIN_PATH}${test_exe} ${C_ARGS} $c_arg"
-	${CLIENT_CMD} "${EXPORT_ENV} $c_cmd" &> $c_outp &
+	${CLIENT_CMD} "${EXPORT_ENV} ${test_env} $c_cmd" &> $c_outp &
 	c_pid=$!
 
 	wait $c_pid
@@ -573,6 +589,7 @@ function multinode_test {
 	local c_ret=0
 	local c_out_arr=()
 	local num_procs=$2
+	local test_env="${3:+env $3}"
 	local test_exe="${test} -n $num_procs -p \"${PROV}\"" 	
 	local c_out
 	local start_time
@@ -584,7 +601,7 @@ function multinode_test {
 	start_time=$(date '+%s')
 	
 	s_cmd="${BIN_PATH}${test_exe} ${S_ARGS} -s ${S_INTERFACE}"
-	${SERVER_CMD} "${EXPORT_ENV} $s_cmd" &> $s_outp &
+	${SERVER_CMD} "${EXPORT_ENV} ${test_env} $s_cmd" &> $s_outp &
 	s_pid=$!
 	sleep 1
 	
@@ -593,7 +610,7 @@ function multinode_test {
 	do
 		local c_out=$(mktemp fabtests.c_outp${i}.XXXXXX)
 		c_cmd="${BIN_PATH}${test_exe} ${S_ARGS} -s ${S_INTERFACE}"
-		${CLIENT_CMD} "${EXPORT_ENV} $c_cmd" &> $c_out & 
+		${CLIENT_CMD} "${EXPORT_ENV} ${test_env} $c_cmd" &> $c_out & 
 		c_pid_arr+=($!)
 		c_out_arr+=($c_out)
 	done
@@ -704,6 +721,9 @@ function main {
 			for test in "${functional_tests[@]}"; do
 				cs_test "$test"
 			done
+			if [[ "$PROV" == *ofi_rxm* || "$PROV" == "tcp" ]]; then
+				cs_test "fi_rdm_flood -M 64" "$rxm_credits_env"
+			fi
 		;;
 		short)
 			for test in "${short_tests[@]}"; do
@@ -724,6 +744,9 @@ function main {
 			for test in "${multinode_tests[@]}"; do
 					multinode_test "$test" 3
 			done
+			if [[ "$PROV" == "udp;ofi_rxd" ]]; then
+				multinode_test "fi_multinode_coll" 3 "$rxd_mcast_env"
+			fi
 		;;
 		*)
 			errcho "Unknown test set: ${ts}"
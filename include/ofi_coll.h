@@ -88,6 +88,10 @@ enum coll_work_type {
 	UTIL_COLL_REDUCE,
 	UTIL_COLL_COPY,
 	UTIL_COLL_COMP,
+	/* The root's data reaches every other member in one multicast,
+	 * posted through util_ep->coll_mcast */
+	UTIL_COLL_MCAST_SEND,
+	UTIL_COLL_MCAST_RECV,
 };
 
 enum coll_state {
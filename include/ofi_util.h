@@ -252,6 +252,9 @@ int ofi_pep_close(struct util_pep *pep);
 struct util_cntr;
 struct util_ep;
 typedef void (*ofi_ep_progress_func)(struct util_ep *util_ep);
+struct util_coll_xfer_item;
+typedef ssize_t (*ofi_coll_mcast_func)(struct util_ep *util_ep,
+				       struct util_coll_xfer_item *item);
 typedef void (*ofi_cntr_inc_func)(struct util_cntr *util_cntr);
 
 struct util_ep {
@@ -298,6 +301,9 @@ struct util_ep {
 
 	struct bitmask		*coll_cid_mask;
 	struct slist		coll_ready_queue;
+	/* Set by providers that can send to all members of a collective
+	 * group at once, see UTIL_COLL_MCAST_SEND */
+	ofi_coll_mcast_func	coll_mcast;
 };
 
 int ofi_ep_bind_av(struct util_ep *util_ep, struct util_av *av);
@@ -605,6 +611,8 @@ ofi_cq_write_src(struct util_cq *cq, void *context, uint64_t flags, size_t len,
 	return ret;
 }
 
+int ofi_cq_write_error_thread_unsafe(struct util_cq *cq,
+				     const struct fi_cq_err_entry *err_entry);
 int ofi_cq_write_error(struct util_cq *cq,
 		       const struct fi_cq_err_entry *err_entry);
 int ofi_cq_write_error_peek(struct util_cq *cq, uint64_t tag, void *context);
@@ -1028,6 +1036,24 @@ struct ofi_ops_flow_ctrl {
 			ssize_t (*send_handler)(struct fid_ep *ep, uint64_t credits));
 };
 
+/*
+ * Lets a utility provider choose where a message lands while the core
+ * provider receives it.  Once the first hdr_size bytes of a message are in
+ * the posted buffer, get_rbuf is called with the context of the receive.
+ * It returns the number of iovecs (at most max_count) that take the rest of
+ * the message, or 0 to keep receiving into the posted buffer.  The buffer
+ * given at post time is still the one reported in the completion.
+ * Receives with more than one iovec or FI_MULTI_RECV are not offered.
+ */
+#define OFI_OPS_DYNAMIC_RBUF "ofix_dynamic_rbuf_v1"
+
+struct ofi_ops_dynamic_rbuf {
+	size_t	size;
+	void	(*set_rbuf_handler)(struct fid_domain *domain, size_t hdr_size,
+			size_t (*get_rbuf)(void *context, size_t msg_len,
+					   struct iovec *iov, size_t max_count));
+};
+
 
 #ifdef __cplusplus
 }
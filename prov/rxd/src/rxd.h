@@ -52,14 +52,16 @@
 #include <ofi_rbuf.h>
 #include <ofi_list.h>
 #include <ofi_util.h>
-#include <ofi_tree.h>
+#include <ofi_signal.h>
 #include <ofi_atomic.h>
+#include <ofi_indexer.h>
+#include <ofi_coll.h>
 #include "rxd_proto.h"
 
 #ifndef _RXD_H_
 #define _RXD_H_
 
-#define RXD_PROTOCOL_VERSION 	(2)
+#define RXD_PROTOCOL_VERSION 	(6)
 
 #define RXD_MAX_MTU_SIZE	4096
 
@@ -72,8 +74,24 @@
 #define RXD_MAX_PENDING		128
 #define RXD_MAX_PKT_RETRY	50
 
+/* Retransmission timeout bounds (usec) and congestion control limits */
+#define RXD_MIN_RTO		1000
+#define RXD_MAX_RTO		4000000
+#define RXD_MIN_CWND		16
+#define RXD_MIN_CREDITS		4
+#define RXD_DUP_ACK_THRESH	3
+#define RXD_LOSS_BURST		4
+#define RXD_MAX_PROBES		3
+
+/* Retransmit timer wheel, one slot per msec */
+#define RXD_TIMER_SLOTS		256
+#define RXD_PEER_POOL_CHUNK_CNT	16
+
 #define RXD_PKT_IN_USE		(1 << 0)
 #define RXD_PKT_ACKED		(1 << 1)
+#define RXD_PKT_SACKED		(1 << 2)
+#define RXD_PKT_RETRANS		(1 << 3)
+#define RXD_PKT_MC		(1 << 4)
 
 #define RXD_REMOTE_CQ_DATA	(1 << 0)
 #define RXD_NO_TX_COMP		(1 << 1)
@@ -82,17 +100,27 @@
 #define RXD_TAG_HDR		(1 << 4)
 #define RXD_INLINE		(1 << 5)
 #define RXD_MULTI_RECV		(1 << 6)
+#define RXD_ACK_REQ		(1 << 7)
+#define RXD_MORE		(1 << 8)
+#define RXD_BATCHED		(1 << 9)
+#define RXD_COLLECTIVE		(1 << 10)
+
+/* Per message flags carried in struct rxd_batch_hdr */
+#define RXD_BATCH_FLAGS		(RXD_REMOTE_CQ_DATA | RXD_TAG_HDR)
 
 struct rxd_env {
 	int spin_count;
 	int retry;
 	int max_peers;
 	int max_unacked;
+	char *progress_affinity;
+	char *mcast_addr;
 };
 
 extern struct rxd_env rxd_env;
 extern struct fi_provider rxd_prov;
 extern struct fi_info rxd_info;
+extern struct fi_info rxd_coll_info;
 extern struct fi_fabric_attr rxd_fabric_attr;
 extern struct util_prov rxd_util_prov;
 extern struct fi_ops_msg rxd_ops_msg;
@@ -105,9 +133,38 @@ struct rxd_fabric {
 	struct fid_fabric *dg_fabric;
 };
 
+/*
+ * Progress thread for FI_PROGRESS_AUTO domains.  It sleeps on the core CQ
+ * fds of the domain's endpoints until a packet arrives or the nearest
+ * retransmit timer is due.  The application path only signals it when it
+ * arms a timer earlier than the one the thread is sleeping on.
+ */
+struct rxd_progress {
+	ofi_epoll_t epoll_fd;
+	struct fd_signal signal;
+	pthread_t thread;
+	/* protects ep_list and run */
+	fastlock_t lock;
+	struct dlist_entry ep_list;
+	/* usec time the thread sleeps until, 0 while it is running */
+	ofi_atomic64_t wake_time;
+	int run;
+};
+
+/* Wake the progress thread if a timer armed by the application is due
+ * before the thread would otherwise wake up */
+static inline void rxd_progress_signal_timer(struct rxd_progress *progress,
+					     uint64_t expire)
+{
+	if (progress &&
+	    (int64_t) expire < ofi_atomic_get64(&progress->wake_time))
+		fd_signal_set(&progress->signal);
+}
+
 struct rxd_domain {
 	struct util_domain util_domain;
 	struct fid_domain *dg_domain;
+	struct rxd_progress *progress;
 
 	ssize_t max_mtu_sz;
 	ssize_t max_inline_msg;
@@ -117,41 +174,109 @@ struct rxd_domain {
 	struct ofi_mr_map mr_map;//TODO use util_domain mr_map instead
 };
 
+/*
+ * Allocated on first use, see rxd_get_peer.  The fields read for every
+ * packet come first so they share a cache line; per message and connection
+ * state follows.
+ */
 struct rxd_peer {
-	struct dlist_entry entry;
 	fi_addr_t peer_addr;
 	uint64_t tx_seq_no;
 	uint64_t rx_seq_no;
 	uint64_t last_rx_ack;
-	uint64_t last_tx_ack;
-	uint16_t rx_window;
+	uint16_t unacked_cnt;
 	uint16_t tx_window;
-	int retry_cnt;
+	uint16_t rx_window;
+	uint16_t cwnd;
+	struct rxd_unexp_msg *curr_unexp;
+	struct dlist_entry unacked;
 
-	uint16_t unacked_cnt;
+	uint16_t rx_win_cnt;
+	uint64_t last_tx_ack;
+
+	/* RTT estimate and retransmission timeout in usec (RFC 6298) */
+	uint64_t srtt;
+	uint64_t rttvar;
+	uint64_t rto;
+	uint64_t ack_time;
+	uint64_t probe_time;
+	uint8_t probe_cnt;
+
+	/* Send order of unacked packets, and the latest one delivered, see
+	 * rxd_detect_loss */
+	uint64_t tx_order;
+	uint64_t rack_order;
+
+	/* Congestion window state, see rxd_handle_ack */
+	uint16_t ssthresh;
+	uint16_t cwnd_cnt;
+	uint16_t lost_cnt;
+	uint8_t recovery;
+	uint8_t cwnd_cut;
 	uint8_t active;
+	uint8_t rx_xfer;
+	int retry_cnt;
+	uint64_t recover_seq;
+
+	/* Retransmit timer, see rxd_peer_set_timer */
+	struct dlist_entry timer_entry;
+	uint64_t timer_expire;
 
 	uint16_t curr_rx_id;
 	uint16_t curr_tx_id;
+	/* Messages of the batch at rx_seq_no already delivered */
+	uint16_t rx_batch_cnt;
 
-	struct rxd_unexp_msg *curr_unexp;
+	struct dlist_entry entry;
 	struct dlist_entry tx_list;
+	/* Unsent inline message at the tail of tx_list that later small
+	 * messages can join, see rxd_tx_entry_init_batch */
+	struct rxd_x_entry *tx_batch;
 	struct dlist_entry rx_list;
 	struct dlist_entry rma_rx_list;
-	struct dlist_entry unacked;
-	struct dlist_entry buf_pkts;
+
+	/* Packets received ahead of rx_seq_no, see rxd_buf_pkt */
+	struct rxd_pkt_entry *rx_win[];
 };
 
+/* Packets that may be outstanding: the smaller of the receiver's
+ * advertised window and the congestion window */
+static inline uint16_t rxd_peer_tx_window(struct rxd_peer *peer)
+{
+	return MIN(peer->tx_window, peer->cwnd);
+}
+
+/* Idle time before a tail loss probe, see rxd_send_probe */
+static inline uint64_t rxd_peer_pto(struct rxd_peer *peer)
+{
+	return MIN(MAX(peer->srtt / 4, RXD_MIN_RTO), peer->rto);
+}
+
+/*
+ * Multiplicative decrease on loss.  Backing off by 0.7 rather than half
+ * (RFC 8312) and keeping a floor of RXD_MIN_CWND packets lets a fabric with
+ * random drops, rather than congestion, keep a useful window.
+ */
+static inline void rxd_peer_reduce_cwnd(struct rxd_peer *peer)
+{
+	peer->ssthresh = MAX(peer->cwnd * 7 / 10,
+			     MIN(peer->cwnd, RXD_MIN_CWND));
+	peer->cwnd = peer->ssthresh;
+	peer->cwnd_cnt = 0;
+}
+
 struct rxd_addr {
 	fi_addr_t fi_addr;
 	fi_addr_t dg_addr;
+	UT_hash_handle hh;
+	uint8_t addr[RXD_NAME_LENGTH];
 };
 
 struct rxd_av {
 	struct util_av util_av;
 	struct fid_av *dg_av;
-	struct ofi_rbmap rbmap;
-	int fi_addr_idx;
+	/* rxd_addr_table entries in use, keyed by their dg address */
+	struct rxd_addr *addr_hash;
 	int rxd_addr_idx;
 
 	int dg_av_used;
@@ -161,6 +286,73 @@ struct rxd_av {
 	struct rxd_addr *rxd_addr_table;
 };
 
+/*
+ * Collective data sent by a root to the multicast group, see rxd_coll.c.
+ * The root's entry tracks the members that acked and how many segments
+ * each holds in order, a member's entry the segments it has received.
+ */
+struct rxd_mc_entry {
+	struct dlist_entry entry;
+	struct util_coll_xfer_item *item;
+	uint32_t cid;
+	uint32_t rank;
+	uint32_t local;
+	fi_addr_t root_addr;
+	char *buf;
+	size_t size;
+	size_t seg_size;
+	uint64_t num_segs;
+	uint64_t next_seg;
+	uint64_t left;
+	uint8_t *map;
+	uint64_t *acked;
+	uint64_t ack_seg;
+
+	uint64_t rto;
+	uint64_t expire;
+	uint64_t repair_seg;
+
+	size_t name_len;
+	uint8_t name[RXD_NAME_LENGTH];
+};
+
+/* Received collective data, kept to ack the root again if it asks */
+#define RXD_MC_DONE_CNT		64
+
+struct rxd_mc_done {
+	uint32_t cid;
+	uint32_t rank;
+	uint32_t local;
+	fi_addr_t root_addr;
+	size_t name_len;
+	uint8_t name[RXD_NAME_LENGTH];
+};
+
+/*
+ * Core endpoint bound to the multicast group set by FI_OFI_RXD_MCAST_ADDR.
+ * It shares the rxd endpoint's core CQ and AV, and data is sent to the
+ * group from the rxd endpoint's own core endpoint.
+ */
+struct rxd_mc_chan {
+	struct fid_ep *ep;
+	struct fid_eq *eq;
+	struct fid_mc *mc;
+	void *addr;
+
+	size_t seg_size;
+	size_t name_len;
+	uint8_t name[RXD_NAME_LENGTH];
+
+	struct dlist_entry rx_pkts;
+	struct dlist_entry tx_list;
+	struct dlist_entry rx_list;
+	struct dlist_entry unexp_list;
+	size_t unexp_cnt;
+
+	struct rxd_mc_done done[RXD_MC_DONE_CNT];
+	size_t done_cnt;
+};
+
 struct rxd_cq;
 typedef int (*rxd_cq_write_fn)(struct rxd_cq *cq,
 			       struct fi_cq_tagged_entry *cq_entry);
@@ -216,9 +408,69 @@ struct rxd_ep {
 	struct dlist_entry rts_sent_list;
 	struct dlist_entry ctrl_pkts;
 
-	struct rxd_peer peers[];
+	/* Peer state by rxd address */
+	struct index_map peers;
+	struct ofi_bufpool *peer_pool;
+	size_t rx_win_size;
+	/* Peers with a multi-packet receive in progress, see rx_xfer */
+	size_t rx_xfer_peers;
+
+	struct dlist_entry timer_wheel[RXD_TIMER_SLOTS];
+	uint64_t timer_tick;
+	size_t timer_cnt;
+
+	/* Batch held back by FI_MORE until the next message or progress */
+	struct rxd_x_entry *tx_more;
+
+	/* Set for FI_PROGRESS_AUTO domains, see rxd_progress_add_ep */
+	struct rxd_progress *progress;
+	struct dlist_entry progress_entry;
+
+	/* Collective transfers that completed, handed to util_coll by
+	 * rxd_ep_progress outside of the ep lock */
+	struct slist coll_comps;
+	struct rxd_mc_chan *mc;
 };
 
+static inline void rxd_coll_comp(struct rxd_ep *ep, void *context)
+{
+	struct util_coll_xfer_item *item = context;
+
+	slist_insert_tail(&item->hdr.ready_entry, &ep->coll_comps);
+	if (ep->util_ep.tx_cq->wait)
+		ep->util_ep.tx_cq->wait->signal(ep->util_ep.tx_cq->wait);
+}
+
+/* Peer that the caller knows was set up by rxd_get_peer */
+static inline struct rxd_peer *rxd_peer(struct rxd_ep *ep, fi_addr_t rxd_addr)
+{
+	return ofi_idm_at(&ep->peers, (int) rxd_addr);
+}
+
+static inline struct rxd_peer *rxd_peer_lookup(struct rxd_ep *ep,
+					       fi_addr_t rxd_addr)
+{
+	return rxd_addr <= OFI_IDX_MAX_INDEX ?
+	       ofi_idm_lookup(&ep->peers, (int) rxd_addr) : NULL;
+}
+
+/*
+ * Receive window granted to a peer.  Peers with a multi-packet receive in
+ * progress share the buffers posted to the core provider evenly, so that
+ * many concurrent senders cannot overrun the receiver between them.
+ */
+static inline uint16_t rxd_peer_rx_credits(struct rxd_ep *ep,
+					   struct rxd_peer *peer)
+{
+	size_t senders = ep->rx_xfer_peers + !peer->rx_xfer;
+
+	if (!peer->rx_window)
+		return 0;
+
+	return (uint16_t) MIN(peer->rx_window,
+			      MAX(ep->rx_size / senders, RXD_MIN_CREDITS));
+}
+
 static inline struct rxd_domain *rxd_ep_domain(struct rxd_ep *ep)
 {
 	return container_of(ep->util_ep.domain, struct rxd_domain, util_domain);
@@ -272,6 +524,10 @@ static inline uint32_t rxd_tx_flags(uint64_t fi_flags)
 		rxd_flags |= RXD_REMOTE_CQ_DATA;
 	if (fi_flags & FI_INJECT)
 		rxd_flags |= RXD_INJECT;
+	if (fi_flags & FI_MORE)
+		rxd_flags |= RXD_MORE;
+	if (fi_flags & FI_COLLECTIVE)
+		rxd_flags |= RXD_COLLECTIVE;
 	if (fi_flags & FI_COMPLETION)
 		return rxd_flags;
 
@@ -284,6 +540,8 @@ static inline uint32_t rxd_rx_flags(uint64_t fi_flags)
 
 	if (fi_flags & FI_MULTI_RECV)
 		rxd_flags |= RXD_MULTI_RECV;
+	if (fi_flags & FI_COLLECTIVE)
+		rxd_flags |= RXD_COLLECTIVE;
 	if (fi_flags & FI_COMPLETION)
 		return rxd_flags;
 
@@ -296,6 +554,8 @@ struct rxd_pkt_entry {
 	uint8_t flags;
 	size_t pkt_size;
 	uint64_t timestamp;
+	uint64_t tx_order;
+	uint64_t prev_order;
 	struct fi_context context;
 	struct fid_mr *mr;
 	void *desc;
@@ -303,6 +563,20 @@ struct rxd_pkt_entry {
 	void *pkt;
 };
 
+/*
+ * Records that a packet reached the peer, for rxd_detect_loss.  An ack for
+ * a resent packet may be for its previous send (Karn's rule), so only that
+ * one is known to have arrived.
+ */
+static inline void rxd_pkt_delivered(struct rxd_peer *peer,
+				     struct rxd_pkt_entry *pkt_entry)
+{
+	peer->rack_order = MAX(peer->rack_order,
+			       (pkt_entry->flags & RXD_PKT_RETRANS ?
+				pkt_entry->prev_order :
+				pkt_entry->tx_order) + 1);
+}
+
 struct rxd_unexp_msg {
 	struct dlist_entry entry;
 	struct rxd_pkt_entry *pkt_entry;
@@ -367,6 +641,14 @@ static inline size_t rxd_pkt_size(struct rxd_ep *ep, struct rxd_base_hdr *base_h
 	return ((char *) ptr - (char *) base_hdr) + ep->tx_prefix_size;
 }
 
+/* Bytes a message takes up in a batch packet */
+static inline size_t rxd_batch_msg_size(uint32_t flags, size_t len)
+{
+	return sizeof(struct rxd_batch_hdr) + len +
+	       (flags & RXD_TAG_HDR ? sizeof(struct rxd_tag_hdr) : 0) +
+	       (flags & RXD_REMOTE_CQ_DATA ? sizeof(struct rxd_data_hdr) : 0);
+}
+
 static inline void rxd_remove_free_pkt_entry(struct rxd_pkt_entry *pkt_entry)
 {
 	dlist_remove(&pkt_entry->d_entry);
@@ -417,6 +699,7 @@ int rxd_query_atomic(struct fid_domain *domain, enum fi_datatype datatype,
 		     enum fi_op op, struct fi_atomic_attr *attr, uint64_t flags);
 
 /* AV sub-functions */
+fi_addr_t rxd_av_rxd_addr(struct rxd_av *av, const void *addr);
 int rxd_av_insert_dg_addr(struct rxd_av *av, const void *addr,
 			  fi_addr_t *dg_fiaddr, uint64_t flags,
 			  void *context);
@@ -428,10 +711,17 @@ struct rxd_pkt_entry *rxd_get_tx_pkt(struct rxd_ep *ep);
 struct rxd_x_entry *rxd_get_tx_entry(struct rxd_ep *ep, uint32_t op);
 struct rxd_x_entry *rxd_get_rx_entry(struct rxd_ep *ep, uint32_t op);
 int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry);
+int rxd_ep_retry_pkt(struct rxd_ep *ep, struct rxd_peer *peer,
+		     struct rxd_pkt_entry *pkt_entry);
 ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry);
 void rxd_insert_unacked(struct rxd_ep *ep, fi_addr_t peer,
 			struct rxd_pkt_entry *pkt_entry);
 ssize_t rxd_send_rts_if_needed(struct rxd_ep *rxd_ep, fi_addr_t rxd_addr);
+struct rxd_peer *rxd_get_peer(struct rxd_ep *ep, fi_addr_t rxd_addr);
+uint64_t rxd_detect_loss(struct rxd_ep *ep, struct rxd_peer *peer,
+			 uint64_t current);
+void rxd_peer_set_timer(struct rxd_ep *ep, struct rxd_peer *peer,
+			uint64_t expire);
 int rxd_start_xfer(struct rxd_ep *ep, struct rxd_x_entry *tx_entry);
 void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
 		       struct rxd_pkt_entry *pkt_entry);
@@ -461,14 +751,15 @@ struct rxd_x_entry *rxd_tx_entry_init_common(struct rxd_ep *ep, fi_addr_t addr,
 			uint32_t op, const struct iovec *iov, size_t iov_count,
 			uint64_t tag, uint64_t data, uint32_t flags, void *context,
 			struct rxd_base_hdr **base_hdr, void **ptr);
+struct rxd_x_entry *rxd_tx_entry_init_batch(struct rxd_ep *ep, fi_addr_t addr,
+			uint32_t op, const struct iovec *iov, size_t iov_count,
+			uint64_t tag, uint64_t data, uint32_t flags, void *context);
 struct rxd_x_entry *rxd_rx_entry_init(struct rxd_ep *ep,
 			const struct iovec *iov, size_t iov_count, uint64_t tag,
 			uint64_t ignore, void *context, fi_addr_t addr,
 			uint32_t op, uint32_t flags);
 void rxd_tx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *tx_entry);
 void rxd_rx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *rx_entry);
-int rxd_get_timeout(uint8_t retry_cnt);
-uint64_t rxd_get_retry_time(uint64_t start, uint8_t retry_cnt);
 
 /* Generic message functions */
 ssize_t rxd_ep_generic_recvmsg(struct rxd_ep *rxd_ep, const struct iovec *iov,
@@ -505,8 +796,24 @@ struct rxd_x_entry *rxd_progress_multi_recv(struct rxd_ep *ep,
 					    struct rxd_x_entry *rx_entry,
 					    size_t total_size);
 void rxd_ep_progress(struct util_ep *util_ep);
+void rxd_ep_do_progress(struct rxd_ep *ep);
+int rxd_ep_trywait(void *arg);
+
+int rxd_progress_init(struct rxd_domain *domain);
+void rxd_progress_close(struct rxd_domain *domain);
+int rxd_progress_add_ep(struct rxd_ep *ep);
+void rxd_progress_del_ep(struct rxd_ep *ep);
 void rxd_cleanup_unexp_msg(struct rxd_unexp_msg *unexp_msg);
 
+/* Collective functions */
+int rxd_coll_open(struct rxd_ep *ep, const struct fi_info *dg_info);
+int rxd_coll_enable(struct rxd_ep *ep);
+void rxd_coll_close(struct rxd_ep *ep);
+void rxd_coll_repost_buf(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry);
+void rxd_coll_handle_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry);
+void rxd_coll_progress(struct rxd_ep *ep);
+void rxd_coll_progress_comps(struct rxd_ep *ep, struct slist *comps);
+
 /* CQ sub-functions */
 void rxd_cq_report_error(struct rxd_cq *cq, struct fi_cq_err_entry *err_entry);
 void rxd_cq_report_tx_comp(struct rxd_cq *cq, struct rxd_x_entry *tx_entry);
@@ -73,11 +73,23 @@ struct fi_ep_attr rxd_ep_attr = {
 	.mem_tag_format = FI_TAG_GENERIC,
 };
 
+struct fi_ep_attr rxd_ep_attr_coll = {
+	.type = FI_EP_RDM,
+	.protocol = FI_PROTO_RXD,
+	.protocol_version = 1,
+	.max_msg_size = SIZE_MAX,
+	.tx_ctx_cnt = 1,
+	.rx_ctx_cnt = 1,
+	.max_order_raw_size = SIZE_MAX,
+	.max_order_waw_size = SIZE_MAX,
+	.mem_tag_format = FI_TAG_GENERIC >> 1,
+};
+
 struct fi_domain_attr rxd_domain_attr = {
 	.caps = RXD_DOMAIN_CAPS,
 	.threading = FI_THREAD_SAFE,
 	.control_progress = FI_PROGRESS_MANUAL,
-	.data_progress = FI_PROGRESS_MANUAL,
+	.data_progress = FI_PROGRESS_AUTO,
 	.resource_mgmt = FI_RM_ENABLED,
 	.av_type = FI_AV_UNSPEC,
 	.mr_mode = FI_MR_BASIC | FI_MR_SCALABLE,
@@ -96,6 +108,16 @@ struct fi_fabric_attr rxd_fabric_attr = {
 	.prov_version = OFI_VERSION_DEF_PROV,
 };
 
+struct fi_info rxd_coll_info = {
+	.caps = RXD_DOMAIN_CAPS | RXD_TX_CAPS | RXD_RX_CAPS | FI_COLLECTIVE,
+	.addr_format = FI_FORMAT_UNSPEC,
+	.tx_attr = &rxd_tx_attr,
+	.rx_attr = &rxd_rx_attr,
+	.ep_attr = &rxd_ep_attr_coll,
+	.domain_attr = &rxd_domain_attr,
+	.fabric_attr = &rxd_fabric_attr
+};
+
 struct fi_info rxd_info = {
 	.caps = RXD_DOMAIN_CAPS | RXD_TX_CAPS | RXD_RX_CAPS,
 	.addr_format = FI_FORMAT_UNSPEC,
@@ -103,7 +125,8 @@ struct fi_info rxd_info = {
 	.rx_attr = &rxd_rx_attr,
 	.ep_attr = &rxd_ep_attr,
 	.domain_attr = &rxd_domain_attr,
-	.fabric_attr = &rxd_fabric_attr
+	.fabric_attr = &rxd_fabric_attr,
+	.next = &rxd_coll_info,
 };
 
 struct util_prov rxd_util_prov = {
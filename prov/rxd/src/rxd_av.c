@@ -34,23 +34,6 @@
 #include <inttypes.h>
 
 
-static int rxd_tree_compare(struct ofi_rbmap *map, void *key, void *data)
-{
-	struct rxd_av *av;
-	uint8_t addr[RXD_NAME_LENGTH];
-	size_t len = RXD_NAME_LENGTH;
-	int ret;
-
-	memset(addr, 0, len);
-	av = container_of(map, struct rxd_av, rbmap);
-	ret = fi_av_lookup(av->dg_av, av->rxd_addr_table[(fi_addr_t) data].dg_addr,
-			   addr, &len);
-	if (ret)
-		return -1;
-
-	return memcmp(key, addr, len);
-}
-
 /*
  * The RXD code is agnostic wrt the datagram address format, but we need
  * to know the size of the address in order to iterate over them.  Because
@@ -127,45 +110,79 @@ static fi_addr_t rxd_set_rxd_addr(struct rxd_av *av, fi_addr_t dg_addr)
 	return av->rxd_addr_idx;
 }
 
-static fi_addr_t rxd_set_fi_addr(struct rxd_av *av, fi_addr_t rxd_addr)
+/*
+ * The util AV hands out fi_addrs, so that AV sets and collectives can walk
+ * the addresses inserted by the application.  Peers are keyed by their
+ * rxd_addr there.
+ */
+static int rxd_set_fi_addr(struct rxd_av *av, fi_addr_t rxd_addr,
+			   fi_addr_t *fi_addr)
 {
-	int tries = 0;
+	int ret;
 
-	while (av->fi_addr_table[av->fi_addr_idx] != FI_ADDR_UNSPEC &&
-	       tries < av->util_av.count) {
-		if (++av->fi_addr_idx == av->util_av.count)
-			av->fi_addr_idx = 0;
-		tries++;
+	ret = ofi_av_insert_addr(&av->util_av, &rxd_addr, fi_addr);
+	if (ret)
+		return ret;
+
+	if (*fi_addr >= av->util_av.count) {
+		ofi_av_remove_addr(&av->util_av, *fi_addr);
+		return -FI_ENOSPC;
 	}
-	assert(av->fi_addr_idx < av->util_av.count && tries < av->util_av.count);
-	av->fi_addr_table[av->fi_addr_idx] = rxd_addr;
-	av->rxd_addr_table[rxd_addr].fi_addr = av->fi_addr_idx;
 
-	return av->fi_addr_idx;
+	av->fi_addr_table[*fi_addr] = rxd_addr;
+	av->rxd_addr_table[rxd_addr].fi_addr = *fi_addr;
+	return 0;
+}
+
+/*
+ * Finds the peer with the given dg address, as inserted by the application
+ * or received in an RTS.  The address is the hash key, so this does not
+ * need to read back addresses from the dg AV.
+ */
+fi_addr_t rxd_av_rxd_addr(struct rxd_av *av, const void *addr)
+{
+	struct rxd_addr *entry = NULL;
+
+	HASH_FIND(hh, av->addr_hash, addr, av->dg_addrlen, entry);
+	return entry ? (fi_addr_t) (entry - av->rxd_addr_table) :
+		       FI_ADDR_UNSPEC;
 }
 
 int rxd_av_insert_dg_addr(struct rxd_av *av, const void *addr,
 			  fi_addr_t *rxd_addr, uint64_t flags,
 			  void *context)
 {
+	struct rxd_addr *entry;
 	fi_addr_t dg_addr;
+	size_t len;
 	int ret;
 
+	if (!av->dg_addrlen) {
+		ret = rxd_av_set_addrlen(av, addr);
+		if (ret)
+			return ret;
+	}
+
 	ret = fi_av_insert(av->dg_av, addr, 1, &dg_addr,
 			     flags, context);
 	if (ret != 1)
 		return -FI_EINVAL;
 
 	*rxd_addr = rxd_set_rxd_addr(av, dg_addr);
+	entry = &av->rxd_addr_table[*rxd_addr];
 
-	ret = ofi_rbmap_insert(&av->rbmap, (void *) addr, (void *) (*rxd_addr),
-			       NULL);
+	/* Key on the address as the dg AV stores it, like lookups return it */
+	len = sizeof(entry->addr);
+	memset(entry->addr, 0, len);
+	ret = fi_av_lookup(av->dg_av, dg_addr, entry->addr, &len);
 	if (ret) {
-		assert(ret != -FI_EALREADY);
 		fi_av_remove(av->dg_av, &dg_addr, 1, flags);
+		entry->dg_addr = FI_ADDR_UNSPEC;
+		return ret;
 	}
 
-	return ret;
+	HASH_ADD(hh, av->addr_hash, addr, av->dg_addrlen, entry);
+	return 0;
 }
 
 static int rxd_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
@@ -174,7 +191,6 @@ static int rxd_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 	struct rxd_av *av;
 	int i = 0, ret = 0, success_cnt = 0;
 	fi_addr_t rxd_addr, util_addr;
-	struct ofi_rbnode *node;
 
 	av = container_of(av_fid, struct rxd_av, util_av.av_fid);
 	fastlock_acquire(&av->util_av.lock);
@@ -185,19 +201,20 @@ static int rxd_av_insert(struct fid_av *av_fid, const void *addr, size_t count,
 	}
 
 	for (; i < count; i++, addr = (uint8_t *) addr + av->dg_addrlen) {
-		node = ofi_rbmap_find(&av->rbmap, (void *) addr);
-		if (node) {
-			rxd_addr = (fi_addr_t) node->data;
-		} else {
+		rxd_addr = rxd_av_rxd_addr(av, addr);
+		if (rxd_addr == FI_ADDR_UNSPEC) {
 			ret = rxd_av_insert_dg_addr(av, addr, &rxd_addr,
 						    flags, context);
 			if (ret)
 				break;
 		}
 
-		util_addr = av->rxd_addr_table[rxd_addr].fi_addr == FI_ADDR_UNSPEC ?
-			    rxd_set_fi_addr(av, rxd_addr) :
-			    av->rxd_addr_table[rxd_addr].fi_addr;
+		util_addr = av->rxd_addr_table[rxd_addr].fi_addr;
+		if (util_addr == FI_ADDR_UNSPEC) {
+			ret = rxd_set_fi_addr(av, rxd_addr, &util_addr);
+			if (ret)
+				break;
+		}
 		if (fi_addr)
 			fi_addr[i] = util_addr;
 
@@ -251,34 +268,29 @@ static int rxd_av_remove(struct fid_av *av_fid, fi_addr_t *fi_addr, size_t count
 			uint64_t flags)
 {
 	int ret = 0;
-	size_t i, addrlen;
+	size_t i;
 	fi_addr_t rxd_addr;
 	struct rxd_av *av;
-	uint8_t addr[RXD_NAME_LENGTH];
 
 	av = container_of(av_fid, struct rxd_av, util_av.av_fid);
 	fastlock_acquire(&av->util_av.lock);
 	for (i = 0; i < count; i++) {
 		rxd_addr = av->fi_addr_table[fi_addr[i]];
-
-		addrlen = RXD_NAME_LENGTH;
-		ret = fi_av_lookup(av->dg_av, av->rxd_addr_table[rxd_addr].dg_addr,
-				   addr, &addrlen);
-		if (ret)
-			goto err;
-		
-		ret = ofi_rbmap_find_delete(&av->rbmap, (void *) addr);
-		if (ret)
+		if (rxd_addr == FI_ADDR_UNSPEC) {
+			ret = -FI_ENOENT;
 			goto err;
+		}
 
 		ret = fi_av_remove(av->dg_av, &av->rxd_addr_table[rxd_addr].dg_addr,
 				   1, flags);
 		if (ret)
 			goto err;
 
+		ofi_av_remove_addr(&av->util_av, fi_addr[i]);
 		av->fi_addr_table[fi_addr[i]] = FI_ADDR_UNSPEC;
 		av->rxd_addr_table[rxd_addr].fi_addr = FI_ADDR_UNSPEC;
 		av->rxd_addr_table[rxd_addr].dg_addr = FI_ADDR_UNSPEC;
+		HASH_DEL(av->addr_hash, &av->rxd_addr_table[rxd_addr]);
 		av->dg_av_used--;
 	}
 
@@ -320,6 +332,7 @@ static struct fi_ops_av rxd_av_ops = {
 	.remove = rxd_av_remove,
 	.lookup = rxd_av_lookup,
 	.straddr = rxd_av_straddr,
+	.av_set = ofi_av_set,
 };
 
 static int rxd_av_close(struct fid *fid)
@@ -332,7 +345,7 @@ static int rxd_av_close(struct fid *fid)
 	if (ret)
 		return ret;
 
-	ofi_rbmap_cleanup(&av->rbmap);
+	HASH_CLEAR(hh, av->addr_hash);
 	ret = ofi_av_close(&av->util_av);
 	if (ret)
 		return ret;
@@ -396,7 +409,6 @@ int rxd_av_create(struct fid_domain *domain_fid, struct fi_av_attr *attr,
 	if (ret)
 		goto err1;
 
-	ofi_rbmap_init(&av->rbmap, rxd_tree_compare);
 	for (i = 0; i < attr->count; av->fi_addr_table[i++] = FI_ADDR_UNSPEC)
 		;
 	for (i = 0; i < rxd_env.max_peers; i++) {
@@ -0,0 +1,895 @@
+/*
+ * Copyright (c) 2021 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+/*
+ * Collective data that a root sends to every other member of a group, as
+ * for a broadcast or the release of a barrier, goes out once to the
+ * multicast group set by FI_OFI_RXD_MCAST_ADDR instead of once per member.
+ * Members NACK the segments they miss to the root, ack their progress
+ * every half receive window and ack once more when they hold all of them.
+ * The root keeps at most a receive window of segments ahead of the slowest
+ * member, and resends only what is NACKed, to the member that asked.  If no
+ * member answers for a timeout, it polls those that have not acked by
+ * resending them the last segment sent.  Repairs and polls are unicast, so
+ * members fall back to unicast if the group does not reach them.  Other
+ * transfers of a collective use the regular data path.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rxd.h"
+
+#define RXD_MC_RTO		10000
+#define RXD_MC_MAX_NACK_RTO	64000
+#define RXD_MC_UNEXP_TIMEOUT	1000000
+#define RXD_MC_JOIN_TIMEOUT	1000
+#define RXD_MC_SACK_BITS	64
+
+static inline int rxd_coll_test_bit(uint8_t *map, uint64_t i)
+{
+	return map[i / 8] & (1 << (i % 8));
+}
+
+static inline void rxd_coll_set_bit(uint8_t *map, uint64_t i)
+{
+	map[i / 8] |= (1 << (i % 8));
+}
+
+static inline uint64_t rxd_coll_num_segs(size_t size, size_t seg_size)
+{
+	return size ? ofi_div_ceil(size, seg_size) : 1;
+}
+
+static int rxd_coll_match(uint32_t cid, uint32_t rank, size_t name_len,
+			  const uint8_t *name, struct rxd_mc_pkt *pkt)
+{
+	return cid == pkt->cid && rank == pkt->rank &&
+	       name_len == pkt->name_len && !memcmp(name, pkt->data, name_len);
+}
+
+static void rxd_coll_free_entry(struct rxd_mc_entry *entry)
+{
+	dlist_remove(&entry->entry);
+	free(entry->map);
+	free(entry->acked);
+	free(entry);
+}
+
+/* Arms the timer of an entry, see rxd_peer_set_timer */
+static void rxd_coll_set_timer(struct rxd_ep *ep, struct rxd_mc_entry *entry,
+			       uint64_t expire)
+{
+	uint64_t current;
+	int delay;
+
+	entry->expire = expire;
+	current = ofi_gettime_us();
+	delay = expire > current ? (int) ((expire - current + 999) / 1000) : 0;
+	ep->next_retry = ep->next_retry == -1 ? delay :
+			 MIN(ep->next_retry, delay);
+	rxd_progress_signal_timer(ep->progress, expire);
+}
+
+static int rxd_coll_post_buf(struct rxd_ep *ep)
+{
+	struct rxd_mc_chan *chan = ep->mc;
+	struct rxd_pkt_entry *pkt_entry;
+	ssize_t ret;
+
+	pkt_entry = ofi_buf_alloc(ep->rx_pkt_pool.pool);
+	if (!pkt_entry)
+		return -FI_ENOMEM;
+
+	pkt_entry->flags = RXD_PKT_MC;
+	ret = fi_recv(chan->ep, rxd_pkt_start(pkt_entry),
+		      rxd_ep_domain(ep)->max_mtu_sz, pkt_entry->desc,
+		      FI_ADDR_UNSPEC, &pkt_entry->context);
+	if (ret) {
+		ofi_buf_free(pkt_entry);
+		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
+			"failed to post multicast buffer\n");
+		return ret;
+	}
+
+	dlist_insert_tail(&pkt_entry->d_entry, &chan->rx_pkts);
+	return 0;
+}
+
+void rxd_coll_repost_buf(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+{
+	dlist_remove(&pkt_entry->d_entry);
+	(void) rxd_coll_post_buf(ep);
+}
+
+static struct rxd_pkt_entry *rxd_coll_get_pkt(struct rxd_ep *ep, uint8_t type,
+					      uint32_t cid, uint32_t rank)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	struct rxd_mc_pkt *pkt;
+
+	pkt_entry = rxd_get_tx_pkt(ep);
+	if (!pkt_entry)
+		return NULL;
+
+	pkt = (struct rxd_mc_pkt *) (pkt_entry->pkt);
+	memset(pkt, 0, sizeof(*pkt));
+	pkt->base_hdr.version = RXD_PROTOCOL_VERSION;
+	pkt->base_hdr.type = type;
+	pkt->cid = cid;
+	pkt->rank = rank;
+	pkt_entry->pkt_size = sizeof(*pkt) + ep->tx_prefix_size;
+
+	return pkt_entry;
+}
+
+/* Sends a packet to one member, over its core address */
+static void rxd_coll_send_ctrl(struct rxd_ep *ep,
+			       struct rxd_pkt_entry *pkt_entry,
+			       fi_addr_t addr)
+{
+	struct rxd_av *av = rxd_ep_av(ep);
+
+	pkt_entry->peer = av->fi_addr_table[addr];
+	if (pkt_entry->peer == FI_ADDR_UNSPEC) {
+		ofi_buf_free(pkt_entry);
+		return;
+	}
+
+	dlist_insert_tail(&pkt_entry->d_entry, &ep->ctrl_pkts);
+	if (rxd_ep_send_pkt(ep, pkt_entry))
+		rxd_remove_free_pkt_entry(pkt_entry);
+}
+
+/* Acks the segments before seg, all of them if seg is the segment count */
+static void rxd_coll_send_ack(struct rxd_ep *ep, uint32_t cid, uint32_t local,
+			      fi_addr_t root_addr, uint64_t seg)
+{
+	struct rxd_pkt_entry *pkt_entry;
+
+	pkt_entry = rxd_coll_get_pkt(ep, RXD_MC_ACK, cid, local);
+	if (!pkt_entry)
+		return;
+
+	((struct rxd_mc_pkt *) (pkt_entry->pkt))->base_hdr.seq_no = seg;
+	rxd_coll_send_ctrl(ep, pkt_entry, root_addr);
+}
+
+/*
+ * Asks for the first missing segment and the 64 after it.  Before any data
+ * arrived, the member does not know how many segments there are and asks
+ * for all of them.
+ */
+static void rxd_coll_send_nack(struct rxd_ep *ep, struct rxd_mc_entry *entry)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	struct rxd_mc_pkt *pkt;
+	uint64_t seg;
+	int i;
+
+	pkt_entry = rxd_coll_get_pkt(ep, RXD_MC_NACK, entry->cid, entry->local);
+	if (!pkt_entry)
+		return;
+
+	pkt = (struct rxd_mc_pkt *) (pkt_entry->pkt);
+	pkt->base_hdr.seq_no = entry->next_seg;
+	if (!entry->map) {
+		pkt->sack = ~0ULL;
+	} else {
+		entry->repair_seg = entry->next_seg;
+		for (i = 0; i < RXD_MC_SACK_BITS; i++) {
+			seg = entry->next_seg + 1 + i;
+			if (seg >= entry->num_segs)
+				break;
+			if (!rxd_coll_test_bit(entry->map, seg)) {
+				pkt->sack |= 1ULL << i;
+				entry->repair_seg = seg;
+			}
+		}
+	}
+
+	rxd_coll_send_ctrl(ep, pkt_entry, entry->root_addr);
+}
+
+/* Sends a segment to the group, or to one member if it repairs a NACK */
+static void rxd_coll_send_seg(struct rxd_ep *ep, struct rxd_mc_entry *entry,
+			      uint64_t seg, struct util_coll_mc *coll_mc,
+			      uint32_t member)
+{
+	struct rxd_mc_chan *chan = ep->mc;
+	struct rxd_pkt_entry *pkt_entry;
+	struct rxd_mc_pkt *pkt;
+	struct iovec iov;
+	struct fi_msg msg;
+	size_t len;
+	int ret;
+
+	pkt_entry = rxd_coll_get_pkt(ep, RXD_MC_DATA, entry->cid, entry->rank);
+	if (!pkt_entry)
+		return;
+
+	pkt = (struct rxd_mc_pkt *) (pkt_entry->pkt);
+	pkt->base_hdr.seq_no = seg;
+	pkt->size = entry->size;
+	pkt->seg_size = entry->seg_size;
+	pkt->name_len = chan->name_len;
+	memcpy(pkt->data, chan->name, chan->name_len);
+
+	len = MIN(entry->seg_size, entry->size - seg * entry->seg_size);
+	if (len)
+		memcpy(pkt->data + chan->name_len,
+		       entry->buf + seg * entry->seg_size, len);
+	pkt_entry->pkt_size += chan->name_len + len;
+
+	if (coll_mc) {
+		rxd_coll_send_ctrl(ep, pkt_entry,
+				   coll_mc->av_set->fi_addr_array[member]);
+		return;
+	}
+
+	pkt_entry->timestamp = ofi_gettime_us();
+
+	iov.iov_base = rxd_pkt_start(pkt_entry);
+	iov.iov_len = pkt_entry->pkt_size;
+	msg.msg_iov = &iov;
+	msg.desc = &pkt_entry->desc;
+	msg.iov_count = 1;
+	msg.addr = chan->mc->fi_addr;
+	msg.context = &pkt_entry->context;
+	msg.data = 0;
+
+	ret = fi_sendmsg(ep->dg_ep, &msg, FI_MULTICAST | FI_COMPLETION);
+	if (ret) {
+		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
+			"error sending multicast packet: %d (%s)\n",
+			ret, fi_strerror(-ret));
+		ofi_buf_free(pkt_entry);
+		return;
+	}
+
+	pkt_entry->flags |= RXD_PKT_IN_USE;
+	dlist_insert_tail(&pkt_entry->d_entry, &ep->ctrl_pkts);
+}
+
+/* The members that have not acked every segment yet */
+static inline int rxd_coll_waiting(struct rxd_mc_entry *entry, size_t rank)
+{
+	return rank != entry->local && !rxd_coll_test_bit(entry->map, rank);
+}
+
+/*
+ * Sends the segments not sent yet, up to a receive window past the slowest
+ * member, whose multicast buffers would otherwise overflow.
+ */
+static void rxd_coll_send_segs(struct rxd_ep *ep, struct rxd_mc_entry *entry)
+{
+	size_t rank, cnt = entry->item->hdr.coll_op->mc->av_set->fi_addr_count;
+	uint64_t limit = entry->num_segs;
+
+	for (rank = 0; rank < cnt; rank++) {
+		if (rxd_coll_waiting(entry, rank))
+			limit = MIN(limit, entry->acked[rank] + ep->rx_size);
+	}
+
+	if (entry->next_seg >= limit)
+		return;
+
+	while (entry->next_seg < limit)
+		rxd_coll_send_seg(ep, entry, entry->next_seg++, NULL, 0);
+
+	rxd_coll_set_timer(ep, entry, ofi_gettime_us() + entry->rto);
+}
+
+/* Resends the last segment sent to each member that has not acked all */
+static void rxd_coll_poll(struct rxd_ep *ep, struct rxd_mc_entry *entry)
+{
+	struct util_coll_mc *coll_mc = entry->item->hdr.coll_op->mc;
+	size_t rank;
+
+	for (rank = 0; rank < coll_mc->av_set->fi_addr_count; rank++) {
+		if (rxd_coll_waiting(entry, rank))
+			rxd_coll_send_seg(ep, entry, entry->next_seg - 1,
+					  coll_mc, (uint32_t) rank);
+	}
+}
+
+/*
+ * Repairs go to the member that NACKed, so that members fall back to
+ * unicast if the group does not reach them.
+ */
+static void rxd_coll_repair(struct rxd_ep *ep, struct rxd_mc_entry *entry,
+			    struct rxd_mc_pkt *pkt)
+{
+	struct util_coll_mc *coll_mc = entry->item->hdr.coll_op->mc;
+	uint64_t seg = pkt->base_hdr.seq_no;
+	int i;
+
+	if (seg >= entry->next_seg)
+		return;
+
+	rxd_coll_send_seg(ep, entry, seg, coll_mc, pkt->rank);
+	for (i = 0; i < RXD_MC_SACK_BITS; i++) {
+		if (seg + 1 + i >= entry->next_seg)
+			break;
+		if (pkt->sack & (1ULL << i))
+			rxd_coll_send_seg(ep, entry, seg + 1 + i, coll_mc,
+					  pkt->rank);
+	}
+	rxd_coll_set_timer(ep, entry, ofi_gettime_us() + entry->rto);
+}
+
+static void rxd_coll_handle_reply(struct rxd_ep *ep,
+				  struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_mc_pkt *pkt = (struct rxd_mc_pkt *) (pkt_entry->pkt);
+	struct rxd_mc_entry *entry;
+	struct dlist_entry *item;
+
+	dlist_foreach(&ep->mc->tx_list, item) {
+		entry = container_of(item, struct rxd_mc_entry, entry);
+		if (entry->cid == pkt->cid)
+			goto found;
+	}
+	return;
+
+found:
+	if (pkt->rank == entry->local || pkt->rank >=
+	    entry->item->hdr.coll_op->mc->av_set->fi_addr_count)
+		return;
+
+	/* Both carry the number of segments the member holds in order */
+	entry->rto = RXD_MC_RTO;
+	entry->acked[pkt->rank] = MAX(entry->acked[pkt->rank],
+				      MIN(pkt->base_hdr.seq_no,
+					  entry->num_segs));
+	if (rxd_pkt_type(pkt_entry) == RXD_MC_NACK) {
+		rxd_coll_repair(ep, entry, pkt);
+	} else if (entry->acked[pkt->rank] == entry->num_segs &&
+		   !rxd_coll_test_bit(entry->map, pkt->rank)) {
+		rxd_coll_set_bit(entry->map, pkt->rank);
+		if (!--entry->left) {
+			rxd_coll_comp(ep, entry->item);
+			rxd_coll_free_entry(entry);
+			return;
+		}
+	}
+
+	rxd_coll_send_segs(ep, entry);
+}
+
+static void rxd_coll_finish_rx(struct rxd_ep *ep, struct rxd_mc_entry *entry)
+{
+	struct rxd_mc_chan *chan = ep->mc;
+	struct rxd_mc_done *done;
+
+	rxd_coll_send_ack(ep, entry->cid, entry->local, entry->root_addr,
+			  entry->num_segs);
+
+	done = &chan->done[chan->done_cnt++ % RXD_MC_DONE_CNT];
+	done->cid = entry->cid;
+	done->rank = entry->rank;
+	done->local = entry->local;
+	done->root_addr = entry->root_addr;
+	done->name_len = entry->name_len;
+	memcpy(done->name, entry->name, entry->name_len);
+
+	rxd_coll_comp(ep, entry->item);
+	rxd_coll_free_entry(entry);
+}
+
+/*
+ * Copies a segment to the receive buffer.  The member NACKs once the last
+ * segment it knows to be outstanding arrives with gaps left, or when the
+ * root polls with a segment it already holds, and acks every half receive
+ * window of segments received in order.  Returns 1 if the entry is done and
+ * freed.
+ */
+static int rxd_coll_recv_seg(struct rxd_ep *ep, struct rxd_mc_entry *entry,
+			     struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_mc_pkt *pkt = (struct rxd_mc_pkt *) (pkt_entry->pkt);
+	uint64_t seg = pkt->base_hdr.seq_no;
+	size_t len, offset;
+
+	if (!entry->map) {
+		if (!pkt->seg_size)
+			return 0;
+
+		entry->seg_size = pkt->seg_size;
+		entry->num_segs = rxd_coll_num_segs(pkt->size, pkt->seg_size);
+		entry->map = calloc(ofi_div_ceil(entry->num_segs, 8), 1);
+		if (!entry->map)
+			return 0;
+
+		entry->left = entry->num_segs;
+		entry->repair_seg = entry->num_segs - 1;
+	}
+
+	if (seg >= entry->num_segs)
+		return 0;
+
+	if (rxd_coll_test_bit(entry->map, seg)) {
+		rxd_coll_send_nack(ep, entry);
+		return 0;
+	}
+
+	offset = seg * entry->seg_size;
+	len = pkt_entry->pkt_size - ep->rx_prefix_size - sizeof(*pkt) -
+	      pkt->name_len;
+	if (offset < entry->size && len)
+		memcpy(entry->buf + offset, pkt->data + pkt->name_len,
+		       MIN(len, entry->size - offset));
+
+	rxd_coll_set_bit(entry->map, seg);
+	while (entry->next_seg < entry->num_segs &&
+	       rxd_coll_test_bit(entry->map, entry->next_seg))
+		entry->next_seg++;
+
+	if (!--entry->left) {
+		rxd_coll_finish_rx(ep, entry);
+		return 1;
+	}
+
+	entry->rto = RXD_MC_RTO;
+	entry->expire = ofi_gettime_us() + entry->rto;
+	if (seg == entry->repair_seg) {
+		rxd_coll_send_nack(ep, entry);
+	} else if (entry->next_seg - entry->ack_seg >=
+		   MAX(ep->rx_size / 2, 1)) {
+		rxd_coll_send_ack(ep, entry->cid, entry->local,
+				  entry->root_addr, entry->next_seg);
+		entry->ack_seg = entry->next_seg;
+	}
+	return 0;
+}
+
+/* Returns 1 if the packet was kept as unexpected */
+static int rxd_coll_handle_data(struct rxd_ep *ep,
+				struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_mc_chan *chan = ep->mc;
+	struct rxd_mc_pkt *pkt = (struct rxd_mc_pkt *) (pkt_entry->pkt);
+	struct rxd_pkt_entry *unexp;
+	struct rxd_mc_entry *entry;
+	struct rxd_mc_done *done;
+	struct dlist_entry *item;
+	size_t i;
+
+	/* Our own data, looped back by the group */
+	if (pkt->name_len == chan->name_len &&
+	    !memcmp(pkt->data, chan->name, chan->name_len))
+		return 0;
+
+	dlist_foreach(&chan->rx_list, item) {
+		entry = container_of(item, struct rxd_mc_entry, entry);
+		if (rxd_coll_match(entry->cid, entry->rank, entry->name_len,
+				   entry->name, pkt)) {
+			(void) rxd_coll_recv_seg(ep, entry, pkt_entry);
+			return 0;
+		}
+	}
+
+	/* The root polls until it has our ack */
+	for (i = 0; i < MIN(chan->done_cnt, RXD_MC_DONE_CNT); i++) {
+		done = &chan->done[i];
+		if (!rxd_coll_match(done->cid, done->rank, done->name_len,
+				    done->name, pkt))
+			continue;
+
+		if (pkt->seg_size && pkt->base_hdr.seq_no ==
+		    rxd_coll_num_segs(pkt->size, pkt->seg_size) - 1)
+			rxd_coll_send_ack(ep, done->cid, done->local,
+					  done->root_addr,
+					  pkt->base_hdr.seq_no + 1);
+		return 0;
+	}
+
+	if (chan->unexp_cnt == ep->rx_size) {
+		dlist_pop_front(&chan->unexp_list, struct rxd_pkt_entry,
+				unexp, d_entry);
+		ofi_buf_free(unexp);
+		chan->unexp_cnt--;
+	}
+
+	pkt_entry->timestamp = ofi_gettime_us();
+	dlist_insert_tail(&pkt_entry->d_entry, &chan->unexp_list);
+	chan->unexp_cnt++;
+	return 1;
+}
+
+void rxd_coll_handle_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_mc_pkt *pkt = (struct rxd_mc_pkt *) (pkt_entry->pkt);
+	size_t hdr_size = ep->rx_prefix_size + sizeof(*pkt);
+
+	if (!ep->mc || pkt_entry->pkt_size < hdr_size)
+		goto free;
+
+	switch (rxd_pkt_type(pkt_entry)) {
+	case RXD_MC_DATA:
+		if (pkt->name_len > RXD_NAME_LENGTH ||
+		    pkt_entry->pkt_size < hdr_size + pkt->name_len)
+			break;
+		if (rxd_coll_handle_data(ep, pkt_entry))
+			return;
+		break;
+	default:
+		rxd_coll_handle_reply(ep, pkt_entry);
+		break;
+	}
+free:
+	ofi_buf_free(pkt_entry);
+}
+
+static void rxd_coll_match_unexp(struct rxd_ep *ep, struct rxd_mc_entry *entry)
+{
+	struct rxd_mc_chan *chan = ep->mc;
+	struct rxd_pkt_entry *pkt_entry;
+	struct dlist_entry *tmp;
+	int done;
+
+	dlist_foreach_container_safe(&chan->unexp_list, struct rxd_pkt_entry,
+				     pkt_entry, d_entry, tmp) {
+		if (!rxd_coll_match(entry->cid, entry->rank, entry->name_len,
+				    entry->name,
+				    (struct rxd_mc_pkt *) (pkt_entry->pkt)))
+			continue;
+
+		chan->unexp_cnt--;
+		done = rxd_coll_recv_seg(ep, entry, pkt_entry);
+		rxd_remove_free_pkt_entry(pkt_entry);
+		if (done)
+			return;
+	}
+}
+
+/* Called by util_coll for UTIL_COLL_MCAST_SEND and _RECV, without the lock */
+static ssize_t rxd_coll_mcast(struct util_ep *util_ep,
+			      struct util_coll_xfer_item *item)
+{
+	struct rxd_ep *ep = container_of(util_ep, struct rxd_ep, util_ep);
+	struct util_coll_mc *coll_mc = item->hdr.coll_op->mc;
+	struct rxd_mc_entry *entry;
+	uint64_t expire;
+	int ret;
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return -FI_ENOMEM;
+
+	entry->item = item;
+	entry->cid = (uint32_t) item->tag;
+	entry->rank = item->remote_rank;
+	entry->local = (uint32_t) coll_mc->local_rank;
+	entry->root_addr = coll_mc->av_set->fi_addr_array[item->remote_rank];
+	entry->buf = item->buf;
+	entry->size = item->count * ofi_datatype_size(item->datatype);
+	entry->rto = RXD_MC_RTO;
+
+	if (item->hdr.type == UTIL_COLL_MCAST_RECV) {
+		entry->name_len = sizeof(entry->name);
+		ret = fi_av_lookup(&util_ep->av->av_fid, entry->root_addr,
+				   entry->name, &entry->name_len);
+		if (ret)
+			goto err;
+	} else {
+		entry->seg_size = ep->mc->seg_size;
+		entry->num_segs = rxd_coll_num_segs(entry->size,
+						    entry->seg_size);
+		entry->left = coll_mc->av_set->fi_addr_count - 1;
+		entry->map = calloc(ofi_div_ceil(coll_mc->av_set->fi_addr_count,
+						 8), 1);
+		entry->acked = calloc(coll_mc->av_set->fi_addr_count,
+				      sizeof(*entry->acked));
+		if (!entry->map || !entry->acked) {
+			ret = -FI_ENOMEM;
+			goto err;
+		}
+	}
+
+	expire = ofi_gettime_us() + entry->rto;
+	fastlock_acquire(&ep->util_ep.lock);
+	if (item->hdr.type == UTIL_COLL_MCAST_RECV) {
+		dlist_insert_tail(&entry->entry, &ep->mc->rx_list);
+		rxd_coll_set_timer(ep, entry, expire);
+		rxd_coll_match_unexp(ep, entry);
+	} else {
+		dlist_insert_tail(&entry->entry, &ep->mc->tx_list);
+		rxd_coll_send_segs(ep, entry);
+	}
+	fastlock_release(&ep->util_ep.lock);
+	return 0;
+
+err:
+	free(entry->map);
+	free(entry->acked);
+	free(entry);
+	return ret;
+}
+
+/* Called with the ep lock held */
+void rxd_coll_progress(struct rxd_ep *ep)
+{
+	struct rxd_mc_chan *chan = ep->mc;
+	struct rxd_pkt_entry *pkt_entry;
+	struct rxd_mc_entry *entry;
+	struct dlist_entry *item;
+	uint64_t current, next = UINT64_MAX;
+	int delay;
+
+	current = ofi_gettime_us();
+	dlist_foreach(&chan->tx_list, item) {
+		entry = container_of(item, struct rxd_mc_entry, entry);
+		if (entry->expire <= current) {
+			rxd_coll_poll(ep, entry);
+			entry->rto = MIN(entry->rto * 2, RXD_MAX_RTO);
+			entry->expire = current + entry->rto;
+		}
+		next = MIN(next, entry->expire);
+	}
+
+	dlist_foreach(&chan->rx_list, item) {
+		entry = container_of(item, struct rxd_mc_entry, entry);
+		if (entry->expire <= current) {
+			rxd_coll_send_nack(ep, entry);
+			entry->rto = MIN(entry->rto * 2, RXD_MC_MAX_NACK_RTO);
+			entry->expire = current + entry->rto;
+		}
+		next = MIN(next, entry->expire);
+	}
+
+	while (!dlist_empty(&chan->unexp_list)) {
+		pkt_entry = container_of(chan->unexp_list.next,
+					 struct rxd_pkt_entry, d_entry);
+		if (pkt_entry->timestamp + RXD_MC_UNEXP_TIMEOUT > current)
+			break;
+		rxd_remove_free_pkt_entry(pkt_entry);
+		chan->unexp_cnt--;
+	}
+
+	/* Peer timers only set next_retry with retries enabled */
+	if (!rxd_env.retry)
+		ep->next_retry = -1;
+	if (next == UINT64_MAX)
+		return;
+
+	delay = next > current ? (int) ((next - current + 999) / 1000) : 0;
+	ep->next_retry = ep->next_retry == -1 ? delay :
+			 MIN(ep->next_retry, delay);
+}
+
+void rxd_coll_progress_comps(struct rxd_ep *ep, struct slist *comps)
+{
+	struct util_coll_xfer_item *item;
+
+	while (!slist_empty(comps)) {
+		slist_remove_head_container(comps, struct util_coll_xfer_item,
+					    item, hdr.ready_entry);
+		ofi_coll_handle_xfer_comp(item->tag, item);
+	}
+
+	ofi_coll_ep_progress(&ep->util_ep.ep_fid);
+}
+
+int rxd_coll_open(struct rxd_ep *ep, const struct fi_info *dg_info)
+{
+	struct rxd_mc_chan *chan;
+	struct fi_info *info;
+	uint32_t addr_format = FI_FORMAT_UNSPEC;
+	size_t addrlen;
+	int ret;
+
+	chan = calloc(1, sizeof(*chan));
+	if (!chan)
+		return -FI_ENOMEM;
+
+	ret = ofi_str_toaddr(rxd_env.mcast_addr, &addr_format, &chan->addr,
+			     &addrlen);
+	if (ret) {
+		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
+			"invalid multicast address %s\n", rxd_env.mcast_addr);
+		goto err1;
+	}
+
+	info = fi_dupinfo(dg_info);
+	if (!info) {
+		ret = -FI_ENOMEM;
+		goto err2;
+	}
+
+	/* The core endpoint receives what is sent to the group */
+	free(info->src_addr);
+	info->src_addr = mem_dup(chan->addr, addrlen);
+	if (!info->src_addr) {
+		fi_freeinfo(info);
+		ret = -FI_ENOMEM;
+		goto err2;
+	}
+	info->src_addrlen = addrlen;
+	info->addr_format = addr_format;
+
+	ret = fi_endpoint(rxd_ep_domain(ep)->dg_domain, info, &chan->ep, ep);
+	fi_freeinfo(info);
+	if (ret)
+		goto err2;
+
+	dlist_init(&chan->rx_pkts);
+	dlist_init(&chan->tx_list);
+	dlist_init(&chan->rx_list);
+	dlist_init(&chan->unexp_list);
+	ep->mc = chan;
+	return 0;
+
+err2:
+	free(chan->addr);
+err1:
+	free(chan);
+	return ret;
+}
+
+static int rxd_coll_join(struct rxd_ep *ep)
+{
+	struct rxd_mc_chan *chan = ep->mc;
+	struct fi_eq_err_entry err_entry;
+	struct fi_eq_entry entry;
+	uint64_t endtime;
+	uint32_t event;
+	ssize_t ret;
+
+	ret = fi_join(chan->ep, chan->addr, 0, &chan->mc, chan);
+	if (ret)
+		return (int) ret;
+
+	endtime = ofi_gettime_ms() + RXD_MC_JOIN_TIMEOUT;
+	do {
+		ret = fi_eq_read(chan->eq, &event, &entry, sizeof(entry), 0);
+	} while (ret == -FI_EAGAIN && ofi_gettime_ms() < endtime);
+
+	if (ret == -FI_EAVAIL) {
+		memset(&err_entry, 0, sizeof(err_entry));
+		(void) fi_eq_readerr(chan->eq, &err_entry, 0);
+		return err_entry.err ? -abs(err_entry.err) : -FI_EOTHER;
+	}
+	if (ret < 0)
+		return (int) ret;
+
+	return event == FI_JOIN_COMPLETE ? 0 : -FI_EOTHER;
+}
+
+int rxd_coll_enable(struct rxd_ep *ep)
+{
+	struct rxd_mc_chan *chan = ep->mc;
+	struct rxd_fabric *fabric;
+	struct fi_eq_attr eq_attr = {
+		.wait_obj = FI_WAIT_NONE,
+	};
+	size_t i, mtu;
+	int ret;
+
+	fabric = container_of(ep->util_ep.domain->fabric, struct rxd_fabric,
+			      util_fabric);
+	ret = fi_eq_open(fabric->dg_fabric, &eq_attr, &chan->eq, NULL);
+	if (ret)
+		goto err;
+
+	ret = fi_ep_bind(chan->ep, &chan->eq->fid, 0);
+	if (ret)
+		goto err;
+
+	ret = fi_ep_bind(chan->ep, &ep->dg_cq->fid, FI_TRANSMIT | FI_RECV);
+	if (ret)
+		goto err;
+
+	ret = fi_ep_bind(chan->ep, &rxd_ep_av(ep)->dg_av->fid, 0);
+	if (ret)
+		goto err;
+
+	ret = fi_enable(chan->ep);
+	if (ret)
+		goto err;
+
+	ret = rxd_coll_join(ep);
+	if (ret)
+		goto err;
+
+	chan->name_len = sizeof(chan->name);
+	ret = fi_getname(&ep->dg_ep->fid, chan->name, &chan->name_len);
+	if (ret)
+		goto err;
+
+	mtu = rxd_ep_domain(ep)->max_mtu_sz;
+	if (mtu <= ep->tx_prefix_size + sizeof(struct rxd_mc_pkt) +
+		   chan->name_len) {
+		ret = -FI_EINVAL;
+		goto err;
+	}
+	chan->seg_size = mtu - ep->tx_prefix_size - sizeof(struct rxd_mc_pkt) -
+			 chan->name_len;
+
+	fastlock_acquire(&ep->util_ep.lock);
+	for (i = 0; i < ep->rx_size; i++) {
+		ret = rxd_coll_post_buf(ep);
+		if (ret)
+			break;
+	}
+	fastlock_release(&ep->util_ep.lock);
+	if (ret)
+		goto err;
+
+	ep->util_ep.coll_mcast = rxd_coll_mcast;
+	return 0;
+
+err:
+	FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
+		"unable to join multicast group %s: %s\n",
+		rxd_env.mcast_addr, fi_strerror(-ret));
+	return ret;
+}
+
+void rxd_coll_close(struct rxd_ep *ep)
+{
+	struct rxd_mc_chan *chan = ep->mc;
+	struct rxd_pkt_entry *pkt_entry;
+	struct rxd_mc_entry *entry;
+
+	if (chan->mc)
+		fi_close(&chan->mc->fid);
+	fi_close(&chan->ep->fid);
+	if (chan->eq)
+		fi_close(&chan->eq->fid);
+
+	while (!dlist_empty(&chan->rx_pkts)) {
+		dlist_pop_front(&chan->rx_pkts, struct rxd_pkt_entry,
+				pkt_entry, d_entry);
+		ofi_buf_free(pkt_entry);
+	}
+	while (!dlist_empty(&chan->unexp_list)) {
+		dlist_pop_front(&chan->unexp_list, struct rxd_pkt_entry,
+				pkt_entry, d_entry);
+		ofi_buf_free(pkt_entry);
+	}
+	while (!dlist_empty(&chan->tx_list)) {
+		entry = container_of(chan->tx_list.next, struct rxd_mc_entry,
+				     entry);
+		rxd_coll_free_entry(entry);
+	}
+	while (!dlist_empty(&chan->rx_list)) {
+		entry = container_of(chan->rx_list.next, struct rxd_mc_entry,
+				     entry);
+		rxd_coll_free_entry(entry);
+	}
+
+	free(chan->addr);
+	free(chan);
+	ep->mc = NULL;
+}
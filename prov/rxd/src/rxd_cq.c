@@ -83,9 +83,17 @@ static int rxd_cq_write_signal(struct rxd_cq *cq,
 
 void rxd_rx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *rx_entry)
 {
+	struct rxd_peer *peer;
+
 	rx_entry->op <= RXD_TAGGED ? ep->rx_msg_avail++ : ep->rx_rma_avail++;
 	rx_entry->op = RXD_NO_OP;
 	dlist_remove(&rx_entry->entry);
+
+	peer = rxd_peer_lookup(ep, rx_entry->peer);
+	if (peer && peer->rx_xfer && dlist_empty(&peer->rx_list)) {
+		peer->rx_xfer = 0;
+		ep->rx_xfer_peers--;
+	}
 	ofi_ibuf_free(rx_entry);
 }
 
@@ -128,6 +136,11 @@ static void rxd_complete_rx(struct rxd_ep *ep, struct rxd_x_entry *rx_entry)
 		goto out;
 	}
 
+	if (rx_entry->flags & RXD_COLLECTIVE) {
+		rxd_coll_comp(ep, rx_entry->cq_entry.op_context);
+		goto out;
+	}
+
 	if (rx_entry->cq_entry.flags & FI_REMOTE_CQ_DATA ||
 	    (!(rx_entry->flags & RXD_NO_RX_COMP) &&
 	      rx_entry->cq_entry.flags & FI_RECV))
@@ -143,28 +156,20 @@ static void rxd_complete_tx(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 {
 	struct rxd_cq *tx_cq = rxd_ep_tx_cq(ep);
 
+	if (tx_entry->flags & RXD_COLLECTIVE) {
+		rxd_coll_comp(ep, tx_entry->cq_entry.op_context);
+		goto out;
+	}
+
 	if (!(tx_entry->flags & RXD_NO_TX_COMP))
 		tx_cq->write_fn(tx_cq, &tx_entry->cq_entry);
 
 	ofi_ep_tx_cntr_inc_func(&ep->util_ep, tx_entry->op);
 
+out:
 	rxd_tx_entry_free(ep, tx_entry);
 }
 
-static int rxd_comp_pkt_seq_no(struct dlist_entry *item, const void *arg)
-{
-	struct rxd_base_hdr *list_hdr;
-	struct rxd_base_hdr *new_hdr;
-
-	list_hdr = rxd_get_base_hdr(container_of(item,
-				   struct rxd_pkt_entry, d_entry));
-
-	new_hdr = rxd_get_base_hdr(container_of((struct dlist_entry *) arg,
-				  struct rxd_pkt_entry, d_entry));
-
-	return new_hdr->seq_no > list_hdr->seq_no;
-}
-
 void rxd_ep_recv_data(struct rxd_ep *ep, struct rxd_x_entry *x_entry,
 		      struct rxd_data_pkt *pkt, size_t size)
 {
@@ -190,8 +195,9 @@ void rxd_ep_recv_data(struct rxd_ep *ep, struct rxd_x_entry *x_entry,
 	x_entry->next_seg_no++;
 
 	if (x_entry->next_seg_no < x_entry->num_segs) {
-		if (!(ep->peers[pkt->base_hdr.peer].rx_seq_no %
-		    ep->peers[pkt->base_hdr.peer].rx_window))
+		if (pkt->base_hdr.flags & RXD_ACK_REQ ||
+		    !(rxd_peer(ep, pkt->base_hdr.peer)->rx_seq_no %
+		    rxd_peer(ep, pkt->base_hdr.peer)->rx_window))
 			rxd_ep_send_ack(ep, pkt->base_hdr.peer);
 		return;
 	}
@@ -203,67 +209,112 @@ void rxd_ep_recv_data(struct rxd_ep *ep, struct rxd_x_entry *x_entry,
 		rxd_complete_rx(ep, x_entry);
 }
 
+static void rxd_peer_reset_rto(struct rxd_peer *peer)
+{
+	peer->rto = MIN(peer->srtt + MAX(RXD_MIN_RTO, 4 * peer->rttvar),
+			RXD_MAX_RTO);
+}
+
+/*
+ * RFC 6298 estimator.  Callers apply Karn's rule and never sample a packet
+ * that was retransmitted.
+ */
+static void rxd_peer_rtt_sample(struct rxd_peer *peer, uint64_t rtt)
+{
+	uint64_t delta;
+
+	if (!peer->srtt) {
+		peer->srtt = MAX(rtt, 1);
+		peer->rttvar = rtt / 2;
+	} else {
+		delta = peer->srtt > rtt ? peer->srtt - rtt : rtt - peer->srtt;
+		peer->rttvar = (3 * peer->rttvar + delta) / 4;
+		peer->srtt = (7 * peer->srtt + rtt) / 8;
+	}
+	rxd_peer_reset_rto(peer);
+}
+
 static void rxd_verify_active(struct rxd_ep *ep, fi_addr_t addr, fi_addr_t peer_addr)
 {
+	struct rxd_peer *peer = rxd_peer(ep, addr);
 	struct rxd_pkt_entry *pkt_entry;
 
-	if (ep->peers[addr].peer_addr != FI_ADDR_UNSPEC &&
-	    ep->peers[addr].peer_addr != peer_addr)
+	if (peer->peer_addr != FI_ADDR_UNSPEC && peer->peer_addr != peer_addr)
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
 			"overwriting active peer - unexpected behavior\n");
 
-	ep->peers[addr].peer_addr = peer_addr;
+	peer->peer_addr = peer_addr;
 
-	if (!dlist_empty(&ep->peers[addr].unacked) && 
-	    rxd_get_base_hdr(container_of((&ep->peers[addr].unacked)->next,
+	if (!dlist_empty(&peer->unacked) && 
+	    rxd_get_base_hdr(container_of((&peer->unacked)->next,
 			     struct rxd_pkt_entry, d_entry))->type == RXD_RTS) {
-		dlist_pop_front(&ep->peers[addr].unacked,
-				struct rxd_pkt_entry, pkt_entry, d_entry);
+		dlist_pop_front(&peer->unacked, struct rxd_pkt_entry,
+				pkt_entry, d_entry);
+		if (!(pkt_entry->flags & RXD_PKT_RETRANS))
+			rxd_peer_rtt_sample(peer, ofi_gettime_us() -
+					    pkt_entry->timestamp);
 		if (pkt_entry->flags & RXD_PKT_IN_USE) {
 			dlist_insert_tail(&pkt_entry->d_entry, &ep->ctrl_pkts);
 			pkt_entry->flags |= RXD_PKT_ACKED;
 		} else {
 			ofi_buf_free(pkt_entry);
-			ep->peers[addr].unacked_cnt--;
+			peer->unacked_cnt--;
 		}
-		dlist_remove(&ep->peers[addr].entry);
+		dlist_remove(&peer->entry);
 	}
 
-	if (!ep->peers[addr].active) {
-		dlist_insert_tail(&ep->peers[addr].entry, &ep->active_peers);
-		ep->peers[addr].retry_cnt = 0;
-		ep->peers[addr].active = 1;
+	if (!peer->active) {
+		dlist_insert_tail(&peer->entry, &ep->active_peers);
+		peer->retry_cnt = 0;
+		peer->active = 1;
+	}
+}
+
+/* Messages appended to a batch go out with its first message */
+static void rxd_start_batch(struct rxd_peer *peer, struct rxd_x_entry *tx_entry)
+{
+	struct rxd_x_entry *batched = tx_entry;
+
+	while (batched->entry.next != &peer->tx_list) {
+		batched = container_of(batched->entry.next,
+				       struct rxd_x_entry, entry);
+		if (!(batched->flags & RXD_BATCHED))
+			break;
+		batched->start_seq = tx_entry->start_seq;
 	}
 }
 
 int rxd_start_xfer(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 {
+	struct rxd_peer *peer = rxd_peer(ep, tx_entry->peer);
 	struct rxd_base_hdr *hdr = rxd_get_base_hdr(tx_entry->pkt);
 
-	if (ep->peers[tx_entry->peer].unacked_cnt >=
-	    ep->peers[tx_entry->peer].tx_window)
+	if (peer->unacked_cnt >= rxd_peer_tx_window(peer))
 		return 0;
 
-	tx_entry->start_seq = rxd_set_pkt_seq(&ep->peers[tx_entry->peer],
-					      tx_entry->pkt);
+	tx_entry->start_seq = rxd_set_pkt_seq(peer, tx_entry->pkt);
 	if (tx_entry->op != RXD_READ_REQ && tx_entry->num_segs > 1) {
-		ep->peers[tx_entry->peer].tx_seq_no = tx_entry->start_seq +
-						      tx_entry->num_segs;
+		peer->tx_seq_no = tx_entry->start_seq + tx_entry->num_segs;
 	}
-	hdr->peer = ep->peers[tx_entry->peer].peer_addr;
+	hdr->peer = peer->peer_addr;
 	rxd_ep_send_pkt(ep, tx_entry->pkt);
 	rxd_insert_unacked(ep, tx_entry->peer, tx_entry->pkt);
 	tx_entry->pkt = NULL;
 
+	if (tx_entry == peer->tx_batch)
+		peer->tx_batch = NULL;
+	if (tx_entry == ep->tx_more)
+		ep->tx_more = NULL;
+	if (hdr->type == RXD_BATCH)
+		rxd_start_batch(peer, tx_entry);
+
 	if (tx_entry->op == RXD_READ_REQ || tx_entry->op == RXD_ATOMIC_FETCH ||
 	    tx_entry->op == RXD_ATOMIC_COMPARE) {
 		dlist_remove(&tx_entry->entry);
-		dlist_insert_tail(&tx_entry->entry,
-				  &ep->peers[tx_entry->peer].rma_rx_list);
+		dlist_insert_tail(&tx_entry->entry, &peer->rma_rx_list);
 	}
 
-	return ep->peers[tx_entry->peer].unacked_cnt <
-	       ep->peers[tx_entry->peer].tx_window;
+	return peer->unacked_cnt < rxd_peer_tx_window(peer);
 }
 
 void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
@@ -304,33 +355,33 @@ void rxd_progress_tx_list(struct rxd_ep *ep, struct rxd_peer *peer)
 		}
 				
 		if (tx_entry->op == RXD_DATA_READ && !tx_entry->bytes_done) {
-			if (ep->peers[tx_entry->peer].unacked_cnt >=
-		    	    ep->peers[tx_entry->peer].tx_window) {
+			if (peer->unacked_cnt >= rxd_peer_tx_window(peer))
 				break;
-			} 
-			tx_entry->start_seq = ep->peers[tx_entry->peer].tx_seq_no;
-			ep->peers[tx_entry->peer].tx_seq_no = tx_entry->start_seq +
-							      tx_entry->num_segs;
+
+			tx_entry->start_seq = peer->tx_seq_no;
+			peer->tx_seq_no = tx_entry->start_seq +
+					  tx_entry->num_segs;
 			inc = 1;
 		}
 
 		ret = rxd_ep_post_data_pkts(ep, tx_entry);
 		if (ret) {
 			if (ret == -FI_ENOMEM && inc)
-				ep->peers[tx_entry->peer].tx_seq_no -=
-							  tx_entry->num_segs;
+				peer->tx_seq_no -= tx_entry->num_segs;
 			break;
 		}
 	}
 
 	if (dlist_empty(&peer->tx_list))
 		peer->retry_cnt = 0;
+	else if (dlist_empty(&peer->unacked))
+		rxd_peer_set_timer(ep, peer, ofi_gettime_us() + RXD_MIN_RTO);
 }
 
 static void rxd_update_peer(struct rxd_ep *ep, fi_addr_t peer, fi_addr_t peer_addr)
 {
 	rxd_verify_active(ep, peer, peer_addr);
-	rxd_progress_tx_list(ep, &ep->peers[peer]);
+	rxd_progress_tx_list(ep, rxd_peer(ep, peer));
 }
 
 static int rxd_send_cts(struct rxd_ep *rxd_ep, struct rxd_rts_pkt *rts_pkt,
@@ -354,6 +405,7 @@ static int rxd_send_cts(struct rxd_ep *rxd_ep, struct rxd_rts_pkt *rts_pkt,
 	cts->base_hdr.type = RXD_CTS;
 	cts->cts_addr = peer;
 	cts->rts_addr = rts_pkt->rts_addr;
+	cts->credits = rxd_peer_rx_credits(rxd_ep, rxd_peer(rxd_ep, peer));
 
 	dlist_insert_tail(&pkt_entry->d_entry, &rxd_ep->ctrl_pkts);
 	ret = rxd_ep_send_pkt(rxd_ep, pkt_entry);
@@ -415,7 +467,6 @@ static struct rxd_unexp_msg *rxd_init_unexp(struct rxd_ep *ep,
 static void rxd_handle_rts(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
 	struct rxd_av *rxd_av;
-	struct ofi_rbnode *node;
 	fi_addr_t rxd_addr;
 	struct rxd_rts_pkt *pkt = (struct rxd_rts_pkt *) (pkt_entry->pkt);
 	int ret;
@@ -427,17 +478,20 @@ static void rxd_handle_rts(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 	}
 
 	rxd_av = rxd_ep_av(ep);
-	node = ofi_rbmap_find(&rxd_av->rbmap, pkt->source);
-
-	if (node) {
-		rxd_addr = (fi_addr_t) node->data;
-	} else {
+	rxd_addr = rxd_av_rxd_addr(rxd_av, pkt->source);
+	if (rxd_addr == FI_ADDR_UNSPEC) {
 		ret = rxd_av_insert_dg_addr(rxd_av, (void *) pkt->source,
 					    &rxd_addr, 0, NULL);
 		if (ret)
 			return;
 	}
 
+	if (!rxd_get_peer(ep, rxd_addr)) {
+		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
+			"could not allocate peer\n");
+		return;
+	}
+
 	if (rxd_send_cts(ep, pkt, rxd_addr)) {
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
 			"error posting CTS\n");
@@ -512,12 +566,12 @@ static struct rxd_x_entry *rxd_match_rx(struct rxd_ep *ep,
 	}
 
 	if (!match) {
-		assert(!ep->peers[base->peer].curr_unexp);
+		assert(!rxd_peer(ep, base->peer)->curr_unexp);
 		unexp_msg = rxd_init_unexp(ep, pkt_entry, base, op,
 					   tag, data, msg, msg_size);
 		if (unexp_msg) {
 			dlist_insert_tail(&unexp_msg->entry, unexp_list);
-			ep->peers[base->peer].curr_unexp = unexp_msg;
+			rxd_peer(ep, base->peer)->curr_unexp = unexp_msg;
 		}
 		return NULL;
 	}
@@ -594,9 +648,10 @@ static struct rxd_x_entry *rxd_rma_read_entry_init(struct rxd_ep *ep,
 	rx_entry->cq_entry.flags = ofi_rx_cq_flags(RXD_READ_REQ);
 	rx_entry->cq_entry.len = sar_hdr->size;
 
-	dlist_insert_tail(&rx_entry->entry, &ep->peers[rx_entry->peer].tx_list);
+	dlist_insert_tail(&rx_entry->entry,
+			  &rxd_peer(ep, rx_entry->peer)->tx_list);
 
-	rxd_progress_tx_list(ep, &ep->peers[rx_entry->peer]);
+	rxd_progress_tx_list(ep, rxd_peer(ep, rx_entry->peer));
 
 	return rx_entry;
 }
@@ -669,11 +724,12 @@ static struct rxd_x_entry *rxd_rx_atomic_fetch(struct rxd_ep *ep,
 	if (rx_entry->bytes_done != rx_entry->cq_entry.len)
 		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "fetch data length mismatch\n");
 
-	dlist_insert_tail(&rx_entry->entry, &ep->peers[rx_entry->peer].tx_list);
+	dlist_insert_tail(&rx_entry->entry,
+			  &rxd_peer(ep, rx_entry->peer)->tx_list);
 
 	rxd_ep_send_ack(ep, base_hdr->peer);
 
-	rxd_progress_tx_list(ep, &ep->peers[rx_entry->peer]);
+	rxd_progress_tx_list(ep, rxd_peer(ep, rx_entry->peer));
 
 	return rx_entry;
 }
@@ -832,10 +888,12 @@ void rxd_progress_op(struct rxd_ep *ep, struct rxd_x_entry *rx_entry,
 		     struct rxd_atom_hdr *atom_hdr,
 		     void **msg, size_t size)
 {
+	struct rxd_peer *peer;
+
 	if (sar_hdr)
-		ep->peers[base_hdr->peer].curr_tx_id = sar_hdr->tx_id;
+		rxd_peer(ep, base_hdr->peer)->curr_tx_id = sar_hdr->tx_id;
 
-	ep->peers[base_hdr->peer].curr_rx_id = rx_entry->rx_id;
+	rxd_peer(ep, base_hdr->peer)->curr_rx_id = rx_entry->rx_id;
 
 	if (base_hdr->type == RXD_READ_REQ)
 		return;
@@ -869,7 +927,94 @@ void rxd_progress_op(struct rxd_ep *ep, struct rxd_x_entry *rx_entry,
 	rx_entry->next_seg_no++;
 	rx_entry->start_seq = base_hdr->seq_no;
 
-	dlist_insert_tail(&rx_entry->entry, &ep->peers[base_hdr->peer].rx_list);
+	peer = rxd_peer(ep, base_hdr->peer);
+	dlist_insert_tail(&rx_entry->entry, &peer->rx_list);
+	if (!peer->rx_xfer) {
+		peer->rx_xfer = 1;
+		ep->rx_xfer_peers++;
+	}
+}
+
+/*
+ * Delivers the messages of a batch packet that is next in sequence.  Each
+ * one is copied into a packet of its own and takes the single packet path,
+ * so an unexpected message keeps its data.  If receive resources run out
+ * part way, the number delivered is kept and the rest is taken from the
+ * resent packet.  Returns 0 once the whole batch has been delivered.
+ */
+static int rxd_progress_batch(struct rxd_ep *ep,
+			      struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_base_hdr *batch_hdr = rxd_get_base_hdr(pkt_entry);
+	struct rxd_peer *peer = rxd_peer(ep, batch_hdr->peer);
+	struct rxd_pkt_entry *msg_entry;
+	struct rxd_base_hdr *base_hdr;
+	struct rxd_batch_hdr hdr;
+	struct rxd_sar_hdr *sar_hdr;
+	struct rxd_tag_hdr *tag_hdr;
+	struct rxd_data_hdr *data_hdr;
+	struct rxd_rma_hdr *rma_hdr;
+	struct rxd_atom_hdr *atom_hdr;
+	struct rxd_x_entry *rx_entry;
+	char *ptr, *end;
+	size_t size, msg_size;
+	void *msg;
+	uint16_t i;
+	int ret;
+
+	ptr = (char *) (batch_hdr + 1);
+	end = (char *) batch_hdr + pkt_entry->pkt_size - ep->rx_prefix_size;
+
+	for (i = 0; ptr + sizeof(hdr) <= end; i++, ptr += size) {
+		memcpy(&hdr, ptr, sizeof(hdr));
+		size = rxd_batch_msg_size(hdr.flags, hdr.size);
+		if (ptr + size > end ||
+		    (hdr.type != RXD_MSG && hdr.type != RXD_TAGGED)) {
+			FI_WARN(&rxd_prov, FI_LOG_CQ, "Cannot process packet\n");
+			break;
+		}
+
+		if (i < peer->rx_batch_cnt)
+			continue;
+
+		msg_entry = ofi_buf_alloc(ep->rx_pkt_pool.pool);
+		if (!msg_entry)
+			return -FI_ENOMEM;
+
+		base_hdr = rxd_get_base_hdr(msg_entry);
+		*base_hdr = *batch_hdr;
+		base_hdr->type = hdr.type;
+		base_hdr->flags = hdr.flags | RXD_INLINE;
+		memcpy(base_hdr + 1, ptr + sizeof(hdr), size - sizeof(hdr));
+		msg_entry->pkt_size = ep->rx_prefix_size + sizeof(*base_hdr) +
+				      size - sizeof(hdr);
+		msg_entry->peer = pkt_entry->peer;
+
+		ret = rxd_unpack_init_rx(ep, &rx_entry, msg_entry, base_hdr,
+					 &sar_hdr, &tag_hdr, &data_hdr, &rma_hdr,
+					 &atom_hdr, &msg, &msg_size);
+		if (ret) {
+			ofi_buf_free(msg_entry);
+			break;
+		}
+
+		if (rx_entry) {
+			rxd_progress_op(ep, rx_entry, msg_entry, base_hdr,
+					sar_hdr, tag_hdr, data_hdr, rma_hdr,
+					atom_hdr, &msg, msg_size);
+			ofi_buf_free(msg_entry);
+		} else if (peer->curr_unexp) {
+			/* the unexpected message now owns the packet */
+			peer->curr_unexp = NULL;
+		} else {
+			ofi_buf_free(msg_entry);
+			return -FI_EAGAIN;
+		}
+		peer->rx_batch_cnt++;
+	}
+
+	peer->rx_batch_cnt = 0;
+	return 0;
 }
 
 static struct rxd_x_entry *rxd_get_data_x_entry(struct rxd_ep *ep,
@@ -877,15 +1022,75 @@ static struct rxd_x_entry *rxd_get_data_x_entry(struct rxd_ep *ep,
 {
 	if (data_pkt->base_hdr.type == RXD_DATA)
 		return ofi_bufpool_get_ibuf(ep->rx_entry_pool.pool,
-			     ep->peers[data_pkt->base_hdr.peer].curr_rx_id);
+			     rxd_peer(ep, data_pkt->base_hdr.peer)->curr_rx_id);
 
 	return ofi_bufpool_get_ibuf(ep->tx_entry_pool.pool, data_pkt->ext_hdr.tx_id);
 }
 
-static void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t peer)
+/*
+ * Delivers a data packet that is next in sequence.  Returns 1 if the packet
+ * was kept for an unexpected message, otherwise the caller frees it.
+ */
+static int rxd_progress_data_pkt(struct rxd_ep *ep,
+				 struct rxd_pkt_entry *pkt_entry)
 {
+	struct rxd_data_pkt *pkt = (struct rxd_data_pkt *) (pkt_entry->pkt);
+	struct rxd_peer *peer = rxd_peer(ep, pkt->base_hdr.peer);
+	struct rxd_unexp_msg *unexp_msg;
+	struct rxd_x_entry *x_entry;
+
+	peer->rx_seq_no++;
+	if (pkt->base_hdr.type == RXD_DATA && peer->curr_unexp) {
+		unexp_msg = peer->curr_unexp;
+		dlist_insert_tail(&pkt_entry->d_entry, &unexp_msg->pkt_list);
+		if (pkt->ext_hdr.seg_no + 1 == unexp_msg->sar_hdr->num_segs - 1) {
+			peer->curr_unexp = NULL;
+			rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+		} else if (pkt->base_hdr.flags & RXD_ACK_REQ) {
+			rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+		}
+		return 1;
+	}
+
+	x_entry = rxd_get_data_x_entry(ep, pkt);
+	rxd_ep_recv_data(ep, x_entry, pkt, pkt_entry->pkt_size);
+	return 0;
+}
+
+/*
+ * Packets that arrive ahead of a gap are kept in the peer's receive window,
+ * a ring of rx_win_size slots indexed by sequence number.  The sender never
+ * has more than max_unacked packets outstanding, so anything further ahead
+ * is stale or bogus.  Returns 1 if the packet was stored.
+ */
+static int rxd_buf_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_base_hdr *base_hdr = rxd_get_base_hdr(pkt_entry);
+	struct rxd_peer *peer = rxd_peer(ep, base_hdr->peer);
+	struct rxd_pkt_entry **slot;
+
+	if (base_hdr->seq_no - peer->rx_seq_no - 1 >= ep->rx_win_size - 1)
+		return 0;
+
+	slot = &peer->rx_win[base_hdr->seq_no & (ep->rx_win_size - 1)];
+	if (*slot) {
+		if (rxd_get_base_hdr(*slot)->seq_no == base_hdr->seq_no)
+			return 0;
+		/* left over from before the window last moved past it */
+		ofi_buf_free(*slot);
+		peer->rx_win_cnt--;
+	}
+
+	*slot = pkt_entry;
+	peer->rx_win_cnt++;
+	return 1;
+}
+
+static void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t addr)
+{
+	struct rxd_peer *peer = rxd_peer(ep, addr);
 	struct fi_cq_err_entry err_entry;
-	struct rxd_pkt_entry *pkt_entry;
+	struct rxd_pkt_entry *pkt_entry, **slot;
 	struct rxd_base_hdr *base_hdr;
 	struct rxd_sar_hdr *sar_hdr;
 	struct rxd_tag_hdr *tag_hdr;
@@ -896,60 +1101,85 @@ static void rxd_progress_buf_pkts(struct rxd_ep *ep, fi_addr_t peer)
 	int ret;
 	size_t msg_size;
 	struct rxd_x_entry *rx_entry = NULL;
-	struct rxd_data_pkt *data_pkt;
 
-	while (!dlist_empty(&ep->peers[peer].buf_pkts)) {
-		pkt_entry = container_of((&ep->peers[peer].buf_pkts)->next,
-					struct rxd_pkt_entry, d_entry);
-		base_hdr = rxd_get_base_hdr(pkt_entry);
-		if (base_hdr->seq_no != ep->peers[peer].rx_seq_no)
+	while (peer->rx_win_cnt) {
+		slot = &peer->rx_win[peer->rx_seq_no & (ep->rx_win_size - 1)];
+		pkt_entry = *slot;
+		if (!pkt_entry)
 			return;
 
+		*slot = NULL;
+		peer->rx_win_cnt--;
+		base_hdr = rxd_get_base_hdr(pkt_entry);
+		if (base_hdr->seq_no != peer->rx_seq_no) {
+			ofi_buf_free(pkt_entry);
+			continue;
+		}
+
 		if (base_hdr->type == RXD_DATA || base_hdr->type == RXD_DATA_READ) {
-			data_pkt = (struct rxd_data_pkt *) pkt_entry->pkt;
-			rx_entry = rxd_get_data_x_entry(ep, data_pkt);
-			rxd_ep_recv_data(ep, rx_entry, data_pkt, pkt_entry->pkt_size);
-		} else {
-			ret = rxd_unpack_init_rx(ep, &rx_entry, pkt_entry, base_hdr, &sar_hdr,
-					      &tag_hdr, &data_hdr, &rma_hdr, &atom_hdr,
-					      &msg, &msg_size);
-			if (ret) {
-				memset(&err_entry, 0, sizeof(err_entry));
-				err_entry.err = FI_ETRUNC;
-				err_entry.prov_errno = 0;
-				ret = ofi_cq_write_error(&rxd_ep_rx_cq(ep)->util_cq,
-							 &err_entry);
-				if (ret)
-					FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
-						"could not write error entry\n");
-				ep->peers[base_hdr->peer].rx_seq_no++;
-				rxd_remove_free_pkt_entry(pkt_entry);
-				continue;
-			}
-			if (!rx_entry) {
-				if (base_hdr->type == RXD_MSG ||
-				    base_hdr->type == RXD_TAGGED) {
-					ep->peers[base_hdr->peer].rx_seq_no++;
-					continue;
-				}
-				break;
+			if (!rxd_progress_data_pkt(ep, pkt_entry))
+				ofi_buf_free(pkt_entry);
+			continue;
+		}
+
+		if (base_hdr->type == RXD_BATCH) {
+			if (rxd_progress_batch(ep, pkt_entry)) {
+				/* out of resources, the peer will resend it */
+				ofi_buf_free(pkt_entry);
+				return;
 			}
+			peer->rx_seq_no++;
+			ofi_buf_free(pkt_entry);
+			continue;
+		}
 
-			rxd_progress_op(ep, rx_entry, pkt_entry, base_hdr,
-					sar_hdr, tag_hdr, data_hdr, rma_hdr,
-					atom_hdr, &msg, msg_size);
+		ret = rxd_unpack_init_rx(ep, &rx_entry, pkt_entry, base_hdr, &sar_hdr,
+				      &tag_hdr, &data_hdr, &rma_hdr, &atom_hdr,
+				      &msg, &msg_size);
+		if (ret) {
+			memset(&err_entry, 0, sizeof(err_entry));
+			err_entry.err = FI_ETRUNC;
+			err_entry.prov_errno = 0;
+			ret = ofi_cq_write_error(&rxd_ep_rx_cq(ep)->util_cq,
+						 &err_entry);
+			if (ret)
+				FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
+					"could not write error entry\n");
+			peer->rx_seq_no++;
+			ofi_buf_free(pkt_entry);
+			continue;
 		}
 
-		ep->peers[base_hdr->peer].rx_seq_no++;
-		rxd_remove_free_pkt_entry(pkt_entry);
+		if (!rx_entry) {
+			if (base_hdr->type != RXD_MSG &&
+			    base_hdr->type != RXD_TAGGED) {
+				peer->rx_window = 0;
+			} else if (peer->curr_unexp) {
+				/* the unexpected message now owns the packet */
+				peer->rx_seq_no++;
+				if (!sar_hdr)
+					peer->curr_unexp = NULL;
+				continue;
+			}
+			/* out of resources, the peer will resend it */
+			ofi_buf_free(pkt_entry);
+			return;
+		}
+
+		peer->rx_seq_no++;
+		peer->rx_window = rxd_env.max_unacked;
+		rxd_progress_op(ep, rx_entry, pkt_entry, base_hdr, sar_hdr,
+				tag_hdr, data_hdr, rma_hdr, atom_hdr, &msg,
+				msg_size);
+		ofi_buf_free(pkt_entry);
 	}
 }
 
 static void rxd_handle_data(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
 	struct rxd_data_pkt *pkt = (struct rxd_data_pkt *) (pkt_entry->pkt);
-	struct rxd_x_entry *x_entry;
-	struct rxd_unexp_msg *unexp_msg;
+	struct rxd_peer *peer = rxd_peer(ep, pkt->base_hdr.peer);
+	int kept;
 
 	if (pkt_entry->pkt_size < sizeof(*pkt) + ep->rx_prefix_size) {
 		FI_WARN(&rxd_prov, FI_LOG_CQ,
@@ -957,28 +1187,22 @@ static void rxd_handle_data(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 		goto free;
 	}
 
-	if (pkt->base_hdr.seq_no == ep->peers[pkt->base_hdr.peer].rx_seq_no) {
-		ep->peers[pkt->base_hdr.peer].rx_seq_no++;
-		if (pkt->base_hdr.type == RXD_DATA &&
-		    ep->peers[pkt->base_hdr.peer].curr_unexp) {
-			unexp_msg = ep->peers[pkt->base_hdr.peer].curr_unexp;
-			dlist_insert_tail(&pkt_entry->d_entry, &unexp_msg->pkt_list);
-			if (pkt->ext_hdr.seg_no + 1 == unexp_msg->sar_hdr->num_segs - 1) {
-				ep->peers[pkt->base_hdr.peer].curr_unexp = NULL;
-				rxd_ep_send_ack(ep, pkt->base_hdr.peer);
-			}
-			return;
-		}
-		x_entry = rxd_get_data_x_entry(ep, pkt);
-		rxd_ep_recv_data(ep, x_entry, pkt, pkt_entry->pkt_size);
-		if (!dlist_empty(&ep->peers[pkt->base_hdr.peer].buf_pkts))
+	if (pkt->base_hdr.seq_no == peer->rx_seq_no) {
+		kept = rxd_progress_data_pkt(ep, pkt_entry);
+		if (peer->rx_win_cnt) {
 			rxd_progress_buf_pkts(ep, pkt->base_hdr.peer);
+			rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+		}
+		if (kept)
+			return;
 	} else if (!rxd_env.retry) {
-		dlist_insert_order(&ep->peers[pkt->base_hdr.peer].buf_pkts,
-				   &rxd_comp_pkt_seq_no, &pkt_entry->d_entry);
-		return;
-	} else if (ep->peers[pkt->base_hdr.peer].peer_addr != FI_ADDR_UNSPEC) {
+		if (rxd_buf_pkt(ep, pkt_entry))
+			return;
+	} else if (peer->peer_addr != FI_ADDR_UNSPEC) {
+		kept = rxd_buf_pkt(ep, pkt_entry);
 		rxd_ep_send_ack(ep, pkt->base_hdr.peer);
+		if (kept)
+			return;
 	}
 free:
 	ofi_buf_free(pkt_entry);
@@ -988,6 +1212,7 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
 	struct rxd_x_entry *rx_entry;
 	struct rxd_base_hdr *base_hdr = rxd_get_base_hdr(pkt_entry);
+	struct rxd_peer *peer = rxd_peer(ep, base_hdr->peer);
 	struct rxd_sar_hdr *sar_hdr;
 	struct rxd_tag_hdr *tag_hdr;
 	struct rxd_data_hdr *data_hdr;
@@ -997,21 +1222,35 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 	size_t msg_size;
 	int ret;
 
-	if (base_hdr->seq_no != ep->peers[base_hdr->peer].rx_seq_no) {
+	if (base_hdr->seq_no != peer->rx_seq_no) {
 		if (!rxd_env.retry) {
-			dlist_insert_order(&ep->peers[base_hdr->peer].buf_pkts,
-					   &rxd_comp_pkt_seq_no, &pkt_entry->d_entry);
-			return;
+			if (rxd_buf_pkt(ep, pkt_entry))
+				return;
+			goto release;
 		}
 
-		if (ep->peers[base_hdr->peer].peer_addr != FI_ADDR_UNSPEC)
-			goto ack;
-		goto release;
+		if (peer->peer_addr == FI_ADDR_UNSPEC)
+			goto release;
+
+		if (rxd_buf_pkt(ep, pkt_entry)) {
+			rxd_ep_send_ack(ep, base_hdr->peer);
+			return;
+		}
+		goto ack;
 	}
 
-	if (ep->peers[base_hdr->peer].peer_addr == FI_ADDR_UNSPEC)
+	if (peer->peer_addr == FI_ADDR_UNSPEC)
 		goto release;
 
+	if (base_hdr->type == RXD_BATCH) {
+		if (!rxd_progress_batch(ep, pkt_entry)) {
+			peer->rx_seq_no++;
+			if (peer->rx_win_cnt)
+				rxd_progress_buf_pkts(ep, base_hdr->peer);
+		}
+		goto ack;
+	}
+
 	ret = rxd_unpack_init_rx(ep, &rx_entry, pkt_entry, base_hdr, &sar_hdr,
 				 &tag_hdr, &data_hdr, &rma_hdr, &atom_hdr,
 				 &msg, &msg_size);
@@ -1020,27 +1259,30 @@ static void rxd_handle_op(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 
 	if (!rx_entry) {
 		if (base_hdr->type == RXD_MSG || base_hdr->type == RXD_TAGGED) {
-			if (!ep->peers[base_hdr->peer].curr_unexp)
+			if (!peer->curr_unexp)
 				goto ack;
 
-			ep->peers[base_hdr->peer].rx_seq_no++;
+			peer->rx_seq_no++;
 
 			if (!sar_hdr)
-				ep->peers[base_hdr->peer].curr_unexp = NULL;
+				peer->curr_unexp = NULL;
+
+			if (peer->rx_win_cnt)
+				rxd_progress_buf_pkts(ep, base_hdr->peer);
 
 			rxd_ep_send_ack(ep, base_hdr->peer);
 			return;
 		}
-		ep->peers[base_hdr->peer].rx_window = 0;
+		peer->rx_window = 0;
 		goto ack;
 	}
 
-	ep->peers[base_hdr->peer].rx_seq_no++;
-	ep->peers[base_hdr->peer].rx_window = rxd_env.max_unacked;
+	peer->rx_seq_no++;
+	peer->rx_window = rxd_env.max_unacked;
 	rxd_progress_op(ep, rx_entry, pkt_entry, base_hdr, sar_hdr, tag_hdr,
 			data_hdr, rma_hdr, atom_hdr, &msg, msg_size);
 
-	if (!dlist_empty(&ep->peers[base_hdr->peer].buf_pkts))
+	if (peer->rx_win_cnt)
 		rxd_progress_buf_pkts(ep, base_hdr->peer);
 
 ack:
@@ -1059,34 +1301,102 @@ static void rxd_handle_cts(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 		return;
 	}
 
+	if (cts->credits)
+		rxd_peer(ep, cts->rts_addr)->tx_window =
+			(uint16_t) MIN(cts->credits, rxd_env.max_unacked);
+
 	rxd_update_peer(ep, cts->rts_addr, cts->cts_addr);
 }
 
+/*
+ * Marks unacked packets that the peer holds out of order.  The bitmap covers
+ * the RXD_SACK_BITS packets after the cumulative ack and replaces what older
+ * acks said about them.
+ */
+static void rxd_mark_sacked(struct rxd_peer *peer, struct rxd_ack_pkt *ack)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	uint64_t offset;
+
+	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		offset = rxd_get_base_hdr(pkt_entry)->seq_no -
+			 ack->base_hdr.seq_no - 1;
+		if (offset < RXD_SACK_BITS && ack->sack & (1ULL << offset)) {
+			pkt_entry->flags |= RXD_PKT_SACKED;
+			rxd_pkt_delivered(peer, pkt_entry);
+		} else if (offset < RXD_SACK_BITS || offset == UINT64_MAX) {
+			pkt_entry->flags &= ~RXD_PKT_SACKED;
+		}
+	}
+}
+
+/* Slow start below ssthresh, then one packet per window (RFC 5681) */
+static void rxd_peer_open_cwnd(struct rxd_peer *peer, int acked)
+{
+	if (peer->cwnd < peer->ssthresh) {
+		peer->cwnd = MIN(peer->cwnd + acked, peer->ssthresh);
+	} else {
+		peer->cwnd_cnt += acked;
+		if (peer->cwnd_cnt >= peer->cwnd) {
+			peer->cwnd_cnt -= peer->cwnd;
+			peer->cwnd++;
+		}
+	}
+	peer->cwnd = MIN(peer->cwnd, rxd_env.max_unacked);
+}
+
 static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 {
 	struct rxd_ack_pkt *ack = (struct rxd_ack_pkt *) (ack_entry->pkt);
 	struct rxd_pkt_entry *pkt_entry;
-	fi_addr_t peer = ack->base_hdr.peer;
+	struct rxd_peer *peer = rxd_peer(ep, ack->base_hdr.peer);
 	struct rxd_base_hdr *hdr;
+	uint64_t next, sent = 0, resent = 0;
+	int acked = 0;
 
-	ep->peers[peer].tx_window = ack->ext_hdr.rx_id;
+	peer->tx_window = ack->ext_hdr.rx_id;
 
-	if (ep->peers[peer].last_rx_ack == ack->base_hdr.seq_no)
+	if (ofi_before(ack->base_hdr.seq_no, peer->last_rx_ack))
 		return;
 
-	ep->peers[peer].last_rx_ack = ack->base_hdr.seq_no;
+	if (peer->last_rx_ack != ack->base_hdr.seq_no) {
+		peer->last_rx_ack = ack->base_hdr.seq_no;
+		peer->ack_time = ofi_gettime_us();
+		peer->probe_time = 0;
+		peer->probe_cnt = 0;
+		/* Undo any backoff on progress, as when every packet acked
+		 * was resent no RTT sample would */
+		rxd_peer_reset_rto(peer);
+	}
 
-	if (dlist_empty(&ep->peers[peer].unacked))
-		return;
+	if (dlist_empty(&peer->unacked))
+		goto out;
 
-	pkt_entry = container_of((&ep->peers[peer].unacked)->next,
+	pkt_entry = container_of((&peer->unacked)->next,
 				struct rxd_pkt_entry, d_entry);
 
-	while (&pkt_entry->d_entry != &ep->peers[peer].unacked) {
+	while (&pkt_entry->d_entry != &peer->unacked) {
 		hdr = rxd_get_base_hdr(pkt_entry);
 		if (ofi_after_eq(hdr->seq_no, ack->base_hdr.seq_no))
 			break;
 
+		/*
+		 * Time the newest packet acked if it was sent once, after
+		 * any resent packet the ack covers, and was not SACKed
+		 * earlier.  Otherwise the ack may have waited on a lost
+		 * packet (Karn's rule).
+		 */
+		if (!(pkt_entry->flags & RXD_PKT_ACKED)) {
+			acked++;
+			if (pkt_entry->flags & RXD_PKT_RETRANS)
+				resent = MAX(resent, pkt_entry->timestamp);
+			sent = pkt_entry->flags &
+			       (RXD_PKT_RETRANS | RXD_PKT_SACKED) ?
+			       0 : pkt_entry->timestamp;
+			rxd_pkt_delivered(peer, pkt_entry);
+		}
+
 		if (pkt_entry->flags & RXD_PKT_IN_USE) {
 			pkt_entry->flags |= RXD_PKT_ACKED;
 			pkt_entry = container_of((&pkt_entry->d_entry)->next,
@@ -1094,21 +1404,37 @@ static void rxd_handle_ack(struct rxd_ep *ep, struct rxd_pkt_entry *ack_entry)
 			continue;
 		}
 		rxd_remove_free_pkt_entry(pkt_entry);
-		ep->peers[peer].unacked_cnt--;
-		ep->peers[peer].retry_cnt = 0;
+		peer->unacked_cnt--;
+		peer->retry_cnt = 0;
 
-		pkt_entry = container_of((&ep->peers[peer].unacked)->next,
+		pkt_entry = container_of((&peer->unacked)->next,
 					struct rxd_pkt_entry, d_entry);
 	}
 
-	rxd_progress_tx_list(ep, &ep->peers[ack->base_hdr.peer]);
-} 
+	if (sent > resent)
+		rxd_peer_rtt_sample(peer, peer->ack_time - sent);
+
+	if (peer->recovery &&
+	    ofi_after_eq(ack->base_hdr.seq_no, peer->recover_seq)) {
+		peer->recovery = 0;
+		peer->cwnd_cut = 0;
+	}
+	if (!peer->cwnd_cut)
+		rxd_peer_open_cwnd(peer, acked);
+
+	rxd_mark_sacked(peer, ack);
+	next = rxd_detect_loss(ep, peer, ofi_gettime_us());
+	if (next != UINT64_MAX)
+		rxd_peer_set_timer(ep, peer, next);
+out:
+	rxd_progress_tx_list(ep, peer);
+}
 
 void rxd_handle_send_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 {
 	struct rxd_pkt_entry *pkt_entry =
 		container_of(comp->op_context, struct rxd_pkt_entry, context);
-	fi_addr_t peer;
+	struct rxd_peer *peer;
 
 	FI_DBG(&rxd_prov, FI_LOG_EP_DATA,
 	       "got send completion (type: %s)\n",
@@ -1117,20 +1443,47 @@ void rxd_handle_send_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 	switch (rxd_pkt_type(pkt_entry)) {
 	case RXD_CTS:
 	case RXD_ACK:
+	case RXD_MC_DATA:
+	case RXD_MC_NACK:
+	case RXD_MC_ACK:
 		rxd_remove_free_pkt_entry(pkt_entry);
 		break;
 	default:
 		if (pkt_entry->flags & RXD_PKT_ACKED) {
-			peer = pkt_entry->peer;
+			peer = rxd_peer(ep, pkt_entry->peer);
 			rxd_remove_free_pkt_entry(pkt_entry);
-			ep->peers[peer].unacked_cnt--;
-			rxd_progress_tx_list(ep, &ep->peers[peer]);
+			peer->unacked_cnt--;
+			rxd_progress_tx_list(ep, peer);
 		} else {
 			pkt_entry->flags &= ~RXD_PKT_IN_USE;
 		}
 	}
 }
 
+/*
+ * Packets other than an RTS carry the address the receiver handed out in a
+ * CTS, so peer state for them already exists.
+ */
+static int rxd_pkt_peer_known(struct rxd_ep *ep,
+			      struct rxd_pkt_entry *pkt_entry)
+{
+	struct rxd_cts_pkt *cts;
+
+	switch (rxd_pkt_type(pkt_entry)) {
+	case RXD_RTS:
+	case RXD_MC_DATA:
+	case RXD_MC_NACK:
+	case RXD_MC_ACK:
+		return 1;
+	case RXD_CTS:
+		cts = (struct rxd_cts_pkt *) (pkt_entry->pkt);
+		return rxd_peer_lookup(ep, cts->rts_addr) != NULL;
+	default:
+		return rxd_peer_lookup(ep,
+				rxd_get_base_hdr(pkt_entry)->peer) != NULL;
+	}
+}
+
 void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 {
 	struct rxd_pkt_entry *pkt_entry =
@@ -1140,10 +1493,20 @@ void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 	       "got recv completion (type: %s)\n",
 	       rxd_pkt_type_str[(rxd_pkt_type(pkt_entry))]);
 
-	rxd_ep_post_buf(ep);
-	rxd_remove_rx_pkt(ep, pkt_entry);
+	if (pkt_entry->flags & RXD_PKT_MC) {
+		rxd_coll_repost_buf(ep, pkt_entry);
+	} else {
+		rxd_ep_post_buf(ep);
+		rxd_remove_rx_pkt(ep, pkt_entry);
+	}
 
 	pkt_entry->pkt_size = comp->len;
+	if (!rxd_pkt_peer_known(ep, pkt_entry)) {
+		FI_WARN(&rxd_prov, FI_LOG_CQ,
+			"dropping packet from unknown peer\n");
+		goto free;
+	}
+
 	switch (rxd_pkt_type(pkt_entry)) {
 	case RXD_RTS:
 		rxd_handle_rts(ep, pkt_entry);
@@ -1160,13 +1523,18 @@ void rxd_handle_recv_comp(struct rxd_ep *ep, struct fi_cq_msg_entry *comp)
 		/* don't need to perform action below:
 		 * - release/repost RX packet */
 		return;
+	case RXD_MC_DATA:
+	case RXD_MC_NACK:
+	case RXD_MC_ACK:
+		rxd_coll_handle_pkt(ep, pkt_entry);
+		return;
 	default:
 		rxd_handle_op(ep, pkt_entry);
 		/* don't need to perform action below:
 		 * - release/repost RX packet */
 		return;
 	}
-
+free:
 	ofi_buf_free(pkt_entry);
 }
 
@@ -1247,7 +1615,7 @@ ssize_t rxd_cq_sreadfrom(struct fid_cq *cq_fid, void *buf, size_t count,
 		cq->cq_fastlock_release(&cq->ep_list_lock);
 
 		ret = fi_wait(&cq->wait->wait_fid, ep_retry == -1 ?
-			      timeout : rxd_get_timeout(ep_retry));
+			      timeout : ep_retry);
 
 		if (ep_retry != -1 && ret == -FI_ETIMEDOUT)
 			ret = 0;
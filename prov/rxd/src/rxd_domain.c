@@ -48,7 +48,7 @@ static struct fi_ops_domain rxd_domain_ops = {
 	.stx_ctx = fi_no_stx_context,
 	.srx_ctx = fi_no_srx_context,
 	.query_atomic = rxd_query_atomic,
-	.query_collective = fi_no_query_collective,
+	.query_collective = ofi_query_collective,
 };
 
 static int rxd_domain_close(fid_t fid)
@@ -66,6 +66,7 @@ static int rxd_domain_close(fid_t fid)
 	if (ret)
 		return ret;
 
+	rxd_progress_close(rxd_domain);
 	ofi_mr_map_close(&rxd_domain->mr_map);
 	free(rxd_domain);
 	return 0;
@@ -147,12 +148,24 @@ int rxd_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	if (ret)
 		goto err4;
 
+	if (info->domain_attr->data_progress == FI_PROGRESS_AUTO) {
+		/* The progress thread completes transfers concurrently
+		 * with the application, so CQs need real locking.
+		 */
+		rxd_domain->util_domain.threading = FI_THREAD_SAFE;
+		ret = rxd_progress_init(rxd_domain);
+		if (ret)
+			goto err5;
+	}
+
 	*domain = &rxd_domain->util_domain.domain_fid;
 	(*domain)->fid.ops = &rxd_domain_fi_ops;
 	(*domain)->ops = &rxd_domain_ops;
 	(*domain)->mr = &rxd_mr_ops;
 	fi_freeinfo(dg_info);
 	return 0;
+err5:
+	ofi_mr_map_close(&rxd_domain->mr_map);
 err4:
 	if (ofi_domain_close(&rxd_domain->util_domain))
 		FI_WARN(&rxd_prov, FI_LOG_DOMAIN,
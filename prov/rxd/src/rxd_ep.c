@@ -232,6 +232,7 @@ int rxd_ep_post_buf(struct rxd_ep *ep)
 	if (!pkt_entry)
 		return -FI_ENOMEM;
 
+	pkt_entry->flags = 0;
 	ret = fi_recv(ep->dg_ep, rxd_pkt_start(pkt_entry),
 		      rxd_ep_domain(ep)->max_mtu_sz,
 		      pkt_entry->desc, FI_ADDR_UNSPEC,
@@ -271,20 +272,16 @@ static int rxd_ep_enable(struct rxd_ep *ep)
 	}
 
 	fastlock_release(&ep->util_ep.lock);
-	return 0;
-}
+	if (ret)
+		return ret;
 
-/*
- * Exponential back-off starting at 1ms, max 4s.
- */
-int rxd_get_timeout(uint8_t retry_cnt)
-{
-	return MIN(1 << retry_cnt, 4000);
-}
+	if (ep->mc) {
+		ret = rxd_coll_enable(ep);
+		if (ret)
+			return ret;
+	}
 
-uint64_t rxd_get_retry_time(uint64_t start, uint8_t retry_cnt)
-{
-	return start + rxd_get_timeout(retry_cnt);
+	return rxd_progress_add_ep(ep);
 }
 
 void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
@@ -305,7 +302,7 @@ void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
 	data_pkt->ext_hdr.rx_id = tx_entry->rx_id;
 	data_pkt->ext_hdr.tx_id = tx_entry->tx_id;
 	data_pkt->ext_hdr.seg_no = tx_entry->next_seg_no++;
-	data_pkt->base_hdr.peer = ep->peers[tx_entry->peer].peer_addr;
+	data_pkt->base_hdr.peer = rxd_peer(ep, tx_entry->peer)->peer_addr;
 
 	pkt_entry->pkt_size = ofi_copy_from_iov(data_pkt->msg, seg_size,
 						tx_entry->iov,
@@ -318,10 +315,9 @@ void rxd_init_data_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
 	pkt_entry->pkt_size += sizeof(*data_pkt) + ep->tx_prefix_size;
 }
 
-struct rxd_x_entry *rxd_tx_entry_init_common(struct rxd_ep *ep, fi_addr_t addr,
+static struct rxd_x_entry *rxd_tx_entry_alloc(struct rxd_ep *ep, fi_addr_t addr,
 			uint32_t op, const struct iovec *iov, size_t iov_count,
-			uint64_t tag, uint64_t data, uint32_t flags, void *context,
-			struct rxd_base_hdr **base_hdr, void **ptr)
+			uint64_t tag, uint64_t data, uint32_t flags, void *context)
 {
 	struct rxd_x_entry *tx_entry;
 
@@ -331,12 +327,6 @@ struct rxd_x_entry *rxd_tx_entry_init_common(struct rxd_ep *ep, fi_addr_t addr,
 		return NULL;
 	}
 
-	tx_entry->pkt = rxd_get_tx_pkt(ep);
-	if (!tx_entry->pkt) {
-		rxd_tx_entry_free(ep, tx_entry);
-		return NULL;
-	}
-
 	tx_entry->op = op;
 	tx_entry->peer = addr;
 	tx_entry->flags = flags;
@@ -353,14 +343,128 @@ struct rxd_x_entry *rxd_tx_entry_init_common(struct rxd_ep *ep, fi_addr_t addr,
 	tx_entry->cq_entry.tag = tag;
 	tx_entry->cq_entry.data = data;
 
+	return tx_entry;
+}
+
+struct rxd_x_entry *rxd_tx_entry_init_common(struct rxd_ep *ep, fi_addr_t addr,
+			uint32_t op, const struct iovec *iov, size_t iov_count,
+			uint64_t tag, uint64_t data, uint32_t flags, void *context,
+			struct rxd_base_hdr **base_hdr, void **ptr)
+{
+	struct rxd_peer *peer = rxd_peer(ep, addr);
+	struct rxd_x_entry *tx_entry;
+
+	/* A batch still waiting to be sent must go out first */
+	if (peer->tx_batch) {
+		if (peer->peer_addr != FI_ADDR_UNSPEC)
+			(void) rxd_start_xfer(ep, peer->tx_batch);
+		peer->tx_batch = NULL;
+	}
+
+	tx_entry = rxd_tx_entry_alloc(ep, addr, op, iov, iov_count, tag, data,
+				      flags, context);
+	if (!tx_entry)
+		return NULL;
+
+	tx_entry->pkt = rxd_get_tx_pkt(ep);
+	if (!tx_entry->pkt) {
+		rxd_tx_entry_free(ep, tx_entry);
+		return NULL;
+	}
+
 	tx_entry->pkt->peer = tx_entry->peer;
 
 	*base_hdr = rxd_get_base_hdr(tx_entry->pkt);
 	*ptr = (void *) *base_hdr;
 	rxd_init_base_hdr(ep, &(*ptr), tx_entry);
 
-	dlist_insert_tail(&tx_entry->entry,
-			  &ep->peers[tx_entry->peer].tx_list);
+	dlist_insert_tail(&tx_entry->entry, &peer->tx_list);
+
+	return tx_entry;
+}
+
+/* Moves the message in a single packet message behind a batch_hdr */
+static void rxd_init_batch_pkt(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
+{
+	struct rxd_base_hdr *base_hdr = rxd_get_base_hdr(tx_entry->pkt);
+	struct rxd_batch_hdr hdr;
+	char *ptr = (char *) (base_hdr + 1);
+
+	hdr.size = (uint16_t) tx_entry->cq_entry.len;
+	hdr.type = base_hdr->type;
+	hdr.flags = base_hdr->flags & RXD_BATCH_FLAGS;
+
+	memmove(ptr + sizeof(hdr), ptr, tx_entry->pkt->pkt_size -
+		ep->tx_prefix_size - sizeof(*base_hdr));
+	memcpy(ptr, &hdr, sizeof(hdr));
+
+	base_hdr->type = RXD_BATCH;
+	base_hdr->flags = 0;
+	tx_entry->pkt->pkt_size += sizeof(hdr);
+}
+
+/*
+ * Small messages posted while the message before them is still waiting to
+ * be sent, behind a full window, a missing CTS or FI_MORE, are appended to
+ * its packet.  The first one turns the packet into a batch, see struct
+ * rxd_batch_hdr.  Returns NULL if the message does not fit, in which case
+ * the caller gives it a packet of its own.
+ */
+struct rxd_x_entry *rxd_tx_entry_init_batch(struct rxd_ep *ep, fi_addr_t addr,
+			uint32_t op, const struct iovec *iov, size_t iov_count,
+			uint64_t tag, uint64_t data, uint32_t flags, void *context)
+{
+	struct rxd_peer *peer = rxd_peer(ep, addr);
+	struct rxd_pkt_entry *pkt_entry;
+	struct rxd_base_hdr *base_hdr;
+	struct rxd_batch_hdr hdr;
+	struct rxd_x_entry *tx_entry;
+	size_t size;
+	char *ptr;
+
+	if (!peer->tx_batch)
+		return NULL;
+
+	pkt_entry = peer->tx_batch->pkt;
+	base_hdr = rxd_get_base_hdr(pkt_entry);
+	size = pkt_entry->pkt_size +
+	       rxd_batch_msg_size(flags, ofi_total_iov_len(iov, iov_count));
+	if (base_hdr->type != RXD_BATCH)
+		size += sizeof(hdr);
+	if (size > rxd_ep_domain(ep)->max_mtu_sz)
+		return NULL;
+
+	tx_entry = rxd_tx_entry_alloc(ep, addr, op, iov, iov_count, tag, data,
+				      flags | RXD_INLINE | RXD_BATCHED, context);
+	if (!tx_entry)
+		return NULL;
+
+	tx_entry->pkt = NULL;
+	tx_entry->num_segs = 1;
+	tx_entry->bytes_done = tx_entry->cq_entry.len;
+
+	if (base_hdr->type != RXD_BATCH)
+		rxd_init_batch_pkt(ep, peer->tx_batch);
+
+	hdr.size = (uint16_t) tx_entry->cq_entry.len;
+	hdr.type = (uint8_t) op;
+	hdr.flags = flags & RXD_BATCH_FLAGS;
+
+	ptr = (char *) base_hdr + pkt_entry->pkt_size - ep->tx_prefix_size;
+	memcpy(ptr, &hdr, sizeof(hdr));
+	ptr += sizeof(hdr);
+	if (flags & RXD_TAG_HDR) {
+		memcpy(ptr, &tag, sizeof(tag));
+		ptr += sizeof(tag);
+	}
+	if (flags & RXD_REMOTE_CQ_DATA) {
+		memcpy(ptr, &data, sizeof(data));
+		ptr += sizeof(data);
+	}
+	ptr += ofi_copy_from_iov(ptr, hdr.size, iov, iov_count, 0);
+	pkt_entry->pkt_size = rxd_pkt_size(ep, base_hdr, ptr);
+
+	dlist_insert_tail(&tx_entry->entry, &peer->tx_list);
 
 	return tx_entry;
 }
@@ -373,22 +477,56 @@ void rxd_tx_entry_free(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 	ofi_ibuf_free(tx_entry);
 }
 
-void rxd_insert_unacked(struct rxd_ep *ep, fi_addr_t peer,
+void rxd_insert_unacked(struct rxd_ep *ep, fi_addr_t addr,
 			struct rxd_pkt_entry *pkt_entry)
 {
-	dlist_insert_tail(&pkt_entry->d_entry,
-			  &ep->peers[peer].unacked);
-	ep->peers[peer].unacked_cnt++;
+	struct rxd_peer *peer = rxd_peer(ep, addr);
+
+	pkt_entry->tx_order = peer->tx_order++;
+	dlist_insert_tail(&pkt_entry->d_entry, &peer->unacked);
+	peer->unacked_cnt++;
+	rxd_peer_set_timer(ep, peer, pkt_entry->timestamp + rxd_peer_pto(peer));
+}
+
+static int rxd_ep_sendmsg_pkt(struct rxd_ep *ep,
+			      struct rxd_pkt_entry *pkt_entry, uint64_t flags)
+{
+	struct iovec iov;
+	struct fi_msg msg;
+	int ret;
+
+	pkt_entry->timestamp = ofi_gettime_us();
+
+	iov.iov_base = rxd_pkt_start(pkt_entry);
+	iov.iov_len = pkt_entry->pkt_size;
+	msg.msg_iov = &iov;
+	msg.desc = &pkt_entry->desc;
+	msg.iov_count = 1;
+	msg.addr = rxd_ep_av(ep)->rxd_addr_table[pkt_entry->peer].dg_addr;
+	msg.context = &pkt_entry->context;
+	msg.data = 0;
+
+	ret = fi_sendmsg(ep->dg_ep, &msg, FI_COMPLETION | flags);
+	if (ret) {
+		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "error sending packet: %d (%s)\n",
+			ret, fi_strerror(-ret));
+		return ret;
+	}
+	pkt_entry->flags |= RXD_PKT_IN_USE;
+
+	return 0;
 }
 
 ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 {
+	struct rxd_peer *peer = rxd_peer(ep, tx_entry->peer);
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_data_pkt *data;
+	uint16_t window, pending;
+	uint64_t more;
 
 	while (tx_entry->bytes_done != tx_entry->cq_entry.len) {
-		if (ep->peers[tx_entry->peer].unacked_cnt >=
-		    ep->peers[tx_entry->peer].tx_window)
+		if (peer->unacked_cnt >= rxd_peer_tx_window(peer))
 			return 0;
 
 		pkt_entry = rxd_get_tx_pkt(ep);
@@ -403,31 +541,46 @@ ssize_t rxd_ep_post_data_pkts(struct rxd_ep *ep, struct rxd_x_entry *tx_entry)
 		if (data->base_hdr.type != RXD_DATA_READ)
 			data->base_hdr.seq_no++;
 
-		rxd_ep_send_pkt(ep, pkt_entry);
+		/*
+		 * Let the datagram provider batch the rest of the window.  Ask
+		 * for an ack at half and at the end of the window mid-message,
+		 * so acks return while the rest of the window is in flight.
+		 */
+		more = 0;
+		if (tx_entry->bytes_done != tx_entry->cq_entry.len) {
+			window = rxd_peer_tx_window(peer);
+			pending = peer->unacked_cnt + 1;
+			if (pending < window)
+				more = FI_MORE;
+			if (pending >= window || pending == window / 2)
+				data->base_hdr.flags |= RXD_ACK_REQ;
+		}
+
+		rxd_ep_sendmsg_pkt(ep, pkt_entry, more);
 		rxd_insert_unacked(ep, tx_entry->peer, pkt_entry);
 	}
 
-	return ep->peers[tx_entry->peer].unacked_cnt >=
-	       ep->peers[tx_entry->peer].tx_window;
+	return peer->unacked_cnt >= rxd_peer_tx_window(peer);
 }
 
 int rxd_ep_send_pkt(struct rxd_ep *ep, struct rxd_pkt_entry *pkt_entry)
 {
-	int ret;
+	return rxd_ep_sendmsg_pkt(ep, pkt_entry, 0);
+}
 
-	pkt_entry->timestamp = ofi_gettime_ms();
+/* Resends an unacked packet, which then follows every packet sent before */
+int rxd_ep_retry_pkt(struct rxd_ep *ep, struct rxd_peer *peer,
+		     struct rxd_pkt_entry *pkt_entry)
+{
+	int ret;
 
-	ret = fi_send(ep->dg_ep, (const void *) rxd_pkt_start(pkt_entry),
-		      pkt_entry->pkt_size, pkt_entry->desc,
-		      rxd_ep_av(ep)->rxd_addr_table[pkt_entry->peer].dg_addr,
-		      &pkt_entry->context);
-	if (ret) {
-		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL, "error sending packet: %d (%s)\n",
-			ret, fi_strerror(-ret));
+	ret = rxd_ep_sendmsg_pkt(ep, pkt_entry, 0);
+	if (ret)
 		return ret;
-	}
-	pkt_entry->flags |= RXD_PKT_IN_USE;
 
+	pkt_entry->flags |= RXD_PKT_RETRANS;
+	pkt_entry->prev_order = pkt_entry->tx_order;
+	pkt_entry->tx_order = peer->tx_order++;
 	return 0;
 }
 
@@ -461,15 +614,21 @@ static ssize_t rxd_ep_send_rts(struct rxd_ep *rxd_ep, fi_addr_t rxd_addr)
 
 	rxd_ep_send_pkt(rxd_ep, pkt_entry);
 	rxd_insert_unacked(rxd_ep, rxd_addr, pkt_entry);
-	dlist_insert_tail(&rxd_ep->peers[rxd_addr].entry, &rxd_ep->rts_sent_list);
+	dlist_insert_tail(&rxd_peer(rxd_ep, rxd_addr)->entry,
+			  &rxd_ep->rts_sent_list);
 
 	return 0;
 }
 
 ssize_t rxd_send_rts_if_needed(struct rxd_ep *ep, fi_addr_t addr)
 {
-	if (ep->peers[addr].peer_addr == FI_ADDR_UNSPEC &&
-	    dlist_empty(&ep->peers[addr].unacked))
+	struct rxd_peer *peer;
+
+	peer = rxd_get_peer(ep, addr);
+	if (!peer)
+		return -FI_ENOMEM;
+
+	if (peer->peer_addr == FI_ADDR_UNSPEC && dlist_empty(&peer->unacked))
 		return rxd_ep_send_rts(ep, addr);
 	return 0;
 }
@@ -482,7 +641,7 @@ void rxd_init_base_hdr(struct rxd_ep *rxd_ep, void **ptr,
 	hdr->version = RXD_PROTOCOL_VERSION;
 	hdr->type = tx_entry->op;
 	hdr->seq_no = 0;
-	hdr->peer = rxd_ep->peers[tx_entry->peer].peer_addr;
+	hdr->peer = rxd_peer(rxd_ep, tx_entry->peer)->peer_addr;
 	hdr->flags = tx_entry->flags;
 
 	*ptr = (char *) (*ptr) + sizeof(*hdr);
@@ -552,10 +711,21 @@ size_t rxd_init_msg(void **ptr, const struct iovec *iov, size_t iov_count,
 	return done;
 }
 
-void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
+void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t addr)
 {
+	struct rxd_peer *peer = rxd_peer(rxd_ep, addr);
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_ack_pkt *ack;
+	uint64_t offset;
+
+	/*
+	 * While rxd_progress_buf_pkts delivers the packets held in rx_win, the
+	 * next one is held but not yet delivered, and an ack would report it
+	 * missing.  The caller acks once they are delivered.
+	 */
+	pkt_entry = peer->rx_win[peer->rx_seq_no & (rxd_ep->rx_win_size - 1)];
+	if (pkt_entry && rxd_get_base_hdr(pkt_entry)->seq_no == peer->rx_seq_no)
+		return;
 
 	pkt_entry = rxd_get_tx_pkt(rxd_ep);
 	if (!pkt_entry) {
@@ -565,14 +735,22 @@ void rxd_ep_send_ack(struct rxd_ep *rxd_ep, fi_addr_t peer)
 
 	ack = (struct rxd_ack_pkt *) (pkt_entry->pkt);
 	pkt_entry->pkt_size = sizeof(*ack) + rxd_ep->tx_prefix_size;
-	pkt_entry->peer = peer;
+	pkt_entry->peer = addr;
 
 	ack->base_hdr.version = RXD_PROTOCOL_VERSION;
 	ack->base_hdr.type = RXD_ACK;
-	ack->base_hdr.peer = rxd_ep->peers[peer].peer_addr;
-	ack->base_hdr.seq_no = rxd_ep->peers[peer].rx_seq_no;
-	ack->ext_hdr.rx_id = rxd_ep->peers[peer].rx_window;
-	rxd_ep->peers[peer].last_tx_ack = ack->base_hdr.seq_no;
+	ack->base_hdr.peer = peer->peer_addr;
+	ack->base_hdr.seq_no = peer->rx_seq_no;
+	ack->ext_hdr.rx_id = rxd_peer_rx_credits(rxd_ep, peer);
+	peer->last_tx_ack = ack->base_hdr.seq_no;
+
+	ack->sack = 0;
+	for (offset = 0; peer->rx_win_cnt && offset < RXD_SACK_BITS &&
+	     offset < rxd_ep->rx_win_size - 1; offset++) {
+		if (peer->rx_win[(ack->base_hdr.seq_no + offset + 1) &
+				 (rxd_ep->rx_win_size - 1)])
+			ack->sack |= 1ULL << offset;
+	}
 
 	dlist_insert_tail(&pkt_entry->d_entry, &rxd_ep->ctrl_pkts);
 	if (rxd_ep_send_pkt(rxd_ep, pkt_entry))
@@ -592,12 +770,16 @@ static void rxd_ep_free_res(struct rxd_ep *ep)
 
 	if (ep->rx_entry_pool.pool)
 		ofi_bufpool_destroy(ep->rx_entry_pool.pool);
+
+	if (ep->peer_pool)
+		ofi_bufpool_destroy(ep->peer_pool);
 }
 
 static void rxd_close_peer(struct rxd_ep *ep, struct rxd_peer *peer)
 {
 	struct rxd_pkt_entry *pkt_entry;
 	struct rxd_x_entry *x_entry;
+	size_t i;
 
 	while (!dlist_empty(&peer->unacked)) {
 		dlist_pop_front(&peer->unacked, struct rxd_pkt_entry,
@@ -609,8 +791,11 @@ static void rxd_close_peer(struct rxd_ep *ep, struct rxd_peer *peer)
 	while(!dlist_empty(&peer->tx_list)) {
 		dlist_pop_front(&peer->tx_list, struct rxd_x_entry,
 				x_entry, entry);
+		if (x_entry == ep->tx_more)
+			ep->tx_more = NULL;
 		rxd_tx_entry_free(ep, x_entry);
 	}
+	peer->tx_batch = NULL;
 
 	while(!dlist_empty(&peer->rx_list)) {
 		dlist_pop_front(&peer->rx_list, struct rxd_x_entry,
@@ -624,6 +809,14 @@ static void rxd_close_peer(struct rxd_ep *ep, struct rxd_peer *peer)
 		rxd_tx_entry_free(ep, x_entry);
 	}
 
+	for (i = 0; peer->rx_win_cnt && i < ep->rx_win_size; i++) {
+		if (peer->rx_win[i]) {
+			ofi_buf_free(peer->rx_win[i]);
+			peer->rx_win[i] = NULL;
+			peer->rx_win_cnt--;
+		}
+	}
+
 	dlist_remove(&peer->entry);
 	peer->active = 0;
 }
@@ -657,13 +850,22 @@ static int rxd_ep_close(struct fid *fid)
 	struct rxd_ep *ep;
 	struct rxd_pkt_entry *pkt_entry;
 	struct slist_entry *entry;
+	struct dlist_entry *tmp;
 	struct rxd_peer *peer;
 
 	ep = container_of(fid, struct rxd_ep, util_ep.ep_fid.fid);
+	rxd_progress_del_ep(ep);
 
-	dlist_foreach_container(&ep->active_peers, struct rxd_peer, peer, entry)
+	dlist_foreach_container_safe(&ep->active_peers, struct rxd_peer,
+				     peer, entry, tmp)
+		rxd_close_peer(ep, peer);
+	dlist_foreach_container_safe(&ep->rts_sent_list, struct rxd_peer,
+				     peer, entry, tmp)
 		rxd_close_peer(ep, peer);
 
+	if (ep->mc)
+		rxd_coll_close(ep);
+
 	ret = fi_close(&ep->dg_ep->fid);
 	if (ret)
 		return ret;
@@ -690,12 +892,13 @@ static int rxd_ep_close(struct fid *fid)
 	}
 
 	rxd_ep_free_res(ep);
+	ofi_idm_reset(&ep->peers);
 	ofi_endpoint_close(&ep->util_ep);
 	free(ep);
 	return 0;
 }
 
-static int rxd_ep_trywait(void *arg)
+int rxd_ep_trywait(void *arg)
 {
 	struct rxd_fabric *rxd_fabric;
 	struct rxd_ep *rxd_ep = (struct rxd_ep *) arg;
@@ -771,7 +974,8 @@ static int rxd_ep_bind(struct fid *ep_fid, struct fid *bfid, uint64_t flags)
 			return ret;
 
 		if (!ep->dg_cq) {
-			ret = rxd_dg_cq_open(ep, cq->wait ? FI_WAIT_FD : FI_WAIT_NONE);
+			ret = rxd_dg_cq_open(ep, cq->wait || ep->progress ?
+					     FI_WAIT_FD : FI_WAIT_NONE);
 			if (ret)
 				return ret;
 		}
@@ -782,6 +986,9 @@ static int rxd_ep_bind(struct fid *ep_fid, struct fid *bfid, uint64_t flags)
 					      &ep->util_ep.ep_fid.fid);
 		break;
 	case FI_CLASS_EQ:
+		/* Collective joins complete to the EQ */
+		ret = ofi_ep_bind_eq(&ep->util_ep, container_of(bfid,
+				     struct util_eq, eq_fid.fid));
 		break;
 	case FI_CLASS_CNTR:
 		cntr = container_of(bfid, struct util_cntr, cntr_fid.fid);
@@ -791,7 +998,8 @@ static int rxd_ep_bind(struct fid *ep_fid, struct fid *bfid, uint64_t flags)
 			return ret;
 
 		if (!ep->dg_cq) {
-			ret = rxd_dg_cq_open(ep, cntr->wait ? FI_WAIT_FD : FI_WAIT_NONE);
+			ret = rxd_dg_cq_open(ep, cntr->wait || ep->progress ?
+					     FI_WAIT_FD : FI_WAIT_NONE);
 		} else if (!ep->dg_cq_fd && cntr->wait) {
 			/* Reopen CQ with WAIT fd set */
 			ret = fi_close(&ep->dg_cq->fid);
@@ -863,6 +1071,19 @@ static int rxd_ep_cm_getname(fid_t fid, void *addr, size_t *addrlen)
 	return fi_getname(&ep->dg_ep->fid, addr, addrlen);
 }
 
+static int rxd_join_coll(struct fid_ep *ep, const void *addr, uint64_t flags,
+			 struct fid_mc **mc, void *context)
+{
+	struct fi_collective_addr *c_addr;
+
+	if (!(flags & FI_COLLECTIVE))
+		return -FI_ENOSYS;
+
+	c_addr = (struct fi_collective_addr *) addr;
+	return ofi_join_collective(ep, c_addr->coll_addr, c_addr->set, flags,
+				   mc, context);
+}
+
 struct fi_ops_cm rxd_ep_cm = {
 	.size = sizeof(struct fi_ops_cm),
 	.setname = rxd_ep_cm_setname,
@@ -873,7 +1094,7 @@ struct fi_ops_cm rxd_ep_cm = {
 	.accept = fi_no_accept,
 	.reject = fi_no_reject,
 	.shutdown = fi_no_shutdown,
-	.join = fi_no_join,
+	.join = rxd_join_coll,
 };
 
 static void rxd_peer_timeout(struct rxd_ep *rxd_ep, struct rxd_peer *peer)
@@ -906,48 +1127,308 @@ static void rxd_peer_timeout(struct rxd_ep *rxd_ep, struct rxd_peer *peer)
 	dlist_remove(&peer->entry);
 }
 
-static void rxd_progress_pkt_list(struct rxd_ep *ep, struct rxd_peer *peer)
+/*
+ * Each timeout doubles the RTO until an ack yields a new RTT sample (RFC
+ * 6298).  The first timeout in a row also reduces the congestion window, as
+ * a fast retransmit does.  Restarting from one packet as TCP does (RFC 5681)
+ * makes random loss on a datagram fabric too costly.
+ */
+static void rxd_peer_backoff(struct rxd_peer *peer)
+{
+	peer->rto = MIN(peer->rto * 2, RXD_MAX_RTO);
+	if (peer->retry_cnt++ || !peer->active)
+		return;
+
+	rxd_peer_reduce_cwnd(peer);
+	peer->recovery = 0;
+	peer->cwnd_cut = 0;
+}
+
+/*
+ * Packets the peer holds out of order are not resent, except at the head of
+ * the window in case the ack covering them was lost.
+ */
+static int rxd_pkt_outstanding(struct rxd_pkt_entry *pkt_entry, int *head)
+{
+	if (pkt_entry->flags & RXD_PKT_ACKED)
+		return 0;
+	if (pkt_entry->flags & RXD_PKT_SACKED && !*head)
+		return 0;
+	*head = 0;
+	return 1;
+}
+
+/*
+ * Random loss on a datagram fabric costs a few packets per window, while a
+ * full queue drops a run of them.  The window is reduced once per recovery
+ * episode, when the episode has lost 1/RXD_LOSS_BURST of it, so a lossy
+ * fabric keeps the window that an idle one would.
+ */
+static void rxd_peer_lost(struct rxd_peer *peer, int cnt)
+{
+	if (!peer->recovery) {
+		peer->recovery = 1;
+		peer->recover_seq = rxd_get_base_hdr(container_of(
+					peer->unacked.prev, struct rxd_pkt_entry,
+					d_entry))->seq_no + 1;
+		peer->lost_cnt = 0;
+		peer->cwnd_cut = 0;
+	}
+
+	peer->lost_cnt += cnt;
+	if (!peer->cwnd_cut && peer->lost_cnt * RXD_LOSS_BURST >= peer->cwnd) {
+		rxd_peer_reduce_cwnd(peer);
+		peer->cwnd_cut = 1;
+	}
+}
+
+/*
+ * Loss detection by send order (RACK, RFC 8985).  A packet is lost once a
+ * packet sent after it has reached the peer, and either RXD_DUP_ACK_THRESH
+ * packets were sent in between or it has been out for an RTT plus a
+ * quarter of one for reordering.  A resent packet follows everything
+ * delivered so far, so it is not resent again until a later packet gets
+ * through without it.  Returns when the next packet is due to be declared
+ * lost, or UINT64_MAX.
+ */
+uint64_t rxd_detect_loss(struct rxd_ep *ep, struct rxd_peer *peer,
+			 uint64_t current)
 {
 	struct rxd_pkt_entry *pkt_entry;
-	uint64_t current;
-	int ret, retry = 0;
+	uint64_t expire, next = UINT64_MAX;
+	int lost = 0;
+
+	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+				pkt_entry, d_entry) {
+		if (pkt_entry->tx_order >= peer->rack_order ||
+		    pkt_entry->flags & (RXD_PKT_IN_USE | RXD_PKT_ACKED |
+					RXD_PKT_SACKED))
+			continue;
+
+		expire = pkt_entry->timestamp + peer->srtt + peer->srtt / 4;
+		if (peer->rack_order - pkt_entry->tx_order <=
+		    RXD_DUP_ACK_THRESH && current < expire) {
+			next = MIN(next, expire);
+			continue;
+		}
+
+		if (rxd_ep_retry_pkt(ep, peer, pkt_entry))
+			break;
+		lost++;
+	}
+
+	if (lost)
+		rxd_peer_lost(peer, lost);
+	return next;
+}
+
+/*
+ * Tail loss probe (RFC 8985).  When nothing has been sent or acked for a
+ * while, the newest packet the peer has not reported is resent with an ack
+ * request.  Its ack, with SACK, lets rxd_detect_loss find any other loss at
+ * the tail of the window, where no later packet would reveal it, without
+ * waiting for the RTO.  Up to RXD_MAX_PROBES are sent, one per PTO, before
+ * the RTO; a probe neither backs off the timer nor reduces the window.  The
+ * RTO counts from the last probe, and includes the time the peer may take
+ * to ack, so a lost probe or resend is better recovered by the next probe.
+ *
+ * A sender with nothing left to post is waiting on the peer for the
+ * completion, and learning of a loss costs it a round trip.  It resends
+ * every packet the peer has not reported instead, using bandwidth that would
+ * otherwise go idle.
+ */
+static int rxd_peer_tx_idle(struct rxd_peer *peer)
+{
+	struct rxd_x_entry *tx_entry;
+
+	dlist_foreach_container(&peer->tx_list, struct rxd_x_entry,
+				tx_entry, entry) {
+		if (tx_entry->pkt ||
+		    tx_entry->bytes_done != tx_entry->cq_entry.len)
+			return 0;
+	}
+	return 1;
+}
+
+static void rxd_send_probe(struct rxd_ep *ep, struct rxd_peer *peer)
+{
+	struct rxd_pkt_entry *pkt_entry, *probe = NULL;
+
+	dlist_foreach_container_reverse(&peer->unacked, struct rxd_pkt_entry,
+					pkt_entry, d_entry) {
+		if (pkt_entry->flags & (RXD_PKT_ACKED | RXD_PKT_SACKED))
+			continue;
+		if (pkt_entry->flags & RXD_PKT_IN_USE)
+			return;
+		probe = pkt_entry;
+		break;
+	}
+	if (!probe)
+		return;
+
+	if (rxd_peer_tx_idle(peer)) {
+		dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+					pkt_entry, d_entry) {
+			if (pkt_entry == probe)
+				break;
+			if (pkt_entry->flags & (RXD_PKT_ACKED | RXD_PKT_SACKED |
+						RXD_PKT_IN_USE))
+				continue;
+			if (rxd_ep_retry_pkt(ep, peer, pkt_entry))
+				return;
+		}
+	}
+
+	rxd_get_base_hdr(probe)->flags |= RXD_ACK_REQ;
+	if (!rxd_ep_retry_pkt(ep, peer, probe)) {
+		peer->probe_time = probe->timestamp;
+		peer->probe_cnt++;
+	}
+}
+
+/*
+ * The timer runs from the later of the oldest outstanding send, the last
+ * ack for new data and the probe, as the peer may ack a window only once it
+ * has all of it.  On expiry every outstanding packet is presumed lost and
+ * resent together, so a window counts as one timeout.
+ */
+static void rxd_progress_pkt_list(struct rxd_ep *ep, struct rxd_peer *peer,
+				  uint64_t current)
+{
+	struct rxd_pkt_entry *pkt_entry;
+	uint64_t next, rto = UINT64_MAX, last = 0;
+	int head = 1;
 
-	current = ofi_gettime_ms();
 	if (peer->retry_cnt > RXD_MAX_PKT_RETRY) {
 		rxd_peer_timeout(ep, peer);
 		return;
 	}
 
+	next = rxd_detect_loss(ep, peer, current);
 	dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
 				pkt_entry, d_entry) {
-		if (pkt_entry->flags & (RXD_PKT_IN_USE | RXD_PKT_ACKED) ||
-		    current < rxd_get_retry_time(pkt_entry->timestamp, peer->retry_cnt))
-			break;
-		retry = 1;
-		ret = rxd_ep_send_pkt(ep, pkt_entry);
-		if (ret)
-			break;
+		if (!rxd_pkt_outstanding(pkt_entry, &head))
+			continue;
+		rto = MIN(rto, MAX(MAX(pkt_entry->timestamp, peer->ack_time),
+				   peer->probe_time) + peer->rto);
+		last = MAX(last, pkt_entry->timestamp);
 	}
-	if (retry)
-		peer->retry_cnt++;
 
-	if (!dlist_empty(&peer->unacked))
-		ep->next_retry = ep->next_retry == -1 ? peer->retry_cnt :
-				 MIN(ep->next_retry, peer->retry_cnt);
+	if (rto == UINT64_MAX)
+		return;
+
+	if (current >= rto) {
+		rxd_peer_backoff(peer);
+		head = 1;
+		dlist_foreach_container(&peer->unacked, struct rxd_pkt_entry,
+					pkt_entry, d_entry) {
+			if (!rxd_pkt_outstanding(pkt_entry, &head) ||
+			    pkt_entry->flags & RXD_PKT_IN_USE)
+				continue;
+			if (rxd_ep_retry_pkt(ep, peer, pkt_entry))
+				break;
+		}
+		rto = current + peer->rto;
+	} else if (!peer->retry_cnt && peer->probe_cnt < RXD_MAX_PROBES) {
+		last = MAX(last, peer->ack_time) + rxd_peer_pto(peer);
+		if (current >= last)
+			rxd_send_probe(ep, peer);
+		else
+			next = MIN(next, last);
+	}
+
+	rxd_peer_set_timer(ep, peer, MIN(next, rto));
 }
 
-void rxd_ep_progress(struct util_ep *util_ep)
+/*
+ * Peers with packets in flight, or with sends that could not be posted, sit
+ * on the timer wheel slot for the msec in which their timer expires.  A
+ * timer already due sooner is kept; the deadline is recomputed when it
+ * fires.
+ */
+void rxd_peer_set_timer(struct rxd_ep *ep, struct rxd_peer *peer,
+			uint64_t expire)
+{
+	uint64_t current, tick;
+	int delay;
+
+	if (!dlist_empty(&peer->timer_entry)) {
+		if (peer->timer_expire <= expire)
+			return;
+		dlist_remove(&peer->timer_entry);
+	} else {
+		ep->timer_cnt++;
+	}
+
+	peer->timer_expire = expire;
+	tick = MAX((expire + 999) / 1000, ep->timer_tick + 1);
+	dlist_insert_tail(&peer->timer_entry,
+			  &ep->timer_wheel[tick % RXD_TIMER_SLOTS]);
+
+	current = ofi_gettime_us();
+	delay = expire > current ? (int) ((expire - current + 999) / 1000) : 0;
+	ep->next_retry = ep->next_retry == -1 ? delay :
+			 MIN(ep->next_retry, delay);
+	rxd_progress_signal_timer(ep->progress, expire);
+}
+
+/*
+ * Visits the wheel slots up to the current msec.  A slot also holds timers
+ * a whole turn of the wheel or more away, which are left in place.  The
+ * time is taken before the core CQ is read, so a timer does not expire on
+ * acks that arrived while the ep was not progressed.
+ */
+static void rxd_progress_timers(struct rxd_ep *ep, uint64_t current)
 {
 	struct rxd_peer *peer;
+	struct dlist_entry *slot, *tmp;
+	uint64_t tick;
+	int i;
+
+	tick = current / 1000;
+	if (ep->timer_tick + RXD_TIMER_SLOTS < tick)
+		ep->timer_tick = tick - RXD_TIMER_SLOTS;
+
+	while (ep->timer_tick < tick) {
+		slot = &ep->timer_wheel[++ep->timer_tick % RXD_TIMER_SLOTS];
+		dlist_foreach_container_safe(slot, struct rxd_peer, peer,
+					     timer_entry, tmp) {
+			if (peer->timer_expire > current)
+				continue;
+
+			dlist_remove_init(&peer->timer_entry);
+			ep->timer_cnt--;
+			if (dlist_empty(&peer->unacked))
+				rxd_progress_tx_list(ep, peer);
+			else
+				rxd_progress_pkt_list(ep, peer, current);
+		}
+	}
+
+	ep->next_retry = -1;
+	for (i = 1; ep->timer_cnt && i <= RXD_TIMER_SLOTS; i++) {
+		if (!dlist_empty(&ep->timer_wheel[(tick + i) %
+						  RXD_TIMER_SLOTS])) {
+			ep->next_retry = i;
+			break;
+		}
+	}
+}
+
+/* Called with the ep lock held */
+void rxd_ep_do_progress(struct rxd_ep *ep)
+{
 	struct fi_cq_msg_entry cq_entry;
-	struct dlist_entry *tmp;
-	struct rxd_ep *ep;
+	uint64_t current;
 	ssize_t ret;
 	int i;
 
-	ep = container_of(util_ep, struct rxd_ep, util_ep);
+	current = ofi_gettime_us();
+
+	/* FI_MORE only holds a batch until the application next waits */
+	if (ep->tx_more)
+		(void) rxd_start_xfer(ep, ep->tx_more);
 
-	fastlock_acquire(&ep->util_ep.lock);
 	for(ret = 1, i = 0;
 	    ret > 0 && (!rxd_env.spin_count || i < rxd_env.spin_count);
 	    i++) {
@@ -966,23 +1447,41 @@ void rxd_ep_progress(struct util_ep *util_ep)
 			rxd_handle_send_comp(ep, &cq_entry);
 	}
 
-	if (!rxd_env.retry)
-		goto out;
+	if (rxd_env.retry)
+		rxd_progress_timers(ep, current);
 
-	ep->next_retry = -1;
-	dlist_foreach_container_safe(&ep->rts_sent_list, struct rxd_peer,
-				     peer, entry, tmp)
-		rxd_progress_pkt_list(ep, peer);
+	if (ep->mc)
+		rxd_coll_progress(ep);
+}
 
-	dlist_foreach_container_safe(&ep->active_peers, struct rxd_peer,
-				     peer, entry, tmp) {
-		rxd_progress_pkt_list(ep, peer);
-		if (dlist_empty(&peer->unacked))
-			rxd_progress_tx_list(ep, peer);
-	}
+/*
+ * With a progress thread running, the application only drives the ep when
+ * the thread is not already doing so, rather than waiting behind it.
+ */
+void rxd_ep_progress(struct util_ep *util_ep)
+{
+	struct rxd_ep *ep;
+	struct slist coll_comps;
 
-out:
+	ep = container_of(util_ep, struct rxd_ep, util_ep);
+	slist_init(&coll_comps);
+
+	if (ep->progress) {
+		if (fastlock_tryacquire(&ep->util_ep.lock))
+			goto coll;
+	} else {
+		fastlock_acquire(&ep->util_ep.lock);
+	}
+	rxd_ep_do_progress(ep);
+	coll_comps = ep->coll_comps;
+	slist_init(&ep->coll_comps);
 	fastlock_release(&ep->util_ep.lock);
+
+coll:
+	/* util_coll posts the next transfers of a collective through the
+	 * ep's own data path, which takes the ep lock */
+	if (ep->util_ep.caps & FI_COLLECTIVE)
+		rxd_coll_progress_comps(ep, &coll_comps);
 }
 
 static int rxd_buf_region_alloc_fn(struct ofi_bufpool_region *region)
@@ -1098,7 +1597,7 @@ static int rxd_entry_pool_create(struct rxd_ep *ep,
 
 int rxd_ep_init_res(struct rxd_ep *ep, struct fi_info *fi_info)
 {
-	int ret;
+	int ret, i;
 
 	ret = rxd_pkt_pool_create(ep, RXD_TX_POOL_CHUNK_CNT,
 				  &ep->tx_pkt_pool, RXD_BUF_POOL_TX);
@@ -1120,6 +1619,14 @@ int rxd_ep_init_res(struct rxd_ep *ep, struct fi_info *fi_info)
 	if (ret)
 		goto err;
 
+	ep->rx_win_size = roundup_power_of_two(rxd_env.max_unacked);
+	ret = ofi_bufpool_create(&ep->peer_pool, sizeof(struct rxd_peer) +
+				 ep->rx_win_size * sizeof(struct rxd_pkt_entry *),
+				 RXD_BUF_POOL_ALIGNMENT, rxd_env.max_peers,
+				 RXD_PEER_POOL_CHUNK_CNT, OFI_BUFPOOL_NO_TRACK);
+	if (ret)
+		goto err;
+
 	dlist_init(&ep->rx_list);
 	dlist_init(&ep->rx_tag_list);
 	dlist_init(&ep->active_peers);
@@ -1128,6 +1635,11 @@ int rxd_ep_init_res(struct rxd_ep *ep, struct fi_info *fi_info)
 	dlist_init(&ep->unexp_tag_list);
 	dlist_init(&ep->ctrl_pkts);
 	slist_init(&ep->rx_pkt_list);
+	slist_init(&ep->coll_comps);
+
+	for (i = 0; i < RXD_TIMER_SLOTS; i++)
+		dlist_init(&ep->timer_wheel[i]);
+	ep->timer_tick = ofi_gettime_ms();
 
 	return 0;
 err:
@@ -1136,35 +1648,111 @@ err:
 	return ret;
 }
 
-static void rxd_init_peer(struct rxd_ep *ep, uint64_t rxd_addr)
+static void rxd_init_peer(struct rxd_ep *ep, struct rxd_peer *peer)
 {
-	ep->peers[rxd_addr].peer_addr = FI_ADDR_UNSPEC;
-	ep->peers[rxd_addr].tx_seq_no = 0;
-	ep->peers[rxd_addr].rx_seq_no = 0;
-	ep->peers[rxd_addr].last_rx_ack = 0;
-	ep->peers[rxd_addr].last_tx_ack = 0;
-	ep->peers[rxd_addr].rx_window = rxd_env.max_unacked;
-	ep->peers[rxd_addr].tx_window = rxd_env.max_unacked;
-	ep->peers[rxd_addr].unacked_cnt = 0;
-	ep->peers[rxd_addr].retry_cnt = 0;
-	ep->peers[rxd_addr].active = 0;
-	dlist_init(&ep->peers[rxd_addr].unacked);
-	dlist_init(&ep->peers[rxd_addr].tx_list);
-	dlist_init(&ep->peers[rxd_addr].rx_list);
-	dlist_init(&ep->peers[rxd_addr].rma_rx_list);
-	dlist_init(&ep->peers[rxd_addr].buf_pkts);
+	peer->peer_addr = FI_ADDR_UNSPEC;
+	peer->tx_seq_no = 0;
+	peer->rx_seq_no = 0;
+	peer->last_rx_ack = 0;
+	peer->last_tx_ack = 0;
+	peer->rx_window = rxd_env.max_unacked;
+	peer->tx_window = rxd_env.max_unacked;
+	peer->unacked_cnt = 0;
+	peer->retry_cnt = 0;
+	peer->srtt = 0;
+	peer->rttvar = 0;
+	peer->rto = RXD_MIN_RTO;
+	peer->ack_time = 0;
+	peer->probe_time = 0;
+	peer->probe_cnt = 0;
+	peer->tx_order = 0;
+	peer->rack_order = 0;
+	peer->cwnd = rxd_env.max_unacked;
+	peer->ssthresh = rxd_env.max_unacked;
+	peer->cwnd_cnt = 0;
+	peer->lost_cnt = 0;
+	peer->recovery = 0;
+	peer->cwnd_cut = 0;
+	peer->recover_seq = 0;
+	peer->active = 0;
+	peer->rx_xfer = 0;
+	peer->curr_unexp = NULL;
+	peer->curr_rx_id = 0;
+	peer->curr_tx_id = 0;
+	peer->rx_batch_cnt = 0;
+	peer->tx_batch = NULL;
+	dlist_init(&peer->unacked);
+	dlist_init(&peer->tx_list);
+	dlist_init(&peer->rx_list);
+	dlist_init(&peer->rma_rx_list);
+	dlist_init(&peer->timer_entry);
+	peer->rx_win_cnt = 0;
+	memset(peer->rx_win, 0, ep->rx_win_size * sizeof(*peer->rx_win));
+}
+
+/*
+ * Peer state is allocated when an address is first sent to or heard from,
+ * so an endpoint only pays for the peers it talks to.  Returns NULL if it
+ * cannot be allocated.
+ */
+struct rxd_peer *rxd_get_peer(struct rxd_ep *ep, fi_addr_t rxd_addr)
+{
+	struct rxd_peer *peer;
+
+	peer = rxd_peer_lookup(ep, rxd_addr);
+	if (peer)
+		return peer;
+
+	peer = ofi_buf_alloc(ep->peer_pool);
+	if (!peer)
+		return NULL;
+
+	if (ofi_idm_set(&ep->peers, (int) rxd_addr, peer) < 0) {
+		ofi_buf_free(peer);
+		return NULL;
+	}
+
+	rxd_init_peer(ep, peer);
+	return peer;
 }
 
+static struct fi_ops_collective rxd_ops_collective = {
+	.size = sizeof(struct fi_ops_collective),
+	.barrier = ofi_ep_barrier,
+	.broadcast = ofi_ep_broadcast,
+	.alltoall = fi_coll_no_alltoall,
+	.allreduce = ofi_ep_allreduce,
+	.allgather = ofi_ep_allgather,
+	.reduce_scatter = fi_coll_no_reduce_scatter,
+	.reduce = fi_coll_no_reduce,
+	.scatter = ofi_ep_scatter,
+	.gather = fi_coll_no_gather,
+	.msg = fi_coll_no_msg,
+};
+
+static struct fi_ops_collective rxd_ops_collective_none = {
+	.size = sizeof(struct fi_ops_collective),
+	.barrier = fi_coll_no_barrier,
+	.broadcast = fi_coll_no_broadcast,
+	.alltoall = fi_coll_no_alltoall,
+	.allreduce = fi_coll_no_allreduce,
+	.allgather = fi_coll_no_allgather,
+	.reduce_scatter = fi_coll_no_reduce_scatter,
+	.reduce = fi_coll_no_reduce,
+	.scatter = fi_coll_no_scatter,
+	.gather = fi_coll_no_gather,
+	.msg = fi_coll_no_msg,
+};
+
 int rxd_endpoint(struct fid_domain *domain, struct fi_info *info,
 		 struct fid_ep **ep, void *context)
 {
 	struct fi_info *dg_info;
 	struct rxd_domain *rxd_domain;
 	struct rxd_ep *rxd_ep;
-	int ret, i;
+	int ret;
 
-	rxd_ep = calloc(1, sizeof(*rxd_ep) + sizeof(struct rxd_peer) *
-			rxd_env.max_peers);
+	rxd_ep = calloc(1, sizeof(*rxd_ep));
 	if (!rxd_ep)
 		return -FI_ENOMEM;
 
@@ -1176,6 +1764,10 @@ int rxd_endpoint(struct fid_domain *domain, struct fi_info *info,
 	if (ret)
 		goto err1;
 
+	rxd_ep->progress = rxd_domain->progress;
+	rxd_ep->tx_more = NULL;
+	dlist_init(&rxd_ep->progress_entry);
+
 	ret = ofi_get_core_info(rxd_domain->util_domain.fabric->fabric_fid.api_version,
 				NULL, NULL, 0, &rxd_util_prov, info, NULL,
 				rxd_info_to_core, &dg_info);
@@ -1199,15 +1791,20 @@ int rxd_endpoint(struct fid_domain *domain, struct fi_info *info,
 	rxd_ep->rx_msg_avail = rxd_ep->rx_size;
 	rxd_ep->tx_rma_avail = rxd_ep->tx_size;
 	rxd_ep->rx_rma_avail = rxd_ep->rx_size;
+
+	if ((info->caps & FI_COLLECTIVE) && rxd_env.mcast_addr) {
+		ret = rxd_coll_open(rxd_ep, dg_info);
+		if (ret) {
+			fi_freeinfo(dg_info);
+			goto err3;
+		}
+	}
 	fi_freeinfo(dg_info);
 
 	rxd_ep->next_retry = -1;
 	ret = rxd_ep_init_res(rxd_ep, info);
 	if (ret)
-		goto err3;
-
-	for (i = 0; i < rxd_env.max_peers; rxd_init_peer(rxd_ep, i++))
-		;
+		goto err4;
 
 	rxd_ep->util_ep.ep_fid.fid.ops = &rxd_ep_fi_ops;
 	rxd_ep->util_ep.ep_fid.cm = &rxd_ep_cm;
@@ -1216,10 +1813,16 @@ int rxd_endpoint(struct fid_domain *domain, struct fi_info *info,
 	rxd_ep->util_ep.ep_fid.tagged = &rxd_ops_tagged;
 	rxd_ep->util_ep.ep_fid.rma = &rxd_ops_rma;
 	rxd_ep->util_ep.ep_fid.atomic = &rxd_ops_atomic;
+	rxd_ep->util_ep.ep_fid.collective = info->caps & FI_COLLECTIVE ?
+					    &rxd_ops_collective :
+					    &rxd_ops_collective_none;
 
 	*ep = &rxd_ep->util_ep.ep_fid;
 	return 0;
 
+err4:
+	if (rxd_ep->mc)
+		rxd_coll_close(rxd_ep);
 err3:
 	fi_close(&rxd_ep->dg_ep->fid);
 err2:
@@ -55,6 +55,9 @@ static void rxd_init_env(void)
 	fi_param_get_bool(&rxd_prov, "retry", &rxd_env.retry);
 	fi_param_get_int(&rxd_prov, "max_peers", &rxd_env.max_peers);
 	fi_param_get_int(&rxd_prov, "max_unacked", &rxd_env.max_unacked);
+	fi_param_get_str(&rxd_prov, "progress_affinity",
+			 &rxd_env.progress_affinity);
+	fi_param_get_str(&rxd_prov, "mcast_addr", &rxd_env.mcast_addr);
 }
 
 void rxd_info_to_core_mr_modes(uint32_t version, const struct fi_info *hints,
@@ -90,21 +93,21 @@ int rxd_info_to_core(uint32_t version, const struct fi_info *rxd_info,
 int rxd_info_to_rxd(uint32_t version, const struct fi_info *core_info,
 		    const struct fi_info *base_info, struct fi_info *info)
 {
-	info->caps = ofi_pick_core_flags(rxd_info.caps, core_info->caps,
+	info->caps = ofi_pick_core_flags(base_info->caps, core_info->caps,
 					 FI_LOCAL_COMM | FI_REMOTE_COMM);
-	info->mode = rxd_info.mode;
+	info->mode = base_info->mode;
 
-	*info->tx_attr = *rxd_info.tx_attr;
+	*info->tx_attr = *base_info->tx_attr;
 	info->tx_attr->inject_size = MIN(core_info->ep_attr->max_msg_size,
 			RXD_MAX_MTU_SIZE) - (sizeof(struct rxd_base_hdr) +
 			core_info->ep_attr->msg_prefix_size +
 			sizeof(struct rxd_rma_hdr) + (RXD_IOV_LIMIT *
 			sizeof(struct ofi_rma_iov)) + sizeof(struct rxd_atom_hdr));
 
-	*info->rx_attr = *rxd_info.rx_attr;
-	*info->ep_attr = *rxd_info.ep_attr;
-	*info->domain_attr = *rxd_info.domain_attr;
-	info->domain_attr->caps = ofi_pick_core_flags(rxd_info.domain_attr->caps,
+	*info->rx_attr = *base_info->rx_attr;
+	*info->ep_attr = *base_info->ep_attr;
+	*info->domain_attr = *base_info->domain_attr;
+	info->domain_attr->caps = ofi_pick_core_flags(base_info->domain_attr->caps,
 						core_info->domain_attr->caps,
 						FI_LOCAL_COMM | FI_REMOTE_COMM);
 	if (core_info->nic) {
@@ -119,8 +122,26 @@ static int rxd_getinfo(uint32_t version, const char *node, const char *service,
 			uint64_t flags, const struct fi_info *hints,
 			struct fi_info **info)
 {
-	return ofix_getinfo(version, node, service, flags, &rxd_util_prov,
-			    hints, rxd_info_to_core, rxd_info_to_rxd, info);
+	struct fi_info *cur;
+	int ret;
+
+	ret = ofix_getinfo(version, node, service, flags, &rxd_util_prov,
+			   hints, rxd_info_to_core, rxd_info_to_rxd, info);
+	if (ret)
+		return ret;
+
+	/* Data progress is driven by the application unless it explicitly
+	 * asks for FI_PROGRESS_AUTO, which starts a progress thread per
+	 * domain.
+	 */
+	for (cur = *info; cur; cur = cur->next) {
+		if (!hints || !hints->domain_attr ||
+		    hints->domain_attr->data_progress != FI_PROGRESS_AUTO)
+			cur->domain_attr->data_progress = FI_PROGRESS_MANUAL;
+		else
+			cur->domain_attr->threading = FI_THREAD_SAFE;
+	}
+	return 0;
 }
 
 static void rxd_fini(void)
@@ -147,6 +168,15 @@ RXD_INI
 			"Maximum number of peers to track (default: 1024)");
 	fi_param_define(&rxd_prov, "max_unacked", FI_PARAM_INT,
 			"Maximum number of packets to send at once (default: 128)");
+	fi_param_define(&rxd_prov, "progress_affinity", FI_PARAM_STRING,
+			"If specified, bind the progress thread of "
+			"FI_PROGRESS_AUTO domains to the indicated range(s) of "
+			"Linux virtual processor ID(s). Usage: "
+			"id_start[-id_end[:stride]][,]");
+	fi_param_define(&rxd_prov, "mcast_addr", FI_PARAM_STRING,
+			"Multicast group used to send collective data to all "
+			"members at once, in FI_ADDR_STR format, e.g. "
+			"fi_sockaddr_in://239.255.0.1:47000 (default: none)");
 
 	rxd_init_env();
 
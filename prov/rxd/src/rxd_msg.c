@@ -77,7 +77,8 @@ static void rxd_progress_unexp_msg(struct rxd_ep *ep, struct rxd_x_entry *rx_ent
 {
 	struct rxd_pkt_entry *pkt_entry;
 	uint64_t num_segs = 0;
-	uint16_t curr_id = ep->peers[unexp_msg->base_hdr->peer].curr_rx_id;
+	struct rxd_peer *peer = rxd_peer(ep, unexp_msg->base_hdr->peer);
+	uint16_t curr_id = peer->curr_rx_id;
 
 	rxd_progress_op(ep, rx_entry, unexp_msg->pkt_entry, unexp_msg->base_hdr,
 			unexp_msg->sar_hdr, unexp_msg->tag_hdr,
@@ -93,11 +94,11 @@ static void rxd_progress_unexp_msg(struct rxd_ep *ep, struct rxd_x_entry *rx_ent
 		num_segs++;
 	}
 
-	if (ep->peers[unexp_msg->base_hdr->peer].curr_unexp) {
+	if (peer->curr_unexp) {
 		if (!unexp_msg->sar_hdr || num_segs == unexp_msg->sar_hdr->num_segs - 1)
-			ep->peers[unexp_msg->base_hdr->peer].curr_rx_id = curr_id;
+			peer->curr_rx_id = curr_id;
 		else
-			ep->peers[unexp_msg->base_hdr->peer].curr_unexp = NULL;
+			peer->curr_unexp = NULL;
 	}
 
 	rxd_free_unexp_msg(unexp_msg);
@@ -138,13 +139,14 @@ static int rxd_ep_discard_recv(struct rxd_ep *rxd_ep, void *context,
 			       struct rxd_unexp_msg *unexp_msg)
 {
 	uint64_t seq = unexp_msg->base_hdr->seq_no;
+	struct rxd_peer *peer;
 	int ret;
 
 	assert(unexp_msg->tag_hdr);
 	seq += unexp_msg->sar_hdr ? unexp_msg->sar_hdr->num_segs : 1;
 
-	rxd_ep->peers[unexp_msg->base_hdr->peer].rx_seq_no =
-			MAX(seq, rxd_ep->peers[unexp_msg->base_hdr->peer].rx_seq_no);
+	peer = rxd_peer(rxd_ep, unexp_msg->base_hdr->peer);
+	peer->rx_seq_no = MAX(seq, peer->rx_seq_no);
 	rxd_ep_send_ack(rxd_ep, unexp_msg->base_hdr->peer);
 
 	ret = ofi_cq_write(rxd_ep->util_ep.rx_cq, context, FI_TAGGED | FI_RECV,
@@ -308,6 +310,11 @@ static struct rxd_x_entry *rxd_tx_entry_init_msg(struct rxd_ep *ep, fi_addr_t ad
 	struct rxd_base_hdr *base_hdr;
 	void *ptr;
 
+	tx_entry = rxd_tx_entry_init_batch(ep, addr, op, iov, iov_count,
+					   tag, data, flags, context);
+	if (tx_entry)
+		return tx_entry;
+
 	tx_entry = rxd_tx_entry_init_common(ep, addr, op, iov, iov_count,
 					    tag, data, flags, context, &base_hdr, &ptr);
 	if (!tx_entry)
@@ -330,6 +337,7 @@ static struct rxd_x_entry *rxd_tx_entry_init_msg(struct rxd_ep *ep, fi_addr_t ad
 		tx_entry->flags |= RXD_INLINE;
 		base_hdr->flags = tx_entry->flags;
 		tx_entry->num_segs = 1;
+		rxd_peer(ep, addr)->tx_batch = tx_entry;
 	}
 
 	tx_entry->bytes_done = rxd_init_msg(&ptr, tx_entry->iov,
@@ -342,6 +350,30 @@ static struct rxd_x_entry *rxd_tx_entry_init_msg(struct rxd_ep *ep, fi_addr_t ad
 	return tx_entry;
 }
 
+/*
+ * Sends the packet holding a new message.  An inline message may have
+ * joined, or started, a batch that later messages can still join.  With
+ * FI_MORE the batch is held back for the next message instead, until the
+ * application next drives progress.
+ */
+static int rxd_start_msg(struct rxd_ep *ep, struct rxd_x_entry *tx_entry,
+			 uint32_t rxd_flags)
+{
+	struct rxd_x_entry *batch = rxd_peer(ep, tx_entry->peer)->tx_batch;
+
+	if (!batch)
+		return rxd_start_xfer(ep, tx_entry);
+
+	if (rxd_flags & RXD_MORE) {
+		if (ep->tx_more && ep->tx_more != batch)
+			(void) rxd_start_xfer(ep, ep->tx_more);
+		ep->tx_more = batch;
+		return 0;
+	}
+
+	return rxd_start_xfer(ep, batch);
+}
+
 ssize_t rxd_ep_generic_inject(struct rxd_ep *rxd_ep, const struct iovec *iov,
 			      size_t iov_count, fi_addr_t addr, uint64_t tag,
 			      uint64_t data, uint32_t op, uint32_t rxd_flags)
@@ -371,8 +403,8 @@ ssize_t rxd_ep_generic_inject(struct rxd_ep *rxd_ep, const struct iovec *iov,
 		goto out;
 	}
 
-	if (rxd_ep->peers[rxd_addr].peer_addr != FI_ADDR_UNSPEC)
-		(void) rxd_start_xfer(rxd_ep, tx_entry);
+	if (rxd_peer(rxd_ep, rxd_addr)->peer_addr != FI_ADDR_UNSPEC)
+		(void) rxd_start_msg(rxd_ep, tx_entry, rxd_flags);
 
 out:
 	fastlock_release(&rxd_ep->util_ep.lock);
@@ -409,10 +441,10 @@ ssize_t rxd_ep_generic_sendmsg(struct rxd_ep *rxd_ep, const struct iovec *iov,
 	if (!tx_entry)
 		goto out;
 
-	if (rxd_ep->peers[rxd_addr].peer_addr == FI_ADDR_UNSPEC)
+	if (rxd_peer(rxd_ep, rxd_addr)->peer_addr == FI_ADDR_UNSPEC)
 		goto out;
 
-	ret = rxd_start_xfer(rxd_ep, tx_entry);
+	ret = rxd_start_msg(rxd_ep, tx_entry, rxd_flags);
 	if (ret && tx_entry->num_segs > 1)
 		(void) rxd_ep_post_data_pkts(rxd_ep, tx_entry);
 
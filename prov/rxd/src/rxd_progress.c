@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2021 Intel Corporation, Inc.  All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+
+#include "rxd.h"
+
+#define RXD_PROGRESS_EVENTS	16
+
+/*
+ * Returns how long the thread may sleep: until the nearest retransmit
+ * timer, without limit if none is armed, or not at all if a core CQ still
+ * holds completions.
+ */
+static int rxd_progress_timeout(struct rxd_progress *progress)
+{
+	struct rxd_ep *ep;
+	int timeout = -1;
+
+	dlist_foreach_container(&progress->ep_list, struct rxd_ep, ep,
+				progress_entry) {
+		fastlock_acquire(&ep->util_ep.lock);
+		if (rxd_ep_trywait(ep))
+			timeout = 0;
+		else if (ep->next_retry != -1)
+			timeout = timeout == -1 ? ep->next_retry :
+				  MIN(timeout, ep->next_retry);
+		fastlock_release(&ep->util_ep.lock);
+	}
+	return timeout;
+}
+
+static void *rxd_progress_thread(void *arg)
+{
+	struct rxd_progress *progress = arg;
+	void *contexts[RXD_PROGRESS_EVENTS];
+	struct rxd_ep *ep;
+	int timeout, nfds, i, ret;
+
+	if (rxd_env.progress_affinity) {
+		ret = ofi_set_thread_affinity(rxd_env.progress_affinity);
+		if (ret)
+			FI_WARN(&rxd_prov, FI_LOG_DOMAIN,
+				"unable to set progress thread affinity: %s\n",
+				fi_strerror(-ret));
+	}
+
+	fastlock_acquire(&progress->lock);
+	while (progress->run) {
+		ofi_atomic_set64(&progress->wake_time, 0);
+		dlist_foreach_container(&progress->ep_list, struct rxd_ep, ep,
+					progress_entry) {
+			fastlock_acquire(&ep->util_ep.lock);
+			rxd_ep_do_progress(ep);
+			fastlock_release(&ep->util_ep.lock);
+		}
+
+		/* From here on, timers armed by the application signal us
+		 * if they are due before we would wake up */
+		ofi_atomic_set64(&progress->wake_time, INT64_MAX);
+		timeout = rxd_progress_timeout(progress);
+		if (timeout > 0)
+			ofi_atomic_set64(&progress->wake_time,
+					 ofi_gettime_us() + timeout * 1000);
+		fastlock_release(&progress->lock);
+
+		if (timeout) {
+			nfds = ofi_epoll_wait(progress->epoll_fd, contexts,
+					      RXD_PROGRESS_EVENTS, timeout);
+			for (i = 0; i < nfds; i++) {
+				if (contexts[i] == &progress->signal)
+					fd_signal_reset(&progress->signal);
+			}
+		}
+		fastlock_acquire(&progress->lock);
+	}
+	fastlock_release(&progress->lock);
+	return NULL;
+}
+
+int rxd_progress_add_ep(struct rxd_ep *ep)
+{
+	struct rxd_progress *progress = ep->progress;
+	int ret;
+
+	if (!progress)
+		return 0;
+
+	fastlock_acquire(&progress->lock);
+	ret = ofi_epoll_add(progress->epoll_fd, ep->dg_cq_fd, OFI_EPOLL_IN, ep);
+	if (ret) {
+		FI_WARN(&rxd_prov, FI_LOG_EP_CTRL,
+			"unable to add ep to progress thread: %s\n",
+			fi_strerror(-ret));
+	} else {
+		dlist_insert_tail(&ep->progress_entry, &progress->ep_list);
+	}
+	fastlock_release(&progress->lock);
+
+	fd_signal_set(&progress->signal);
+	return ret;
+}
+
+/* Once this returns the progress thread no longer references the ep */
+void rxd_progress_del_ep(struct rxd_ep *ep)
+{
+	struct rxd_progress *progress = ep->progress;
+
+	if (!progress)
+		return;
+
+	fastlock_acquire(&progress->lock);
+	if (!dlist_empty(&ep->progress_entry)) {
+		(void) ofi_epoll_del(progress->epoll_fd, ep->dg_cq_fd);
+		dlist_remove_init(&ep->progress_entry);
+	}
+	fastlock_release(&progress->lock);
+}
+
+int rxd_progress_init(struct rxd_domain *domain)
+{
+	struct rxd_progress *progress;
+	int ret;
+
+	progress = calloc(1, sizeof(*progress));
+	if (!progress)
+		return -FI_ENOMEM;
+
+	ret = ofi_epoll_create(&progress->epoll_fd);
+	if (ret)
+		goto err1;
+
+	ret = fd_signal_init(&progress->signal);
+	if (ret)
+		goto err2;
+
+	ret = ofi_epoll_add(progress->epoll_fd,
+			    fd_signal_get(&progress->signal),
+			    OFI_EPOLL_IN, &progress->signal);
+	if (ret)
+		goto err3;
+
+	ret = fastlock_init(&progress->lock);
+	if (ret)
+		goto err3;
+
+	dlist_init(&progress->ep_list);
+	ofi_atomic_initialize64(&progress->wake_time, 0);
+	progress->run = 1;
+
+	ret = pthread_create(&progress->thread, NULL,
+			     rxd_progress_thread, progress);
+	if (ret) {
+		FI_WARN(&rxd_prov, FI_LOG_DOMAIN,
+			"unable to start progress thread\n");
+		ret = -ret;
+		goto err4;
+	}
+
+	domain->progress = progress;
+	return 0;
+err4:
+	fastlock_destroy(&progress->lock);
+err3:
+	fd_signal_free(&progress->signal);
+err2:
+	ofi_epoll_close(progress->epoll_fd);
+err1:
+	free(progress);
+	return ret;
+}
+
+void rxd_progress_close(struct rxd_domain *domain)
+{
+	struct rxd_progress *progress = domain->progress;
+
+	if (!progress)
+		return;
+
+	fastlock_acquire(&progress->lock);
+	progress->run = 0;
+	fastlock_release(&progress->lock);
+
+	fd_signal_set(&progress->signal);
+	pthread_join(progress->thread, NULL);
+
+	fastlock_destroy(&progress->lock);
+	fd_signal_free(&progress->signal);
+	ofi_epoll_close(progress->epoll_fd);
+	free(progress);
+	domain->progress = NULL;
+}
@@ -60,7 +60,11 @@
 	FUNC(RXD_ACK),			\
 	FUNC(RXD_DATA),			\
 	FUNC(RXD_DATA_READ),		\
-	FUNC(RXD_NO_OP)
+	FUNC(RXD_NO_OP),		\
+	FUNC(RXD_BATCH),		\
+	FUNC(RXD_MC_DATA),		\
+	FUNC(RXD_MC_NACK),		\
+	FUNC(RXD_MC_ACK)
 
 enum rxd_pkt_type {
 	RXD_FOREACH_TYPE(OFI_ENUM_VAL)
@@ -111,20 +115,27 @@ struct rxd_rts_pkt {
  * Clear to send: response to RTS request
  * 	- rts_addr: peer address packet is responding to
  * 	- cts_addr: local address for peer
+ * 	- credits: receive window granted to the peer, in packets
  */
 struct rxd_cts_pkt {
 	struct	rxd_base_hdr	base_hdr;
 	uint64_t		rts_addr;
 	uint64_t		cts_addr;
+	uint64_t		credits;
 };
 
 /*
  * ACK: to signal received packets and send tx/rx id info
+ * 	- base_hdr.seq_no: next sequence number expected (cumulative)
+ * 	- ext_hdr.rx_id: receive window granted to the peer, in packets
+ * 	- sack: bit i set if packet seq_no + 1 + i is buffered out of order
  */
+#define RXD_SACK_BITS		64
+
 struct rxd_ack_pkt {
 	struct rxd_base_hdr	base_hdr;
 	struct rxd_ext_hdr	ext_hdr;
-	//TODO fill in more fields? Selective ack?
+	uint64_t		sack;
 };
 
 /*
@@ -137,6 +148,51 @@ struct rxd_data_pkt {
 	char			msg[];
 };
 
+/*
+ * Batch: small messages to the same peer sent in one packet
+ * 	- base_hdr.type is RXD_BATCH and base_hdr.seq_no is shared by all of
+ * 	  the messages
+ * 	- each message starts with a batch_hdr, followed by the tag_hdr and
+ * 	  data_hdr its flags indicate and then size bytes of data.  The
+ * 	  batch_hdr takes the place of the base_hdr of a single packet
+ * 	  message, and entries are not aligned
+ */
+struct rxd_batch_hdr {
+	uint16_t	size;
+	uint8_t		type;
+	uint8_t		flags;
+};
+
+/*
+ * Multicast: collective data that a root sends to its group at once, see
+ * rxd_coll.c.  Members answer the root directly.
+ * 	- base_hdr.type: RXD_MC_DATA from the root to the multicast group,
+ * 	  or to a member repairing its NACK or polling it, RXD_MC_NACK and
+ * 	  RXD_MC_ACK from a member to the root
+ * 	- base_hdr.peer: unused, members may not have peer state for the root
+ * 	- base_hdr.seq_no: segment number of the data, or the number of
+ * 	  segments the member holds in order, which is the first segment a
+ * 	  NACK asks for
+ * 	- cid: id of the collective, the same on every member of the group
+ * 	- rank: the root's rank for data, the member's own for NACK and ACK
+ * 	- size: total size of the data
+ * 	- seg_size: data carried by every segment but the last
+ * 	- name_len: data only, length of the root's address that precedes the
+ * 	  data, which tells groups sharing the multicast address apart
+ * 	- sack: NACK only, bit i set if segment seq_no + 1 + i is missing too
+ */
+struct rxd_mc_pkt {
+	struct rxd_base_hdr	base_hdr;
+	uint32_t		cid;
+	uint32_t		rank;
+	uint64_t		size;
+	uint32_t		seg_size;
+	uint32_t		name_len;
+	uint64_t		sack;
+
+	uint8_t			data[];
+};
+
 /*
  * The below five headers are used for op pkts and can be used in combination.
  * The presence of each header is determined by either op type or flags (in base_hr).
@@ -60,17 +60,20 @@
 
 #define RXM_CM_DATA_VERSION	1
 #define RXM_OP_VERSION		3
-#define RXM_CTRL_VERSION	4
+#define RXM_CTRL_VERSION	5
 
 #define RXM_BUF_SIZE	16384
 extern size_t rxm_eager_limit;
 
 #define RXM_SAR_LIMIT	131072
+#define RXM_SAR_SEG_ALIGN	64
 #define RXM_SAR_TX_ERROR	UINT64_MAX
 #define RXM_SAR_RX_INIT		UINT64_MAX
 
 #define RXM_IOV_LIMIT 4
 
+#define RXM_MATCH_HASH_SIZE	256
+
 #define RXM_MR_MODES	(OFI_MR_BASIC_MAP | FI_MR_LOCAL)
 
 #define RXM_PASSTHRU_TX_OP_FLAGS (FI_TRANSMIT_COMPLETE)
@@ -132,6 +135,7 @@ extern int force_auto_progress;
 extern enum fi_wait_obj def_wait_obj, def_tcp_wait_obj;
 
 struct rxm_ep;
+struct rxm_tx_eager_buf;
 
 
 /*
@@ -208,11 +212,28 @@ struct rxm_cmap {
 	struct dlist_entry	peer_list;
 	struct rxm_cmap_attr	attr;
 	pthread_t		cm_thread;
+
+	/* MSG EQ events read by the CM thread and handled by ep progress
+	 * or the CM thread.  The CM thread is the only writer and advances
+	 * event_tail; event_head is advanced under the ep lock. */
+	char			*event_ring;
+	ofi_atomic64_t		event_head;
+	ofi_atomic64_t		event_tail;
 	ofi_fastlock_acquire_t	acquire;
 	ofi_fastlock_release_t	release;
 	fastlock_t		lock;
 };
 
+#define RXM_CM_EVENT_RING_SIZE	64
+#define RXM_CM_HANDOFF_TIMEOUT	10 /* ms */
+
+static inline bool rxm_cmap_events_pending(struct rxm_cmap *cmap)
+{
+	return cmap && cmap->event_ring &&
+	       ofi_atomic_get64(&cmap->event_head) !=
+	       ofi_atomic_get64(&cmap->event_tail);
+}
+
 enum rxm_cmap_reject_reason {
 	RXM_CMAP_REJECT_UNSPEC,
 	RXM_CMAP_REJECT_GENUINE,
@@ -226,7 +247,8 @@ union rxm_cm_data {
 		uint8_t ctrl_version;
 		uint8_t op_version;
 		uint16_t port;
-		uint8_t padding[2];
+		/* Length of the eager packet following the CM data */
+		uint16_t eager_len;
 		uint32_t eager_size;
 		uint32_t rx_size;
 		uint64_t client_conn_id;
@@ -235,8 +257,27 @@ union rxm_cm_data {
 	struct _accept {
 		uint64_t server_conn_id;
 		uint32_t rx_size;
+		/* Addresses of the server's additional rails, each
+		 * rail_addrlen bytes, follow the CM data */
+		uint8_t rail_cnt;
+		uint8_t rail_addrlen;
+		uint8_t padding[2];
+		/* Length of the client's eager packet that was delivered.
+		 * Older peers send no such field and drop the packet. */
+		uint16_t eager_len;
 	} accept;
 
+	/* Connects an additional rail of an established connection */
+	struct _rail {
+		uint8_t version;
+		uint8_t endianness;
+		uint8_t ctrl_version;
+		uint8_t op_version;
+		uint32_t index;
+		uint64_t server_conn_id;
+		uint64_t client_conn_id;
+	} rail;
+
 	struct _reject {
 		uint8_t version;
 		uint8_t reason;
@@ -253,6 +294,9 @@ void rxm_cmap_process_shutdown(struct rxm_cmap *cmap,
 			       struct rxm_cmap_handle *handle);
 int rxm_cmap_connect(struct rxm_ep *rxm_ep, fi_addr_t fi_addr,
 		     struct rxm_cmap_handle *handle);
+int rxm_cmap_connect_eager(struct rxm_ep *rxm_ep,
+			   struct rxm_cmap_handle *handle,
+			   struct rxm_tx_eager_buf *tx_buf);
 void rxm_cmap_del_handle_ts(struct rxm_cmap_handle *handle);
 void rxm_cmap_free(struct rxm_cmap *cmap);
 int rxm_cmap_alloc(struct rxm_ep *rxm_ep, struct rxm_cmap_attr *attr);
@@ -340,8 +384,13 @@ struct rxm_atomic_resp_hdr {
 	FUNC(RXM_RNDV_ACK_SENT),	\
 	FUNC(RXM_RNDV_ACK_RECVD),	\
 	FUNC(RXM_RNDV_FINISH),		\
+	FUNC(RXM_RNDV_WRITE),		\
+	FUNC(RXM_RNDV_CTS_SENT),	\
+	FUNC(RXM_RNDV_DONE_WAIT),	\
+	FUNC(RXM_RNDV_DONE_RECVD),	\
 	FUNC(RXM_ATOMIC_RESP_WAIT),	\
-	FUNC(RXM_ATOMIC_RESP_SENT)
+	FUNC(RXM_ATOMIC_RESP_SENT),	\
+	FUNC(RXM_AGG_TX)
 
 enum rxm_proto_state {
 	RXM_PROTO_STATES(OFI_ENUM_VAL)
@@ -356,7 +405,11 @@ enum {
 	rxm_ctrl_rndv_ack,
 	rxm_ctrl_atomic,
 	rxm_ctrl_atomic_resp,
-	rxm_ctrl_credit
+	rxm_ctrl_credit,
+	rxm_ctrl_rndv_wr,
+	rxm_ctrl_rndv_cts,
+	rxm_ctrl_rndv_done,
+	rxm_ctrl_agg
 };
 
 struct rxm_pkt {
@@ -389,6 +442,17 @@ rxm_sar_set_seg_type(struct ofi_ctrl_hdr *ctrl_hdr, enum rxm_sar_seg_type seg_ty
 	((union rxm_sar_ctrl_data *)&(ctrl_hdr->ctrl_data))->seg_type = seg_type;
 }
 
+static inline uint32_t rxm_sar_get_offset(struct ofi_ctrl_hdr *ctrl_hdr)
+{
+	return ((union rxm_sar_ctrl_data *)&(ctrl_hdr->ctrl_data))->offset;
+}
+
+static inline void
+rxm_sar_set_offset(struct ofi_ctrl_hdr *ctrl_hdr, uint32_t offset)
+{
+	((union rxm_sar_ctrl_data *)&(ctrl_hdr->ctrl_data))->offset = offset;
+}
+
 struct rxm_recv_match_attr {
 	fi_addr_t addr;
 	uint64_t tag;
@@ -397,8 +461,10 @@ struct rxm_recv_match_attr {
 
 struct rxm_unexp_msg {
 	struct dlist_entry entry;
+	struct dlist_entry hash_entry;
 	fi_addr_t addr;
 	uint64_t tag;
+	uint64_t seq;
 };
 
 struct rxm_iov {
@@ -418,7 +484,8 @@ enum rxm_buf_pool_type {
 	RXM_BUF_POOL_TX_ATOMIC,
 	RXM_BUF_POOL_TX_CREDIT,
 	RXM_BUF_POOL_TX_SAR,
-	RXM_BUF_POOL_TX_END	= RXM_BUF_POOL_TX_SAR,
+	RXM_BUF_POOL_TX_AGG,
+	RXM_BUF_POOL_TX_END	= RXM_BUF_POOL_TX_AGG,
 	RXM_BUF_POOL_RMA,
 	RXM_BUF_POOL_MAX,
 };
@@ -448,11 +515,21 @@ struct rxm_rx_buf {
 	// TODO remove this and modify unexp msg handling path to not repost
 	// rx_buf
 	uint8_t repost;
+	/* Counted in rxm_ep->rx_unhandled until the completion is handled */
+	uint8_t unhandled;
+	/* The MSG provider placed the payload in recv_entry's buffer */
+	uint8_t direct_recv;
 
 	/* Used for large messages */
 	struct rxm_rndv_hdr *rndv_hdr;
 	size_t rndv_rma_index;
+	/* MSG EP the rendezvous data is read through */
+	struct fid_ep *rndv_ep;
 	struct fid_mr *mr[RXM_IOV_LIMIT];
+	/* Write rendezvous waiting for DONE, on rxm_conn::rndv_write_rx_list */
+	struct dlist_entry rndv_entry;
+	/* Reported instead of the data if the write rendezvous failed */
+	int rndv_err;
 
 	/* Must stay at bottom */
 	struct rxm_pkt pkt;
@@ -477,6 +554,35 @@ struct rxm_tx_eager_buf {
 	struct rxm_pkt pkt;
 };
 
+/* Small messages to the same peer are packed into one rxm_ctrl_agg packet.
+ * Each message starts with this header and its data is padded to 8 bytes. */
+#define RXM_AGG_MAX_MSGS	64
+#define RXM_AGG_REMOTE_CQ_DATA	(1 << 0)
+
+struct rxm_agg_hdr {
+	uint64_t tag;
+	uint64_t data;
+	uint32_t size;
+	uint8_t op;
+	uint8_t flags;
+	uint8_t resv[2];
+};
+
+struct rxm_tx_agg_buf {
+	/* Must stay at top */
+	struct rxm_buf hdr;
+
+	size_t count;
+	struct {
+		void *app_context;
+		uint64_t flags;
+		uint8_t op;
+	} msg[RXM_AGG_MAX_MSGS];
+
+	/* Must stay at bottom */
+	struct rxm_pkt pkt;
+};
+
 struct rxm_tx_sar_buf {
 	/* Must stay at top */
 	struct rxm_buf hdr;
@@ -484,6 +590,14 @@ struct rxm_tx_sar_buf {
 	void *app_context;
 	uint64_t flags;
 
+	/* Only used in the first segment, which lives until every segment
+	 * of the message has completed */
+	struct {
+		struct rxm_conn *conn;
+		size_t segs_left;
+		bool failed;
+	} msg;
+
 	/* Must stay at bottom */
 	struct rxm_pkt pkt;
 };
@@ -497,6 +611,29 @@ struct rxm_tx_rndv_buf {
 	struct fid_mr *mr[RXM_IOV_LIMIT];
 	uint8_t count;
 
+	/* Used when the receiver's buffer is written to (rxm_ctrl_rndv_wr) */
+	struct {
+		struct iovec iov[RXM_IOV_LIMIT];
+		void *desc[RXM_IOV_LIMIT];
+		struct rxm_conn *conn;
+		/* Rail the data and DONE are sent through */
+		struct fid_ep *msg_ep;
+		/* Target buffers and rx_buf index returned in the CTS */
+		struct rxm_rndv_hdr remote;
+		uint64_t remote_id;
+		uint8_t remote_index;
+		size_t index;
+		size_t offset;
+		/* MSG provider operations not yet completed */
+		size_t pending;
+		struct rxm_tx_base_buf *done_buf;
+		bool done_posted;
+		/* Queued for rxm_ep_progress_deferred_queue */
+		bool deferred;
+		/* First error, reported once nothing is outstanding */
+		int err;
+	} write;
+
 	/* Must stay at bottom */
 	struct rxm_pkt pkt;
 };
@@ -535,6 +672,8 @@ enum rxm_deferred_tx_entry_type {
 	RXM_DEFERRED_TX_SAR_SEG,
 	RXM_DEFERRED_TX_ATOMIC_RESP,
 	RXM_DEFERRED_TX_CREDIT_SEND,
+	RXM_DEFERRED_TX_RNDV_CTS,
+	RXM_DEFERRED_TX_RNDV_WRITE,
 };
 
 struct rxm_deferred_tx_entry {
@@ -553,22 +692,13 @@ struct rxm_deferred_tx_entry {
 			struct rxm_iov rxm_iov;
 		} rndv_read;
 		struct {
-			struct rxm_tx_sar_buf *cur_seg_tx_buf;
-			struct {
-				struct iovec iov[RXM_IOV_LIMIT];
-				uint8_t count;
-				size_t cur_iov_offset;
-				uint64_t data;
-				uint64_t tag;
-			} payload;
+			struct rxm_tx_sar_buf *first_tx_buf;
+			struct iovec iov[RXM_IOV_LIMIT];
+			uint8_t count;
+			size_t iov_offset;
+			size_t seg_size;
 			size_t next_seg_no;
 			size_t segs_cnt;
-			uint8_t op;
-			size_t total_len;
-			size_t remain_len;
-			uint64_t msg_id;
-			void *app_context;
-			uint64_t flags;
 		} sar_seg;
 		struct {
 			struct rxm_tx_atomic_buf *tx_buf;
@@ -577,6 +707,12 @@ struct rxm_deferred_tx_entry {
 		struct {
 			struct rxm_tx_base_buf *tx_buf;
 		} credit_msg;
+		struct {
+			struct rxm_rx_buf *rx_buf;
+		} rndv_cts;
+		struct {
+			struct rxm_tx_rndv_buf *tx_buf;
+		} rndv_write;
 	};
 };
 
@@ -588,6 +724,7 @@ struct rxm_recv_entry {
 	uint64_t flags;
 	uint64_t tag;
 	uint64_t ignore;
+	uint64_t seq;
 	uint64_t comp_flags;
 	size_t total_len;
 	struct rxm_recv_queue *recv_queue;
@@ -601,7 +738,7 @@ struct rxm_recv_entry {
 	} sar;
 	/* Used for Rendezvous protocol */
 	struct {
-		/* This is used to send RNDV ACK */
+		/* This is used to send RNDV ACK or CTS */
 		struct rxm_tx_base_buf *tx_buf;
 	} rndv;
 };
@@ -613,12 +750,28 @@ enum rxm_recv_queue_type {
 	RXM_RECV_QUEUE_TAGGED,
 };
 
+/*
+ * Posted receives that name both a source (when FI_DIRECTED_RECV is
+ * enabled) and an exact tag are hashed by (source, tag) into recv_hash.
+ * Receives using any wildcard stay in recv_list in the order they were
+ * posted.  Every receive is stamped with a sequence number, so an incoming
+ * message that matches both a hashed and a wildcard receive is given to
+ * the one posted first.
+ *
+ * Unexpected messages are hashed the same way into unexp_hash and are
+ * also kept in arrival order on unexp_msg_list, which is searched by
+ * wildcard receives.
+ */
 struct rxm_recv_queue {
 	struct rxm_ep *rxm_ep;
 	enum rxm_recv_queue_type type;
 	struct rxm_recv_fs *fs;
 	struct dlist_entry recv_list;
 	struct dlist_entry unexp_msg_list;
+	struct dlist_entry recv_hash[RXM_MATCH_HASH_SIZE];
+	struct dlist_entry unexp_hash[RXM_MATCH_HASH_SIZE];
+	uint64_t seq;
+	bool directed;
 	dlist_func_t *match_recv;
 	dlist_func_t *match_unexp;
 };
@@ -639,10 +792,12 @@ struct rxm_msg_eq_entry {
 	struct fi_eq_cm_entry	cm_entry;
 };
 
+/* Connection requests may carry an eager packet after the CM data */
+#define RXM_MAX_CM_DATA_SIZE	256
 #define RXM_MSG_EQ_ENTRY_SZ (sizeof(struct rxm_msg_eq_entry) + \
-			     sizeof(union rxm_cm_data))
+			     RXM_MAX_CM_DATA_SIZE)
 #define RXM_CM_ENTRY_SZ (sizeof(struct fi_eq_cm_entry) + \
-			 sizeof(union rxm_cm_data))
+			 RXM_MAX_CM_DATA_SIZE)
 
 struct rxm_eager_ops {
 	int (*comp_tx)(struct rxm_ep *rxm_ep,
@@ -650,6 +805,35 @@ struct rxm_eager_ops {
 	ssize_t (*handle_rx)(struct rxm_rx_buf *rx_buf);
 };
 
+/* MSG CQ entries read, and user completions written, per batch */
+#define RXM_COMP_BATCH_SIZE 16
+
+struct rxm_comp {
+	struct util_cq		*cq;
+	struct fi_cq_tagged_entry comp;
+	fi_addr_t		src_addr;
+};
+
+/*
+ * While progress handles a batch of MSG CQ entries, successful user
+ * completions are collected here and written with one CQ lock acquisition.
+ */
+struct rxm_comp_batch {
+	bool			active;
+	size_t			count;
+	struct rxm_comp		comp[RXM_COMP_BATCH_SIZE];
+};
+
+/* Rail 0 is rxm_conn->msg_ep, the others are opened once it connects */
+#define RXM_MAX_RAILS 4
+
+/* Local interface of an additional rail */
+struct rxm_ep_rail {
+	struct fi_info *info;
+	struct fid_pep *pep;
+	struct sockaddr_storage name;
+};
+
 struct rxm_ep {
 	struct util_ep 		util_ep;
 	struct fi_info 		*rxm_info;
@@ -674,16 +858,45 @@ struct rxm_ep {
 	size_t			inject_limit;
 	size_t			eager_limit;
 	size_t			sar_limit;
+	/* SAR segments in flight per connection */
+	size_t			sar_window;
+	/* Rendezvous messages at least this large use RMA write */
+	size_t			rndv_write_min;
+	/* Largest message sent inside a connection request */
+	size_t			cm_eager_size;
+	/* Messages the MSG provider has started to receive whose
+	 * completions are not handled yet */
+	size_t			rx_unhandled;
+	/* Flow control credits granted to each peer, 0 if disabled */
+	size_t			flow_ctrl_credits;
+	uint64_t		flow_ctrl_stalls;
+	uint64_t		flow_ctrl_stall_ns;
 
 	struct rxm_buf_pool	*buf_pools;
 
 	struct dlist_entry	repost_ready_list;
 	struct dlist_entry	deferred_tx_conn_queue;
+	/* Connections that owe their peer credits */
+	struct dlist_entry	credit_return_list;
+	/* Messages up to this size are aggregated, 0 if disabled */
+	size_t			agg_size;
+	/* Connections with an aggregate not yet sent */
+	struct dlist_entry	agg_conn_list;
+	/* Local interfaces of additional rails */
+	struct rxm_ep_rail	rails[RXM_MAX_RAILS - 1];
+	size_t			rail_cnt;
+	size_t			rail_addrlen;
 
 	struct rxm_recv_queue	recv_queue;
 	struct rxm_recv_queue	trecv_queue;
 
 	struct rxm_eager_ops	*eager_ops;
+	struct rxm_comp_batch	comp_batch;
+};
+
+struct rxm_conn_rail {
+	struct fid_ep *msg_ep;
+	bool connected;
 };
 
 struct rxm_conn {
@@ -702,10 +915,50 @@ struct rxm_conn {
 	struct dlist_entry deferred_tx_queue;
 	struct dlist_entry sar_rx_msg_list;
 	struct dlist_entry sar_deferred_rx_msg_list;
+	struct dlist_entry rndv_write_rx_list;
 
 	uint32_t rndv_tx_credits;
+	/* SAR segments that may still be sent before one completes */
+	size_t sar_tx_credits;
+	/* Message carried by our connection request, held until the
+	 * peer has it */
+	struct rxm_tx_eager_buf *connect_tx_buf;
+
+	/* Set once the peer grants flow control credits.  tx_credits is
+	 * the number of messages the peer still has room for, rx_credits
+	 * the number of its messages matched here but not yet returned. */
+	bool flow_ctrl;
+	ssize_t tx_credits;
+	size_t rx_credits;
+	uint64_t stall_start;
+	struct dlist_entry credit_entry;
+
+	/* Small messages waiting to be sent together */
+	struct rxm_tx_agg_buf *agg_buf;
+	struct dlist_entry agg_entry;
+
+	/* Additional rails to the peer, which rendezvous data transfers
+	 * use in turn with msg_ep */
+	struct rxm_conn_rail rails[RXM_MAX_RAILS - 1];
+	size_t rail_next;
 };
 
+/* Only rendezvous data is spread over rails, everything that is matched
+ * or must stay ordered goes through msg_ep */
+static inline struct fid_ep *rxm_conn_rail_ep(struct rxm_conn *rxm_conn)
+{
+	size_t i, rail;
+
+	for (i = 0; i < RXM_MAX_RAILS; i++) {
+		rail = rxm_conn->rail_next++ % RXM_MAX_RAILS;
+		if (!rail)
+			break;
+		if (rxm_conn->rails[rail - 1].connected)
+			return rxm_conn->rails[rail - 1].msg_ep;
+	}
+	return rxm_conn->msg_ep;
+}
+
 extern struct fi_provider rxm_prov;
 extern struct fi_fabric_attr rxm_fabric_attr;
 extern struct fi_domain_attr rxm_domain_attr;
@@ -720,9 +973,14 @@ int rxm_info_to_rxm(uint32_t version, const struct fi_info *core_info,
 		     const struct fi_info *base_info, struct fi_info *info);
 int rxm_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 			     struct fid_domain **dom, void *context);
+ssize_t rxm_send_credits(struct fid_ep *ep, size_t credits);
+extern struct ofi_ops_flow_ctrl rxm_no_ops_flow_ctrl;
 int rxm_cq_open(struct fid_domain *domain, struct fi_cq_attr *attr,
 			 struct fid_cq **cq_fid, void *context);
 ssize_t rxm_handle_rx_buf(struct rxm_rx_buf *rx_buf);
+struct rxm_rx_buf *rxm_get_cm_eager(struct rxm_conn *rxm_conn,
+				    const void *pkt, size_t len);
+ssize_t rxm_handle_cm_eager(struct rxm_rx_buf *rx_buf);
 
 int rxm_endpoint(struct fid_domain *domain, struct fi_info *info,
 			  struct fid_ep **ep, void *context);
@@ -731,6 +989,7 @@ int rxm_conn_cmap_alloc(struct rxm_ep *rxm_ep);
 void rxm_cq_write_error(struct util_cq *cq, struct util_cntr *cntr,
 			void *op_context, int err);
 void rxm_cq_write_error_all(struct rxm_ep *rxm_ep, int err);
+void rxm_cq_flush_batch(struct rxm_ep *rxm_ep);
 void rxm_handle_comp_error(struct rxm_ep *rxm_ep);
 ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp);
 void rxm_ep_progress(struct util_ep *util_ep);
@@ -739,10 +998,27 @@ void rxm_ep_do_progress(struct util_ep *util_ep);
 
 ssize_t rxm_handle_eager(struct rxm_rx_buf *rx_buf);
 ssize_t rxm_handle_coll_eager(struct rxm_rx_buf *rx_buf);
+size_t rxm_get_rbuf(void *context, size_t msg_len, struct iovec *iov,
+		    size_t max_count);
 int rxm_finish_eager_send(struct rxm_ep *rxm_ep, struct rxm_tx_eager_buf *tx_eager_buf);
 int rxm_finish_coll_eager_send(struct rxm_ep *rxm_ep, struct rxm_tx_eager_buf *tx_eager_buf);
 
 int rxm_msg_ep_prepost_recv(struct rxm_ep *rxm_ep, struct fid_ep *msg_ep);
+ssize_t rxm_conn_flush_agg(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn);
+void rxm_ep_flush_agg(struct rxm_ep *rxm_ep);
+
+void rxm_recv_queue_insert(struct rxm_recv_queue *recv_queue,
+			   struct rxm_recv_entry *recv_entry);
+struct rxm_recv_entry *
+rxm_recv_queue_find(struct rxm_recv_queue *recv_queue,
+		    struct rxm_recv_match_attr *match_attr);
+struct rxm_recv_entry *
+rxm_recv_queue_match(struct rxm_recv_queue *recv_queue,
+		     struct rxm_recv_match_attr *match_attr);
+void rxm_unexp_msg_insert(struct rxm_recv_queue *recv_queue,
+			  struct rxm_rx_buf *rx_buf);
+void rxm_unexp_msg_set_addr(struct rxm_recv_queue *recv_queue,
+			    struct rxm_rx_buf *rx_buf, fi_addr_t addr);
 
 int rxm_ep_query_atomic(struct fid_domain *domain, enum fi_datatype datatype,
 			enum fi_op op, struct fi_atomic_attr *attr,
@@ -779,7 +1055,8 @@ rxm_atomic_send_respmsg(struct rxm_ep *rxm_ep, struct rxm_conn *conn,
 static inline int rxm_needs_atomic_progress(const struct fi_info *info)
 {
 	return (info->caps & FI_ATOMIC) && info->domain_attr &&
-			info->domain_attr->data_progress == FI_PROGRESS_AUTO;
+	       (info->domain_attr->data_progress == FI_PROGRESS_AUTO ||
+		force_auto_progress);
 }
 
 static inline struct rxm_conn *rxm_key2conn(struct rxm_ep *rxm_ep, uint64_t key)
@@ -790,6 +1067,14 @@ static inline struct rxm_conn *rxm_key2conn(struct rxm_ep *rxm_ep, uint64_t key)
 void rxm_ep_progress_deferred_queue(struct rxm_ep *rxm_ep,
 				    struct rxm_conn *rxm_conn);
 
+void rxm_rndv_hdr_init(struct rxm_ep *rxm_ep, void *buf,
+		       const struct iovec *iov, size_t count,
+		       struct fid_mr **mr);
+int rxm_rndv_rx_fail(struct rxm_rx_buf *rx_buf, int err);
+void rxm_rndv_rx_conn_close(struct rxm_conn *rxm_conn);
+ssize_t rxm_rndv_write_progress(struct rxm_ep *rxm_ep,
+				struct rxm_tx_rndv_buf *tx_buf);
+
 struct rxm_deferred_tx_entry *
 rxm_ep_alloc_deferred_tx_entry(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 			       enum rxm_deferred_tx_entry_type type);
@@ -840,8 +1125,8 @@ static inline void rxm_cq_log_comp(uint64_t flags)
 }
 
 static inline ssize_t
-rxm_ep_prepare_tx(struct rxm_ep *rxm_ep, fi_addr_t dest_addr,
-		  struct rxm_conn **rxm_conn)
+rxm_ep_prepare_tx_common(struct rxm_ep *rxm_ep, fi_addr_t dest_addr,
+			 struct rxm_conn **rxm_conn, bool cm_eager)
 {
 	ssize_t ret;
 
@@ -852,6 +1137,11 @@ rxm_ep_prepare_tx(struct rxm_ep *rxm_ep, fi_addr_t dest_addr,
 		return -FI_EHOSTUNREACH;
 
 	if (OFI_UNLIKELY((*rxm_conn)->handle.state != RXM_CMAP_CONNECTED)) {
+		/* The send path connects, so it can pass the message along */
+		if (cm_eager && rxm_ep->cm_eager_size &&
+		    (*rxm_conn)->handle.state == RXM_CMAP_IDLE)
+			return 0;
+
 		ret = rxm_cmap_connect(rxm_ep, dest_addr, &(*rxm_conn)->handle);
 		if (ret)
 			return ret;
@@ -865,6 +1155,30 @@ rxm_ep_prepare_tx(struct rxm_ep *rxm_ep, fi_addr_t dest_addr,
 	return 0;
 }
 
+static inline ssize_t
+rxm_ep_prepare_tx(struct rxm_ep *rxm_ep, fi_addr_t dest_addr,
+		  struct rxm_conn **rxm_conn)
+{
+	ssize_t ret;
+
+	ret = rxm_ep_prepare_tx_common(rxm_ep, dest_addr, rxm_conn, false);
+	if (ret)
+		return ret;
+
+	/* RMA and atomics must not overtake messages sent before them */
+	if (OFI_UNLIKELY((*rxm_conn)->agg_buf != NULL))
+		return rxm_conn_flush_agg(rxm_ep, *rxm_conn);
+	return 0;
+}
+
+/* Message sends may leave the connection idle, see rxm_ep_connect_send */
+static inline ssize_t
+rxm_ep_prepare_msg_tx(struct rxm_ep *rxm_ep, fi_addr_t dest_addr,
+		      struct rxm_conn **rxm_conn)
+{
+	return rxm_ep_prepare_tx_common(rxm_ep, dest_addr, rxm_conn, true);
+}
+
 static inline void
 rxm_ep_format_tx_buf_pkt(struct rxm_conn *rxm_conn, size_t len, uint8_t op,
 			 uint64_t data, uint64_t tag, uint64_t flags,
@@ -888,7 +1202,8 @@ rxm_tx_buf_alloc(struct rxm_ep *rxm_ep, enum rxm_buf_pool_type type)
 	       (type == RXM_BUF_POOL_TX_RNDV) ||
 	       (type == RXM_BUF_POOL_TX_ATOMIC) ||
 	       (type == RXM_BUF_POOL_TX_CREDIT) ||
-	       (type == RXM_BUF_POOL_TX_SAR));
+	       (type == RXM_BUF_POOL_TX_SAR) ||
+	       (type == RXM_BUF_POOL_TX_AGG));
 	return ofi_buf_alloc(rxm_ep->buf_pools[type].pool);
 }
 
@@ -903,6 +1218,8 @@ rxm_rx_buf_alloc(struct rxm_ep *rxm_ep, struct fid_ep *msg_ep, uint8_t repost)
 		rx_buf->hdr.state = RXM_RX;
 		rx_buf->msg_ep = msg_ep;
 		rx_buf->repost = repost;
+		rx_buf->unhandled = 0;
+		rx_buf->direct_recv = 0;
 
 		if (!rxm_ep->srx_ctx)
 			rx_buf->conn = container_of(msg_ep->fid.context,
@@ -922,6 +1239,16 @@ rxm_rx_buf_free(struct rxm_rx_buf *rx_buf)
 	}
 }
 
+void rxm_return_credit(struct rxm_rx_buf *rx_buf);
+
+/* Called when an unexpected message is claimed by a receive */
+static inline void rxm_unexp_msg_remove(struct rxm_rx_buf *rx_buf)
+{
+	dlist_remove(&rx_buf->unexp_msg.entry);
+	dlist_remove(&rx_buf->unexp_msg.hash_entry);
+	rxm_return_credit(rx_buf);
+}
+
 static inline void
 rxm_recv_entry_release(struct rxm_recv_queue *queue, struct rxm_recv_entry *entry)
 {
@@ -929,19 +1256,46 @@ rxm_recv_entry_release(struct rxm_recv_queue *queue, struct rxm_recv_entry *entr
 	freestack_push(queue->fs, entry);
 }
 
+static inline int
+rxm_cq_write_comp(struct rxm_ep *rxm_ep, struct util_cq *cq, void *context,
+		  uint64_t flags, size_t len, void *buf, uint64_t data,
+		  uint64_t tag, fi_addr_t src_addr)
+{
+	struct rxm_comp_batch *batch = &rxm_ep->comp_batch;
+	struct rxm_comp *comp;
+
+	if (!batch->active) {
+		return cq->src ?
+		       ofi_cq_write_src(cq, context, flags, len, buf, data,
+					tag, src_addr) :
+		       ofi_cq_write(cq, context, flags, len, buf, data, tag);
+	}
+
+	if (batch->count == RXM_COMP_BATCH_SIZE)
+		rxm_cq_flush_batch(rxm_ep);
+
+	comp = &batch->comp[batch->count++];
+	comp->cq = cq;
+	comp->comp.op_context = context;
+	comp->comp.flags = flags;
+	comp->comp.len = len;
+	comp->comp.buf = buf;
+	comp->comp.data = data;
+	comp->comp.tag = tag;
+	comp->src_addr = src_addr;
+	return 0;
+}
+
 static inline int rxm_cq_write_recv_comp(struct rxm_rx_buf *rx_buf,
 					 void *context, uint64_t flags,
 					 size_t len, char *buf)
 {
-	if (rx_buf->ep->rxm_info->caps & FI_SOURCE)
-		return ofi_cq_write_src(rx_buf->ep->util_ep.rx_cq, context,
-					flags, len, buf, rx_buf->pkt.hdr.data,
-					rx_buf->pkt.hdr.tag,
-					rx_buf->conn->handle.fi_addr);
-	else
-		return ofi_cq_write(rx_buf->ep->util_ep.rx_cq, context,
-				    flags, len, buf, rx_buf->pkt.hdr.data,
-				    rx_buf->pkt.hdr.tag);
+	return rxm_cq_write_comp(rx_buf->ep, rx_buf->ep->util_ep.rx_cq,
+				 context, flags, len, buf,
+				 rx_buf->pkt.hdr.data, rx_buf->pkt.hdr.tag,
+				 rx_buf->ep->rxm_info->caps & FI_SOURCE ?
+				 rx_buf->conn->handle.fi_addr :
+				 FI_ADDR_NOTAVAIL);
 }
 
 #endif
@@ -41,7 +41,8 @@
 
 static struct rxm_cmap_handle *rxm_conn_alloc(struct rxm_cmap *cmap);
 static int rxm_conn_connect(struct rxm_ep *ep,
-			    struct rxm_cmap_handle *handle, const void *addr);
+			    struct rxm_cmap_handle *handle, const void *addr,
+			    struct rxm_tx_eager_buf *tx_buf);
 static int rxm_conn_signal(struct rxm_ep *ep, void *context,
 			   enum rxm_cmap_signal signal);
 static void rxm_conn_av_updated_handler(struct rxm_cmap_handle *handle);
@@ -49,6 +50,7 @@ static void *rxm_conn_progress(void *arg);
 static void *rxm_conn_atomic_progress(void *arg);
 static int rxm_conn_handle_event(struct rxm_ep *rxm_ep,
 				 struct rxm_msg_eq_entry *entry);
+static void rxm_conn_wake_up_wait_obj(struct rxm_ep *rxm_ep);
 
 
 /*
@@ -239,6 +241,10 @@ static int rxm_conn_res_alloc(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn)
 	dlist_init(&rxm_conn->deferred_tx_queue);
 	dlist_init(&rxm_conn->sar_rx_msg_list);
 	dlist_init(&rxm_conn->sar_deferred_rx_msg_list);
+	dlist_init(&rxm_conn->rndv_write_rx_list);
+	dlist_init(&rxm_conn->credit_entry);
+	dlist_init(&rxm_conn->agg_entry);
+	rxm_conn->sar_tx_credits = rxm_ep->sar_window;
 
 	if (rxm_ep->util_ep.domain->threading != FI_THREAD_SAFE) {
 		rxm_conn->inject_pkt =
@@ -268,11 +274,13 @@ static int rxm_conn_res_alloc(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn)
 static void rxm_conn_close(struct rxm_cmap_handle *handle)
 {
 	struct rxm_conn *rxm_conn = container_of(handle, struct rxm_conn, handle);
+	struct rxm_ep *rxm_ep = handle->cmap->ep;
 	struct rxm_conn *rxm_conn_tmp;
 	struct rxm_deferred_tx_entry *def_tx_entry;
 	struct dlist_entry *conn_entry_tmp;
+	size_t i;
 
-	dlist_foreach_container_safe(&handle->cmap->ep->deferred_tx_conn_queue,
+	dlist_foreach_container_safe(&rxm_ep->deferred_tx_conn_queue,
 				     struct rxm_conn, rxm_conn_tmp,
 				     deferred_conn_entry, conn_entry_tmp)
 	{
@@ -285,10 +293,40 @@ static void rxm_conn_close(struct rxm_cmap_handle *handle)
 					     struct rxm_deferred_tx_entry, entry);
 			FI_DBG(&rxm_prov, FI_LOG_EP_CTRL,
 			       "cancelled deferred message\n");
+			/* The CTS is never sent, see rxm_rndv_rx_conn_close */
+			if (def_tx_entry->type == RXM_DEFERRED_TX_RNDV_CTS)
+				RXM_UPDATE_STATE(FI_LOG_EP_CTRL,
+						 def_tx_entry->rndv_cts.rx_buf,
+						 RXM_RNDV_DONE_WAIT);
 			rxm_ep_dequeue_deferred_tx_queue(def_tx_entry);
 			free(def_tx_entry);
 		}
 	}
+	rxm_rndv_rx_conn_close(rxm_conn);
+	dlist_remove_init(&rxm_conn->credit_entry);
+
+	if (rxm_conn->agg_buf) {
+		FI_DBG(&rxm_prov, FI_LOG_EP_CTRL,
+		       "cancelled aggregated messages\n");
+		for (i = 0; i < rxm_conn->agg_buf->count; i++)
+			rxm_cq_write_error(rxm_ep->util_ep.tx_cq,
+					   rxm_ep->util_ep.tx_cntr,
+					   rxm_conn->agg_buf->msg[i].app_context,
+					   -FI_ECANCELED);
+		ofi_buf_free(rxm_conn->agg_buf);
+		rxm_conn->agg_buf = NULL;
+		dlist_remove_init(&rxm_conn->agg_entry);
+	}
+
+	for (i = 0; i < RXM_MAX_RAILS - 1; i++) {
+		if (!rxm_conn->rails[i].msg_ep)
+			continue;
+		if (fi_close(&rxm_conn->rails[i].msg_ep->fid))
+			FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+				"unable to close rail msg_ep\n");
+		rxm_conn->rails[i].msg_ep = NULL;
+		rxm_conn->rails[i].connected = false;
+	}
 
 	FI_DBG(&rxm_prov, FI_LOG_EP_CTRL, "closing msg ep\n");
 	if (!rxm_conn->msg_ep)
@@ -306,6 +344,8 @@ static void rxm_conn_free(struct rxm_cmap_handle *handle)
 
 	rxm_conn_close(handle);
 	rxm_conn_res_free(rxm_conn);
+	if (rxm_conn->connect_tx_buf)
+		ofi_buf_free(rxm_conn->connect_tx_buf);
 	free(rxm_conn);
 }
 
@@ -444,6 +484,78 @@ int rxm_cmap_update(struct rxm_cmap *cmap, const void *addr, fi_addr_t fi_addr)
 	return 0;
 }
 
+static void rxm_conn_fail_connect_tx(struct rxm_conn *rxm_conn, int err)
+{
+	struct rxm_tx_eager_buf *tx_buf = rxm_conn->connect_tx_buf;
+	struct rxm_ep *rxm_ep = rxm_conn->handle.cmap->ep;
+
+	if (!tx_buf)
+		return;
+
+	rxm_conn->connect_tx_buf = NULL;
+	rxm_cq_write_error(rxm_ep->util_ep.tx_cq, rxm_ep->util_ep.tx_cntr,
+			   tx_buf->app_context, err);
+	ofi_buf_free(tx_buf);
+}
+
+/*
+ * The peer echoes the length of the message carried by our connection
+ * request when it accepts the request and delivers the message.  Peers
+ * that predate this accept the request without it.
+ */
+static bool
+rxm_conn_connect_tx_delivered(struct rxm_conn *rxm_conn,
+			      union rxm_cm_data *cm_data, size_t cm_data_len)
+{
+	struct rxm_tx_eager_buf *tx_buf = rxm_conn->connect_tx_buf;
+
+	if (!tx_buf || cm_data_len < offsetof(struct _accept, eager_len) +
+				     sizeof(cm_data->accept.eager_len))
+		return false;
+
+	return cm_data->accept.eager_len ==
+	       sizeof(tx_buf->pkt) + tx_buf->pkt.hdr.size;
+}
+
+/*
+ * The message carried by our connection request has arrived if the peer
+ * says so when it accepts that request.  Otherwise, either the peer's own
+ * request won and ours was rejected unread, or the peer dropped the
+ * message, and it is sent first on the new connection.
+ */
+static void rxm_conn_finish_connect_tx(struct rxm_conn *rxm_conn,
+				       bool delivered)
+{
+	struct rxm_tx_eager_buf *tx_buf = rxm_conn->connect_tx_buf;
+	struct rxm_ep *rxm_ep = rxm_conn->handle.cmap->ep;
+	ssize_t ret;
+
+	if (!tx_buf)
+		return;
+
+	if (delivered) {
+		rxm_conn->connect_tx_buf = NULL;
+		ret = rxm_ep->eager_ops->comp_tx(rxm_ep, tx_buf);
+		if (ret)
+			FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+				"unable to write send completion\n");
+		ofi_buf_free(tx_buf);
+		return;
+	}
+
+	tx_buf->pkt.ctrl_hdr.conn_id = rxm_conn->handle.remote_key;
+	ret = fi_send(rxm_conn->msg_ep, &tx_buf->pkt,
+		      sizeof(tx_buf->pkt) + tx_buf->pkt.hdr.size,
+		      tx_buf->hdr.desc, 0, tx_buf);
+	if (ret) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+			"unable to resend connection request data\n");
+		rxm_conn_fail_connect_tx(rxm_conn, (int) ret);
+		return;
+	}
+	rxm_conn->connect_tx_buf = NULL;
+}
+
 void rxm_cmap_process_shutdown(struct rxm_cmap *cmap,
 			       struct rxm_cmap_handle *handle)
 {
@@ -462,9 +574,10 @@ void rxm_cmap_process_shutdown(struct rxm_cmap *cmap,
 
 void rxm_cmap_process_connect(struct rxm_cmap *cmap,
 			      struct rxm_cmap_handle *handle,
-			      union rxm_cm_data *cm_data)
+			      union rxm_cm_data *cm_data, size_t cm_data_len)
 {
 	struct rxm_conn *rxm_conn = container_of(handle, struct rxm_conn, handle);
+	bool delivered = false;
 
 	FI_DBG(cmap->av->prov, FI_LOG_EP_CTRL,
 	       "processing FI_CONNECTED event for handle: %p\n", handle);
@@ -472,10 +585,15 @@ void rxm_cmap_process_connect(struct rxm_cmap *cmap,
 		assert(handle->state == RXM_CMAP_CONNREQ_SENT);
 		handle->remote_key = cm_data->accept.server_conn_id;
 		rxm_conn->rndv_tx_credits = cm_data->accept.rx_size;
+		rxm_conn->sar_tx_credits = MIN(rxm_conn->sar_tx_credits,
+					       cm_data->accept.rx_size);
+		delivered = rxm_conn_connect_tx_delivered(rxm_conn, cm_data,
+							  cm_data_len);
 	} else {
 		assert(handle->state == RXM_CMAP_CONNREQ_RECV);
 	}
 	RXM_CM_UPDATE_STATE(handle, RXM_CMAP_CONNECTED);
+	rxm_conn_finish_connect_tx(rxm_conn, delivered);
 
 	/* Set the remote key to the inject packets */
 	if (cmap->ep->util_ep.domain->threading != FI_THREAD_SAFE) {
@@ -484,6 +602,12 @@ void rxm_cmap_process_connect(struct rxm_cmap *cmap,
 		rxm_conn->tinject_pkt->ctrl_hdr.conn_id = rxm_conn->handle.remote_key;
 		rxm_conn->tinject_data_pkt->ctrl_hdr.conn_id = rxm_conn->handle.remote_key;
 	}
+
+	/* Tell the peer how many of its messages we are willing to buffer */
+	if (cmap->ep->flow_ctrl_credits &&
+	    rxm_send_credits(rxm_conn->msg_ep, cmap->ep->flow_ctrl_credits))
+		FI_WARN(cmap->av->prov, FI_LOG_EP_CTRL,
+			"unable to grant flow control credits\n");
 }
 
 void rxm_cmap_process_reject(struct rxm_cmap *cmap,
@@ -501,6 +625,9 @@ void rxm_cmap_process_reject(struct rxm_cmap *cmap,
 		if (reject_reason == RXM_CMAP_REJECT_GENUINE) {
 			FI_DBG(cmap->av->prov, FI_LOG_EP_CTRL,
 			       "Deleting connection handle\n");
+			rxm_conn_fail_connect_tx(container_of(handle,
+						 struct rxm_conn, handle),
+						 -FI_ECONNREFUSED);
 			rxm_cmap_del_handle(handle);
 		} else {
 			FI_DBG(cmap->av->prov, FI_LOG_EP_CTRL,
@@ -609,11 +736,101 @@ unlock:
 	return ret;
 }
 
+static struct rxm_msg_eq_entry *
+rxm_cm_event_slot(struct rxm_cmap *cmap, int64_t cnt)
+{
+	return (struct rxm_msg_eq_entry *) (cmap->event_ring +
+		(cnt & (RXM_CM_EVENT_RING_SIZE - 1)) * RXM_MSG_EQ_ENTRY_SZ);
+}
+
+/* Called by the CM thread.  Returns NULL if the ring is full. */
+static struct rxm_msg_eq_entry *rxm_cm_event_reserve(struct rxm_cmap *cmap)
+{
+	struct rxm_msg_eq_entry *entry;
+	int64_t tail = ofi_atomic_get64(&cmap->event_tail);
+
+	if (tail - ofi_atomic_get64(&cmap->event_head) >=
+	    RXM_CM_EVENT_RING_SIZE)
+		return NULL;
+
+	entry = rxm_cm_event_slot(cmap, tail);
+	memset(entry, 0, RXM_MSG_EQ_ENTRY_SZ);
+	return entry;
+}
+
+/* Publishes the reserved entry to the progress path */
+static void rxm_cm_event_commit(struct rxm_ep *rxm_ep,
+				struct rxm_msg_eq_entry *entry)
+{
+	/* Error data belongs to the EQ and is gone after its next read */
+	if (entry->rd == -FI_ECONNREFUSED) {
+		if (entry->err_entry.err_data_size <= RXM_MAX_CM_DATA_SIZE)
+			memcpy(entry->cm_entry.data, entry->err_entry.err_data,
+			       entry->err_entry.err_data_size);
+		else
+			entry->err_entry.err_data_size = 0;
+		entry->err_entry.err_data = NULL;
+	}
+
+	ofi_atomic_inc64(&rxm_ep->cmap->event_tail);
+	rxm_conn_wake_up_wait_obj(rxm_ep);
+}
+
+static int rxm_cm_event_progress(struct rxm_ep *rxm_ep)
+{
+	struct rxm_cmap *cmap = rxm_ep->cmap;
+	struct rxm_msg_eq_entry *entry;
+	int64_t head;
+	int ret;
+
+	entry = alloca(RXM_MSG_EQ_ENTRY_SZ);
+
+	/* Handling an event may progress the ring again, so each entry
+	 * is copied out and released before it is handled. */
+	while ((head = ofi_atomic_get64(&cmap->event_head)) !=
+	       ofi_atomic_get64(&cmap->event_tail)) {
+		memcpy(entry, rxm_cm_event_slot(cmap, head),
+		       RXM_MSG_EQ_ENTRY_SZ);
+		ofi_atomic_set64(&cmap->event_head, head + 1);
+
+		if (entry->err_entry.err_data_size)
+			entry->err_entry.err_data = entry->cm_entry.data;
+		ret = rxm_conn_handle_event(rxm_ep, entry);
+		if (ret) {
+			FI_DBG(&rxm_prov, FI_LOG_EP_CTRL,
+			       "invalid connection handle event: %d\n", ret);
+		}
+	}
+	return -FI_EAGAIN;
+}
+
+/* Drops events the CM thread left behind when it stopped */
+static void rxm_cm_event_discard(struct rxm_cmap *cmap)
+{
+	struct rxm_msg_eq_entry *entry;
+	int64_t head;
+
+	for (head = ofi_atomic_get64(&cmap->event_head);
+	     head != ofi_atomic_get64(&cmap->event_tail); head++) {
+		entry = rxm_cm_event_slot(cmap, head);
+		if (entry->rd >= 0 && entry->event == FI_CONNREQ)
+			fi_freeinfo(entry->cm_entry.info);
+	}
+	ofi_atomic_set64(&cmap->event_head, head);
+}
+
 int rxm_msg_eq_progress(struct rxm_ep *rxm_ep)
 {
 	struct rxm_msg_eq_entry *entry;
 	int ret;
 
+	/* The CM thread owns the MSG EQ while it runs */
+	if (rxm_ep->cmap && rxm_ep->cmap->event_ring) {
+		ret = rxm_cm_event_progress(rxm_ep);
+		if (rxm_ep->do_progress)
+			return ret;
+	}
+
 	entry = alloca(RXM_MSG_EQ_ENTRY_SZ);
 	if (!entry) {
 		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
@@ -647,7 +864,8 @@ int rxm_cmap_connect(struct rxm_ep *rxm_ep, fi_addr_t fi_addr,
 		FI_DBG(&rxm_prov, FI_LOG_EP_CTRL, "initiating MSG_EP connect "
 		       "for fi_addr: %" PRIu64 "\n", fi_addr);
 		ret = rxm_conn_connect(rxm_ep, handle,
-				       ofi_av_get_addr(rxm_ep->cmap->av, fi_addr));
+				       ofi_av_get_addr(rxm_ep->cmap->av, fi_addr),
+				       NULL);
 		if (ret) {
 			rxm_cmap_del_handle(handle);
 		} else {
@@ -672,6 +890,32 @@ int rxm_cmap_connect(struct rxm_ep *rxm_ep, fi_addr_t fi_addr,
 	return ret;
 }
 
+/* Starts the connection with tx_buf's message in the request */
+int rxm_cmap_connect_eager(struct rxm_ep *rxm_ep,
+			   struct rxm_cmap_handle *handle,
+			   struct rxm_tx_eager_buf *tx_buf)
+{
+	struct rxm_conn *rxm_conn = container_of(handle, struct rxm_conn,
+						 handle);
+	int ret;
+
+	assert(handle->state == RXM_CMAP_IDLE);
+	FI_DBG(&rxm_prov, FI_LOG_EP_CTRL, "initiating MSG_EP connect with "
+	       "eager data for fi_addr: %" PRIu64 "\n", handle->fi_addr);
+	ret = rxm_conn_connect(rxm_ep, handle,
+			       ofi_av_get_addr(rxm_ep->cmap->av,
+					       handle->fi_addr), tx_buf);
+	if (ret) {
+		rxm_cmap_del_handle(handle);
+		return ret;
+	}
+
+	RXM_CM_UPDATE_STATE(handle, RXM_CMAP_CONNREQ_SENT);
+	rxm_conn->connect_tx_buf = tx_buf;
+	rxm_msg_eq_progress(rxm_ep);
+	return 0;
+}
+
 static int rxm_cmap_cm_thread_close(struct rxm_cmap *cmap)
 {
 	int ret;
@@ -693,6 +937,7 @@ static int rxm_cmap_cm_thread_close(struct rxm_cmap *cmap)
 			"Unable to join CM thread\n");
 		return ret;
 	}
+	rxm_cm_event_discard(cmap);
 	return 0;
 }
 
@@ -724,6 +969,7 @@ void rxm_cmap_free(struct rxm_cmap *cmap)
 
 	free(cmap->handles_av);
 	free(cmap->attr.name);
+	free(cmap->event_ring);
 	ofi_idx_reset(&cmap->handles_idx);
 	free(cmap);
 }
@@ -778,6 +1024,15 @@ int rxm_cmap_alloc(struct rxm_ep *rxm_ep, struct rxm_cmap_attr *attr)
 	if (ep->domain->data_progress == FI_PROGRESS_AUTO || force_auto_progress) {
 
 		assert(ep->domain->threading == FI_THREAD_SAFE);
+		cmap->event_ring = calloc(RXM_CM_EVENT_RING_SIZE,
+					  RXM_MSG_EQ_ENTRY_SZ);
+		if (!cmap->event_ring) {
+			ret = -FI_ENOMEM;
+			goto err3;
+		}
+		ofi_atomic_initialize64(&cmap->event_head, 0);
+		ofi_atomic_initialize64(&cmap->event_tail, 0);
+
 		rxm_ep->do_progress = true;
 		if (pthread_create(&cmap->cm_thread, 0,
 				   rxm_ep->rxm_info->caps & FI_ATOMIC ?
@@ -800,6 +1055,7 @@ err4:
 	rxm_cmap_cm_thread_close(cmap);
 err3:
 	rxm_ep->cmap = NULL;
+	free(cmap->event_ring);
 	free(cmap->attr.name);
 err2:
 	free(cmap->handles_av);
@@ -809,7 +1065,7 @@ err1:
 }
 
 static int rxm_msg_ep_open(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
-			   struct rxm_conn *rxm_conn, void *context)
+			   struct fid_ep **ep, void *context)
 {
 	struct rxm_domain *rxm_domain;
 	struct fid_ep *msg_ep;
@@ -862,13 +1118,13 @@ static int rxm_msg_ep_open(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 			msg_ep, rxm_ep->msg_info->rx_attr->size / 2);
 	}
 
-	rxm_conn->msg_ep = msg_ep;
-
 	if (!rxm_ep->srx_ctx) {
 		ret = rxm_msg_ep_prepost_recv(rxm_ep, msg_ep);
 		if (ret)
 			goto err;
 	}
+
+	*ep = msg_ep;
 	return 0;
 err:
 	fi_close(&msg_ep->fid);
@@ -878,7 +1134,7 @@ err:
 static int rxm_conn_reprocess_directed_recvs(struct rxm_recv_queue *recv_queue)
 {
 	struct rxm_rx_buf *rx_buf;
-	struct dlist_entry *entry, *tmp_entry;
+	struct dlist_entry *tmp_entry;
 	struct rxm_recv_match_attr match_attr;
 	struct fi_cq_err_entry err_entry = {0};
 	int ret, count = 0;
@@ -891,19 +1147,17 @@ static int rxm_conn_reprocess_directed_recvs(struct rxm_recv_queue *recv_queue)
 
 		assert(rx_buf->unexp_msg.addr == FI_ADDR_NOTAVAIL);
 
-		rx_buf->unexp_msg.addr = rx_buf->conn->handle.fi_addr;
+		rxm_unexp_msg_set_addr(recv_queue, rx_buf,
+				       rx_buf->conn->handle.fi_addr);
 		match_attr.addr = rx_buf->unexp_msg.addr;
 		match_attr.tag = rx_buf->unexp_msg.tag;
 
-		entry = dlist_remove_first_match(&recv_queue->recv_list,
-						 recv_queue->match_recv,
-						 &match_attr);
-		if (!entry)
+		rx_buf->recv_entry = rxm_recv_queue_match(recv_queue,
+							  &match_attr);
+		if (!rx_buf->recv_entry)
 			continue;
 
-		dlist_remove(&rx_buf->unexp_msg.entry);
-		rx_buf->recv_entry = container_of(entry, struct rxm_recv_entry,
-						  entry);
+		rxm_unexp_msg_remove(rx_buf);
 
 		ret = rxm_handle_rx_buf(rx_buf);
 		if (ret) {
@@ -1019,7 +1273,7 @@ static size_t rxm_conn_get_rx_size(struct rxm_ep *rxm_ep,
 
 static int
 rxm_msg_process_connreq(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
-			union rxm_cm_data *remote_cm_data)
+			union rxm_cm_data *remote_cm_data, size_t cm_data_len)
 {
 	struct rxm_conn *rxm_conn;
 	union rxm_cm_data cm_data = {
@@ -1037,8 +1291,12 @@ rxm_msg_process_connreq(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 			.reason = RXM_CMAP_REJECT_GENUINE,
 		}
 	};
+	struct rxm_rx_buf *eager_buf = NULL;
 	struct rxm_cmap_handle *handle;
 	struct sockaddr_storage remote_pep_addr;
+	char cm_buf[RXM_MAX_CM_DATA_SIZE];
+	size_t cm_len = sizeof(cm_data);
+	size_t i;
 	int ret;
 
 	assert(sizeof(uint32_t) == sizeof(cm_data.accept.rx_size));
@@ -1051,6 +1309,14 @@ rxm_msg_process_connreq(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 		goto err1;
 	}
 
+	if (cm_data_len < sizeof(*remote_cm_data) +
+			  remote_cm_data->connect.eager_len) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+			"CM data is shorter than its eager data\n");
+		ret = -FI_EINVAL;
+		goto err1;
+	}
+
 	memcpy(&remote_pep_addr, msg_info->dest_addr, msg_info->dest_addrlen);
 	ofi_addr_set_port((struct sockaddr *)&remote_pep_addr,
 			  remote_cm_data->connect.port);
@@ -1065,22 +1331,59 @@ rxm_msg_process_connreq(struct rxm_ep *rxm_ep, struct fi_info *msg_info,
 	rxm_conn->handle.remote_key = remote_cm_data->connect.client_conn_id;
 	rxm_conn->rndv_tx_credits = remote_cm_data->connect.rx_size;
 	assert(rxm_conn->rndv_tx_credits);
+	rxm_conn->sar_tx_credits = MIN(rxm_conn->sar_tx_credits,
+				       remote_cm_data->connect.rx_size);
 
-	ret = rxm_msg_ep_open(rxm_ep, msg_info, rxm_conn, handle);
+	ret = rxm_msg_ep_open(rxm_ep, msg_info, &rxm_conn->msg_ep, handle);
 	if (ret)
 		goto err2;
 
 	cm_data.accept.server_conn_id = rxm_conn->handle.key;
 	cm_data.accept.rx_size = rxm_conn_get_rx_size(rxm_ep, msg_info);
 
-	ret = fi_accept(rxm_conn->msg_ep, &cm_data.accept.server_conn_id,
-			sizeof(cm_data.accept));
+	/* Tell the client that we took the message in its request */
+	if (remote_cm_data->connect.eager_len)
+		eager_buf = rxm_get_cm_eager(rxm_conn, remote_cm_data + 1,
+					     remote_cm_data->connect.eager_len);
+	cm_data.accept.eager_len = eager_buf ?
+				   remote_cm_data->connect.eager_len : 0;
+
+	/* Tell the client where to connect our additional rails */
+	if (rxm_ep->rail_cnt) {
+		cm_data.accept.rail_cnt = (uint8_t) rxm_ep->rail_cnt;
+		cm_data.accept.rail_addrlen = (uint8_t) rxm_ep->rail_addrlen;
+		for (i = 0; i < rxm_ep->rail_cnt; i++) {
+			memcpy(cm_buf + cm_len, &rxm_ep->rails[i].name,
+			       rxm_ep->rail_addrlen);
+			cm_len += rxm_ep->rail_addrlen;
+		}
+	} else {
+		cm_len = sizeof(cm_data.accept);
+	}
+	memcpy(cm_buf, &cm_data, sizeof(cm_data));
+
+	ret = fi_accept(rxm_conn->msg_ep, cm_buf, cm_len);
 	if (ret) {
 		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
 			"Unable to accept incoming connection\n");
+		if (eager_buf)
+			rxm_rx_buf_free(eager_buf);
 		goto err2;
 	}
 
+	/* Nothing can arrive on the connection before we return.  The client
+	 * counts the message as sent, so a failure is reported as for any
+	 * other received message. */
+	if (eager_buf) {
+		ret = rxm_handle_cm_eager(eager_buf);
+		if (ret) {
+			FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+				"Unable to process connection request data\n");
+			rxm_cq_write_error_all(rxm_ep, (int) ret);
+			ret = 0;
+		}
+	}
+
 	return ret;
 err2:
 	rxm_cmap_del_handle(&rxm_conn->handle);
@@ -1152,10 +1455,22 @@ static int rxm_conn_handle_notify(struct fi_eq_entry *eq_entry)
 
 static void rxm_conn_wake_up_wait_obj(struct rxm_ep *rxm_ep)
 {
-	if (rxm_ep->util_ep.tx_cq && rxm_ep->util_ep.tx_cq->wait)
-		util_cq_signal(rxm_ep->util_ep.tx_cq);
-	if (rxm_ep->util_ep.tx_cntr && rxm_ep->util_ep.tx_cntr->wait)
-		util_cntr_signal(rxm_ep->util_ep.tx_cntr);
+	struct util_ep *util_ep = &rxm_ep->util_ep;
+
+	if (util_ep->tx_cq && util_ep->tx_cq->wait)
+		util_cq_signal(util_ep->tx_cq);
+	if (util_ep->tx_cntr && util_ep->tx_cntr->wait)
+		util_cntr_signal(util_ep->tx_cntr);
+
+	/* Queued CM events are handled by whoever progresses the ep */
+	if (!rxm_ep->cmap || !rxm_ep->cmap->event_ring)
+		return;
+	if (util_ep->rx_cq && util_ep->rx_cq != util_ep->tx_cq &&
+	    util_ep->rx_cq->wait)
+		util_cq_signal(util_ep->rx_cq);
+	if (util_ep->rx_cntr && util_ep->rx_cntr != util_ep->tx_cntr &&
+	    util_ep->rx_cntr->wait)
+		util_cntr_signal(util_ep->rx_cntr);
 }
 
 static int
@@ -1201,9 +1516,199 @@ rxm_conn_handle_reject(struct rxm_ep *rxm_ep, struct rxm_msg_eq_entry *entry)
 	return 0;
 }
 
+/*
+ * Additional rails are connected by the client once the connection is
+ * established, to the addresses the server sent with its accept.  The
+ * server finds the connection by its key.  Rails share the MSG CQ and
+ * shared receive context, so anything arriving on them is handled like
+ * data on msg_ep.
+ */
+static void rxm_conn_connect_rails(struct rxm_ep *rxm_ep,
+				   struct rxm_conn *rxm_conn,
+				   union rxm_cm_data *cm_data,
+				   size_t cm_data_len)
+{
+	union rxm_cm_data rail_cm_data = {
+		.rail = {
+			.version = RXM_CM_DATA_VERSION,
+			.endianness = ofi_detect_endianness(),
+			.ctrl_version = RXM_CTRL_VERSION,
+			.op_version = RXM_OP_VERSION,
+			.server_conn_id = rxm_conn->handle.remote_key,
+			.client_conn_id = rxm_conn->handle.key,
+		},
+	};
+	size_t i, cnt, addrlen = cm_data->accept.rail_addrlen;
+	struct rxm_conn_rail *rail;
+	struct fi_info *info;
+	char *addr;
+	int ret;
+
+	cnt = MIN(cm_data->accept.rail_cnt, rxm_ep->rail_cnt);
+	if (!cnt)
+		return;
+
+	if (addrlen > sizeof(struct sockaddr_storage) ||
+	    cm_data_len < sizeof(*cm_data) + cnt * addrlen) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+			"invalid rail addresses in accept data\n");
+		return;
+	}
+
+	addr = (char *) (cm_data + 1);
+	for (i = 0; i < cnt; i++, addr += addrlen) {
+		info = rxm_ep->rails[i].info;
+		rail = &rxm_conn->rails[i];
+
+		free(info->dest_addr);
+		info->dest_addr = mem_dup(addr, addrlen);
+		if (!info->dest_addr) {
+			info->dest_addrlen = 0;
+			return;
+		}
+		info->dest_addrlen = addrlen;
+
+		ret = rxm_msg_ep_open(rxm_ep, info, &rail->msg_ep,
+				      &rxm_conn->handle);
+		if (ret)
+			return;
+
+		rail_cm_data.rail.index = (uint32_t) i;
+		ret = fi_connect(rail->msg_ep, info->dest_addr, &rail_cm_data,
+				 sizeof(rail_cm_data));
+		if (ret) {
+			FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+				"unable to connect rail %zu\n", i + 1);
+			fi_close(&rail->msg_ep->fid);
+			rail->msg_ep = NULL;
+			return;
+		}
+	}
+}
+
+static void
+rxm_conn_process_rail_req(struct rxm_ep *rxm_ep, size_t index,
+			  struct fi_info *msg_info,
+			  union rxm_cm_data *remote_cm_data)
+{
+	struct rxm_cmap_handle *handle;
+	struct rxm_conn *rxm_conn;
+	struct rxm_conn_rail *rail;
+
+	if (remote_cm_data->rail.version != RXM_CM_DATA_VERSION ||
+	    remote_cm_data->rail.endianness != ofi_detect_endianness() ||
+	    remote_cm_data->rail.ctrl_version != RXM_CTRL_VERSION ||
+	    remote_cm_data->rail.op_version != RXM_OP_VERSION ||
+	    remote_cm_data->rail.index != index) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+			"invalid rail connection request\n");
+		goto reject;
+	}
+
+	handle = rxm_cmap_key2handle(rxm_ep->cmap,
+				     remote_cm_data->rail.server_conn_id);
+	if (!handle || (handle->state != RXM_CMAP_CONNECTED &&
+			handle->state != RXM_CMAP_CONNREQ_RECV) ||
+	    handle->remote_key != remote_cm_data->rail.client_conn_id) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+			"rail connection request for unknown connection\n");
+		goto reject;
+	}
+
+	rxm_conn = container_of(handle, struct rxm_conn, handle);
+	rail = &rxm_conn->rails[index];
+	if (rail->msg_ep)
+		goto reject;
+
+	if (rxm_msg_ep_open(rxm_ep, msg_info, &rail->msg_ep, handle))
+		goto reject;
+
+	if (fi_accept(rail->msg_ep, NULL, 0)) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "unable to accept rail\n");
+		fi_close(&rail->msg_ep->fid);
+		rail->msg_ep = NULL;
+		goto reject;
+	}
+	return;
+
+reject:
+	fi_reject(rxm_ep->rails[index].pep, msg_info->handle, NULL, 0);
+}
+
+static struct rxm_conn_rail *
+rxm_conn_fid2rail(struct rxm_cmap_handle *handle, struct fid *fid)
+{
+	struct rxm_conn *rxm_conn = container_of(handle, struct rxm_conn,
+						 handle);
+	size_t i;
+
+	for (i = 0; i < RXM_MAX_RAILS - 1; i++) {
+		if (rxm_conn->rails[i].msg_ep &&
+		    &rxm_conn->rails[i].msg_ep->fid == fid)
+			return &rxm_conn->rails[i];
+	}
+	return NULL;
+}
+
+/* A rail that fails stays out of use until the connection is closed */
+static int
+rxm_conn_handle_rail_event(struct rxm_ep *rxm_ep,
+			   struct rxm_msg_eq_entry *entry)
+{
+	struct rxm_conn_rail *rail;
+	struct fid *fid;
+	size_t i;
+
+	if (entry->rd == -FI_ECONNREFUSED) {
+		fid = entry->err_entry.fid;
+		rail = rxm_conn_fid2rail(entry->context, fid);
+		if (!rail)
+			return -FI_ENOENT;
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "rail connection refused\n");
+		rail->connected = false;
+		return 0;
+	}
+
+	switch (entry->event) {
+	case FI_CONNREQ:
+		for (i = 0; i < rxm_ep->rail_cnt; i++) {
+			if (entry->cm_entry.fid == &rxm_ep->rails[i].pep->fid)
+				break;
+		}
+		if (i == rxm_ep->rail_cnt)
+			return -FI_ENOENT;
+
+		if ((size_t) entry->rd < sizeof(entry->cm_entry) +
+					 sizeof(union rxm_cm_data))
+			fi_reject(rxm_ep->rails[i].pep,
+				  entry->cm_entry.info->handle, NULL, 0);
+		else
+			rxm_conn_process_rail_req(rxm_ep, i,
+				entry->cm_entry.info,
+				(union rxm_cm_data *) entry->cm_entry.data);
+		fi_freeinfo(entry->cm_entry.info);
+		return 0;
+	case FI_CONNECTED:
+	case FI_SHUTDOWN:
+		fid = entry->cm_entry.fid;
+		rail = rxm_conn_fid2rail(fid->context, fid);
+		if (!rail)
+			return -FI_ENOENT;
+		rail->connected = (entry->event == FI_CONNECTED);
+		FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "rail %s\n",
+			rail->connected ? "connected" : "shut down");
+		return 0;
+	default:
+		return -FI_ENOENT;
+	}
+}
+
 static int
 rxm_conn_handle_event(struct rxm_ep *rxm_ep, struct rxm_msg_eq_entry *entry)
 {
+	if (rxm_ep->rail_cnt && !rxm_conn_handle_rail_event(rxm_ep, entry))
+		return 0;
+
 	if (entry->rd == -FI_ECONNREFUSED)
 		return rxm_conn_handle_reject(rxm_ep, entry);
 
@@ -1213,17 +1718,20 @@ rxm_conn_handle_event(struct rxm_ep *rxm_ep, struct rxm_msg_eq_entry *entry)
 					      &entry->cm_entry);
 	case FI_CONNREQ:
 		FI_DBG(&rxm_prov, FI_LOG_EP_CTRL, "Got new connection\n");
-		if ((size_t)entry->rd != RXM_CM_ENTRY_SZ) {
+		if ((size_t)entry->rd < sizeof(entry->cm_entry) +
+					sizeof(union rxm_cm_data)) {
 			FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
 				"Received a connection request with no CM data. "
 				"Is sender running FI_PROTO_RXM?\n");
 			FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "Received CM entry "
-				"size (%zd) not matching expected (%zu)\n",
-				entry->rd, RXM_CM_ENTRY_SZ);
+				"size (%zd) smaller than expected (%zu)\n",
+				entry->rd, sizeof(entry->cm_entry) +
+				sizeof(union rxm_cm_data));
 			return -FI_EOTHER;
 		}
 		rxm_msg_process_connreq(rxm_ep, entry->cm_entry.info,
-					(union rxm_cm_data *) entry->cm_entry.data);
+					(union rxm_cm_data *) entry->cm_entry.data,
+					entry->rd - sizeof(entry->cm_entry));
 		fi_freeinfo(entry->cm_entry.info);
 		break;
 	case FI_CONNECTED:
@@ -1233,7 +1741,15 @@ rxm_conn_handle_event(struct rxm_ep *rxm_ep, struct rxm_msg_eq_entry *entry)
 		rxm_cmap_process_connect(rxm_ep->cmap,
 			entry->cm_entry.fid->context,
 			entry->rd - sizeof(entry->cm_entry) > 0 ?
-			(union rxm_cm_data *) entry->cm_entry.data : NULL);
+			(union rxm_cm_data *) entry->cm_entry.data : NULL,
+			entry->rd - sizeof(entry->cm_entry));
+		if (rxm_ep->rail_cnt &&
+		    entry->rd - sizeof(entry->cm_entry) > 0)
+			rxm_conn_connect_rails(rxm_ep,
+				container_of(entry->cm_entry.fid->context,
+					     struct rxm_conn, handle),
+				(union rxm_cm_data *) entry->cm_entry.data,
+				entry->rd - sizeof(entry->cm_entry));
 		rxm_conn_wake_up_wait_obj(rxm_ep);
 		break;
 	case FI_SHUTDOWN:
@@ -1251,7 +1767,7 @@ rxm_conn_handle_event(struct rxm_ep *rxm_ep, struct rxm_msg_eq_entry *entry)
 }
 
 static ssize_t rxm_eq_sread(struct rxm_ep *rxm_ep, size_t len,
-			    struct rxm_msg_eq_entry *entry)
+			    struct rxm_msg_eq_entry *entry, int timeout)
 {
 	ssize_t rd;
 	int once = 1;
@@ -1263,8 +1779,8 @@ static ssize_t rxm_eq_sread(struct rxm_ep *rxm_ep, size_t len,
 		 * can be done only for non-Windows OSes as Windows doesn't
 		 * have poll for a generic file descriptor. */
 		rd = fi_eq_sread(rxm_ep->msg_eq, &entry->event, &entry->cm_entry,
-				 len, -1, 0);
-		if (rd >= 0)
+				 len, timeout, 0);
+		if (rd >= 0 || rd == -FI_EAGAIN)
 			return rd;
 		if (rd == -FI_EINTR && once) {
 			FI_DBG(&rxm_prov, FI_LOG_EP_CTRL, "Ignoring EINTR\n");
@@ -1279,69 +1795,76 @@ static ssize_t rxm_eq_sread(struct rxm_ep *rxm_ep, size_t len,
 		return rd;
 	}
 
-	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	rd = rxm_eq_readerr(rxm_ep, entry);
-	ofi_ep_lock_release(&rxm_ep->util_ep);
-	return rd;
+	return rxm_eq_readerr(rxm_ep, entry);
 }
 
-static inline int rxm_conn_eq_event(struct rxm_ep *rxm_ep,
-				    struct rxm_msg_eq_entry *entry)
+static void rxm_conn_handle_events(struct rxm_ep *ep)
 {
-	int ret;
-
-	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	ret = rxm_conn_handle_event(rxm_ep, entry) ? -1 : 0;
-	ofi_ep_lock_release(&rxm_ep->util_ep);
+	if (!rxm_cmap_events_pending(ep->cmap))
+		return;
 
-	return ret;
+	ofi_ep_lock_acquire(&ep->util_ep);
+	rxm_cm_event_progress(ep);
+	ofi_ep_lock_release(&ep->util_ep);
 }
 
+/*
+ * The CM thread waits for MSG EQ events without the ep lock and queues
+ * them for ep progress to handle.  Events that are still queued after the
+ * thread waited RXM_CM_HANDOFF_TIMEOUT for the next one, or that fill the
+ * ring, it handles itself under the ep lock, so connections are set up even
+ * if the application does not progress the ep.
+ */
 static void *rxm_conn_progress(void *arg)
 {
 	struct rxm_ep *ep = container_of(arg, struct rxm_ep, util_ep);
 	struct rxm_msg_eq_entry *entry;
 
-	entry = alloca(RXM_MSG_EQ_ENTRY_SZ);
-	if (!entry)
-		return NULL;
-
 	FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "Starting auto-progress thread\n");
 
 	while (ep->do_progress) {
-		memset(entry, 0, RXM_MSG_EQ_ENTRY_SZ);
-		entry->rd = rxm_eq_sread(ep, RXM_CM_ENTRY_SZ, entry);
+		entry = rxm_cm_event_reserve(ep->cmap);
+		if (!entry) {
+			rxm_conn_handle_events(ep);
+			continue;
+		}
+
+		entry->rd = rxm_eq_sread(ep, RXM_CM_ENTRY_SZ, entry,
+					 rxm_cmap_events_pending(ep->cmap) ?
+					 RXM_CM_HANDOFF_TIMEOUT : -1);
+		if (entry->rd == -FI_EAGAIN) {
+			rxm_conn_handle_events(ep);
+			continue;
+		}
 		if (entry->rd < 0 && entry->rd != -FI_ECONNREFUSED)
 			continue;
 
-		rxm_conn_eq_event(ep, entry);
+		rxm_cm_event_commit(ep, entry);
 	}
 
 	FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "Stopping auto-progress thread\n");
 	return NULL;
 }
 
-static inline int
-rxm_conn_auto_progress_eq(struct rxm_ep *rxm_ep, struct rxm_msg_eq_entry *entry)
+/* Stops at a full ring, which the ep progress call that follows drains */
+static void rxm_conn_auto_progress_eq(struct rxm_ep *rxm_ep)
 {
-	memset(entry, 0, RXM_MSG_EQ_ENTRY_SZ);
-
-	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	entry->rd = rxm_eq_read(rxm_ep, RXM_CM_ENTRY_SZ, entry);
-	ofi_ep_lock_release(&rxm_ep->util_ep);
+	struct rxm_msg_eq_entry *entry;
 
-	if (!entry->rd || entry->rd == -FI_EAGAIN)
-		return FI_SUCCESS;
-	if (entry->rd < 0 && entry->rd != -FI_ECONNREFUSED)
-		return entry->rd;
+	while ((entry = rxm_cm_event_reserve(rxm_ep->cmap))) {
+		entry->rd = rxm_eq_read(rxm_ep, RXM_CM_ENTRY_SZ, entry);
+		if (!entry->rd || entry->rd == -FI_EAGAIN)
+			break;
+		if (entry->rd < 0 && entry->rd != -FI_ECONNREFUSED)
+			break;
 
-	return rxm_conn_eq_event(rxm_ep, entry);
+		rxm_cm_event_commit(rxm_ep, entry);
+	}
 }
 
 static void *rxm_conn_atomic_progress(void *arg)
 {
 	struct rxm_ep *ep = container_of(arg, struct rxm_ep, util_ep);
-	struct rxm_msg_eq_entry *entry;
 	struct rxm_fabric *fabric;
 	struct fid *fids[2] = {
 		&ep->msg_eq->fid,
@@ -1353,10 +1876,6 @@ static void *rxm_conn_atomic_progress(void *arg)
 	};
 	int ret;
 
-	entry = alloca(RXM_MSG_EQ_ENTRY_SZ);
-	if (!entry)
-		return NULL;
-
 	fabric = container_of(ep->util_ep.domain->fabric,
 			      struct rxm_fabric, util_fabric);
 
@@ -1364,14 +1883,14 @@ static void *rxm_conn_atomic_progress(void *arg)
 	if (ret) {
 		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
 			"unable to get msg EQ fd: %s\n", fi_strerror(ret));
-		return NULL;
+		goto out;
 	}
 
 	ret = fi_control(&ep->msg_cq->fid, FI_GETWAIT, &fds[1].fd);
 	if (ret) {
 		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
 			"unable to get msg CQ fd: %s\n", fi_strerror(ret));
-		return NULL;
+		goto out;
 	}
 
 	FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "Starting auto-progress thread\n");
@@ -1390,11 +1909,14 @@ static void *rxm_conn_atomic_progress(void *arg)
 				break;
 			}
 		}
-		rxm_conn_auto_progress_eq(ep, entry);
+		rxm_conn_auto_progress_eq(ep);
 		ep->util_ep.progress(&ep->util_ep);
 	}
 
 	FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "Stopping auto progress thread\n");
+out:
+	/* Hand the MSG EQ back to the progress path */
+	ep->do_progress = false;
 	return NULL;
 }
 
@@ -1432,8 +1954,10 @@ static int rxm_prepare_cm_data(struct fid_pep *pep, struct rxm_cmap_handle *hand
 
 static int
 rxm_conn_connect(struct rxm_ep *ep, struct rxm_cmap_handle *handle,
-		 const void *addr)
+		 const void *addr, struct rxm_tx_eager_buf *tx_buf)
 {
+	char cm_buf[RXM_MAX_CM_DATA_SIZE];
+	size_t cm_len = sizeof(union rxm_cm_data);
 	int ret;
 	struct rxm_conn *rxm_conn = container_of(handle, struct rxm_conn, handle);
 	union rxm_cm_data cm_data = {
@@ -1461,7 +1985,8 @@ rxm_conn_connect(struct rxm_ep *ep, struct rxm_cmap_handle *handle,
 		return -FI_ENOMEM;
 	}
 
-	ret = rxm_msg_ep_open(ep, ep->msg_info, rxm_conn, &rxm_conn->handle);
+	ret = rxm_msg_ep_open(ep, ep->msg_info, &rxm_conn->msg_ep,
+			      &rxm_conn->handle);
 	if (ret)
 		return ret;
 
@@ -1474,8 +1999,18 @@ rxm_conn_connect(struct rxm_ep *ep, struct rxm_cmap_handle *handle,
 
 	cm_data.connect.rx_size = rxm_conn_get_rx_size(ep, ep->msg_info);
 
+	if (tx_buf) {
+		cm_data.connect.eager_len = (uint16_t) (sizeof(tx_buf->pkt) +
+							tx_buf->pkt.hdr.size);
+		assert(cm_len + cm_data.connect.eager_len <= sizeof(cm_buf));
+		memcpy(cm_buf + cm_len, &tx_buf->pkt,
+		       cm_data.connect.eager_len);
+		cm_len += cm_data.connect.eager_len;
+	}
+	memcpy(cm_buf, &cm_data, sizeof(cm_data));
+
 	ret = fi_connect(rxm_conn->msg_ep, ep->msg_info->dest_addr,
-			 &cm_data, sizeof(cm_data));
+			 cm_buf, cm_len);
 	if (ret) {
 		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "unable to connect msg_ep\n");
 		goto err;
@@ -1505,6 +2040,32 @@ static int rxm_conn_signal(struct rxm_ep *ep, void *context,
 	return 0;
 }
 
+/* A connection request carries the CM data and an eager packet */
+static void rxm_conn_init_cm_eager(struct rxm_ep *rxm_ep)
+{
+	size_t hdr_size = sizeof(union rxm_cm_data) + sizeof(struct rxm_pkt);
+	size_t cm_data_size = 0, max_size = 0;
+	size_t opt_size = sizeof(cm_data_size);
+
+	if (fi_getopt(&rxm_ep->msg_pep->fid, FI_OPT_ENDPOINT,
+		      FI_OPT_CM_DATA_SIZE, &cm_data_size, &opt_size))
+		cm_data_size = 0;
+
+	cm_data_size = MIN(cm_data_size, RXM_MAX_CM_DATA_SIZE);
+	if (cm_data_size > hdr_size)
+		max_size = MIN(cm_data_size - hdr_size, rxm_eager_limit);
+
+	if (fi_param_get_size_t(&rxm_prov, "cm_eager_size",
+				&rxm_ep->cm_eager_size))
+		rxm_ep->cm_eager_size = max_size;
+	else
+		rxm_ep->cm_eager_size = MIN(rxm_ep->cm_eager_size, max_size);
+
+	FI_INFO(&rxm_prov, FI_LOG_EP_CTRL,
+		"connection requests carry messages up to %zu bytes\n",
+		rxm_ep->cm_eager_size);
+}
+
 int rxm_conn_cmap_alloc(struct rxm_ep *rxm_ep)
 {
 	struct rxm_cmap_attr attr;
@@ -1529,6 +2090,7 @@ int rxm_conn_cmap_alloc(struct rxm_ep *rxm_ep)
 
 	attr.name		= name;
 
+	rxm_conn_init_cm_eager(rxm_ep);
 	ret = rxm_cmap_alloc(rxm_ep, &attr);
 	if (ret)
 		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
@@ -62,6 +62,15 @@ rxm_cq_strerror(struct fid_cq *cq_fid, int prov_errno,
 	return fi_cq_strerror(rxm_ep->msg_cq, prov_errno, err_data, buf, len);
 }
 
+static void rxm_rx_buf_handled(struct rxm_rx_buf *rx_buf)
+{
+	if (rx_buf->unhandled) {
+		assert(rx_buf->ep->rx_unhandled);
+		rx_buf->unhandled = 0;
+		rx_buf->ep->rx_unhandled--;
+	}
+}
+
 static int rxm_repost_new_rx(struct rxm_rx_buf *rx_buf)
 {
 	struct rxm_rx_buf *new_rx_buf;
@@ -95,7 +104,8 @@ static int rxm_finish_buf_recv(struct rxm_rx_buf *rx_buf)
 	if (rx_buf->pkt.ctrl_hdr.type != rxm_ctrl_eager)
 		flags |= FI_MORE;
 
-	if (rx_buf->pkt.ctrl_hdr.type == rxm_ctrl_rndv)
+	if ((rx_buf->pkt.ctrl_hdr.type == rxm_ctrl_rndv) ||
+	    (rx_buf->pkt.ctrl_hdr.type == rxm_ctrl_rndv_wr))
 		data = rxm_pkt_rndv_data(&rx_buf->pkt);
 	else
 		data = rx_buf->pkt.data;
@@ -112,6 +122,7 @@ static int rxm_cq_write_error_trunc(struct rxm_rx_buf *rx_buf, size_t done_len)
 {
 	int ret;
 
+	rxm_cq_flush_batch(rx_buf->ep);
 	if (rx_buf->ep->util_ep.flags & OFI_CNTR_ENABLED)
 		rxm_cntr_incerr(rx_buf->ep->util_ep.rx_cntr);
 
@@ -161,9 +172,11 @@ static int rxm_finish_recv(struct rxm_rx_buf *rx_buf, size_t done_len)
 		recv_entry->total_len -= recv_size;
 
 		if (recv_entry->total_len < rx_buf->ep->min_multi_recv_size) {
-			ret = ofi_cq_write(rx_buf->ep->util_ep.rx_cq,
-					   recv_entry->context,
-					   FI_MULTI_RECV, 0, NULL, 0, 0);
+			ret = rxm_cq_write_comp(rx_buf->ep,
+						rx_buf->ep->util_ep.rx_cq,
+						recv_entry->context,
+						FI_MULTI_RECV, 0, NULL, 0, 0,
+						FI_ADDR_NOTAVAIL);
 			goto release;
 		}
 
@@ -192,8 +205,9 @@ rxm_cq_write_tx_comp(struct rxm_ep *rxm_ep, uint64_t comp_flags,
 	int ret;
 
 	if (flags & FI_COMPLETION) {
-		ret = ofi_cq_write(rxm_ep->util_ep.tx_cq, app_context,
-				   comp_flags, 0, NULL, 0, 0);
+		ret = rxm_cq_write_comp(rxm_ep, rxm_ep->util_ep.tx_cq,
+					app_context, comp_flags, 0, NULL, 0, 0,
+					FI_ADDR_NOTAVAIL);
 		if (ret) {
 			FI_WARN(&rxm_prov, FI_LOG_CQ,
 				"Unable to report completion\n");
@@ -240,42 +254,53 @@ int rxm_finish_eager_send(struct rxm_ep *rxm_ep, struct rxm_tx_eager_buf *tx_buf
 	return ret;
 }
 
+/*
+ * The message completes once all of its segments have, whatever order the
+ * MSG provider reports them in.  A failed segment is reported on its own
+ * and suppresses the completion.  Its credit is not returned, as the
+ * connection is no longer usable.
+ */
 static int rxm_finish_sar_segment_send(struct rxm_ep *rxm_ep,
 				       struct rxm_tx_sar_buf *tx_buf, bool err)
 {
 	struct rxm_tx_sar_buf *first_tx_buf;
 	int ret = FI_SUCCESS;
 
-	switch (rxm_sar_get_seg_type(&tx_buf->pkt.ctrl_hdr)) {
-	case RXM_SAR_SEG_FIRST:
-		break;
-	case RXM_SAR_SEG_MIDDLE:
-		ofi_buf_free(tx_buf);
-		break;
-	case RXM_SAR_SEG_LAST:
-		if (!err) {
-			ret = rxm_cq_write_tx_comp(rxm_ep,
-					ofi_tx_cq_flags(tx_buf->pkt.hdr.op),
-					tx_buf->app_context, tx_buf->flags);
-
-			assert(ofi_tx_cq_flags(tx_buf->pkt.hdr.op) & FI_SEND);
-			ofi_ep_tx_cntr_inc(&rxm_ep->util_ep);
-		}
-		first_tx_buf = ofi_bufpool_get_ibuf(rxm_ep->
-					buf_pools[RXM_BUF_POOL_TX_SAR].pool,
-					tx_buf->pkt.ctrl_hdr.msg_id);
-		ofi_buf_free(first_tx_buf);
+	first_tx_buf = ofi_bufpool_get_ibuf(rxm_ep->
+				buf_pools[RXM_BUF_POOL_TX_SAR].pool,
+				tx_buf->pkt.ctrl_hdr.msg_id);
+	if (err)
+		first_tx_buf->msg.failed = true;
+	else
+		first_tx_buf->msg.conn->sar_tx_credits++;
+
+	if (tx_buf != first_tx_buf)
 		ofi_buf_free(tx_buf);
-		break;
+
+	assert(first_tx_buf->msg.segs_left);
+	if (--first_tx_buf->msg.segs_left)
+		return 0;
+
+	if (!first_tx_buf->msg.failed) {
+		ret = rxm_cq_write_tx_comp(rxm_ep,
+				ofi_tx_cq_flags(first_tx_buf->pkt.hdr.op),
+				first_tx_buf->app_context, first_tx_buf->flags);
+
+		assert(ofi_tx_cq_flags(first_tx_buf->pkt.hdr.op) & FI_SEND);
+		ofi_ep_tx_cntr_inc(&rxm_ep->util_ep);
 	}
+	ofi_buf_free(first_tx_buf);
 
 	return ret;
 }
 
-static int rxm_finish_send_rndv_ack(struct rxm_rx_buf *rx_buf)
+static int rxm_rndv_rx_finish(struct rxm_rx_buf *rx_buf)
 {
 	RXM_UPDATE_STATE(FI_LOG_CQ, rx_buf, RXM_RNDV_FINISH);
 
+	if (rx_buf->pkt.ctrl_hdr.type == rxm_ctrl_rndv_wr)
+		dlist_remove_init(&rx_buf->rndv_entry);
+
 	if (rx_buf->recv_entry->rndv.tx_buf) {
 		ofi_buf_free(rx_buf->recv_entry->rndv.tx_buf);
 		rx_buf->recv_entry->rndv.tx_buf = NULL;
@@ -285,9 +310,51 @@ static int rxm_finish_send_rndv_ack(struct rxm_rx_buf *rx_buf)
 		rxm_msg_mr_closev(rx_buf->mr,
 				  rx_buf->recv_entry->rxm_iov.count);
 
+	if (rx_buf->pkt.ctrl_hdr.type == rxm_ctrl_rndv_wr && rx_buf->rndv_err) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ, "write rendezvous failed: %s\n",
+			fi_strerror(-rx_buf->rndv_err));
+		rxm_cq_write_error(rx_buf->ep->util_ep.rx_cq,
+				   rx_buf->ep->util_ep.rx_cntr,
+				   rx_buf->recv_entry->context,
+				   rx_buf->rndv_err);
+		rxm_recv_entry_release(rx_buf->recv_entry->recv_queue,
+				       rx_buf->recv_entry);
+		rxm_rx_buf_free(rx_buf);
+		return 0;
+	}
+
 	return rxm_finish_recv(rx_buf, rx_buf->recv_entry->total_len);
 }
 
+/*
+ * Completes a write rendezvous receive in error.  If its CTS is still being
+ * sent, the receive completes once the send does.
+ */
+int rxm_rndv_rx_fail(struct rxm_rx_buf *rx_buf, int err)
+{
+	if (!rx_buf->rndv_err)
+		rx_buf->rndv_err = err;
+
+	if (rx_buf->hdr.state == RXM_RNDV_CTS_SENT) {
+		RXM_UPDATE_STATE(FI_LOG_CQ, rx_buf, RXM_RNDV_DONE_RECVD);
+		return 0;
+	}
+	return rxm_rndv_rx_finish(rx_buf);
+}
+
+/* Nothing arrives anymore for the write rendezvous of a closing connection */
+void rxm_rndv_rx_conn_close(struct rxm_conn *rxm_conn)
+{
+	struct rxm_rx_buf *rx_buf;
+
+	while (!dlist_empty(&rxm_conn->rndv_write_rx_list)) {
+		dlist_pop_front(&rxm_conn->rndv_write_rx_list,
+				struct rxm_rx_buf, rx_buf, rndv_entry);
+		dlist_init(&rx_buf->rndv_entry);
+		rxm_rndv_rx_fail(rx_buf, -FI_ECONNABORTED);
+	}
+}
+
 static int rxm_rndv_tx_finish(struct rxm_ep *rxm_ep,
 			      struct rxm_tx_rndv_buf *tx_buf)
 {
@@ -295,9 +362,24 @@ static int rxm_rndv_tx_finish(struct rxm_ep *rxm_ep,
 
 	RXM_UPDATE_STATE(FI_LOG_CQ, tx_buf, RXM_RNDV_FINISH);
 
+	if ((tx_buf->pkt.ctrl_hdr.type == rxm_ctrl_rndv_wr) &&
+	    tx_buf->write.done_buf) {
+		ofi_buf_free(tx_buf->write.done_buf);
+		tx_buf->write.done_buf = NULL;
+	}
+
 	if (!rxm_ep->rdm_mr_local)
 		rxm_msg_mr_closev(tx_buf->mr, tx_buf->count);
 
+	if ((tx_buf->pkt.ctrl_hdr.type == rxm_ctrl_rndv_wr) &&
+	    tx_buf->write.err) {
+		rxm_cq_write_error(rxm_ep->util_ep.tx_cq,
+				   rxm_ep->util_ep.tx_cntr,
+				   tx_buf->app_context, tx_buf->write.err);
+		ofi_buf_free(tx_buf);
+		return 0;
+	}
+
 	ret = rxm_cq_write_tx_comp(rxm_ep, ofi_tx_cq_flags(tx_buf->pkt.hdr.op),
 				   tx_buf->app_context, tx_buf->flags);
 
@@ -309,6 +391,62 @@ static int rxm_rndv_tx_finish(struct rxm_ep *rxm_ep,
 	return ret;
 }
 
+static ssize_t rxm_rndv_send_done(struct rxm_ep *rxm_ep,
+				  struct rxm_tx_rndv_buf *tx_buf);
+
+/*
+ * Ends a failed write rendezvous once nothing is outstanding.  If the
+ * receiver sent its CTS, it is sent a DONE carrying the error first, so
+ * that it fails the receive instead of waiting for the data.  Returns
+ * -FI_EAGAIN if that DONE must be retried.
+ */
+static ssize_t rxm_rndv_write_abort(struct rxm_ep *rxm_ep,
+				    struct rxm_tx_rndv_buf *tx_buf)
+{
+	ssize_t ret;
+
+	if (tx_buf->write.msg_ep && !tx_buf->write.done_posted) {
+		ret = rxm_rndv_send_done(rxm_ep, tx_buf);
+		if (ret == -FI_EAGAIN)
+			return ret;
+		tx_buf->write.done_posted = true;
+		if (!ret && tx_buf->write.pending)
+			return 0;
+	}
+	return rxm_rndv_tx_finish(rxm_ep, tx_buf);
+}
+
+/*
+ * Records the first error of a write rendezvous.  The error completion is
+ * written, and the tx_buf freed, once no MSG provider operation is
+ * outstanding and the write is not queued for retry.
+ */
+static ssize_t rxm_rndv_write_fail(struct rxm_ep *rxm_ep,
+				   struct rxm_tx_rndv_buf *tx_buf, int err)
+{
+	struct rxm_deferred_tx_entry *def_tx_entry;
+
+	if (!tx_buf->write.err)
+		tx_buf->write.err = err;
+
+	if (tx_buf->write.pending || tx_buf->write.deferred)
+		return 0;
+
+	if (rxm_rndv_write_abort(rxm_ep, tx_buf) != -FI_EAGAIN)
+		return 0;
+
+	def_tx_entry = rxm_ep_alloc_deferred_tx_entry(rxm_ep,
+						      tx_buf->write.conn,
+						      RXM_DEFERRED_TX_RNDV_WRITE);
+	if (!def_tx_entry)
+		return rxm_rndv_tx_finish(rxm_ep, tx_buf);
+
+	def_tx_entry->rndv_write.tx_buf = tx_buf;
+	tx_buf->write.deferred = true;
+	rxm_ep_enqueue_deferred_tx_queue(def_tx_entry);
+	return 0;
+}
+
 static int rxm_rndv_handle_ack(struct rxm_ep *rxm_ep, struct rxm_rx_buf *rx_buf)
 {
 	struct rxm_tx_rndv_buf *tx_buf;
@@ -334,6 +472,184 @@ static int rxm_rndv_handle_ack(struct rxm_ep *rxm_ep, struct rxm_rx_buf *rx_buf)
 	return ret;
 }
 
+static ssize_t rxm_rndv_send_done(struct rxm_ep *rxm_ep,
+				  struct rxm_tx_rndv_buf *tx_buf)
+{
+	struct rxm_conn *rxm_conn = tx_buf->write.conn;
+	struct rxm_tx_base_buf *done_buf;
+	struct rxm_pkt pkt = {
+		.hdr.op = ofi_op_msg,
+		.hdr.version = OFI_OP_VERSION,
+		.ctrl_hdr.version = RXM_CTRL_VERSION,
+		.ctrl_hdr.type = rxm_ctrl_rndv_done,
+		.ctrl_hdr.conn_id = rxm_conn->handle.remote_key,
+		.ctrl_hdr.msg_id = tx_buf->write.remote_id,
+		/* Error of the write, 0 if the data was placed */
+		.ctrl_hdr.ctrl_data = (uint64_t) -tx_buf->write.err,
+	};
+	ssize_t ret;
+
+	if (sizeof(pkt) <= rxm_ep->inject_limit) {
+		ret = fi_inject(tx_buf->write.msg_ep, &pkt, sizeof(pkt), 0);
+		if (ret != -FI_EAGAIN)
+			return ret;
+	}
+
+	done_buf = rxm_tx_buf_alloc(rxm_ep, RXM_BUF_POOL_TX_ACK);
+	if (!done_buf) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ,
+			"ran out of buffers from ACK buffer pool\n");
+		return -FI_EAGAIN;
+	}
+
+	done_buf->pkt.ctrl_hdr.type = rxm_ctrl_rndv_done;
+	done_buf->pkt.ctrl_hdr.conn_id = pkt.ctrl_hdr.conn_id;
+	done_buf->pkt.ctrl_hdr.msg_id = pkt.ctrl_hdr.msg_id;
+	done_buf->pkt.ctrl_hdr.ctrl_data = pkt.ctrl_hdr.ctrl_data;
+
+	/* Completes in the RXM_RNDV_WRITE state like the writes do */
+	ret = fi_send(tx_buf->write.msg_ep, &done_buf->pkt,
+		      sizeof(done_buf->pkt), done_buf->hdr.desc, 0, tx_buf);
+	if (ret) {
+		ofi_buf_free(done_buf);
+		return ret;
+	}
+
+	tx_buf->write.done_buf = done_buf;
+	tx_buf->write.pending++;
+	return 0;
+}
+
+/*
+ * Write the data into the buffers described by the receiver's CTS, then
+ * send DONE.  The MSG provider orders sends after writes (FI_ORDER_SAW)
+ * on the rail used for both, so DONE arrives only after the data has been
+ * placed.  Returns -FI_EAGAIN
+ * if the caller must retry; the progress made so far is kept in tx_buf.
+ * Other errors are reported through the tx_buf, see rxm_rndv_write_fail.
+ */
+ssize_t rxm_rndv_write_progress(struct rxm_ep *rxm_ep,
+				struct rxm_tx_rndv_buf *tx_buf)
+{
+	struct rxm_rndv_hdr *remote = &tx_buf->write.remote;
+	struct ofi_rma_iov *rma_iov;
+	struct iovec iov[RXM_IOV_LIMIT];
+	void *desc[RXM_IOV_LIMIT];
+	size_t count, index, offset;
+	ssize_t ret;
+
+	if (tx_buf->write.err)
+		return tx_buf->write.pending ? 0 :
+		       rxm_rndv_write_abort(rxm_ep, tx_buf);
+
+	for (; tx_buf->write.remote_index < remote->count;
+	     tx_buf->write.remote_index++) {
+		rma_iov = &remote->iov[tx_buf->write.remote_index];
+		if (!rma_iov->len)
+			continue;
+
+		index = tx_buf->write.index;
+		offset = tx_buf->write.offset;
+		if (index >= tx_buf->count)
+			return rxm_rndv_write_fail(rxm_ep, tx_buf,
+						   -FI_ETOOSMALL);
+
+		ret = ofi_copy_iov_desc(iov, desc, &count, tx_buf->write.iov,
+					tx_buf->write.desc, tx_buf->count,
+					&index, &offset, rma_iov->len);
+		if (ret)
+			return rxm_rndv_write_fail(rxm_ep, tx_buf, (int) ret);
+
+		ret = fi_writev(tx_buf->write.msg_ep, iov, desc, count, 0,
+				rma_iov->addr, rma_iov->key, tx_buf);
+		if (ret)
+			goto err;
+
+		tx_buf->write.index = index;
+		tx_buf->write.offset = offset;
+		tx_buf->write.pending++;
+	}
+
+	if (!tx_buf->write.done_posted) {
+		ret = rxm_rndv_send_done(rxm_ep, tx_buf);
+		if (ret)
+			goto err;
+		tx_buf->write.done_posted = true;
+	}
+
+	if (!tx_buf->write.pending)
+		return rxm_rndv_tx_finish(rxm_ep, tx_buf);
+	return 0;
+err:
+	return ret == -FI_EAGAIN ? ret :
+	       rxm_rndv_write_fail(rxm_ep, tx_buf, (int) ret);
+}
+
+static ssize_t rxm_rndv_handle_cts(struct rxm_ep *rxm_ep,
+				   struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_deferred_tx_entry *def_tx_entry;
+	struct rxm_tx_rndv_buf *tx_buf;
+	ssize_t ret;
+
+	tx_buf = ofi_bufpool_get_ibuf(rxm_ep->buf_pools[RXM_BUF_POOL_TX_RNDV].pool,
+				      rx_buf->pkt.ctrl_hdr.msg_id);
+
+	FI_DBG(&rxm_prov, FI_LOG_CQ, "Got CTS for msg_id: 0x%" PRIx64 "\n",
+	       rx_buf->pkt.ctrl_hdr.msg_id);
+
+	assert(tx_buf->pkt.ctrl_hdr.msg_id == rx_buf->pkt.ctrl_hdr.msg_id);
+	assert(tx_buf->hdr.state == RXM_RNDV_WRITE);
+
+	memcpy(&tx_buf->write.remote, rx_buf->pkt.data,
+	       sizeof(tx_buf->write.remote));
+	tx_buf->write.remote_id = rx_buf->pkt.ctrl_hdr.ctrl_data;
+	rxm_rx_buf_free(rx_buf);
+
+	tx_buf->write.msg_ep = rxm_conn_rail_ep(tx_buf->write.conn);
+	if (tx_buf->write.remote.count > RXM_IOV_LIMIT)
+		return rxm_rndv_write_fail(rxm_ep, tx_buf, -FI_EINVAL);
+	ret = rxm_rndv_write_progress(rxm_ep, tx_buf);
+	if (ret != -FI_EAGAIN)
+		return ret;
+
+	def_tx_entry = rxm_ep_alloc_deferred_tx_entry(rxm_ep,
+						      tx_buf->write.conn,
+						      RXM_DEFERRED_TX_RNDV_WRITE);
+	if (!def_tx_entry) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ, "unable to allocate TX entry "
+			"for deferred rendezvous write\n");
+		return rxm_rndv_write_fail(rxm_ep, tx_buf, -FI_ENOMEM);
+	}
+
+	def_tx_entry->rndv_write.tx_buf = tx_buf;
+	tx_buf->write.deferred = true;
+	rxm_ep_enqueue_deferred_tx_queue(def_tx_entry);
+	return 0;
+}
+
+static int rxm_rndv_handle_done(struct rxm_ep *rxm_ep,
+				struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_rx_buf *rndv_rx_buf;
+
+	rndv_rx_buf = ofi_bufpool_get_ibuf(rxm_ep->buf_pools[RXM_BUF_POOL_RX].pool,
+					   rx_buf->pkt.ctrl_hdr.msg_id);
+
+	FI_DBG(&rxm_prov, FI_LOG_CQ, "Got DONE for msg_id: 0x%" PRIx64 "\n",
+	       rndv_rx_buf->pkt.ctrl_hdr.msg_id);
+
+	rndv_rx_buf->rndv_err = -(int) rx_buf->pkt.ctrl_hdr.ctrl_data;
+	rxm_rx_buf_free(rx_buf);
+
+	if (rndv_rx_buf->hdr.state == RXM_RNDV_DONE_WAIT)
+		return rxm_rndv_rx_finish(rndv_rx_buf);
+
+	assert(rndv_rx_buf->hdr.state == RXM_RNDV_CTS_SENT);
+	RXM_UPDATE_STATE(FI_LOG_CQ, rndv_rx_buf, RXM_RNDV_DONE_RECVD);
+	return 0;
+}
+
 static int rxm_rx_buf_match_msg_id(struct dlist_entry *item, const void *arg)
 {
 	uint64_t msg_id = *((uint64_t *) arg);
@@ -343,29 +659,32 @@ static int rxm_rx_buf_match_msg_id(struct dlist_entry *item, const void *arg)
 	return (msg_id == rx_buf->pkt.ctrl_hdr.msg_id);
 }
 
+/*
+ * Segments are placed at the offset they carry, so they may be processed in
+ * any order.  The message is done once all of its bytes have arrived, even
+ * if the receive buffer was too small to hold them.
+ */
 static ssize_t rxm_process_seg_data(struct rxm_rx_buf *rx_buf, int *done)
 {
 	uint64_t done_len;
 	ssize_t ret;
 
-	done_len = ofi_copy_to_iov(rx_buf->recv_entry->rxm_iov.iov,
-				   rx_buf->recv_entry->rxm_iov.count,
-				   rx_buf->recv_entry->sar.total_recv_len,
-				   rx_buf->pkt.data,
-				   rx_buf->pkt.ctrl_hdr.seg_size);
-	rx_buf->recv_entry->sar.total_recv_len += done_len;
-
-	if ((rxm_sar_get_seg_type(&rx_buf->pkt.ctrl_hdr) == RXM_SAR_SEG_LAST) ||
-	    (done_len != rx_buf->pkt.ctrl_hdr.seg_size)) {
+	ofi_copy_to_iov(rx_buf->recv_entry->rxm_iov.iov,
+			rx_buf->recv_entry->rxm_iov.count,
+			rxm_sar_get_offset(&rx_buf->pkt.ctrl_hdr),
+			rx_buf->pkt.data, rx_buf->pkt.ctrl_hdr.seg_size);
+	rx_buf->recv_entry->sar.total_recv_len += rx_buf->pkt.ctrl_hdr.seg_size;
 
-		dlist_remove(&rx_buf->recv_entry->sar.entry);
+	if (rx_buf->recv_entry->sar.total_recv_len >= rx_buf->pkt.hdr.size) {
+		if (rx_buf->recv_entry->sar.msg_id != RXM_SAR_RX_INIT)
+			dlist_remove(&rx_buf->recv_entry->sar.entry);
 
 		/* Mark rxm_recv_entry::msg_id as unknown for futher re-use */
 		rx_buf->recv_entry->sar.msg_id = RXM_SAR_RX_INIT;
-
-		done_len = rx_buf->recv_entry->sar.total_recv_len;
 		rx_buf->recv_entry->sar.total_recv_len = 0;
 
+		done_len = MIN(rx_buf->recv_entry->total_len,
+			       rx_buf->pkt.hdr.size);
 		*done = 1;
 		ret = rxm_finish_recv(rx_buf, done_len);
 	} else {
@@ -510,6 +829,7 @@ static ssize_t rxm_handle_rndv(struct rxm_rx_buf *rx_buf)
 	       (rx_buf->rndv_hdr->count <= RXM_IOV_LIMIT));
 
 	RXM_UPDATE_STATE(FI_LOG_CQ, rx_buf, RXM_RNDV_READ);
+	rx_buf->rndv_ep = rxm_conn_rail_ep(rx_buf->conn);
 
 	for (i = 0; i < rx_buf->rndv_hdr->count; i++) {
 		size_t copy_len = MIN(rx_buf->rndv_hdr->iov[i].len,
@@ -526,7 +846,7 @@ static ssize_t rxm_handle_rndv(struct rxm_rx_buf *rx_buf)
 							recv_entry->total_len);
 		}
 		total_recv_len -= copy_len;
-		ret = fi_readv(rx_buf->conn->msg_ep, iov, desc, count, 0,
+		ret = fi_readv(rx_buf->rndv_ep, iov, desc, count, 0,
 			       rx_buf->rndv_hdr->iov[i].addr,
 			       rx_buf->rndv_hdr->iov[i].key, rx_buf);
 		if (ret) {
@@ -552,6 +872,130 @@ readv_err:
 	return ret;
 }
 
+/*
+ * Write rendezvous: the sender waits for a CTS naming our buffer before it
+ * writes the data, then tells us it is done with a DONE message.
+ */
+static ssize_t rxm_rndv_send_cts(struct rxm_rx_buf *rx_buf,
+				 struct iovec *iov, void **desc, size_t count,
+				 size_t total_len)
+{
+	struct rxm_deferred_tx_entry *def_tx_entry;
+	struct rxm_tx_base_buf *tx_buf;
+	struct fid_mr **mr;
+	size_t pkt_size = sizeof(struct rxm_pkt) + sizeof(struct rxm_rndv_hdr);
+	ssize_t ret;
+
+	if (!rx_buf->ep->rdm_mr_local) {
+		ret = rxm_msg_mr_regv(rx_buf->ep, iov, count, total_len,
+				      FI_REMOTE_WRITE, rx_buf->mr);
+		if (ret)
+			return ret;
+		mr = rx_buf->mr;
+	} else {
+		/* desc is msg fid_mr * array */
+		mr = (struct fid_mr **) desc;
+	}
+
+	tx_buf = rxm_tx_buf_alloc(rx_buf->ep, RXM_BUF_POOL_TX_ACK);
+	if (!tx_buf) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ,
+			"ran out of buffers from ACK buffer pool\n");
+		ret = -FI_EAGAIN;
+		goto err;
+	}
+
+	tx_buf->pkt.ctrl_hdr.type = rxm_ctrl_rndv_cts;
+	tx_buf->pkt.ctrl_hdr.conn_id = rx_buf->conn->handle.remote_key;
+	tx_buf->pkt.ctrl_hdr.msg_id = rx_buf->pkt.ctrl_hdr.msg_id;
+	tx_buf->pkt.ctrl_hdr.ctrl_data = ofi_buf_index(rx_buf);
+	rxm_rndv_hdr_init(rx_buf->ep, tx_buf->pkt.data, iov, count, mr);
+
+	if (pkt_size <= rx_buf->ep->inject_limit) {
+		RXM_UPDATE_STATE(FI_LOG_CQ, rx_buf, RXM_RNDV_DONE_WAIT);
+		ret = fi_inject(rx_buf->conn->msg_ep, &tx_buf->pkt, pkt_size, 0);
+		if (!ret) {
+			ofi_buf_free(tx_buf);
+			return 0;
+		}
+		if (ret != -FI_EAGAIN)
+			goto free;
+	}
+
+	rx_buf->recv_entry->rndv.tx_buf = tx_buf;
+	RXM_UPDATE_STATE(FI_LOG_CQ, rx_buf, RXM_RNDV_CTS_SENT);
+	ret = fi_send(rx_buf->conn->msg_ep, &tx_buf->pkt, pkt_size,
+		      tx_buf->hdr.desc, 0, rx_buf);
+	if (!ret)
+		return 0;
+	if (ret != -FI_EAGAIN)
+		goto clear;
+
+	def_tx_entry = rxm_ep_alloc_deferred_tx_entry(rx_buf->ep, rx_buf->conn,
+						      RXM_DEFERRED_TX_RNDV_CTS);
+	if (!def_tx_entry) {
+		FI_WARN(&rxm_prov, FI_LOG_CQ,
+			"unable to allocate TX entry for deferred CTS\n");
+		ret = -FI_ENOMEM;
+		goto clear;
+	}
+
+	def_tx_entry->rndv_cts.rx_buf = rx_buf;
+	rxm_ep_enqueue_deferred_tx_queue(def_tx_entry);
+	return 0;
+clear:
+	rx_buf->recv_entry->rndv.tx_buf = NULL;
+free:
+	ofi_buf_free(tx_buf);
+err:
+	if (!rx_buf->ep->rdm_mr_local)
+		rxm_msg_mr_closev(rx_buf->mr, count);
+	return ret;
+}
+
+static ssize_t rxm_handle_rndv_write(struct rxm_rx_buf *rx_buf)
+{
+	struct iovec iov[RXM_IOV_LIMIT];
+	void *desc[RXM_IOV_LIMIT];
+	size_t count = 0, index = 0, offset = 0, total_len;
+	ssize_t ret;
+
+	ret = rxm_repost_new_rx(rx_buf);
+	if (ret)
+		return ret;
+
+	if (!rx_buf->conn) {
+		assert(rx_buf->ep->srx_ctx);
+		rx_buf->conn = rxm_key2conn(rx_buf->ep,
+					    rx_buf->pkt.ctrl_hdr.conn_id);
+		if (!rx_buf->conn)
+			return -FI_EOTHER;
+	}
+
+	FI_DBG(&rxm_prov, FI_LOG_CQ,
+	       "Got incoming write rendezvous with msg_id: 0x%" PRIx64 "\n",
+	       rx_buf->pkt.ctrl_hdr.msg_id);
+
+	/* Only offer the part of the buffer the message will fill */
+	total_len = MIN(rx_buf->recv_entry->total_len, rx_buf->pkt.hdr.size);
+	if (total_len) {
+		ret = ofi_copy_iov_desc(iov, desc, &count,
+					rx_buf->recv_entry->rxm_iov.iov,
+					rx_buf->recv_entry->rxm_iov.desc,
+					rx_buf->recv_entry->rxm_iov.count,
+					&index, &offset, total_len);
+		if (ret)
+			return ret;
+	}
+
+	rx_buf->rndv_err = 0;
+	ret = rxm_rndv_send_cts(rx_buf, iov, desc, count, total_len);
+	if (!ret)
+		dlist_insert_tail(&rx_buf->rndv_entry,
+				  &rx_buf->conn->rndv_write_rx_list);
+	return ret;
+}
+
 ssize_t rxm_handle_eager(struct rxm_rx_buf *rx_buf)
 {
 	uint64_t done_len;
@@ -590,6 +1034,8 @@ ssize_t rxm_handle_rx_buf(struct rxm_rx_buf *rx_buf)
 		return rx_buf->ep->eager_ops->handle_rx(rx_buf);
 	case rxm_ctrl_rndv:
 		return rxm_handle_rndv(rx_buf);
+	case rxm_ctrl_rndv_wr:
+		return rxm_handle_rndv_write(rx_buf);
 	case rxm_ctrl_seg:
 		return rxm_handle_seg_data(rx_buf);
 	default:
@@ -604,12 +1050,9 @@ rxm_match_rx_buf(struct rxm_rx_buf *rx_buf,
 		 struct rxm_recv_queue *recv_queue,
 		    struct rxm_recv_match_attr *match_attr)
 {
-	struct dlist_entry *entry;
-
-	entry = dlist_remove_first_match(&recv_queue->recv_list,
-					 recv_queue->match_recv, match_attr);
-	if (entry) {
-		rx_buf->recv_entry = container_of(entry, struct rxm_recv_entry, entry);
+	rx_buf->recv_entry = rxm_recv_queue_match(recv_queue, match_attr);
+	if (rx_buf->recv_entry) {
+		rxm_return_credit(rx_buf);
 		return rxm_handle_rx_buf(rx_buf);
 	}
 
@@ -619,14 +1062,82 @@ rxm_match_rx_buf(struct rxm_rx_buf *rx_buf,
 	rx_buf->unexp_msg.addr = match_attr->addr;
 	rx_buf->unexp_msg.tag = match_attr->tag;
 
-	dlist_insert_tail(&rx_buf->unexp_msg.entry,
-			  &recv_queue->unexp_msg_list);
+	rxm_unexp_msg_insert(recv_queue, rx_buf);
 
 	// repost a new buffer now since we don't know when the unexpected
 	// buffer will be consumed
 	return rxm_repost_new_rx(rx_buf);
 }
 
+/*
+ * Called by the MSG provider once the rxm header of a message is in the
+ * posted rx_buf.  An eager message that matches a posted receive right away
+ * is received straight into the user buffer, saving the copy out of the
+ * rx_buf.  Messages are matched in arrival order, so this is only done when
+ * every message received before it has been handled.  Runs from the MSG CQ
+ * read in rxm progress, under the endpoint lock.
+ */
+size_t rxm_get_rbuf(void *context, size_t msg_len, struct iovec *iov,
+		    size_t max_count)
+{
+	struct rxm_rx_buf *rx_buf = context;
+	struct rxm_ep *rxm_ep = rx_buf->ep;
+	struct rxm_recv_match_attr match_attr = {
+		.addr = FI_ADDR_UNSPEC,
+	};
+	struct rxm_recv_queue *recv_queue;
+	struct rxm_recv_entry *recv_entry;
+	struct rxm_conn *conn;
+
+	assert(rx_buf->hdr.state == RXM_RX);
+	rx_buf->unhandled = 1;
+	if (rxm_ep->rx_unhandled++)
+		return 0;
+
+	if (msg_len < sizeof(struct rxm_pkt) ||
+	    msg_len - sizeof(struct rxm_pkt) != rx_buf->pkt.hdr.size ||
+	    rx_buf->pkt.ctrl_hdr.type != rxm_ctrl_eager ||
+	    rx_buf->pkt.ctrl_hdr.version != RXM_CTRL_VERSION ||
+	    rx_buf->pkt.hdr.version != OFI_OP_VERSION ||
+	    rxm_ep->eager_ops->handle_rx != rxm_handle_eager ||
+	    rxm_ep->rxm_info->mode & FI_BUFFERED_RECV)
+		return 0;
+
+	if (rxm_ep->rxm_info->caps & (FI_SOURCE | FI_DIRECTED_RECV)) {
+		conn = rxm_ep->srx_ctx ?
+		       rxm_key2conn(rxm_ep, rx_buf->pkt.ctrl_hdr.conn_id) :
+		       rx_buf->conn;
+		if (!conn)
+			return 0;
+		match_attr.addr = conn->handle.fi_addr;
+	}
+
+	switch (rx_buf->pkt.hdr.op) {
+	case ofi_op_msg:
+		recv_queue = &rxm_ep->recv_queue;
+		break;
+	case ofi_op_tagged:
+		recv_queue = &rxm_ep->trecv_queue;
+		match_attr.tag = rx_buf->pkt.hdr.tag;
+		break;
+	default:
+		return 0;
+	}
+
+	recv_entry = rxm_recv_queue_find(recv_queue, &match_attr);
+	if (!recv_entry || recv_entry->flags & FI_MULTI_RECV ||
+	    recv_entry->total_len < rx_buf->pkt.hdr.size ||
+	    recv_entry->rxm_iov.count > max_count)
+		return 0;
+
+	dlist_remove(&recv_entry->entry);
+	rx_buf->recv_entry = recv_entry;
+	rx_buf->direct_recv = 1;
+	memcpy(iov, recv_entry->rxm_iov.iov,
+	       recv_entry->rxm_iov.count * sizeof(*iov));
+	return recv_entry->rxm_iov.count;
+}
+
 static ssize_t rxm_handle_recv_comp(struct rxm_rx_buf *rx_buf)
 {
 	struct rxm_recv_match_attr match_attr = {
@@ -642,8 +1153,16 @@ static ssize_t rxm_handle_recv_comp(struct rxm_rx_buf *rx_buf)
 		match_attr.addr = rx_buf->conn->handle.fi_addr;
 	}
 
-	if (rx_buf->ep->rxm_info->mode & FI_BUFFERED_RECV)
+	/* Matched and received by rxm_get_rbuf() */
+	if (rx_buf->direct_recv) {
+		rxm_return_credit(rx_buf);
+		return rxm_finish_recv(rx_buf, rx_buf->pkt.hdr.size);
+	}
+
+	if (rx_buf->ep->rxm_info->mode & FI_BUFFERED_RECV) {
+		rxm_return_credit(rx_buf);
 		return rxm_finish_buf_recv(rx_buf);
+	}
 
 	switch(rx_buf->pkt.hdr.op) {
 	case ofi_op_msg:
@@ -662,6 +1181,112 @@ static ssize_t rxm_handle_recv_comp(struct rxm_rx_buf *rx_buf)
 	}
 }
 
+/*
+ * Takes a message carried by a connection request into an rx_buf before the
+ * request is accepted, as the accept tells the sender whether the message
+ * was taken.  Returns NULL if the message is invalid or no rx_buf is
+ * available, and the sender then resends it over the connection.
+ */
+struct rxm_rx_buf *rxm_get_cm_eager(struct rxm_conn *rxm_conn,
+				    const void *pkt, size_t len)
+{
+	struct rxm_ep *rxm_ep = rxm_conn->handle.cmap->ep;
+	const struct rxm_pkt *hdr = pkt;
+	struct rxm_rx_buf *rx_buf;
+
+	if (len < sizeof(struct rxm_pkt) ||
+	    len > sizeof(struct rxm_pkt) + rxm_eager_limit) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+			"invalid eager data length in CM data: %zu\n", len);
+		return NULL;
+	}
+
+	if (hdr->ctrl_hdr.version != RXM_CTRL_VERSION ||
+	    hdr->hdr.version != OFI_OP_VERSION ||
+	    hdr->ctrl_hdr.type != rxm_ctrl_eager ||
+	    hdr->hdr.size != len - sizeof(struct rxm_pkt)) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+			"invalid eager packet in CM data\n");
+		return NULL;
+	}
+
+	rx_buf = rxm_rx_buf_alloc(rxm_ep, rxm_conn->msg_ep, 0);
+	if (!rx_buf) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+			"unable to allocate rx_buf for CM data\n");
+		return NULL;
+	}
+
+	memcpy(&rx_buf->pkt, pkt, len);
+	rx_buf->conn = rxm_conn;
+	rx_buf->pkt.ctrl_hdr.conn_id = rxm_conn->handle.key;
+	return rx_buf;
+}
+
+/*
+ * Once the connection is accepted, the message is handled as if it had been
+ * the first to arrive on it.
+ */
+ssize_t rxm_handle_cm_eager(struct rxm_rx_buf *rx_buf)
+{
+	return rxm_handle_recv_comp(rx_buf);
+}
+
+/*
+ * Each message packed into an aggregate is handed on in order as an eager
+ * message of its own.
+ */
+static ssize_t rxm_handle_agg(struct rxm_rx_buf *agg_buf)
+{
+	struct rxm_ep *rxm_ep = agg_buf->ep;
+	struct rxm_agg_hdr *agg_hdr;
+	struct rxm_rx_buf *rx_buf;
+	size_t offset = 0, len;
+	ssize_t ret = 0;
+
+	while (offset < agg_buf->pkt.hdr.size) {
+		agg_hdr = (struct rxm_agg_hdr *) (agg_buf->pkt.data + offset);
+		if (agg_buf->pkt.hdr.size - offset < sizeof(*agg_hdr))
+			goto err;
+
+		len = sizeof(*agg_hdr) + ofi_get_aligned_size(agg_hdr->size, 8);
+		if (agg_hdr->size > rxm_eager_limit ||
+		    len > agg_buf->pkt.hdr.size - offset)
+			goto err;
+
+		rx_buf = rxm_rx_buf_alloc(rxm_ep, agg_buf->msg_ep, 0);
+		if (!rx_buf) {
+			ret = -FI_ENOMEM;
+			break;
+		}
+
+		rx_buf->pkt.ctrl_hdr = agg_buf->pkt.ctrl_hdr;
+		rx_buf->pkt.ctrl_hdr.type = rxm_ctrl_eager;
+		rx_buf->pkt.hdr = agg_buf->pkt.hdr;
+		rx_buf->pkt.hdr.op = agg_hdr->op;
+		rx_buf->pkt.hdr.size = agg_hdr->size;
+		rx_buf->pkt.hdr.tag = agg_hdr->tag;
+		rx_buf->pkt.hdr.data = agg_hdr->data;
+		rx_buf->pkt.hdr.flags = (agg_hdr->flags &
+					 RXM_AGG_REMOTE_CQ_DATA) ?
+					FI_REMOTE_CQ_DATA : 0;
+		rx_buf->conn = agg_buf->conn;
+		memcpy(rx_buf->pkt.data, agg_hdr + 1, agg_hdr->size);
+
+		ret = rxm_handle_recv_comp(rx_buf);
+		if (ret)
+			break;
+		offset += len;
+	}
+
+	rxm_rx_buf_free(agg_buf);
+	return ret;
+err:
+	FI_WARN(&rxm_prov, FI_LOG_CQ, "invalid aggregated message\n");
+	rxm_rx_buf_free(agg_buf);
+	return -FI_EIO;
+}
+
 static int rxm_sar_match_msg_id(struct dlist_entry *item, const void *arg)
 {
 	uint64_t msg_id = *((uint64_t *) arg);
@@ -743,8 +1368,7 @@ static ssize_t rxm_rndv_send_ack(struct rxm_rx_buf *rx_buf)
 			"ran out of buffers from ACK buffer pool\n");
 		return -FI_EAGAIN;
 	}
-	assert(rx_buf->recv_entry->rndv.tx_buf->pkt.ctrl_hdr.type ==
-	       rxm_ctrl_rndv_ack);
+	rx_buf->recv_entry->rndv.tx_buf->pkt.ctrl_hdr.type = rxm_ctrl_rndv_ack;
 
 	assert(rx_buf->hdr.state == RXM_RNDV_READ);
 
@@ -792,8 +1416,9 @@ static int rxm_handle_remote_write(struct rxm_ep *rxm_ep,
 	int ret;
 
 	FI_DBG(&rxm_prov, FI_LOG_CQ, "writing remote write completion\n");
-	ret = ofi_cq_write(rxm_ep->util_ep.rx_cq, NULL, comp->flags, 0, NULL,
-			   comp->data, 0);
+	ret = rxm_cq_write_comp(rxm_ep, rxm_ep->util_ep.rx_cq, NULL,
+				comp->flags, 0, NULL, comp->data, 0,
+				FI_ADDR_NOTAVAIL);
 	if (ret) {
 		FI_WARN(&rxm_prov, FI_LOG_CQ,
 				"Unable to write remote write completion\n");
@@ -1052,13 +1677,101 @@ static ssize_t rxm_handle_credit(struct rxm_ep *rxm_ep, struct rxm_rx_buf *rx_bu
 {
 	struct rxm_domain *domain = container_of(rxm_ep->util_ep.domain,
 						 struct rxm_domain, util_domain);
+	struct rxm_conn *rxm_conn;
 
-	domain->flow_ctrl_ops->add_credits(rx_buf->msg_ep,
-					   rx_buf->pkt.ctrl_hdr.ctrl_data);
+	if (domain->flow_ctrl_ops != &rxm_no_ops_flow_ctrl) {
+		domain->flow_ctrl_ops->add_credits(rx_buf->msg_ep,
+						rx_buf->pkt.ctrl_hdr.ctrl_data);
+		goto free;
+	}
+
+	rxm_conn = rxm_key2conn(rxm_ep, rx_buf->pkt.ctrl_hdr.conn_id);
+	if (!rxm_conn)
+		goto free;
+
+	rxm_conn->flow_ctrl = true;
+	rxm_conn->tx_credits += rx_buf->pkt.ctrl_hdr.ctrl_data;
+	if (rxm_conn->stall_start && rxm_conn->tx_credits > 0) {
+		rxm_ep->flow_ctrl_stall_ns += ofi_gettime_ns() -
+					      rxm_conn->stall_start;
+		rxm_conn->stall_start = 0;
+	}
+free:
 	rxm_rx_buf_free(rx_buf);
 	return FI_SUCCESS;
 }
 
+static void rxm_conn_return_credits(struct rxm_conn *rxm_conn)
+{
+	if (rxm_send_credits(rxm_conn->msg_ep, rxm_conn->rx_credits))
+		return;
+
+	rxm_conn->rx_credits = 0;
+	dlist_remove_init(&rxm_conn->credit_entry);
+}
+
+/*
+ * Without flow control in the MSG provider, each peer is granted
+ * flow_ctrl_credits messages when the connection is established.  A credit
+ * goes back to the sender once its message has been matched here, so the
+ * messages a peer has waiting unmatched never exceed the grant.  Credits
+ * are returned in batches of a quarter of the grant, and whatever is left
+ * once the MSG CQ runs empty, so that a stalled sender is never kept
+ * waiting for a batch to fill up.
+ */
+void rxm_return_credit(struct rxm_rx_buf *rx_buf)
+{
+	struct rxm_ep *rxm_ep = rx_buf->ep;
+	struct rxm_conn *rxm_conn;
+
+	if (!rxm_ep->flow_ctrl_credits ||
+	    (rx_buf->pkt.ctrl_hdr.type == rxm_ctrl_seg &&
+	     rxm_sar_get_seg_type(&rx_buf->pkt.ctrl_hdr) != RXM_SAR_SEG_FIRST))
+		return;
+
+	rxm_conn = rxm_key2conn(rxm_ep, rx_buf->pkt.ctrl_hdr.conn_id);
+	if (!rxm_conn)
+		return;
+
+	if (!rxm_conn->rx_credits++)
+		dlist_insert_tail(&rxm_conn->credit_entry,
+				  &rxm_ep->credit_return_list);
+
+	if (rxm_conn->rx_credits >= MAX(rxm_ep->flow_ctrl_credits / 4, 1))
+		rxm_conn_return_credits(rxm_conn);
+}
+
+static void rxm_ep_return_credits(struct rxm_ep *rxm_ep)
+{
+	struct dlist_entry *conn_entry_tmp;
+	struct rxm_conn *rxm_conn;
+
+	dlist_foreach_container_safe(&rxm_ep->credit_return_list,
+				     struct rxm_conn, rxm_conn,
+				     credit_entry, conn_entry_tmp)
+		rxm_conn_return_credits(rxm_conn);
+}
+
+static int
+rxm_finish_agg_send(struct rxm_ep *rxm_ep, struct rxm_tx_agg_buf *tx_buf)
+{
+	size_t i;
+	int ret, err = 0;
+
+	for (i = 0; i < tx_buf->count; i++) {
+		ret = rxm_cq_write_tx_comp(rxm_ep,
+					   ofi_tx_cq_flags(tx_buf->msg[i].op),
+					   tx_buf->msg[i].app_context,
+					   tx_buf->msg[i].flags);
+		if (ret)
+			err = ret;
+		ofi_ep_tx_cntr_inc(&rxm_ep->util_ep);
+	}
+
+	ofi_buf_free(tx_buf);
+	return err;
+}
+
 int rxm_finish_coll_eager_send(struct rxm_ep *rxm_ep,
 			       struct rxm_tx_eager_buf *tx_eager_buf)
 {
@@ -1102,6 +1815,9 @@ ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 		assert(comp->flags & FI_SEND);
 		ofi_buf_free(tx_buf);
 		return 0;
+	case RXM_AGG_TX:
+		assert(comp->flags & FI_SEND);
+		return rxm_finish_agg_send(rxm_ep, comp->op_context);
 	case RXM_INJECT_TX:
 		assert(0);
 		return -FI_EOPBADSTATE;
@@ -1115,13 +1831,19 @@ ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 		assert(!(comp->flags & FI_REMOTE_READ));
 		assert((rx_buf->pkt.hdr.version == OFI_OP_VERSION) &&
 		       (rx_buf->pkt.ctrl_hdr.version == RXM_CTRL_VERSION));
+		rxm_rx_buf_handled(rx_buf);
 
 		switch (rx_buf->pkt.ctrl_hdr.type) {
 		case rxm_ctrl_eager:
 		case rxm_ctrl_rndv:
+		case rxm_ctrl_rndv_wr:
 			return rxm_handle_recv_comp(rx_buf);
 		case rxm_ctrl_rndv_ack:
 			return rxm_rndv_handle_ack(rxm_ep, rx_buf);
+		case rxm_ctrl_rndv_cts:
+			return rxm_rndv_handle_cts(rxm_ep, rx_buf);
+		case rxm_ctrl_rndv_done:
+			return rxm_rndv_handle_done(rxm_ep, rx_buf);
 		case rxm_ctrl_seg:
 			return rxm_sar_handle_segment(rx_buf);
 		case rxm_ctrl_atomic:
@@ -1130,6 +1852,8 @@ ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 			return rxm_handle_atomic_resp(rxm_ep, rx_buf);
 		case rxm_ctrl_credit:
 			return rxm_handle_credit(rxm_ep, rx_buf);
+		case rxm_ctrl_agg:
+			return rxm_handle_agg(rx_buf);
 		default:
 			FI_WARN(&rxm_prov, FI_LOG_CQ, "Unknown message type\n");
 			assert(0);
@@ -1156,7 +1880,7 @@ ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 			return rxm_rndv_send_ack(rx_buf);
 	case RXM_RNDV_ACK_SENT:
 		assert(comp->flags & FI_SEND);
-		return rxm_finish_send_rndv_ack(comp->op_context);
+		return rxm_rndv_rx_finish(comp->op_context);
 	case RXM_RNDV_ACK_RECVD:
 		tx_rndv_buf = comp->op_context;
 		assert(comp->flags & FI_SEND);
@@ -1164,6 +1888,30 @@ ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 	case RXM_RNDV_FINISH:
 		assert(0);
 		return -FI_EOPBADSTATE;
+	case RXM_RNDV_WRITE:
+		tx_rndv_buf = comp->op_context;
+		assert(comp->flags & (FI_SEND | FI_WRITE));
+		assert(tx_rndv_buf->write.pending);
+		if (--tx_rndv_buf->write.pending)
+			return 0;
+		if (tx_rndv_buf->write.err)
+			return rxm_rndv_write_fail(rxm_ep, tx_rndv_buf, 0);
+		if (!tx_rndv_buf->write.done_posted)
+			return 0;
+		return rxm_rndv_tx_finish(rxm_ep, tx_rndv_buf);
+	case RXM_RNDV_CTS_SENT:
+		rx_buf = comp->op_context;
+		assert(comp->flags & FI_SEND);
+		ofi_buf_free(rx_buf->recv_entry->rndv.tx_buf);
+		rx_buf->recv_entry->rndv.tx_buf = NULL;
+		RXM_UPDATE_STATE(FI_LOG_CQ, rx_buf, RXM_RNDV_DONE_WAIT);
+		return 0;
+	case RXM_RNDV_DONE_RECVD:
+		assert(comp->flags & FI_SEND);
+		return rxm_rndv_rx_finish(comp->op_context);
+	case RXM_RNDV_DONE_WAIT:
+		assert(0);
+		return -FI_EOPBADSTATE;
 	case RXM_ATOMIC_RESP_WAIT:
 		/* Optional atomic request completion; TX completion
 		 * processing is performed when atomic response is received */
@@ -1180,6 +1928,44 @@ ssize_t rxm_handle_comp(struct rxm_ep *rxm_ep, struct fi_cq_data_entry *comp)
 	}
 }
 
+/* Write out completions collected by rxm_cq_write_comp() */
+void rxm_cq_flush_batch(struct rxm_ep *rxm_ep)
+{
+	struct rxm_comp_batch *batch = &rxm_ep->comp_batch;
+	struct util_cq *cq = NULL;
+	struct rxm_comp *comp;
+	size_t i;
+	int ret;
+
+	for (i = 0; i < batch->count; i++) {
+		comp = &batch->comp[i];
+		if (comp->cq != cq) {
+			if (cq)
+				cq->cq_fastlock_release(&cq->cq_lock);
+			cq = comp->cq;
+			cq->cq_fastlock_acquire(&cq->cq_lock);
+		}
+
+		if (cq->src)
+			ret = ofi_cq_write_src_thread_unsafe(cq,
+					comp->comp.op_context, comp->comp.flags,
+					comp->comp.len, comp->comp.buf,
+					comp->comp.data, comp->comp.tag,
+					comp->src_addr);
+		else
+			ret = ofi_cq_write_thread_unsafe(cq,
+					comp->comp.op_context, comp->comp.flags,
+					comp->comp.len, comp->comp.buf,
+					comp->comp.data, comp->comp.tag);
+		if (ret)
+			FI_WARN(&rxm_prov, FI_LOG_CQ,
+				"Unable to report completion\n");
+	}
+	if (cq)
+		cq->cq_fastlock_release(&cq->cq_lock);
+	batch->count = 0;
+}
+
 void rxm_cq_write_error(struct util_cq *cq, struct util_cntr *cntr,
 			void *op_context, int err)
 {
@@ -1202,6 +1988,8 @@ void rxm_cq_write_error_all(struct rxm_ep *rxm_ep, int err)
 	struct fi_cq_err_entry err_entry = {0};
 	ssize_t ret = 0;
 
+	rxm_cq_flush_batch(rxm_ep);
+
 	err_entry.prov_errno = err;
 	err_entry.err = -err;
 	if (rxm_ep->util_ep.tx_cq) {
@@ -1237,15 +2025,19 @@ void rxm_handle_comp_error(struct rxm_ep *rxm_ep)
 {
 	struct rxm_tx_base_buf *base_buf;
 	struct rxm_tx_eager_buf *eager_buf;
-	struct rxm_tx_sar_buf *sar_buf;
+	struct rxm_tx_sar_buf *sar_buf, *first_sar_buf;
 	struct rxm_tx_rndv_buf *rndv_buf;
+	struct rxm_tx_agg_buf *agg_buf;
 	struct rxm_rx_buf *rx_buf;
 	struct rxm_rma_buf *rma_buf;
 	struct util_cq *cq;
+	bool reported;
+	size_t i;
 	struct util_cntr *cntr;
 	struct fi_cq_err_entry err_entry = {0};
 	ssize_t ret;
 
+	rxm_cq_flush_batch(rxm_ep);
 	ret = fi_cq_readerr(rxm_ep->msg_cq, &err_entry, 0);
 	if ((ret) < 0) {
 		FI_WARN(&rxm_prov, FI_LOG_CQ,
@@ -1285,13 +2077,34 @@ void rxm_handle_comp_error(struct rxm_ep *rxm_ep)
 		sar_buf = err_entry.op_context;
 		err_entry.op_context = sar_buf->app_context;
 		err_entry.flags = ofi_tx_cq_flags(sar_buf->pkt.hdr.op);
+		/* Report each failed message once */
+		first_sar_buf = ofi_bufpool_get_ibuf(rxm_ep->
+					buf_pools[RXM_BUF_POOL_TX_SAR].pool,
+					sar_buf->pkt.ctrl_hdr.msg_id);
+		reported = first_sar_buf->msg.failed;
 		rxm_finish_sar_segment_send(rxm_ep, sar_buf, true);
+		if (reported)
+			return;
 		break;
+	case RXM_AGG_TX:
+		agg_buf = err_entry.op_context;
+		for (i = 0; i < agg_buf->count; i++) {
+			rxm_cq_write_error(cq, cntr, agg_buf->msg[i].app_context,
+					   -err_entry.err);
+		}
+		ofi_buf_free(agg_buf);
+		return;
 	case RXM_CREDIT_TX:
 		base_buf = err_entry.op_context;
 		err_entry.op_context = 0;
 		err_entry.flags = ofi_tx_cq_flags(base_buf->pkt.hdr.op);
 		break;
+	case RXM_RNDV_WRITE:
+		rndv_buf = err_entry.op_context;
+		assert(rndv_buf->write.pending);
+		rndv_buf->write.pending--;
+		rxm_rndv_write_fail(rxm_ep, rndv_buf, -err_entry.err);
+		return;
 	case RXM_RNDV_TX:
 		rndv_buf = err_entry.op_context;
 		err_entry.op_context = rndv_buf->app_context;
@@ -1300,23 +2113,52 @@ void rxm_handle_comp_error(struct rxm_ep *rxm_ep)
 
 	/* Application receive related error */
 	case RXM_RX:
+		rxm_rx_buf_handled(err_entry.op_context);
 		/* Silently drop any MSG CQ error entries for canceled receive
 		 * operations as these are internal to RxM. This situation can
 		 * happen when the MSG EP receives a reject / shutdown and CM
 		 * thread hasn't handled the event yet. */
 		if (err_entry.err == FI_ECANCELED) {
+			rx_buf = err_entry.op_context;
+			/* The receive that rxm_get_rbuf matched the message
+			 * to is no longer queued, so complete it in error */
+			if (rx_buf->direct_recv) {
+				rx_buf->direct_recv = 0;
+				err_entry.op_context =
+					rx_buf->recv_entry->context;
+				err_entry.flags =
+					rx_buf->recv_entry->comp_flags;
+				rxm_recv_entry_release(
+					rx_buf->recv_entry->recv_queue,
+					rx_buf->recv_entry);
+				if (rxm_ep->util_ep.rx_cntr)
+					rxm_cntr_incerr(rxm_ep->util_ep.rx_cntr);
+				if (ofi_cq_write_error(rxm_ep->util_ep.rx_cq,
+						       &err_entry))
+					FI_WARN(&rxm_prov, FI_LOG_CQ,
+						"Unable to ofi_cq_write_error\n");
+			}
 			/* No need to re-post these buffers. Free directly */
-			ofi_buf_free((struct rxm_rx_buf *)err_entry.op_context);
+			ofi_buf_free(rx_buf);
 			return;
 		}
 		/* fall through */
 	case RXM_RNDV_ACK_SENT:
 		/* fall through */
+	case RXM_RNDV_CTS_SENT:
+		/* fall through */
+	case RXM_RNDV_DONE_RECVD:
+		/* fall through */
 	case RXM_RNDV_READ:
 		rx_buf = (struct rxm_rx_buf *) err_entry.op_context;
 		assert(rx_buf->recv_entry);
 		err_entry.op_context = rx_buf->recv_entry->context;
 		err_entry.flags = rx_buf->recv_entry->comp_flags;
+		if (rx_buf->direct_recv) {
+			rx_buf->direct_recv = 0;
+			rxm_recv_entry_release(rx_buf->recv_entry->recv_queue,
+					       rx_buf->recv_entry);
+		}
 
 		cq = rx_buf->ep->util_ep.rx_cq;
 		cntr = rx_buf->ep->util_ep.rx_cntr;
@@ -1338,17 +2180,28 @@ void rxm_handle_comp_error(struct rxm_ep *rxm_ep)
 		FI_WARN(&rxm_prov, FI_LOG_CQ, "Unable to ofi_cq_write_error\n");
 }
 
-static int rxm_msg_ep_recv(struct rxm_rx_buf *rx_buf)
+static int rxm_msg_ep_recv(struct rxm_rx_buf *rx_buf, uint64_t flags)
 {
+	struct iovec iov = {
+		.iov_base = &rx_buf->pkt,
+		.iov_len = rxm_eager_limit + sizeof(struct rxm_pkt),
+	};
+	struct fi_msg msg = {
+		.msg_iov = &iov,
+		.desc = &rx_buf->hdr.desc,
+		.iov_count = 1,
+		.addr = FI_ADDR_UNSPEC,
+		.context = rx_buf,
+	};
 	int ret, level;
 
 	if (rx_buf->ep->srx_ctx)
 		rx_buf->conn = NULL;
 	rx_buf->hdr.state = RXM_RX;
+	rx_buf->unhandled = 0;
+	rx_buf->direct_recv = 0;
 
-	ret = (int) fi_recv(rx_buf->msg_ep, &rx_buf->pkt,
-			    rxm_eager_limit + sizeof(struct rxm_pkt),
-			    rx_buf->hdr.desc, FI_ADDR_UNSPEC, rx_buf);
+	ret = (int) fi_recvmsg(rx_buf->msg_ep, &msg, flags);
 	if (!ret)
 		return 0;
 
@@ -1372,7 +2225,7 @@ int rxm_msg_ep_prepost_recv(struct rxm_ep *rxm_ep, struct fid_ep *msg_ep)
 		if (!rx_buf)
 			return -FI_ENOMEM;
 
-		ret = rxm_msg_ep_recv(rx_buf);
+		ret = rxm_msg_ep_recv(rx_buf, 0);
 		if (ret) {
 			ofi_buf_free(&rx_buf->hdr);
 			return ret;
@@ -1381,45 +2234,85 @@ int rxm_msg_ep_prepost_recv(struct rxm_ep *rxm_ep, struct fid_ep *msg_ep)
 	return 0;
 }
 
-void rxm_ep_do_progress(struct util_ep *util_ep)
+static bool rxm_rx_buf_postable(struct rxm_ep *rxm_ep, struct rxm_rx_buf *buf)
 {
-	struct rxm_ep *rxm_ep = container_of(util_ep, struct rxm_ep, util_ep);
-	struct fi_cq_data_entry comp;
-	struct dlist_entry *conn_entry_tmp;
-	struct rxm_conn *rxm_conn;
-	struct rxm_rx_buf *buf;
-	ssize_t ret;
-	size_t comp_read = 0;
-	uint64_t timestamp;
+	/* Buffers of a closed msg_ep are discarded */
+	return rxm_ep->srx_ctx || buf->conn->msg_ep;
+}
+
+/*
+ * Repost consumed rx buffers.  Consecutive buffers for the same MSG
+ * endpoint are posted with FI_MORE so the provider can submit them
+ * together.
+ */
+static void rxm_ep_repost_rx_bufs(struct rxm_ep *rxm_ep)
+{
+	struct rxm_rx_buf *buf, *next;
+	uint64_t flags;
+	int ret;
 
 	while (!dlist_empty(&rxm_ep->repost_ready_list)) {
 		dlist_pop_front(&rxm_ep->repost_ready_list, struct rxm_rx_buf,
 				buf, repost_entry);
 
-		/* Discard rx buffer if its msg_ep was closed */
-		if (!rxm_ep->srx_ctx && !buf->conn->msg_ep) {
+		if (!rxm_rx_buf_postable(rxm_ep, buf)) {
 			ofi_buf_free(&buf->hdr);
 			continue;
 		}
 
-		ret = rxm_msg_ep_recv(buf);
+		flags = 0;
+		if (!dlist_empty(&rxm_ep->repost_ready_list)) {
+			next = container_of(rxm_ep->repost_ready_list.next,
+					    struct rxm_rx_buf, repost_entry);
+			if (next->msg_ep == buf->msg_ep &&
+			    rxm_rx_buf_postable(rxm_ep, next))
+				flags = FI_MORE;
+		}
+
+		ret = rxm_msg_ep_recv(buf, flags);
 		if (ret) {
 			if (ret == -FI_EAGAIN)
 				ofi_buf_free(&buf->hdr);
 		}
 	}
+}
 
+void rxm_ep_do_progress(struct util_ep *util_ep)
+{
+	struct rxm_ep *rxm_ep = container_of(util_ep, struct rxm_ep, util_ep);
+	struct fi_cq_data_entry comp[RXM_COMP_BATCH_SIZE];
+	struct dlist_entry *conn_entry_tmp;
+	struct rxm_conn *rxm_conn;
+	ssize_t ret, i;
+	size_t comp_read = 0, count;
+	uint64_t timestamp;
+	int err;
+
+	if (rxm_cmap_events_pending(rxm_ep->cmap))
+		rxm_msg_eq_progress(rxm_ep);
+
+	rxm_ep_repost_rx_bufs(rxm_ep);
+
+	if (!dlist_empty(&rxm_ep->agg_conn_list))
+		rxm_ep_flush_agg(rxm_ep);
+
+	rxm_ep->comp_batch.active = true;
 	do {
-		ret = fi_cq_read(rxm_ep->msg_cq, &comp, 1);
+		count = MIN(rxm_ep->comp_per_progress - comp_read,
+			    RXM_COMP_BATCH_SIZE);
+		ret = fi_cq_read(rxm_ep->msg_cq, comp, count);
 		if (ret > 0) {
-			ret = rxm_handle_comp(rxm_ep, &comp);
-			if (ret) {
-				// We don't have enough info to write a good
-				// error entry to the CQ at this point
-				rxm_cq_write_error_all(rxm_ep, ret);
-			} else {
-				ret = 1;
+			for (i = 0; i < ret; i++) {
+				err = rxm_handle_comp(rxm_ep, &comp[i]);
+				if (err) {
+					// We don't have enough info to write
+					// a good error entry to the CQ at this
+					// point
+					rxm_cq_write_error_all(rxm_ep, err);
+				}
 			}
+			comp_read += ret;
+			rxm_ep->cq_eq_fairness -= (int) ret;
 		} else if (ret < 0 && (ret != -FI_EAGAIN)) {
 			if (ret == -FI_EAVAIL)
 				rxm_handle_comp_error(rxm_ep);
@@ -1427,7 +2320,7 @@ void rxm_ep_do_progress(struct util_ep *util_ep)
 				rxm_cq_write_error_all(rxm_ep, ret);
 		}
 
-		if (ret == -FI_EAGAIN || --rxm_ep->cq_eq_fairness <= 0) {
+		if (ret == -FI_EAGAIN || rxm_ep->cq_eq_fairness <= 0) {
 			rxm_ep->cq_eq_fairness = rxm_cq_eq_fairness;
 			timestamp = ofi_gettime_us();
 			if (timestamp - rxm_ep->msg_cq_last_poll >
@@ -1436,7 +2329,13 @@ void rxm_ep_do_progress(struct util_ep *util_ep)
 				rxm_msg_eq_progress(rxm_ep);
 			}
 		}
-	} while ((ret > 0) && (++comp_read < rxm_ep->comp_per_progress));
+	} while ((ret == (ssize_t) count) &&
+		 (comp_read < rxm_ep->comp_per_progress));
+	rxm_cq_flush_batch(rxm_ep);
+	rxm_ep->comp_batch.active = false;
+
+	if (ret == -FI_EAGAIN && !dlist_empty(&rxm_ep->credit_return_list))
+		rxm_ep_return_credits(rxm_ep);
 
 	if (!dlist_empty(&rxm_ep->deferred_tx_conn_queue)) {
 		dlist_foreach_container_safe(&rxm_ep->deferred_tx_conn_queue,
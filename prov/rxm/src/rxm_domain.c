@@ -222,6 +222,10 @@ rxm_mr_get_msg_access(struct rxm_domain *rxm_domain, uint64_t access)
 	/* Additional flags to use RMA read for large message transfers */
 	access |= FI_READ | FI_REMOTE_READ;
 
+	/* Receive buffers are written to by the write rendezvous protocol */
+	if (access & FI_RECV)
+		access |= FI_REMOTE_WRITE;
+
 	if (rxm_domain->mr_local)
 		access |= FI_WRITE;
 	return access;
@@ -355,7 +359,7 @@ static struct fi_ops_mr rxm_domain_mr_ops = {
 	.regattr = rxm_mr_regattr,
 };
 
-static ssize_t rxm_send_credits(struct fid_ep *ep, size_t credits)
+ssize_t rxm_send_credits(struct fid_ep *ep, size_t credits)
 {
 	struct rxm_conn *rxm_conn =
 		container_of(ep->fid.context, struct rxm_conn, handle);
@@ -439,6 +443,7 @@ int rxm_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	struct rxm_fabric *rxm_fabric;
 	struct fi_info *msg_info;
 	struct ofi_ops_flow_ctrl *flow_ctrl_ops;
+	struct ofi_ops_dynamic_rbuf *dynamic_rbuf_ops;
 
 	rxm_domain = calloc(1, sizeof(*rxm_domain));
 	if (!rxm_domain)
@@ -488,6 +493,16 @@ int rxm_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 		goto err3;
 	}
 
+	ret = fi_open_ops(&rxm_domain->msg_domain->fid, OFI_OPS_DYNAMIC_RBUF, 0,
+			  (void **) &dynamic_rbuf_ops, NULL);
+	if (!ret && dynamic_rbuf_ops) {
+		dynamic_rbuf_ops->set_rbuf_handler(rxm_domain->msg_domain,
+						   sizeof(struct rxm_pkt),
+						   rxm_get_rbuf);
+	} else if (ret != -FI_ENOSYS) {
+		goto err3;
+	}
+
 	fi_freeinfo(msg_info);
 	return 0;
 err3:
@@ -33,12 +33,14 @@
 
 #include <inttypes.h>
 #include <math.h>
+#include <netdb.h>
 
 #include <rdma/fabric.h>
 #include <rdma/fi_collective.h>
 #include "ofi.h"
 #include <ofi_util.h>
 #include <ofi_coll.h>
+#include <shared/ofi_str.h>
 
 #include "rxm.h"
 
@@ -106,6 +108,145 @@ static int rxm_match_unexp_msg_tag_addr(struct dlist_entry *item, const void *ar
 		ofi_match_tag(attr->tag, attr->ignore, unexp_msg->tag);
 }
 
+static inline bool rxm_recv_queue_hashed(struct rxm_recv_queue *recv_queue)
+{
+	return recv_queue->type == RXM_RECV_QUEUE_TAGGED || recv_queue->directed;
+}
+
+/* Only receives without wildcards are hashed */
+static inline bool
+rxm_recv_entry_hashed(struct rxm_recv_queue *recv_queue, fi_addr_t addr,
+		      uint64_t ignore)
+{
+	if (recv_queue->type == RXM_RECV_QUEUE_MSG)
+		return recv_queue->directed && addr != FI_ADDR_UNSPEC;
+
+	return !ignore && (!recv_queue->directed || addr != FI_ADDR_UNSPEC);
+}
+
+static struct dlist_entry *
+rxm_match_bucket(struct rxm_recv_queue *recv_queue, struct dlist_entry *table,
+		 fi_addr_t addr, uint64_t tag)
+{
+	uint64_t key;
+
+	if (!recv_queue->directed)
+		addr = 0;
+	if (recv_queue->type == RXM_RECV_QUEUE_MSG)
+		tag = 0;
+
+	key = tag ^ (addr * 0x9e3779b97f4a7c15ULL);
+	key ^= key >> 32;
+	key ^= key >> 16;
+	key ^= key >> 8;
+	return &table[key & (RXM_MATCH_HASH_SIZE - 1)];
+}
+
+void rxm_recv_queue_insert(struct rxm_recv_queue *recv_queue,
+			   struct rxm_recv_entry *recv_entry)
+{
+	recv_entry->seq = recv_queue->seq++;
+
+	if (rxm_recv_entry_hashed(recv_queue, recv_entry->addr,
+				  recv_entry->ignore)) {
+		dlist_insert_tail(&recv_entry->entry,
+				  rxm_match_bucket(recv_queue,
+						   recv_queue->recv_hash,
+						   recv_entry->addr,
+						   recv_entry->tag));
+	} else {
+		dlist_insert_tail(&recv_entry->entry, &recv_queue->recv_list);
+	}
+}
+
+/*
+ * Find the oldest posted receive for an incoming message.  Hash chains and
+ * recv_list are both kept in post order, so the first match in each is the
+ * candidate from that list, and the sequence numbers pick between the two.
+ */
+struct rxm_recv_entry *
+rxm_recv_queue_find(struct rxm_recv_queue *recv_queue,
+		    struct rxm_recv_match_attr *match_attr)
+{
+	struct rxm_recv_entry *recv_entry = NULL, *wild_entry;
+	struct dlist_entry *entry;
+
+	if (rxm_recv_queue_hashed(recv_queue)) {
+		entry = dlist_find_first_match(
+				rxm_match_bucket(recv_queue,
+						 recv_queue->recv_hash,
+						 match_attr->addr,
+						 match_attr->tag),
+				recv_queue->match_recv, match_attr);
+		if (entry)
+			recv_entry = container_of(entry, struct rxm_recv_entry,
+						  entry);
+	}
+
+	entry = dlist_find_first_match(&recv_queue->recv_list,
+				       recv_queue->match_recv, match_attr);
+	if (entry) {
+		wild_entry = container_of(entry, struct rxm_recv_entry, entry);
+		if (!recv_entry || wild_entry->seq < recv_entry->seq)
+			recv_entry = wild_entry;
+	}
+
+	return recv_entry;
+}
+
+struct rxm_recv_entry *
+rxm_recv_queue_match(struct rxm_recv_queue *recv_queue,
+		     struct rxm_recv_match_attr *match_attr)
+{
+	struct rxm_recv_entry *recv_entry;
+
+	recv_entry = rxm_recv_queue_find(recv_queue, match_attr);
+	if (recv_entry)
+		dlist_remove(&recv_entry->entry);
+	return recv_entry;
+}
+
+void rxm_unexp_msg_insert(struct rxm_recv_queue *recv_queue,
+			  struct rxm_rx_buf *rx_buf)
+{
+	rx_buf->unexp_msg.seq = recv_queue->seq++;
+	dlist_insert_tail(&rx_buf->unexp_msg.entry,
+			  &recv_queue->unexp_msg_list);
+
+	if (rxm_recv_queue_hashed(recv_queue)) {
+		dlist_insert_tail(&rx_buf->unexp_msg.hash_entry,
+				  rxm_match_bucket(recv_queue,
+						   recv_queue->unexp_hash,
+						   rx_buf->unexp_msg.addr,
+						   rx_buf->unexp_msg.tag));
+	} else {
+		dlist_init(&rx_buf->unexp_msg.hash_entry);
+	}
+}
+
+static int rxm_unexp_msg_order(struct dlist_entry *item, const void *arg)
+{
+	struct rxm_unexp_msg *new_msg =
+		container_of(arg, struct rxm_unexp_msg, hash_entry);
+	struct rxm_unexp_msg *unexp_msg =
+		container_of(item, struct rxm_unexp_msg, hash_entry);
+	return unexp_msg->seq > new_msg->seq;
+}
+
+/* Source of the message became known after it was queued */
+void rxm_unexp_msg_set_addr(struct rxm_recv_queue *recv_queue,
+			    struct rxm_rx_buf *rx_buf, fi_addr_t addr)
+{
+	rx_buf->unexp_msg.addr = addr;
+	if (!rxm_recv_queue_hashed(recv_queue))
+		return;
+
+	dlist_remove(&rx_buf->unexp_msg.hash_entry);
+	dlist_insert_order(rxm_match_bucket(recv_queue, recv_queue->unexp_hash,
+					    addr, rx_buf->unexp_msg.tag),
+			   rxm_unexp_msg_order, &rx_buf->unexp_msg.hash_entry);
+}
+
 static int rxm_buf_reg(struct ofi_bufpool_region *region)
 {
 	struct rxm_buf_pool *pool = region->pool->attr.context;
@@ -135,6 +276,7 @@ static void rxm_buf_init(struct ofi_bufpool_region *region, void *buf)
 	struct rxm_tx_base_buf *tx_base_buf;
 	struct rxm_tx_eager_buf *tx_eager_buf;
 	struct rxm_tx_sar_buf *tx_sar_buf;
+	struct rxm_tx_agg_buf *tx_agg_buf;
 	struct rxm_tx_rndv_buf *tx_rndv_buf;
 	struct rxm_tx_atomic_buf *tx_atomic_buf;
 	struct rxm_rma_buf *rma_buf;
@@ -180,6 +322,15 @@ static void rxm_buf_init(struct ofi_bufpool_region *region, void *buf)
 		pkt = &tx_sar_buf->pkt;
 		type = rxm_ctrl_seg;
 		break;
+	case RXM_BUF_POOL_TX_AGG:
+		tx_agg_buf = buf;
+		tx_agg_buf->hdr.state = RXM_AGG_TX;
+		tx_agg_buf->pkt.hdr.op = ofi_op_msg;
+
+		tx_agg_buf->hdr.desc = mr_desc;
+		pkt = &tx_agg_buf->pkt;
+		type = rxm_ctrl_agg;
+		break;
 	case RXM_BUF_POOL_TX_CREDIT:
 		tx_base_buf = buf;
 		tx_base_buf->hdr.state = RXM_CREDIT_TX;
@@ -303,6 +454,8 @@ static void rxm_recv_entry_init(struct rxm_recv_entry *entry, void *arg)
 static int rxm_recv_queue_init(struct rxm_ep *rxm_ep,  struct rxm_recv_queue *recv_queue,
 			       size_t size, enum rxm_recv_queue_type type)
 {
+	int i;
+
 	recv_queue->rxm_ep = rxm_ep;
 	recv_queue->type = type;
 	recv_queue->fs = rxm_recv_fs_create(size, rxm_recv_entry_init,
@@ -312,6 +465,13 @@ static int rxm_recv_queue_init(struct rxm_ep *rxm_ep,  struct rxm_recv_queue *re
 
 	dlist_init(&recv_queue->recv_list);
 	dlist_init(&recv_queue->unexp_msg_list);
+	for (i = 0; i < RXM_MATCH_HASH_SIZE; i++) {
+		dlist_init(&recv_queue->recv_hash[i]);
+		dlist_init(&recv_queue->unexp_hash[i]);
+	}
+	recv_queue->seq = 0;
+	recv_queue->directed = !!(rxm_ep->rxm_info->caps & FI_DIRECTED_RECV);
+
 	if (type == RXM_RECV_QUEUE_MSG) {
 		if (rxm_ep->rxm_info->caps & FI_DIRECTED_RECV) {
 			recv_queue->match_recv = rxm_match_recv_entry;
@@ -353,6 +513,7 @@ static int rxm_ep_txrx_pool_create(struct rxm_ep *rxm_ep)
 		[RXM_BUF_POOL_TX_RNDV] = rxm_ep->msg_info->tx_attr->size,
 		[RXM_BUF_POOL_TX_ATOMIC] = rxm_ep->msg_info->tx_attr->size,
 		[RXM_BUF_POOL_TX_SAR] = rxm_ep->msg_info->tx_attr->size,
+		[RXM_BUF_POOL_TX_AGG] = rxm_ep->msg_info->tx_attr->size,
 		[RXM_BUF_POOL_TX_CREDIT] = rxm_ep->msg_info->tx_attr->size,
 		[RXM_BUF_POOL_RMA] = rxm_ep->msg_info->tx_attr->size,
 	};
@@ -363,7 +524,8 @@ static int rxm_ep_txrx_pool_create(struct rxm_ep *rxm_ep)
 				    sizeof(struct rxm_tx_eager_buf),
 		[RXM_BUF_POOL_TX_INJECT] = rxm_ep->inject_limit +
 					   sizeof(struct rxm_tx_base_buf),
-		[RXM_BUF_POOL_TX_ACK] = sizeof(struct rxm_tx_base_buf),
+		[RXM_BUF_POOL_TX_ACK] = sizeof(struct rxm_tx_base_buf) +
+					sizeof(struct rxm_rndv_hdr),
 		[RXM_BUF_POOL_TX_RNDV] = sizeof(struct rxm_rndv_hdr) +
 					 rxm_ep->buffered_min +
 					 sizeof(struct rxm_tx_rndv_buf),
@@ -371,6 +533,8 @@ static int rxm_ep_txrx_pool_create(struct rxm_ep *rxm_ep)
 					 sizeof(struct rxm_tx_atomic_buf),
 		[RXM_BUF_POOL_TX_SAR] = rxm_eager_limit +
 					sizeof(struct rxm_tx_sar_buf),
+		[RXM_BUF_POOL_TX_AGG] = rxm_eager_limit +
+					sizeof(struct rxm_tx_agg_buf),
 		[RXM_BUF_POOL_TX_CREDIT] = sizeof(struct rxm_tx_base_buf),
 		[RXM_BUF_POOL_RMA] = rxm_eager_limit +
 				     sizeof(struct rxm_rma_buf),
@@ -512,12 +676,17 @@ static int rxm_ep_cancel_recv(struct rxm_ep *rxm_ep,
 	struct fi_cq_err_entry err_entry;
 	struct rxm_recv_entry *recv_entry;
 	struct dlist_entry *entry;
-	int ret;
+	int i, ret;
 
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
 	entry = dlist_remove_first_match(&recv_queue->recv_list,
 					 rxm_match_recv_entry_context,
 					 context);
+	for (i = 0; !entry && i < RXM_MATCH_HASH_SIZE; i++) {
+		entry = dlist_remove_first_match(&recv_queue->recv_hash[i],
+						 rxm_match_recv_entry_context,
+						 context);
+	}
 	if (entry) {
 		recv_entry = container_of(entry, struct rxm_recv_entry, entry);
 		memset(&err_entry, 0, sizeof(err_entry));
@@ -659,7 +828,8 @@ rxm_get_unexp_msg(struct rxm_recv_queue *recv_queue, fi_addr_t addr,
 		  uint64_t tag, uint64_t ignore)
 {
 	struct rxm_recv_match_attr match_attr;
-	struct dlist_entry *entry;
+	struct rxm_unexp_msg *unexp_msg;
+	struct dlist_entry *bucket, *entry;
 
 	if (dlist_empty(&recv_queue->unexp_msg_list))
 		return NULL;
@@ -668,15 +838,29 @@ rxm_get_unexp_msg(struct rxm_recv_queue *recv_queue, fi_addr_t addr,
 	match_attr.tag = tag;
 	match_attr.ignore = ignore;
 
+	if (rxm_recv_entry_hashed(recv_queue, addr, ignore)) {
+		bucket = rxm_match_bucket(recv_queue, recv_queue->unexp_hash,
+					  addr, tag);
+		dlist_foreach_container(bucket, struct rxm_unexp_msg,
+					unexp_msg, hash_entry) {
+			if (recv_queue->match_unexp(&unexp_msg->entry,
+						    &match_attr))
+				goto found;
+		}
+		return NULL;
+	}
+
 	entry = dlist_find_first_match(&recv_queue->unexp_msg_list,
 				       recv_queue->match_unexp, &match_attr);
 	if (!entry)
 		return NULL;
+	unexp_msg = container_of(entry, struct rxm_unexp_msg, entry);
 
+found:
 	RXM_DBG_ADDR_TAG(FI_LOG_EP_DATA, "Match for posted recv found in unexp"
 			 " msg list\n", match_attr.addr, match_attr.tag);
 
-	return container_of(entry, struct rxm_rx_buf, unexp_msg.entry);
+	return container_of(unexp_msg, struct rxm_rx_buf, unexp_msg);
 }
 
 static int rxm_handle_unexp_sar(struct rxm_recv_queue *recv_queue,
@@ -685,12 +869,11 @@ static int rxm_handle_unexp_sar(struct rxm_recv_queue *recv_queue,
 {
 	struct rxm_recv_match_attr match_attr;
 	struct dlist_entry *entry;
-	bool last;
 	ssize_t ret;
 
+	/* The receive's msg_id is reset once the whole message is placed */
 	ret = rxm_handle_rx_buf(rx_buf);
-	last = rxm_sar_get_seg_type(&rx_buf->pkt.ctrl_hdr) == RXM_SAR_SEG_LAST;
-	if (ret || last)
+	if (ret || recv_entry->sar.msg_id == RXM_SAR_RX_INIT)
 		return ret;
 
 	match_attr.addr = recv_entry->addr;
@@ -715,11 +898,9 @@ static int rxm_handle_unexp_sar(struct rxm_recv_queue *recv_queue,
 		if (recv_entry->sar.conn != rx_buf->conn)
 			continue;
 		rx_buf->recv_entry = recv_entry;
-		dlist_remove(&rx_buf->unexp_msg.entry);
-		last = rxm_sar_get_seg_type(&rx_buf->pkt.ctrl_hdr) ==
-		       RXM_SAR_SEG_LAST;
+		rxm_unexp_msg_remove(rx_buf);
 		ret = rxm_handle_rx_buf(rx_buf);
-		if (ret || last)
+		if (ret || recv_entry->sar.msg_id == RXM_SAR_RX_INIT)
 			break;
 	}
 	return ret;
@@ -759,14 +940,14 @@ static int rxm_ep_peek_recv(struct rxm_ep *rxm_ep, fi_addr_t addr, uint64_t tag,
 	FI_DBG(&rxm_prov, FI_LOG_EP_DATA, "Message found\n");
 
 	if (flags & FI_DISCARD) {
-		dlist_remove(&rx_buf->unexp_msg.entry);
+		rxm_unexp_msg_remove(rx_buf);
 		return rxm_ep_discard_recv(rxm_ep, rx_buf, context);
 	}
 
 	if (flags & FI_CLAIM) {
 		FI_DBG(&rxm_prov, FI_LOG_EP_DATA, "Marking message for Claim\n");
 		((struct fi_context *)context)->internal[0] = rx_buf;
-		dlist_remove(&rx_buf->unexp_msg.entry);
+		rxm_unexp_msg_remove(rx_buf);
 	}
 
 	return ofi_cq_write(rxm_ep->util_ep.rx_cq, context, FI_TAGGED | FI_RECV,
@@ -835,12 +1016,11 @@ rxm_ep_post_mrecv(struct rxm_ep *ep, const struct iovec *iov,
 
 		rx_buf = rxm_get_unexp_msg(&ep->recv_queue, recv_entry->addr, 0,  0);
 		if (!rx_buf) {
-			dlist_insert_tail(&recv_entry->entry,
-					  &ep->recv_queue.recv_list);
+			rxm_recv_queue_insert(&ep->recv_queue, recv_entry);
 			return 0;
 		}
 
-		dlist_remove(&rx_buf->unexp_msg.entry);
+		rxm_unexp_msg_remove(rx_buf);
 		rx_buf->recv_entry = recv_entry;
 		recv_entry->flags &= ~FI_MULTI_RECV;
 		recv_entry->total_len = MIN(cur_iov.iov_len, rx_buf->pkt.hdr.size);
@@ -886,12 +1066,11 @@ rxm_ep_post_recv(struct rxm_ep *rxm_ep, const struct iovec *iov,
 
 	rx_buf = rxm_get_unexp_msg(&rxm_ep->recv_queue, recv_entry->addr, 0,  0);
 	if (!rx_buf) {
-		dlist_insert_tail(&recv_entry->entry,
-				  &rxm_ep->recv_queue.recv_list);
+		rxm_recv_queue_insert(&rxm_ep->recv_queue, recv_entry);
 		return FI_SUCCESS;
 	}
 
-	dlist_remove(&rx_buf->unexp_msg.entry);
+	rxm_unexp_msg_remove(rx_buf);
 	rx_buf->recv_entry = recv_entry;
 
 	if (rx_buf->pkt.ctrl_hdr.type != rxm_ctrl_seg)
@@ -998,9 +1177,9 @@ static ssize_t rxm_ep_recvv(struct fid_ep *ep_fid, const struct iovec *iov,
 				  context, rxm_ep->util_ep.rx_op_flags);
 }
 
-static void rxm_rndv_hdr_init(struct rxm_ep *rxm_ep, void *buf,
-			      const struct iovec *iov, size_t count,
-			      struct fid_mr **mr)
+void rxm_rndv_hdr_init(struct rxm_ep *rxm_ep, void *buf,
+		       const struct iovec *iov, size_t count,
+		       struct fid_mr **mr)
 {
 	struct rxm_rndv_hdr *rndv_hdr = (struct rxm_rndv_hdr *)buf;
 	size_t i;
@@ -1043,6 +1222,53 @@ rxm_ep_msg_normal_send(struct rxm_conn *rxm_conn, struct rxm_pkt *tx_pkt,
 	return fi_send(rxm_conn->msg_ep, tx_pkt, pkt_size, desc, 0, context);
 }
 
+/*
+ * The receiver answers a write rendezvous request with a CTS describing its
+ * buffer, so the request carries no keys.  Our buffer is only a local
+ * source, which needs registering only if the MSG provider requires it.
+ */
+static int
+rxm_ep_init_rndv_write(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
+		       struct rxm_tx_rndv_buf *tx_buf, const struct iovec *iov,
+		       void **desc)
+{
+	size_t i;
+	int ret;
+
+	tx_buf->pkt.ctrl_hdr.type = rxm_ctrl_rndv_wr;
+	memset(tx_buf->mr, 0, sizeof(tx_buf->mr));
+	memset(tx_buf->pkt.data, 0, sizeof(struct rxm_rndv_hdr));
+
+	if (!rxm_ep->rdm_mr_local && rxm_ep->msg_mr_local) {
+		ret = rxm_msg_mr_regv(rxm_ep, iov, tx_buf->count,
+				      tx_buf->pkt.hdr.size, FI_WRITE,
+				      tx_buf->mr);
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < tx_buf->count; i++) {
+		tx_buf->write.iov[i] = iov[i];
+		if (rxm_ep->rdm_mr_local)
+			tx_buf->write.desc[i] = fi_mr_desc(desc[i]);
+		else
+			tx_buf->write.desc[i] = tx_buf->mr[i] ?
+						fi_mr_desc(tx_buf->mr[i]) : NULL;
+	}
+
+	tx_buf->write.conn = rxm_conn;
+	tx_buf->write.msg_ep = NULL;
+	tx_buf->write.remote_index = 0;
+	tx_buf->write.index = 0;
+	tx_buf->write.offset = 0;
+	tx_buf->write.pending = 0;
+	tx_buf->write.done_buf = NULL;
+	tx_buf->write.done_posted = false;
+	tx_buf->write.deferred = false;
+	tx_buf->write.err = 0;
+	return 0;
+}
+
 static ssize_t
 rxm_ep_alloc_rndv_tx_res(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 			 void *context, uint8_t count, const struct iovec *iov,
@@ -1068,6 +1294,16 @@ rxm_ep_alloc_rndv_tx_res(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	tx_buf->flags = flags;
 	tx_buf->count = count;
 
+	if (data_len >= rxm_ep->rndv_write_min) {
+		ret = rxm_ep_init_rndv_write(rxm_ep, rxm_conn, tx_buf, iov,
+					     desc);
+		if (ret)
+			goto err;
+		ret = sizeof(struct rxm_pkt) + sizeof(struct rxm_rndv_hdr);
+		goto out;
+	}
+
+	tx_buf->pkt.ctrl_hdr.type = rxm_ctrl_rndv;
 	if (!rxm_ep->rdm_mr_local) {
 		ret = rxm_msg_mr_regv(rxm_ep, iov, tx_buf->count, data_len,
 				      FI_REMOTE_READ, tx_buf->mr);
@@ -1083,7 +1319,7 @@ rxm_ep_alloc_rndv_tx_res(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 			  mr_iov);
 
 	ret = sizeof(struct rxm_pkt) + sizeof(struct rxm_rndv_hdr);
-
+out:
 	if (rxm_ep->rxm_info->mode & FI_BUFFERED_RECV) {
 		ofi_copy_from_iov(rxm_pkt_rndv_data(&tx_buf->pkt),
 				  rxm_ep->buffered_min, iov, count, 0);
@@ -1102,16 +1338,22 @@ static ssize_t
 rxm_ep_rndv_tx_send(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		   struct rxm_tx_rndv_buf *tx_buf, size_t pkt_size)
 {
+	bool write = (tx_buf->pkt.ctrl_hdr.type == rxm_ctrl_rndv_wr);
 	ssize_t ret;
 
-	RXM_UPDATE_STATE(FI_LOG_EP_DATA, tx_buf, RXM_RNDV_TX);
+	/* A write rendezvous counts the request among its pending
+	 * operations instead of tracking it with a separate state. */
+	RXM_UPDATE_STATE(FI_LOG_EP_DATA, tx_buf,
+			 write ? RXM_RNDV_WRITE : RXM_RNDV_TX);
 	if (pkt_size <= rxm_ep->inject_limit) {
-		RXM_UPDATE_STATE(FI_LOG_EP_DATA, tx_buf, RXM_RNDV_ACK_WAIT);
+		if (!write)
+			RXM_UPDATE_STATE(FI_LOG_EP_DATA, tx_buf,
+					 RXM_RNDV_ACK_WAIT);
 		ret = rxm_ep_msg_inject_send(rxm_ep, rxm_conn, &tx_buf->pkt,
 					     pkt_size, ofi_cntr_inc_noop);
 	} else {
-		tx_buf->hdr.state = RXM_RNDV_TX;
-
+		if (write)
+			tx_buf->write.pending = 1;
 		ret = rxm_ep_msg_normal_send(rxm_conn, &tx_buf->pkt, pkt_size,
 					     tx_buf->hdr.desc, tx_buf);
 	}
@@ -1127,175 +1369,349 @@ err:
 	return ret;
 }
 
-static size_t
-rxm_ep_sar_calc_segs_cnt(struct rxm_ep *rxm_ep, size_t data_len)
+/*
+ * Segments are sized evenly up to the eager limit, so that a message just
+ * over a multiple of the limit does not end with a runt segment.  The size
+ * is kept a multiple of the cache line to keep the copies aligned.
+ */
+static size_t rxm_ep_sar_calc_seg_size(size_t data_len)
 {
-	return (data_len + rxm_eager_limit - 1) / rxm_eager_limit;
-}
+	size_t segs_cnt, seg_size;
 
-static struct rxm_tx_sar_buf *
-rxm_ep_sar_tx_prepare_segment(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
-			      void *app_context, size_t total_len,
-			      size_t seg_len, size_t seg_no, uint64_t data,
-			      uint64_t flags, uint64_t tag, uint8_t op,
-			      enum rxm_sar_seg_type seg_type, uint64_t *msg_id)
-{
-	struct rxm_tx_sar_buf *tx_buf;
-
-	tx_buf = rxm_tx_buf_alloc(rxm_ep, RXM_BUF_POOL_TX_SAR);
-	if (!tx_buf) {
-		FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
-			"Ran out of buffers from SAR buffer pool\n");
-		return NULL;
-	};
-
-	rxm_ep_format_tx_buf_pkt(rxm_conn, total_len, op, data, tag, flags,
-				 &tx_buf->pkt);
-	if (seg_type == RXM_SAR_SEG_FIRST) {
-		*msg_id = tx_buf->pkt.ctrl_hdr.msg_id = ofi_buf_index(tx_buf);
-	} else {
-		tx_buf->pkt.ctrl_hdr.msg_id = *msg_id;
-	}
-	tx_buf->pkt.ctrl_hdr.seg_size = seg_len;
-	tx_buf->pkt.ctrl_hdr.seg_no = seg_no;
-	tx_buf->app_context = app_context;
-	tx_buf->flags = flags;
-	rxm_sar_set_seg_type(&tx_buf->pkt.ctrl_hdr, seg_type);
-
-	return tx_buf;
+	segs_cnt = ofi_div_ceil(data_len, rxm_eager_limit);
+	seg_size = ofi_get_aligned_size(ofi_div_ceil(data_len, segs_cnt),
+					RXM_SAR_SEG_ALIGN);
+	return MIN(seg_size, rxm_eager_limit);
 }
 
+/*
+ * Report a SAR message as failed.  Segments that were never posted will not
+ * complete, so they are dropped from the count the completions wait for.
+ */
 static void
-rxm_ep_sar_tx_cleanup(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
-		      struct rxm_tx_sar_buf *tx_buf)
+rxm_ep_sar_tx_fail(struct rxm_ep *rxm_ep, struct rxm_tx_sar_buf *first_tx_buf,
+		   size_t unsent, ssize_t err)
 {
-	struct rxm_tx_sar_buf *first_tx_buf;
+	if (!first_tx_buf->msg.failed) {
+		first_tx_buf->msg.failed = true;
+		rxm_cq_write_error(rxm_ep->util_ep.tx_cq, rxm_ep->util_ep.tx_cntr,
+				   first_tx_buf->app_context, (int) err);
+	}
 
-	first_tx_buf = ofi_bufpool_get_ibuf(rxm_ep->
-					    buf_pools[RXM_BUF_POOL_TX_SAR].pool,
-					    tx_buf->pkt.ctrl_hdr.msg_id);
-	ofi_buf_free(first_tx_buf);
-	ofi_buf_free(tx_buf);
+	assert(first_tx_buf->msg.segs_left >= unsent);
+	first_tx_buf->msg.segs_left -= unsent;
+	if (!first_tx_buf->msg.segs_left)
+		ofi_buf_free(first_tx_buf);
 }
 
+/*
+ * Post the segments of a SAR message, starting at *seg_no, for as long as
+ * the connection has credits.  Every segment carries its offset into the
+ * message, so the receiver can place segments in whatever order they
+ * arrive.  Returns -FI_EAGAIN with *seg_no and *iov_offset advanced past
+ * the segments posted if the rest has to wait.
+ */
 static ssize_t
-rxm_ep_sar_tx_prepare_and_send_segment(struct rxm_ep *rxm_ep,
-		struct rxm_conn *rxm_conn, void *app_context, size_t data_len,
-		size_t remain_len, uint64_t msg_id, size_t seg_len,
-		size_t seg_no, size_t segs_cnt, uint64_t data, uint64_t flags,
-		uint64_t tag, uint8_t op, const struct iovec *iov,
-		uint8_t count, size_t *iov_offset,
-		struct rxm_tx_sar_buf **out_tx_buf)
+rxm_ep_sar_tx_post_segments(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
+			    struct rxm_tx_sar_buf *first_tx_buf,
+			    const struct iovec *iov, uint8_t count,
+			    size_t seg_size, size_t segs_cnt, size_t *seg_no,
+			    size_t *iov_offset)
 {
 	struct rxm_tx_sar_buf *tx_buf;
-	enum rxm_sar_seg_type seg_type = RXM_SAR_SEG_MIDDLE;
+	size_t seg_len;
+	ssize_t ret;
 
-	if (seg_no == (segs_cnt - 1)) {
-		seg_type = RXM_SAR_SEG_LAST;
-		assert(remain_len <= seg_len);
-		seg_len = remain_len;
-	}
+	for (; *seg_no < segs_cnt; (*seg_no)++) {
+		if (!rxm_conn->sar_tx_credits)
+			return -FI_EAGAIN;
 
-	tx_buf = rxm_ep_sar_tx_prepare_segment(rxm_ep, rxm_conn, app_context,
-					       data_len, seg_len, seg_no, data,
-					       flags, tag, op, seg_type, &msg_id);
-	if (!tx_buf) {
-		*out_tx_buf = NULL;
-		return -FI_EAGAIN;
-	}
+		if (*seg_no) {
+			tx_buf = rxm_tx_buf_alloc(rxm_ep, RXM_BUF_POOL_TX_SAR);
+			if (!tx_buf) {
+				FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
+					"Ran out of buffers from SAR buffer pool\n");
+				return -FI_EAGAIN;
+			}
+
+			tx_buf->pkt.ctrl_hdr = first_tx_buf->pkt.ctrl_hdr;
+			tx_buf->pkt.hdr = first_tx_buf->pkt.hdr;
+			tx_buf->app_context = first_tx_buf->app_context;
+			tx_buf->flags = first_tx_buf->flags;
+			rxm_sar_set_seg_type(&tx_buf->pkt.ctrl_hdr,
+					     (*seg_no == segs_cnt - 1) ?
+					     RXM_SAR_SEG_LAST :
+					     RXM_SAR_SEG_MIDDLE);
+		} else {
+			tx_buf = first_tx_buf;
+		}
 
-	ofi_copy_from_iov(tx_buf->pkt.data, seg_len, iov, count, *iov_offset);
-	*iov_offset += seg_len;
+		seg_len = MIN(seg_size, tx_buf->pkt.hdr.size - *iov_offset);
+		tx_buf->pkt.ctrl_hdr.seg_size = (uint16_t) seg_len;
+		tx_buf->pkt.ctrl_hdr.seg_no = (uint32_t) *seg_no;
+		rxm_sar_set_offset(&tx_buf->pkt.ctrl_hdr, (uint32_t) *iov_offset);
+		ofi_copy_from_iov(tx_buf->pkt.data, seg_len, iov, count,
+				  *iov_offset);
 
-	*out_tx_buf = tx_buf;
+		ret = fi_send(rxm_conn->msg_ep, &tx_buf->pkt,
+			      sizeof(struct rxm_pkt) + seg_len,
+			      tx_buf->hdr.desc, 0, tx_buf);
+		if (ret) {
+			if (tx_buf != first_tx_buf)
+				ofi_buf_free(tx_buf);
+			return ret;
+		}
 
-	return fi_send(rxm_conn->msg_ep, &tx_buf->pkt, sizeof(struct rxm_pkt) +
-		       tx_buf->pkt.ctrl_hdr.seg_size, tx_buf->hdr.desc, 0, tx_buf);
+		rxm_conn->sar_tx_credits--;
+		*iov_offset += seg_len;
+	}
+	return 0;
 }
 
 static ssize_t
 rxm_ep_sar_tx_send(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		   void *context, uint8_t count, const struct iovec *iov,
-		   size_t data_len, size_t segs_cnt, uint64_t data,
-		   uint64_t flags, uint64_t tag, uint8_t op)
+		   size_t data_len, uint64_t data, uint64_t flags,
+		   uint64_t tag, uint8_t op)
 {
-	struct rxm_tx_sar_buf *tx_buf, *first_tx_buf;
-	size_t i, iov_offset = 0, remain_len = data_len;
-	ssize_t ret;
 	struct rxm_deferred_tx_entry *def_tx;
-	uint64_t msg_id = 0;
+	struct rxm_tx_sar_buf *first_tx_buf;
+	size_t seg_size, segs_cnt, seg_no = 0, iov_offset = 0;
+	ssize_t ret;
 
+	seg_size = rxm_ep_sar_calc_seg_size(data_len);
+	segs_cnt = ofi_div_ceil(data_len, seg_size);
 	assert(segs_cnt >= 2);
 
-	first_tx_buf = rxm_ep_sar_tx_prepare_segment(rxm_ep, rxm_conn, context,
-						     data_len, rxm_eager_limit,
-						     0, data, flags, tag, op,
-						     RXM_SAR_SEG_FIRST, &msg_id);
-	if (!first_tx_buf)
+	first_tx_buf = rxm_tx_buf_alloc(rxm_ep, RXM_BUF_POOL_TX_SAR);
+	if (!first_tx_buf) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
+			"Ran out of buffers from SAR buffer pool\n");
 		return -FI_EAGAIN;
+	}
 
-	ofi_copy_from_iov(first_tx_buf->pkt.data, rxm_eager_limit,
-			  iov, count, iov_offset);
-	iov_offset += rxm_eager_limit;
+	rxm_ep_format_tx_buf_pkt(rxm_conn, data_len, op, data, tag, flags,
+				 &first_tx_buf->pkt);
+	first_tx_buf->pkt.ctrl_hdr.msg_id = ofi_buf_index(first_tx_buf);
+	rxm_sar_set_seg_type(&first_tx_buf->pkt.ctrl_hdr, RXM_SAR_SEG_FIRST);
+	first_tx_buf->app_context = context;
+	first_tx_buf->flags = flags;
+	first_tx_buf->msg.conn = rxm_conn;
+	first_tx_buf->msg.segs_left = segs_cnt;
+	first_tx_buf->msg.failed = false;
+
+	ret = rxm_ep_sar_tx_post_segments(rxm_ep, rxm_conn, first_tx_buf,
+					  iov, count, seg_size, segs_cnt,
+					  &seg_no, &iov_offset);
+	if (!ret)
+		return 0;
 
-	ret = fi_send(rxm_conn->msg_ep, &first_tx_buf->pkt,
-		      sizeof(struct rxm_pkt) + first_tx_buf->pkt.ctrl_hdr.seg_size,
-		      first_tx_buf->hdr.desc, 0, first_tx_buf);
-	if (ret) {
+	if (!seg_no) {
+		/* Nothing was sent, so the application can retry */
 		if (ret == -FI_EAGAIN)
 			rxm_ep_do_progress(&rxm_ep->util_ep);
 		ofi_buf_free(first_tx_buf);
 		return ret;
 	}
 
-	remain_len -= rxm_eager_limit;
+	if (ret != -FI_EAGAIN)
+		goto fail;
 
-	for (i = 1; i < segs_cnt; i++) {
-		ret = rxm_ep_sar_tx_prepare_and_send_segment(rxm_ep, rxm_conn,
-				context, data_len, remain_len,
-				msg_id, rxm_eager_limit, i, segs_cnt,
-				data, flags, tag, op, iov, count,
-				&iov_offset, &tx_buf);
-		if (ret) {
-			if (ret == -FI_EAGAIN)
-				goto defer;
-			goto free;
-		}
-		remain_len -= rxm_eager_limit;
+	def_tx = rxm_ep_alloc_deferred_tx_entry(rxm_ep, rxm_conn,
+						RXM_DEFERRED_TX_SAR_SEG);
+	if (!def_tx) {
+		ret = -FI_ENOMEM;
+		goto fail;
 	}
 
+	def_tx->sar_seg.first_tx_buf = first_tx_buf;
+	memcpy(def_tx->sar_seg.iov, iov, sizeof(*iov) * count);
+	def_tx->sar_seg.count = count;
+	def_tx->sar_seg.iov_offset = iov_offset;
+	def_tx->sar_seg.seg_size = seg_size;
+	def_tx->sar_seg.next_seg_no = seg_no;
+	def_tx->sar_seg.segs_cnt = segs_cnt;
+	rxm_ep_enqueue_deferred_tx_queue(def_tx);
+	return 0;
+
+fail:
+	/* Part of the message is on the wire, so report it on the CQ */
+	rxm_ep_sar_tx_fail(rxm_ep, first_tx_buf, segs_cnt - seg_no, ret);
 	return 0;
+}
+
+/*
+ * The first message to a peer rides in the connection request when it is
+ * small enough, instead of waiting for the handshake.  Its completion is
+ * written once the peer has it.
+ */
+static ssize_t
+rxm_ep_connect_send(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
+		    const struct iovec *iov, size_t count, size_t data_len,
+		    void *context, uint64_t data, uint64_t flags, uint64_t tag,
+		    uint8_t op)
+{
+	struct rxm_tx_eager_buf *tx_buf;
+	ssize_t ret;
+
+	if (data_len > rxm_ep->cm_eager_size)
+		return rxm_cmap_connect(rxm_ep, rxm_conn->handle.fi_addr,
+					&rxm_conn->handle);
+
+	tx_buf = rxm_tx_buf_alloc(rxm_ep, RXM_BUF_POOL_TX);
+	if (!tx_buf) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
+			"Ran out of buffers from Eager buffer pool\n");
+		return -FI_EAGAIN;
+	}
+
+	rxm_ep_format_tx_buf_pkt(rxm_conn, data_len, op, data, tag, flags,
+				 &tx_buf->pkt);
+	ofi_copy_from_iov(tx_buf->pkt.data, data_len, iov, count, 0);
+	tx_buf->app_context = context;
+	tx_buf->flags = flags;
 
-free:
-	ofi_buf_free(first_tx_buf);
+	ret = rxm_cmap_connect_eager(rxm_ep, &rxm_conn->handle, tx_buf);
+	if (ret)
+		ofi_buf_free(tx_buf);
+	else
+		rxm_conn->tx_credits--;
 	return ret;
-defer:
-	def_tx = rxm_ep_alloc_deferred_tx_entry(rxm_ep,
-			rxm_conn, RXM_DEFERRED_TX_SAR_SEG);
-	if (!def_tx) {
-		if (tx_buf)
-			ofi_buf_free(tx_buf);
-		return -FI_ENOMEM;
+}
+
+/*
+ * A peer that granted flow control credits is sent no more messages than
+ * it has credits for.  The stall lasts until its next credit message.
+ */
+static inline bool
+rxm_conn_tx_stalled(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn)
+{
+	if (OFI_LIKELY(!rxm_conn->flow_ctrl || rxm_conn->tx_credits > 0))
+		return false;
+
+	if (!rxm_conn->stall_start) {
+		rxm_conn->stall_start = ofi_gettime_ns();
+		rxm_ep->flow_ctrl_stalls++;
 	}
-	memcpy(def_tx->sar_seg.payload.iov,
-		iov, sizeof(*iov) * count);
-	def_tx->sar_seg.payload.count = count;
-	def_tx->sar_seg.payload.cur_iov_offset = iov_offset;
-	def_tx->sar_seg.payload.tag = tag;
-	def_tx->sar_seg.payload.data = data;
-	def_tx->sar_seg.cur_seg_tx_buf = tx_buf;
-	def_tx->sar_seg.app_context = context;
-	def_tx->sar_seg.flags = flags;
-	def_tx->sar_seg.op = op;
-	def_tx->sar_seg.next_seg_no = i;
-	def_tx->sar_seg.segs_cnt = segs_cnt;
-	def_tx->sar_seg.total_len = data_len;
-	def_tx->sar_seg.remain_len = remain_len;
-	def_tx->sar_seg.msg_id = msg_id;
-	rxm_ep_enqueue_deferred_tx_queue(def_tx);
+	return true;
+}
+
+ssize_t rxm_conn_flush_agg(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn)
+{
+	struct rxm_tx_agg_buf *tx_buf = rxm_conn->agg_buf;
+	ssize_t ret;
+
+	ret = rxm_ep_msg_normal_send(rxm_conn, &tx_buf->pkt,
+				     sizeof(struct rxm_pkt) +
+				     tx_buf->pkt.hdr.size,
+				     tx_buf->hdr.desc, tx_buf);
+	if (ret)
+		return ret;
+
+	rxm_conn->agg_buf = NULL;
+	dlist_remove(&rxm_conn->agg_entry);
 	return 0;
 }
 
+void rxm_ep_flush_agg(struct rxm_ep *rxm_ep)
+{
+	struct dlist_entry *conn_entry_tmp;
+	struct rxm_conn *rxm_conn;
+
+	dlist_foreach_container_safe(&rxm_ep->agg_conn_list, struct rxm_conn,
+				     rxm_conn, agg_entry, conn_entry_tmp)
+		(void) rxm_conn_flush_agg(rxm_ep, rxm_conn);
+}
+
+static inline bool
+rxm_ep_agg_eligible(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
+		    size_t len, uint8_t op, uint64_t tag)
+{
+	return rxm_ep->agg_size && len <= rxm_ep->agg_size &&
+	       rxm_conn->handle.state == RXM_CMAP_CONNECTED &&
+	       !(op == ofi_op_tagged && (tag & OFI_COLL_TAG_FLAG));
+}
+
+/* Whether the next message might not fit */
+static inline bool
+rxm_agg_full(struct rxm_ep *rxm_ep, struct rxm_tx_agg_buf *tx_buf)
+{
+	return tx_buf->count == RXM_AGG_MAX_MSGS ||
+	       tx_buf->pkt.hdr.size + sizeof(struct rxm_agg_hdr) +
+	       ofi_get_aligned_size(rxm_ep->agg_size, 8) > rxm_eager_limit;
+}
+
+/*
+ * Small messages to a connected peer are packed into one MSG send, which
+ * goes out once it is full or at the next progress call.  Their
+ * completions are written when that send completes.
+ */
+static ssize_t
+rxm_ep_agg_send(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
+		const struct iovec *iov, size_t count, size_t data_len,
+		void *context, uint64_t data, uint64_t flags, uint64_t tag,
+		uint8_t op)
+{
+	struct rxm_tx_agg_buf *tx_buf = rxm_conn->agg_buf;
+	struct rxm_agg_hdr *agg_hdr;
+	ssize_t ret;
+
+	if (tx_buf && rxm_agg_full(rxm_ep, tx_buf)) {
+		ret = rxm_conn_flush_agg(rxm_ep, rxm_conn);
+		if (ret)
+			return ret;
+		tx_buf = NULL;
+	}
+
+	if (!tx_buf) {
+		tx_buf = rxm_tx_buf_alloc(rxm_ep, RXM_BUF_POOL_TX_AGG);
+		if (!tx_buf) {
+			FI_WARN(&rxm_prov, FI_LOG_EP_DATA,
+				"Ran out of buffers from aggregation pool\n");
+			return -FI_EAGAIN;
+		}
+
+		rxm_ep_format_tx_buf_pkt(rxm_conn, 0, ofi_op_msg, 0, 0, 0,
+					 &tx_buf->pkt);
+		tx_buf->count = 0;
+		rxm_conn->agg_buf = tx_buf;
+		dlist_insert_tail(&rxm_conn->agg_entry,
+				  &rxm_ep->agg_conn_list);
+	}
+
+	agg_hdr = (struct rxm_agg_hdr *)
+		  (tx_buf->pkt.data + tx_buf->pkt.hdr.size);
+	agg_hdr->tag = tag;
+	agg_hdr->data = data;
+	agg_hdr->size = (uint32_t) data_len;
+	agg_hdr->op = op;
+	agg_hdr->flags = (flags & FI_REMOTE_CQ_DATA) ?
+			 RXM_AGG_REMOTE_CQ_DATA : 0;
+	ofi_copy_from_iov(agg_hdr + 1, data_len, iov, count, 0);
+
+	tx_buf->msg[tx_buf->count].app_context = context;
+	tx_buf->msg[tx_buf->count].flags = flags;
+	tx_buf->msg[tx_buf->count].op = op;
+	tx_buf->count++;
+	tx_buf->pkt.hdr.size += sizeof(*agg_hdr) +
+				ofi_get_aligned_size(data_len, 8);
+	rxm_conn->tx_credits--;
+
+	if (rxm_agg_full(rxm_ep, tx_buf))
+		(void) rxm_conn_flush_agg(rxm_ep, rxm_conn);
+	return 0;
+}
+
+/* Messages that are not aggregated must not overtake those that are */
+static inline ssize_t
+rxm_ep_agg_prepare(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn)
+{
+	if (OFI_LIKELY(!rxm_conn->agg_buf))
+		return 0;
+
+	return rxm_conn_flush_agg(rxm_ep, rxm_conn);
+}
+
 static ssize_t
 rxm_ep_emulate_inject(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		      const void *buf, size_t len, size_t pkt_size,
@@ -1333,10 +1749,36 @@ rxm_ep_inject_send_fast(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 			const void *buf, size_t len, struct rxm_pkt *inject_pkt)
 {
 	size_t pkt_size = sizeof(struct rxm_pkt) + len;
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
 	ssize_t ret;
 
 	assert(len <= rxm_ep->rxm_info->tx_attr->inject_size);
 
+	if (OFI_UNLIKELY(rxm_conn_tx_stalled(rxm_ep, rxm_conn)))
+		return -FI_EAGAIN;
+
+	if (OFI_UNLIKELY(rxm_conn->handle.state == RXM_CMAP_IDLE))
+		return rxm_ep_connect_send(rxm_ep, rxm_conn, &iov, 1, len, NULL,
+					   inject_pkt->hdr.data,
+					   inject_pkt->hdr.flags,
+					   inject_pkt->hdr.tag,
+					   inject_pkt->hdr.op);
+
+	if (rxm_ep_agg_eligible(rxm_ep, rxm_conn, len, inject_pkt->hdr.op,
+				inject_pkt->hdr.tag))
+		return rxm_ep_agg_send(rxm_ep, rxm_conn, &iov, 1, len, NULL,
+				       inject_pkt->hdr.data,
+				       inject_pkt->hdr.flags,
+				       inject_pkt->hdr.tag,
+				       inject_pkt->hdr.op);
+
+	ret = rxm_ep_agg_prepare(rxm_ep, rxm_conn);
+	if (ret)
+		return ret;
+
 	if (pkt_size <= rxm_ep->inject_limit &&
 	    !rxm_ep->util_ep.tx_cntr) {
 		inject_pkt->hdr.size = len;
@@ -1351,6 +1793,8 @@ rxm_ep_inject_send_fast(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 					    inject_pkt->hdr.tag,
 					    inject_pkt->hdr.op);
 	}
+	if (!ret)
+		rxm_conn->tx_credits--;
 	return ret;
 }
 
@@ -1361,10 +1805,29 @@ rxm_ep_inject_send(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 {
 	struct rxm_tx_base_buf *tx_buf;
 	size_t pkt_size = sizeof(struct rxm_pkt) + len;
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
 	ssize_t ret;
 
 	assert(len <= rxm_ep->rxm_info->tx_attr->inject_size);
 
+	if (OFI_UNLIKELY(rxm_conn_tx_stalled(rxm_ep, rxm_conn)))
+		return -FI_EAGAIN;
+
+	if (OFI_UNLIKELY(rxm_conn->handle.state == RXM_CMAP_IDLE))
+		return rxm_ep_connect_send(rxm_ep, rxm_conn, &iov, 1, len, NULL,
+					   data, flags, tag, op);
+
+	if (rxm_ep_agg_eligible(rxm_ep, rxm_conn, len, op, tag))
+		return rxm_ep_agg_send(rxm_ep, rxm_conn, &iov, 1, len, NULL,
+				       data, flags, tag, op);
+
+	ret = rxm_ep_agg_prepare(rxm_ep, rxm_conn);
+	if (ret)
+		return ret;
+
 	if (pkt_size <= rxm_ep->inject_limit &&
 	    !rxm_ep->util_ep.tx_cntr) {
 		tx_buf = rxm_tx_buf_alloc(rxm_ep, RXM_BUF_POOL_TX_INJECT);
@@ -1386,6 +1849,8 @@ rxm_ep_inject_send(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		ret = rxm_ep_emulate_inject(rxm_ep, rxm_conn, buf, len,
 					    pkt_size, data, flags, tag, op);
 	}
+	if (!ret)
+		rxm_conn->tx_credits--;
 unlock:
 	return ret;
 
@@ -1407,6 +1872,22 @@ rxm_ep_send_common(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		(data_len > rxm_ep->rxm_info->tx_attr->inject_size)) ||
 	       (data_len <= rxm_ep->rxm_info->tx_attr->inject_size));
 
+	if (OFI_UNLIKELY(rxm_conn_tx_stalled(rxm_ep, rxm_conn)))
+		return -FI_EAGAIN;
+
+	if (OFI_UNLIKELY(rxm_conn->handle.state == RXM_CMAP_IDLE))
+		return rxm_ep_connect_send(rxm_ep, rxm_conn, iov, count,
+					   data_len, context, data, flags,
+					   tag, op);
+
+	if (rxm_ep_agg_eligible(rxm_ep, rxm_conn, data_len, op, tag))
+		return rxm_ep_agg_send(rxm_ep, rxm_conn, iov, count, data_len,
+				       context, data, flags, tag, op);
+
+	ret = rxm_ep_agg_prepare(rxm_ep, rxm_conn);
+	if (ret)
+		return ret;
+
 	if (data_len <= rxm_eager_limit) {
 		tx_buf = rxm_tx_buf_alloc(rxm_ep, RXM_BUF_POOL_TX);
 		if (!tx_buf) {
@@ -1431,12 +1912,11 @@ rxm_ep_send_common(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 			ofi_buf_free(tx_buf);
 		}
 	} else if (data_len <= rxm_ep->sar_limit &&
-		   /* SAR uses eager_limit as segment size */
+		   /* SAR segments are at most eager_limit in size */
 		   (rxm_eager_limit <
 		    (1ULL << (8 * sizeof_field(struct ofi_ctrl_hdr, seg_size))))) {
 		ret = rxm_ep_sar_tx_send(rxm_ep, rxm_conn, context,
 					 count, iov, data_len,
-					 rxm_ep_sar_calc_segs_cnt(rxm_ep, data_len),
 					 data, flags, tag, op);
 	} else {
 		struct rxm_tx_rndv_buf *tx_buf;
@@ -1448,6 +1928,8 @@ rxm_ep_send_common(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 		if (ret >= 0)
 			ret = rxm_ep_rndv_tx_send(rxm_ep, rxm_conn, tx_buf, ret);
 	}
+	if (!ret)
+		rxm_conn->tx_credits--;
 unlock:
 	return ret;
 }
@@ -1470,79 +1952,32 @@ rxm_ep_alloc_deferred_tx_entry(struct rxm_ep *rxm_ep, struct rxm_conn *rxm_conn,
 	return def_tx_entry;
 }
 
-static void
-rxm_ep_sar_handle_segment_failure(struct rxm_deferred_tx_entry *def_tx_entry,
-				ssize_t ret)
-{
-	rxm_ep_sar_tx_cleanup(def_tx_entry->rxm_ep, def_tx_entry->rxm_conn,
-			      def_tx_entry->sar_seg.cur_seg_tx_buf);
-	rxm_cq_write_error(def_tx_entry->rxm_ep->util_ep.tx_cq,
-			   def_tx_entry->rxm_ep->util_ep.tx_cntr,
-			   def_tx_entry->sar_seg.app_context, ret);
-}
-
-/* Returns FI_SUCCESS if the SAR deferred TX queue is empty,
+/* Returns FI_SUCCESS once the deferred SAR message has been fully posted,
  * otherwise, it returns -FI_EAGAIN or error from MSG provider */
 static ssize_t
 rxm_ep_progress_sar_deferred_segments(struct rxm_deferred_tx_entry *def_tx_entry)
 {
-	ssize_t ret = 0;
-	struct rxm_tx_sar_buf *tx_buf = def_tx_entry->sar_seg.cur_seg_tx_buf;
-
-	if (tx_buf) {
-		ret = fi_send(def_tx_entry->rxm_conn->msg_ep, &tx_buf->pkt,
-			      sizeof(tx_buf->pkt) + tx_buf->pkt.ctrl_hdr.seg_size,
-			      tx_buf->hdr.desc, 0, tx_buf);
-		if (ret) {
-			if (ret != -FI_EAGAIN) {
-				rxm_ep_sar_handle_segment_failure(def_tx_entry, ret);
-				goto sar_finish;
-			}
-			return ret;
-		}
-
-		def_tx_entry->sar_seg.next_seg_no++;
-		def_tx_entry->sar_seg.remain_len -= rxm_eager_limit;
-
-		if (def_tx_entry->sar_seg.next_seg_no ==
-		    def_tx_entry->sar_seg.segs_cnt) {
-			assert(rxm_sar_get_seg_type(&tx_buf->pkt.ctrl_hdr) ==
-			       RXM_SAR_SEG_LAST);
-			goto sar_finish;
-		}
-	}
+	ssize_t ret;
 
-	while (def_tx_entry->sar_seg.next_seg_no !=
-	       def_tx_entry->sar_seg.segs_cnt) {
-		ret = rxm_ep_sar_tx_prepare_and_send_segment(
-				def_tx_entry->rxm_ep, def_tx_entry->rxm_conn,
-				def_tx_entry->sar_seg.app_context,
-				def_tx_entry->sar_seg.total_len,
-				def_tx_entry->sar_seg.remain_len,
-				def_tx_entry->sar_seg.msg_id, rxm_eager_limit,
-				def_tx_entry->sar_seg.next_seg_no,
-				def_tx_entry->sar_seg.segs_cnt,
-				def_tx_entry->sar_seg.payload.data,
-				def_tx_entry->sar_seg.flags,
-				def_tx_entry->sar_seg.payload.tag,
-				def_tx_entry->sar_seg.op,
-				def_tx_entry->sar_seg.payload.iov,
-				def_tx_entry->sar_seg.payload.count,
-				&def_tx_entry->sar_seg.payload.cur_iov_offset,
-				&def_tx_entry->sar_seg.cur_seg_tx_buf);
-		if (ret) {
-			if (ret != -FI_EAGAIN) {
-				rxm_ep_sar_handle_segment_failure(def_tx_entry, ret);
-				goto sar_finish;
-			}
+	ret = rxm_ep_sar_tx_post_segments(def_tx_entry->rxm_ep,
+					  def_tx_entry->rxm_conn,
+					  def_tx_entry->sar_seg.first_tx_buf,
+					  def_tx_entry->sar_seg.iov,
+					  def_tx_entry->sar_seg.count,
+					  def_tx_entry->sar_seg.seg_size,
+					  def_tx_entry->sar_seg.segs_cnt,
+					  &def_tx_entry->sar_seg.next_seg_no,
+					  &def_tx_entry->sar_seg.iov_offset);
+	if (ret == -FI_EAGAIN)
+		return ret;
 
-			return ret;
-		}
-		def_tx_entry->sar_seg.next_seg_no++;
-		def_tx_entry->sar_seg.remain_len -= rxm_eager_limit;
+	if (ret) {
+		rxm_ep_sar_tx_fail(def_tx_entry->rxm_ep,
+				   def_tx_entry->sar_seg.first_tx_buf,
+				   def_tx_entry->sar_seg.segs_cnt -
+				   def_tx_entry->sar_seg.next_seg_no, ret);
 	}
 
-sar_finish:
 	rxm_ep_dequeue_deferred_tx_queue(def_tx_entry);
 	free(def_tx_entry);
 
@@ -1553,6 +1988,8 @@ void rxm_ep_progress_deferred_queue(struct rxm_ep *rxm_ep,
 				    struct rxm_conn *rxm_conn)
 {
 	struct rxm_deferred_tx_entry *def_tx_entry;
+	struct rxm_tx_rndv_buf *tx_rndv_buf;
+	struct rxm_rx_buf *rx_buf;
 	struct iovec iov;
 	struct fi_msg msg;
 	ssize_t ret = 0;
@@ -1588,7 +2025,7 @@ void rxm_ep_progress_deferred_queue(struct rxm_ep *rxm_ep,
 			free(def_tx_entry);
 			break;
 		case RXM_DEFERRED_TX_RNDV_READ:
-			ret = fi_readv(def_tx_entry->rxm_conn->msg_ep,
+			ret = fi_readv(def_tx_entry->rndv_read.rx_buf->rndv_ep,
 				       def_tx_entry->rndv_read.rxm_iov.iov,
 				       def_tx_entry->rndv_read.rxm_iov.desc,
 				       def_tx_entry->rndv_read.rxm_iov.count, 0,
@@ -1647,6 +2084,37 @@ void rxm_ep_progress_deferred_queue(struct rxm_ep *rxm_ep,
 			rxm_ep_dequeue_deferred_tx_queue(def_tx_entry);
 			free(def_tx_entry);
 			break;
+		case RXM_DEFERRED_TX_RNDV_CTS:
+			rx_buf = def_tx_entry->rndv_cts.rx_buf;
+			ret = fi_send(def_tx_entry->rxm_conn->msg_ep,
+				      &rx_buf->recv_entry->rndv.tx_buf->pkt,
+				      sizeof(struct rxm_pkt) +
+				      sizeof(struct rxm_rndv_hdr),
+				      rx_buf->recv_entry->rndv.tx_buf->hdr.desc,
+				      0, rx_buf);
+			if (ret) {
+				if (ret == -FI_EAGAIN)
+					break;
+				RXM_UPDATE_STATE(FI_LOG_EP_DATA, rx_buf,
+						 RXM_RNDV_DONE_WAIT);
+				rxm_rndv_rx_fail(rx_buf, (int) ret);
+			}
+			rxm_ep_dequeue_deferred_tx_queue(def_tx_entry);
+			free(def_tx_entry);
+			break;
+		case RXM_DEFERRED_TX_RNDV_WRITE:
+			/* Errors are reported through the tx_buf, which
+			 * may be freed unless the write must be retried */
+			tx_rndv_buf = def_tx_entry->rndv_write.tx_buf;
+			tx_rndv_buf->write.deferred = false;
+			ret = rxm_rndv_write_progress(rxm_ep, tx_rndv_buf);
+			if (ret == -FI_EAGAIN) {
+				tx_rndv_buf->write.deferred = true;
+				break;
+			}
+			rxm_ep_dequeue_deferred_tx_queue(def_tx_entry);
+			free(def_tx_entry);
+			break;
 		}
 	}
 }
@@ -1660,7 +2128,7 @@ rxm_ep_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg, uint64_t flags)
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	ret = rxm_ep_prepare_tx(rxm_ep, msg->addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, msg->addr, &rxm_conn);
 	if (ret)
 		goto unlock;
 
@@ -1687,7 +2155,7 @@ static ssize_t rxm_ep_send(struct fid_ep *ep_fid, const void *buf, size_t len,
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		goto unlock;
 
@@ -1709,7 +2177,7 @@ static ssize_t rxm_ep_sendv(struct fid_ep *ep_fid, const struct iovec *iov,
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		goto unlock;
 
@@ -1730,7 +2198,7 @@ static ssize_t rxm_ep_inject(struct fid_ep *ep_fid, const void *buf, size_t len,
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		goto unlock;
 
@@ -1750,7 +2218,7 @@ static ssize_t rxm_ep_inject_fast(struct fid_ep *ep_fid, const void *buf,
 	ssize_t ret;
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		return ret;
 
@@ -1772,7 +2240,7 @@ static ssize_t rxm_ep_senddata(struct fid_ep *ep_fid, const void *buf, size_t le
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		goto unlock;
 
@@ -1793,7 +2261,7 @@ static ssize_t rxm_ep_injectdata(struct fid_ep *ep_fid, const void *buf, size_t
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		goto unlock;
 
@@ -1813,7 +2281,7 @@ static ssize_t rxm_ep_injectdata_fast(struct fid_ep *ep_fid, const void *buf, si
 	ssize_t ret;
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		return ret;
 
@@ -1869,12 +2337,11 @@ rxm_ep_post_trecv(struct rxm_ep *rxm_ep, const struct iovec *iov,
 	rx_buf = rxm_get_unexp_msg(&rxm_ep->trecv_queue, recv_entry->addr,
 				   recv_entry->tag, recv_entry->ignore);
 	if (!rx_buf) {
-		dlist_insert_tail(&recv_entry->entry,
-				  &rxm_ep->trecv_queue.recv_list);
+		rxm_recv_queue_insert(&rxm_ep->trecv_queue, recv_entry);
 		return FI_SUCCESS;
 	}
 
-	dlist_remove(&rx_buf->unexp_msg.entry);
+	rxm_unexp_msg_remove(rx_buf);
 	rx_buf->recv_entry = recv_entry;
 
 	if (rx_buf->pkt.ctrl_hdr.type != rxm_ctrl_seg)
@@ -2012,7 +2479,7 @@ rxm_ep_tsendmsg(struct fid_ep *ep_fid, const struct fi_msg_tagged *msg,
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	ret = rxm_ep_prepare_tx(rxm_ep, msg->addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, msg->addr, &rxm_conn);
 	if (ret)
 		goto unlock;
 
@@ -2040,7 +2507,7 @@ static ssize_t rxm_ep_tsend(struct fid_ep *ep_fid, const void *buf, size_t len,
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		goto unlock;
 
@@ -2062,7 +2529,7 @@ static ssize_t rxm_ep_tsendv(struct fid_ep *ep_fid, const struct iovec *iov,
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		goto unlock;
 
@@ -2083,7 +2550,7 @@ static ssize_t rxm_ep_tinject(struct fid_ep *ep_fid, const void *buf, size_t len
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		goto unlock;
 
@@ -2103,7 +2570,7 @@ static ssize_t rxm_ep_tinject_fast(struct fid_ep *ep_fid, const void *buf, size_
 	ssize_t ret;
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		return ret;
 
@@ -2127,7 +2594,7 @@ static ssize_t rxm_ep_tsenddata(struct fid_ep *ep_fid, const void *buf, size_t l
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		goto unlock;
 
@@ -2148,7 +2615,7 @@ static ssize_t rxm_ep_tinjectdata(struct fid_ep *ep_fid, const void *buf, size_t
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
 	ofi_ep_lock_acquire(&rxm_ep->util_ep);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		goto unlock;
 
@@ -2168,7 +2635,7 @@ static ssize_t rxm_ep_tinjectdata_fast(struct fid_ep *ep_fid, const void *buf, s
 	ssize_t ret;
 
 	rxm_ep = container_of(ep_fid, struct rxm_ep, util_ep.ep_fid.fid);
-	ret = rxm_ep_prepare_tx(rxm_ep, dest_addr, &rxm_conn);
+	ret = rxm_ep_prepare_msg_tx(rxm_ep, dest_addr, &rxm_conn);
 	if (ret)
 		return ret;
 
@@ -2249,9 +2716,143 @@ static int rxm_ep_msg_res_close(struct rxm_ep *rxm_ep)
 	return ret;
 }
 
+static void rxm_ep_rail_close(struct rxm_ep_rail *rail)
+{
+	if (rail->pep) {
+		if (fi_close(&rail->pep->fid))
+			FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+				"Unable to close rail pep\n");
+		rail->pep = NULL;
+	}
+	fi_freeinfo(rail->info);
+	rail->info = NULL;
+}
+
+/*
+ * A rail listens on a local address of another interface.  It is opened
+ * on the same MSG domain, so memory registrations hold on every rail.
+ */
+static int rxm_ep_rail_open(struct rxm_ep *rxm_ep, struct rxm_ep_rail *rail,
+			    const char *node)
+{
+	struct rxm_fabric *rxm_fabric;
+	struct addrinfo hints = {
+		.ai_family = ofi_get_sa_family(rxm_ep->msg_info),
+		.ai_flags = AI_NUMERICHOST,
+	};
+	struct addrinfo *ai;
+	size_t len = sizeof(rail->name);
+	int ret;
+
+	rxm_fabric = container_of(rxm_ep->util_ep.domain->fabric,
+				  struct rxm_fabric, util_fabric);
+
+	ret = getaddrinfo(node, NULL, &hints, &ai);
+	if (ret) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+			"Invalid rail address: %s\n", node);
+		return -FI_EINVAL;
+	}
+
+	rail->info = fi_dupinfo(rxm_ep->msg_info);
+	if (!rail->info) {
+		ret = -FI_ENOMEM;
+		goto err;
+	}
+
+	free(rail->info->src_addr);
+	rail->info->src_addrlen = ai->ai_addrlen;
+	rail->info->src_addr = mem_dup(ai->ai_addr, ai->ai_addrlen);
+	if (!rail->info->src_addr) {
+		ret = -FI_ENOMEM;
+		goto err;
+	}
+
+	ret = fi_passive_ep(rxm_fabric->msg_fabric, rail->info, &rail->pep,
+			    rxm_ep);
+	if (ret)
+		goto err;
+
+	ret = fi_pep_bind(rail->pep, &rxm_ep->msg_eq->fid, 0);
+	if (ret)
+		goto err;
+
+	ret = fi_listen(rail->pep);
+	if (ret)
+		goto err;
+
+	ret = fi_getname(&rail->pep->fid, &rail->name, &len);
+	if (ret)
+		goto err;
+
+	freeaddrinfo(ai);
+	return 0;
+err:
+	FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+		"Unable to open rail on %s: %d\n", node, ret);
+	rxm_ep_rail_close(rail);
+	freeaddrinfo(ai);
+	return ret;
+}
+
+/* The addresses of all rails must fit into the CM data of an accept */
+static void rxm_ep_rails_open(struct rxm_ep *rxm_ep)
+{
+	size_t cm_data_size = 0, opt_size = sizeof(cm_data_size);
+	char *rail_addr, **addrv;
+	size_t i, addrlen;
+
+	if (fi_param_get_str(&rxm_prov, "rail_addr", &rail_addr) ||
+	    !rail_addr || !rail_addr[0])
+		return;
+
+	if (!rxm_ep->srx_ctx) {
+		FI_WARN(&rxm_prov, FI_LOG_EP_CTRL, "Additional rails require "
+			"a shared receive context, ignoring FI_OFI_RXM_RAIL_ADDR\n");
+		return;
+	}
+
+	if (fi_getopt(&rxm_ep->msg_pep->fid, FI_OPT_ENDPOINT,
+		      FI_OPT_CM_DATA_SIZE, &cm_data_size, &opt_size))
+		return;
+	cm_data_size = MIN(cm_data_size, RXM_MAX_CM_DATA_SIZE);
+
+	addrv = ofi_split_and_alloc(rail_addr, ",", NULL);
+	if (!addrv)
+		return;
+
+	for (i = 0; addrv[i] && rxm_ep->rail_cnt < RXM_MAX_RAILS - 1; i++) {
+		if (rxm_ep_rail_open(rxm_ep, &rxm_ep->rails[rxm_ep->rail_cnt],
+				     addrv[i]))
+			continue;
+
+		addrlen = ofi_sizeofaddr((struct sockaddr *)
+				&rxm_ep->rails[rxm_ep->rail_cnt].name);
+		if ((rxm_ep->rail_cnt && addrlen != rxm_ep->rail_addrlen) ||
+		    sizeof(union rxm_cm_data) +
+		    (rxm_ep->rail_cnt + 1) * addrlen > cm_data_size) {
+			FI_WARN(&rxm_prov, FI_LOG_EP_CTRL,
+				"Unable to use rail %s\n", addrv[i]);
+			rxm_ep_rail_close(&rxm_ep->rails[rxm_ep->rail_cnt]);
+			continue;
+		}
+		rxm_ep->rail_addrlen = addrlen;
+		rxm_ep->rail_cnt++;
+	}
+	ofi_free_string_array(addrv);
+
+	FI_INFO(&rxm_prov, FI_LOG_EP_CTRL, "%zu additional rails\n",
+		rxm_ep->rail_cnt);
+}
+
 static int rxm_listener_close(struct rxm_ep *rxm_ep)
 {
 	int ret, retv = 0;
+	size_t i;
+
+	for (i = 0; i < rxm_ep->rail_cnt; i++)
+		rxm_ep_rail_close(&rxm_ep->rails[i]);
+	rxm_ep->rail_cnt = 0;
 
 	if (rxm_ep->msg_pep) {
 		ret = fi_close(&rxm_ep->msg_pep->fid);
@@ -2278,6 +2879,12 @@ static int rxm_ep_close(struct fid *fid)
 	struct rxm_ep *rxm_ep;
 
 	rxm_ep = container_of(fid, struct rxm_ep, util_ep.ep_fid.fid);
+	if (rxm_ep->flow_ctrl_stalls)
+		FI_INFO(&rxm_prov, FI_LOG_EP_DATA, "Sends stalled on flow "
+			"control credits %" PRIu64 " times, for %" PRIu64
+			" usec in total\n", rxm_ep->flow_ctrl_stalls,
+			rxm_ep->flow_ctrl_stall_ns / 1000);
+
 	if (rxm_ep->cmap)
 		rxm_cmap_free(rxm_ep->cmap);
 
@@ -2450,6 +3057,14 @@ static void rxm_ep_sar_init(struct rxm_ep *rxm_ep)
 			param = rxm_eager_limit;
 		}
 
+		/* Segments carry a 32-bit offset into the message */
+		if (param > UINT32_MAX) {
+			FI_WARN(&rxm_prov, FI_LOG_CORE,
+				"SAR limit reduced to %" PRIu32 "\n",
+				UINT32_MAX);
+			param = UINT32_MAX;
+		}
+
 		rxm_ep->sar_limit = param;
 	} else {
 		size_t sar_limit = rxm_ep->msg_info->tx_attr->size *
@@ -2458,6 +3073,46 @@ static void rxm_ep_sar_init(struct rxm_ep *rxm_ep)
 		rxm_ep->sar_limit = (sar_limit > RXM_SAR_LIMIT) ?
 				    RXM_SAR_LIMIT : sar_limit;
 	}
+
+	/* By default, leave half of the MSG transmit queue of a connection
+	 * to other traffic */
+	if (fi_param_get_size_t(&rxm_prov, "sar_window",
+				&rxm_ep->sar_window) || !rxm_ep->sar_window)
+		rxm_ep->sar_window = MAX(rxm_ep->msg_info->tx_attr->size / 2, 1);
+}
+
+static void rxm_ep_rndv_init(struct rxm_ep *rxm_ep)
+{
+	if (fi_param_get_size_t(&rxm_prov, "rndv_write_min",
+				&rxm_ep->rndv_write_min))
+		rxm_ep->rndv_write_min = SIZE_MAX;
+
+	/* The done message must not overtake the data it announces */
+	if ((rxm_ep->rndv_write_min != SIZE_MAX) &&
+	    !(rxm_ep->msg_info->tx_attr->msg_order & FI_ORDER_SAW)) {
+		FI_WARN(&rxm_prov, FI_LOG_CORE,
+			"MSG provider does not order sends after writes, "
+			"rendezvous will use RMA read\n");
+		rxm_ep->rndv_write_min = SIZE_MAX;
+	}
+}
+
+/* Credits are only used when the MSG provider has no flow control */
+static void rxm_ep_flow_ctrl_init(struct rxm_ep *rxm_ep)
+{
+	struct rxm_domain *domain = container_of(rxm_ep->util_ep.domain,
+						 struct rxm_domain, util_domain);
+
+	if (fi_param_get_size_t(&rxm_prov, "flow_ctrl_credits",
+				&rxm_ep->flow_ctrl_credits))
+		rxm_ep->flow_ctrl_credits = 0;
+
+	if (rxm_ep->flow_ctrl_credits &&
+	    domain->flow_ctrl_ops != &rxm_no_ops_flow_ctrl) {
+		FI_INFO(&rxm_prov, FI_LOG_CORE, "MSG provider has flow "
+			"control, ignoring FI_OFI_RXM_FLOW_CTRL_CREDITS\n");
+		rxm_ep->flow_ctrl_credits = 0;
+	}
 }
 
 static void rxm_ep_settings_init(struct rxm_ep *rxm_ep)
@@ -2495,6 +3150,14 @@ static void rxm_ep_settings_init(struct rxm_ep *rxm_ep)
 	rxm_ep->buffered_limit = rxm_eager_limit;
 
 	rxm_ep_sar_init(rxm_ep);
+	rxm_ep_rndv_init(rxm_ep);
+	rxm_ep_flow_ctrl_init(rxm_ep);
+
+	if (fi_param_get_size_t(&rxm_prov, "agg_size", &rxm_ep->agg_size))
+		rxm_ep->agg_size = 0;
+	rxm_ep->agg_size = MIN(rxm_ep->agg_size,
+			       (rxm_eager_limit - sizeof(struct rxm_agg_hdr)) &
+			       ~(size_t) 7);
 
  	FI_INFO(&rxm_prov, FI_LOG_CORE,
 		"Settings:\n"
@@ -2505,12 +3168,18 @@ static void rxm_ep_settings_init(struct rxm_ep *rxm_ep)
 	        "\t\t FI_EP_MSG provider inject size: %zu\n"
 	        "\t\t rxm inject size: %zu\n"
 		"\t\t Protocol limits: Eager: %zu, "
-				      "SAR: %zu\n",
+				      "SAR: %zu, "
+				      "SAR window: %zu, "
+				      "Rendezvous write: %zu\n"
+		"\t\t Flow control credits: %zu\n"
+		"\t\t Aggregation size: %zu\n",
 		rxm_ep->msg_mr_local, rxm_ep->rdm_mr_local,
 		rxm_ep->comp_per_progress, rxm_ep->buffered_min,
 		rxm_ep->min_multi_recv_size, rxm_ep->inject_limit,
 		rxm_ep->rxm_info->tx_attr->inject_size,
-		rxm_eager_limit, rxm_ep->sar_limit);
+		rxm_eager_limit, rxm_ep->sar_limit, rxm_ep->sar_window,
+		rxm_ep->rndv_write_min, rxm_ep->flow_ctrl_credits,
+		rxm_ep->agg_size);
 }
 
 static int rxm_ep_txrx_res_open(struct rxm_ep *rxm_ep)
@@ -2522,6 +3191,8 @@ static int rxm_ep_txrx_res_open(struct rxm_ep *rxm_ep)
 		return ret;
 
 	dlist_init(&rxm_ep->deferred_tx_conn_queue);
+	dlist_init(&rxm_ep->credit_return_list);
+	dlist_init(&rxm_ep->agg_conn_list);
 
 	ret = rxm_ep_rx_queue_init(rxm_ep);
 	if (ret)
@@ -2595,6 +3266,9 @@ static int rxm_ep_ctrl(struct fid *fid, int command, void *arg)
 			return ret;
 		}
 
+		/* Rails must be listening before we accept connections */
+		rxm_ep_rails_open(rxm_ep);
+
 		ret = rxm_conn_cmap_alloc(rxm_ep);
 		if (ret)
 			return ret;
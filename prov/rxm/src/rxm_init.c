@@ -89,6 +89,27 @@ void rxm_info_to_core_mr_modes(uint32_t version, const struct fi_info *hints,
 	}
 }
 
+/*
+ * Shared receive contexts are used over tcp unless the user says otherwise.
+ * At fi_getinfo time the core provider is named by the base info; when
+ * opening a domain or endpoint there is no base info, and the name comes
+ * from the rxm info instead, e.g. "tcp;ofi_rxm".
+ */
+static bool rxm_use_srx_default(const struct fi_info *hints,
+				const struct fi_info *base_info)
+{
+	const char *name = NULL;
+	size_t len = strlen("tcp");
+
+	if (base_info && base_info->fabric_attr)
+		name = base_info->fabric_attr->prov_name;
+	else if (hints && hints->fabric_attr)
+		name = hints->fabric_attr->prov_name;
+
+	return name && !strncasecmp(name, "tcp", len) &&
+	       (name[len] == '\0' || name[len] == OFI_NAME_DELIM);
+}
+
 int rxm_info_to_core(uint32_t version, const struct fi_info *hints,
 		     const struct fi_info *base_info, struct fi_info *core_info)
 {
@@ -105,7 +126,8 @@ int rxm_info_to_core(uint32_t version, const struct fi_info *hints,
 
 		/* FI_RMA cap is needed for large message transfer protocol */
 		if (core_info->caps & FI_MSG)
-			core_info->caps |= FI_RMA | FI_READ | FI_REMOTE_READ;
+			core_info->caps |= FI_RMA | FI_READ | FI_REMOTE_READ |
+					   FI_WRITE | FI_REMOTE_WRITE;
 
 		if (hints->domain_attr) {
 			core_info->domain_attr->caps |= hints->domain_attr->caps;
@@ -128,9 +150,8 @@ int rxm_info_to_core(uint32_t version, const struct fi_info *hints,
 	core_info->ep_attr->type = FI_EP_MSG;
 
 	ret = fi_param_get_bool(&rxm_prov, "use_srx", &use_srx);
-	if (use_srx || ((ret == -FI_ENODATA) && base_info &&
-	    base_info->fabric_attr->prov_name &&
-	    !strcmp(base_info->fabric_attr->prov_name, "tcp"))) {
+	if (use_srx || ((ret == -FI_ENODATA) &&
+	    rxm_use_srx_default(hints, base_info))) {
 		FI_DBG(&rxm_prov, FI_LOG_FABRIC,
 		       "Requesting shared receive context from core provider\n");
 		core_info->ep_attr->rx_ctx_cnt = FI_SHARED_CONTEXT;
@@ -432,6 +453,50 @@ RXM_INI
 			"of size greater than this would be transmitted via "
 			"rendezvous protocol.", sizeof(struct rxm_pkt));
 
+	fi_param_define(&rxm_prov, "sar_window", FI_PARAM_SIZE_T,
+			"Maximum number of SAR segments a connection keeps in "
+			"flight. Further segments are sent as earlier ones "
+			"complete (default: half of FI_OFI_RXM_MSG_TX_SIZE).");
+
+	fi_param_define(&rxm_prov, "rndv_write_min", FI_PARAM_SIZE_T,
+			"Rendezvous messages of at least this size are "
+			"transferred by the sender writing into the receive "
+			"buffer, instead of the receiver reading from the send "
+			"buffer (default: disabled). "
+			"Requires an MSG provider that orders sends after "
+			"writes (FI_ORDER_SAW).");
+
+	fi_param_define(&rxm_prov, "cm_eager_size", FI_PARAM_SIZE_T,
+			"Defines the largest message that is sent inside the "
+			"connection request to a peer, rather than after the "
+			"connection is established. Set to 0 to disable "
+			"(default: the largest that fits in the MSG provider's "
+			"CM data).");
+
+	fi_param_define(&rxm_prov, "flow_ctrl_credits", FI_PARAM_SIZE_T,
+			"Number of messages each peer may send before they "
+			"are matched by a receive, when the MSG provider has "
+			"no flow control of its own. Senders wait for credits "
+			"beyond that, which bounds the memory used for "
+			"unexpected messages (default: 0, disabled).");
+
+	fi_param_define(&rxm_prov, "rail_addr", FI_PARAM_STRING,
+			"Comma separated list of local IP addresses of "
+			"additional interfaces. Connections open one more MSG "
+			"endpoint to the peer per address, and rendezvous "
+			"transfers are spread over all of them. The interfaces "
+			"must be usable through the same MSG domain. Rails "
+			"are only used between peers that both set addresses "
+			"(default: none).");
+
+	fi_param_define(&rxm_prov, "agg_size", FI_PARAM_SIZE_T,
+			"Largest message that is packed together with other "
+			"small messages to the same peer into one MSG "
+			"transfer. The transfer is sent when full or at the "
+			"next progress call. Peers must use an RxM version "
+			"that understands aggregated messages "
+			"(default: 0, disabled).");
+
 	fi_param_define(&rxm_prov, "use_srx", FI_PARAM_BOOL,
 			"Set this environment variable to control the RxM "
 			"receive path. If this variable set to 1 (default: 0), "
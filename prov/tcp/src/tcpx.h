@@ -67,7 +67,9 @@
 
 #define TCPX_MAX_CM_DATA_SIZE	(1 << 8)
 #define TCPX_IOV_LIMIT		(4)
-#define TCPX_MAX_INJECT_SZ	(64)
+#define TCPX_TX_COALESCE_IOV	(64)
+#define TCPX_MAX_INJECT_SZ	(4096)
+#define TCPX_INJECT_CHUNK_CNT	(16)
 
 #define MAX_POLL_EVENTS		100
 
@@ -79,6 +81,7 @@ extern struct fi_provider	tcpx_prov;
 extern struct util_prov		tcpx_util_prov;
 extern struct fi_info		tcpx_info;
 extern struct tcpx_port_range	port_range;
+extern struct tcpx_env		tcpx_env;
 struct tcpx_xfer_entry;
 struct tcpx_ep;
 
@@ -102,9 +105,15 @@ enum tcpx_cm_event_type {
 	CLIENT_RECV_CONNRESP,
 };
 
+/* CM sockets are nonblocking.  A partially transferred control message
+ * is tracked by msg_hdr/xfer_done, and the fd stays in the EQ wait set
+ * until the transfer completes.
+ */
 struct tcpx_cm_context {
 	fid_t			fid;
 	enum tcpx_cm_event_type	type;
+	struct ofi_ctrl_hdr	msg_hdr;
+	size_t			xfer_done;
 	size_t			cm_data_sz;
 	char			cm_data[TCPX_MAX_CM_DATA_SIZE];
 };
@@ -114,6 +123,11 @@ struct tcpx_port_range {
 	int low;
 };
 
+struct tcpx_env {
+	char	*progress_affinity;
+	int	fastopen;
+};
+
 struct tcpx_conn_handle {
 	struct fid		handle;
 	struct tcpx_pep		*pep;
@@ -155,8 +169,10 @@ struct tcpx_cq_data_hdr {
 #define TCPX_MAX_HDR_SZ (sizeof(struct tcpx_base_hdr) + 	\
 			 sizeof(uint64_t) +			\
 			 sizeof(struct ofi_rma_iov) *		\
-			 TCPX_IOV_LIMIT +			\
-			 TCPX_MAX_INJECT_SZ)
+			 TCPX_IOV_LIMIT)
+
+/* inject buffers carry a copy of the header followed by the payload */
+#define TCPX_INJECT_BUF_SZ (TCPX_MAX_HDR_SZ + TCPX_MAX_INJECT_SZ)
 
 struct tcpx_cur_rx_msg {
 	union {
@@ -167,12 +183,33 @@ struct tcpx_cur_rx_msg {
 	size_t			done_len;
 };
 
+struct tcpx_xfer_entry {
+	struct slist_entry	entry;
+	union {
+		struct tcpx_base_hdr	base_hdr;
+		struct tcpx_cq_data_hdr cq_data_hdr;
+		uint8_t		       	max_hdr[TCPX_MAX_HDR_SZ];
+	} hdr;
+	size_t			iov_cnt;
+	struct iovec		iov[TCPX_IOV_LIMIT+1];
+	struct tcpx_ep		*ep;
+	uint64_t		flags;
+	void			*context;
+	uint64_t		rem_len;
+	void			*mrecv_msg_start;
+	void			*inject_buf;
+	/* posted FI_MULTI_RECV buffer: 1 while queued + 1 per piece */
+	ofi_atomic32_t		mrecv_ref;
+};
+
 struct tcpx_rx_ctx {
 	struct fid_ep		rx_fid;
 	struct slist		rx_queue;
 	struct ofi_bufpool	*buf_pool;
 	uint64_t		op_flags;
+	size_t			min_multi_recv_size;
 	fastlock_t		lock;
+	struct tcpx_progress	*progress;
 };
 
 typedef int (*tcpx_rx_process_fn_t)(struct tcpx_xfer_entry *rx_entry);
@@ -196,6 +233,10 @@ struct tcpx_ep {
 	struct dlist_entry	ep_entry;
 	struct slist		rx_queue;
 	struct slist		tx_queue;
+	/* responses to the peer, sent ahead of tx_queue */
+	struct slist		tx_priority_queue;
+	/* partially sent entry, at the head of one of the tx queues */
+	struct tcpx_xfer_entry	*cur_tx_entry;
 	struct slist		tx_rsp_pend_queue;
 	struct slist		rma_read_queue;
 	struct tcpx_rx_ctx	*srx_ctx;
@@ -206,31 +247,53 @@ struct tcpx_ep {
 	void (*hdr_bswap)(struct tcpx_base_hdr *hdr);
 	struct stage_buf	stage_buf;
 	size_t			min_multi_recv_size;
+	/* piece of a multi-recv buffer being received, see tcpx_mrecv_carve */
+	struct tcpx_xfer_entry	mrecv_entry;
+	struct tcpx_xfer_entry	*cur_mrecv;
 	bool			pollout_set;
+	/* inject arena, protected by lock */
+	struct ofi_bufpool	*inject_pool;
+
+	/* auto progress state, protected by lock */
+	uint32_t		progress_events;
+	bool			progress_active;
+	bool			progress_stalled;
+	/* protected by tcpx_progress lock */
+	struct dlist_entry	progress_entry;
 };
 
 struct tcpx_fabric {
 	struct util_fabric	util_fabric;
 };
 
-struct tcpx_xfer_entry {
-	struct slist_entry	entry;
-	union {
-		struct tcpx_base_hdr	base_hdr;
-		struct tcpx_cq_data_hdr cq_data_hdr;
-		uint8_t		       	max_hdr[TCPX_MAX_HDR_SZ];
-	} hdr;
-	size_t			iov_cnt;
-	struct iovec		iov[TCPX_IOV_LIMIT+1];
-	struct tcpx_ep		*ep;
-	uint64_t		flags;
-	void			*context;
-	uint64_t		rem_len;
-	void			*mrecv_msg_start;
+/*
+ * Progress thread used for FI_PROGRESS_AUTO domains.  The thread waits on
+ * its own epoll set containing the sockets of all connected endpoints of
+ * the domain.  The lock is only held while dispatching ready endpoints;
+ * the application data path never takes it.
+ */
+struct tcpx_progress {
+	ofi_epoll_t		epoll_fd;
+	struct fd_signal	signal;
+	pthread_t		thread;
+	/* protects ep_list, del_cnt and run */
+	fastlock_t		lock;
+	struct dlist_entry	ep_list;
+	/* newly connected eps, picked up by the thread */
+	fastlock_t		add_lock;
+	struct dlist_entry	add_list;
+	uint64_t		del_cnt;
+	ofi_atomic32_t		stalled_cnt;
+	int			run;
 };
 
 struct tcpx_domain {
 	struct util_domain	util_domain;
+	struct tcpx_progress	*progress;
+	/* set through OFI_OPS_DYNAMIC_RBUF */
+	size_t			rbuf_hdr_size;
+	size_t			(*get_rbuf)(void *context, size_t msg_len,
+					    struct iovec *iov, size_t max_count);
 };
 
 struct tcpx_buf_pool {
@@ -299,16 +362,68 @@ struct tcpx_xfer_entry *
 tcpx_srx_next_xfer_entry(struct tcpx_rx_ctx *srx_ctx,
 			struct tcpx_ep *ep, size_t entry_size);
 
+struct tcpx_xfer_entry *tcpx_mrecv_carve(struct tcpx_ep *ep,
+					 struct slist *queue, size_t len,
+					 size_t min_size);
+bool tcpx_mrecv_put(struct tcpx_ep *ep, struct tcpx_xfer_entry *mrecv);
+struct tcpx_xfer_entry *tcpx_mrecv_piece_done(struct tcpx_xfer_entry *piece);
+
+static inline bool tcpx_xfer_is_mrecv(struct tcpx_xfer_entry *xfer_entry)
+{
+	return xfer_entry == &xfer_entry->ep->mrecv_entry;
+}
+
+static inline int tcpx_mrecv_init(struct tcpx_xfer_entry *recv_entry)
+{
+	if (!(recv_entry->flags & FI_MULTI_RECV))
+		return FI_SUCCESS;
+
+	if (recv_entry->iov_cnt != 1)
+		return -FI_EINVAL;
+
+	ofi_atomic_initialize32(&recv_entry->mrecv_ref, 1);
+	return FI_SUCCESS;
+}
+
+static inline bool tcpx_tx_pending(struct tcpx_ep *ep)
+{
+	return !slist_empty(&ep->tx_queue) ||
+	       !slist_empty(&ep->tx_priority_queue);
+}
+
 void tcpx_progress_tx(struct tcpx_ep *ep);
 void tcpx_progress_rx(struct tcpx_ep *ep);
 int tcpx_try_func(void *util_ep);
 
+int tcpx_progress_init(struct tcpx_domain *domain);
+void tcpx_progress_close(struct tcpx_domain *domain);
+void tcpx_progress_add_ep(struct tcpx_ep *ep);
+void tcpx_progress_del_ep(struct tcpx_ep *ep);
+void tcpx_progress_update_events(struct tcpx_ep *ep);
+
+static inline struct tcpx_progress *tcpx_ep_progress(struct tcpx_ep *ep)
+{
+	return container_of(ep->util_ep.domain, struct tcpx_domain,
+			    util_domain)->progress;
+}
+
+/* Wake the progress thread if an endpoint is waiting for a posted buffer */
+static inline void tcpx_progress_signal_rx(struct tcpx_progress *progress)
+{
+	if (progress && ofi_atomic_get32(&progress->stalled_cnt))
+		fd_signal_set(&progress->signal);
+}
+
 void tcpx_hdr_none(struct tcpx_base_hdr *hdr);
 void tcpx_hdr_bswap(struct tcpx_base_hdr *hdr);
 
 int tcpx_ep_shutdown_report(struct tcpx_ep *ep, fid_t fid);
 void tcpx_tx_queue_insert(struct tcpx_ep *tcpx_ep,
 			  struct tcpx_xfer_entry *tx_entry);
+int tcpx_tx_queue_inject(struct tcpx_ep *tcpx_ep,
+			 struct tcpx_xfer_entry *tx_entry,
+			 const struct iovec *iov, size_t iov_cnt,
+			 size_t hdr_len);
 
 void tcpx_conn_mgr_run(struct util_eq *eq);
 int tcpx_eq_wait_try_func(void *arg);
@@ -37,7 +37,7 @@
 #define TCPX_EP_CAPS	 (FI_MSG | FI_RMA | FI_RMA_PMEM)
 #define TCPX_TX_CAPS	 (FI_SEND | FI_WRITE | FI_READ)
 #define TCPX_RX_CAPS	 (FI_RECV | FI_REMOTE_READ | 			\
-			  FI_REMOTE_WRITE)
+			  FI_REMOTE_WRITE | FI_MULTI_RECV)
 
 
 #define TCPX_MSG_ORDER (OFI_ORDER_RAR_SET | OFI_ORDER_RAW_SET | FI_ORDER_RAS | \
@@ -48,14 +48,14 @@
 	(FI_INJECT | FI_INJECT_COMPLETE | FI_TRANSMIT_COMPLETE | \
 	 FI_DELIVERY_COMPLETE | FI_COMMIT_COMPLETE | FI_COMPLETION)
 
-#define TCPX_RX_OP_FLAGS (FI_COMPLETION)
+#define TCPX_RX_OP_FLAGS (FI_COMPLETION | FI_MULTI_RECV)
 
 static struct fi_tx_attr tcpx_tx_attr = {
 	.caps = TCPX_EP_CAPS | TCPX_TX_CAPS,
 	.op_flags = TCPX_TX_OP_FLAGS,
 	.comp_order = FI_ORDER_STRICT,
 	.msg_order = TCPX_MSG_ORDER,
-	.inject_size = 64,
+	.inject_size = TCPX_MAX_INJECT_SZ,
 	.size = 1024,
 	.iov_limit = TCPX_IOV_LIMIT,
 	.rma_iov_limit = TCPX_IOV_LIMIT,
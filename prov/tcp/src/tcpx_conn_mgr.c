@@ -39,84 +39,139 @@
 #include <ofi_util.h>
 
 
+static ssize_t tcpx_cm_recv(SOCKET fd, void *buf, size_t len)
+{
+	ssize_t ret;
+
+	ret = ofi_recv_socket(fd, buf, len, 0);
+	if (ret > 0)
+		return ret;
+	if (!ret)
+		return -FI_EIO;
+
+	return OFI_SOCK_TRY_SND_RCV_AGAIN(ofi_sockerr()) ?
+	       -FI_EAGAIN : -ofi_sockerr();
+}
+
+/* Receive a control message without blocking.  Returns -FI_EAGAIN until
+ * the header and all of its payload have arrived; any payload beyond
+ * TCPX_MAX_CM_DATA_SIZE is drained and dropped.
+ */
 static int rx_cm_data(SOCKET fd, struct ofi_ctrl_hdr *hdr,
 		      int type, struct tcpx_cm_context *cm_ctx)
 {
-	size_t data_size = 0;
+	char discard[64];
+	size_t seg_size, data_size, offset;
 	ssize_t ret;
 
-	ret = ofi_recv_socket(fd, hdr, sizeof(*hdr), MSG_WAITALL);
-	if (ret != sizeof(*hdr)) {
-		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
-			"Failed to read cm header\n");
-		ret = ofi_sockerr() ? -ofi_sockerr() : -FI_EIO;
-		goto out;
-	}
-
-	if (hdr->version != TCPX_CTRL_HDR_VERSION) {
-		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
-			"cm protocol version mismatch\n");
-		ret = -FI_ENOPROTOOPT;
-		goto out;
-	}
+	while (cm_ctx->xfer_done < sizeof(*hdr)) {
+		ret = tcpx_cm_recv(fd, (char *) &cm_ctx->msg_hdr +
+				   cm_ctx->xfer_done,
+				   sizeof(*hdr) - cm_ctx->xfer_done);
+		if (ret < 0)
+			goto out;
 
-	if (hdr->type != type) {
-		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
-			"unexpected cm message type\n");
-		ret = -FI_ECONNREFUSED;
-		goto out;
-	}
+		cm_ctx->xfer_done += ret;
+		if (cm_ctx->xfer_done < sizeof(*hdr))
+			continue;
 
-	data_size = MIN(ntohs(hdr->seg_size), TCPX_MAX_CM_DATA_SIZE);
-	if (data_size) {
-		ret = ofi_recv_socket(fd, cm_ctx->cm_data, data_size,
-				      MSG_WAITALL);
-		if ((size_t) ret != data_size) {
+		if (cm_ctx->msg_hdr.version != TCPX_CTRL_HDR_VERSION) {
 			FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
-				"Failed to read cm data\n");
-			ret = ofi_sockerr() ? -ofi_sockerr() : -FI_EIO;
-			data_size = 0;
-			goto out;
+				"cm protocol version mismatch\n");
+			return -FI_ENOPROTOOPT;
 		}
 
-		if (ntohs(hdr->seg_size) > TCPX_MAX_CM_DATA_SIZE) {
+		if (cm_ctx->msg_hdr.type != type) {
 			FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
-				"Discarding unexpected cm data\n");
-			ofi_discard_socket(fd, ntohs(hdr->seg_size) -
-					   TCPX_MAX_CM_DATA_SIZE);
+				"unexpected cm message type\n");
+			return -FI_ECONNREFUSED;
 		}
 	}
-	ret = 0;
-out:
+
+	seg_size = ntohs(cm_ctx->msg_hdr.seg_size);
+	data_size = MIN(seg_size, TCPX_MAX_CM_DATA_SIZE);
+	while (cm_ctx->xfer_done < sizeof(*hdr) + seg_size) {
+		offset = cm_ctx->xfer_done - sizeof(*hdr);
+		if (offset < data_size) {
+			ret = tcpx_cm_recv(fd, &cm_ctx->cm_data[offset],
+					   data_size - offset);
+		} else {
+			ret = tcpx_cm_recv(fd, discard, MIN(sizeof(discard),
+						seg_size - offset));
+		}
+		if (ret < 0)
+			goto out;
+
+		cm_ctx->xfer_done += ret;
+	}
+
+	if (seg_size > TCPX_MAX_CM_DATA_SIZE)
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"Discarded unexpected cm data\n");
+
+	*hdr = cm_ctx->msg_hdr;
 	cm_ctx->cm_data_sz = data_size;
-	return ret;
+	cm_ctx->xfer_done = 0;
+	return 0;
+out:
+	if (ret != -FI_EAGAIN)
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"Failed to read cm %s\n",
+			cm_ctx->xfer_done < sizeof(*hdr) ? "header" : "data");
+	return (int) ret;
 }
 
+/* Send a control message without blocking.  The header and payload go
+ * out in one call, so with TCP Fast Open the connection request rides
+ * in the SYN.  A TFO socket that has not finished connecting reports
+ * EINPROGRESS, which is handled the same as a full send buffer.
+ */
 static int tx_cm_data(SOCKET fd, uint8_t type, struct tcpx_cm_context *cm_ctx)
 {
-	struct ofi_ctrl_hdr hdr;
+	struct msghdr msg = {0};
+	struct iovec iov[2];
+	size_t len;
 	ssize_t ret;
 
-	memset(&hdr, 0, sizeof(hdr));
-	hdr.version = TCPX_CTRL_HDR_VERSION;
-	hdr.type = type;
-	hdr.seg_size = htons((uint16_t) cm_ctx->cm_data_sz);
-	hdr.conn_data = 1; /* For testing endianess mismatch at peer */
-
-	ret = ofi_send_socket(fd, &hdr, sizeof(hdr), MSG_NOSIGNAL);
-	if (ret != sizeof(hdr))
-		goto err;
+	if (!cm_ctx->xfer_done) {
+		memset(&cm_ctx->msg_hdr, 0, sizeof(cm_ctx->msg_hdr));
+		cm_ctx->msg_hdr.version = TCPX_CTRL_HDR_VERSION;
+		cm_ctx->msg_hdr.type = type;
+		cm_ctx->msg_hdr.seg_size = htons((uint16_t) cm_ctx->cm_data_sz);
+		/* For testing endianess mismatch at peer */
+		cm_ctx->msg_hdr.conn_data = 1;
+	}
 
-	if (cm_ctx->cm_data_sz) {
-		ret = ofi_send_socket(fd, cm_ctx->cm_data,
-				      cm_ctx->cm_data_sz, MSG_NOSIGNAL);
-		if ((size_t) ret != cm_ctx->cm_data_sz)
-			goto err;
+	len = sizeof(cm_ctx->msg_hdr) + cm_ctx->cm_data_sz;
+	while (cm_ctx->xfer_done < len) {
+		if (cm_ctx->xfer_done < sizeof(cm_ctx->msg_hdr)) {
+			iov[0].iov_base = (char *) &cm_ctx->msg_hdr +
+					  cm_ctx->xfer_done;
+			iov[0].iov_len = sizeof(cm_ctx->msg_hdr) -
+					 cm_ctx->xfer_done;
+			iov[1].iov_base = cm_ctx->cm_data;
+			iov[1].iov_len = cm_ctx->cm_data_sz;
+			msg.msg_iovlen = cm_ctx->cm_data_sz ? 2 : 1;
+		} else {
+			iov[0].iov_base = &cm_ctx->cm_data[cm_ctx->xfer_done -
+						sizeof(cm_ctx->msg_hdr)];
+			iov[0].iov_len = len - cm_ctx->xfer_done;
+			msg.msg_iovlen = 1;
+		}
+		msg.msg_iov = iov;
+
+		ret = ofi_sendmsg_tcp(fd, &msg, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (OFI_SOCK_TRY_SND_RCV_AGAIN(ofi_sockerr()) ||
+			    OFI_SOCK_TRY_CONN_AGAIN(ofi_sockerr()))
+				return -FI_EAGAIN;
+			return ofi_sockerr() ? -ofi_sockerr() : -FI_EIO;
+		}
+		cm_ctx->xfer_done += ret;
 	}
 
+	cm_ctx->xfer_done = 0;
 	return FI_SUCCESS;
-err:
-	return ofi_sockerr() ? -ofi_sockerr() : -FI_EIO;
 }
 
 static int tcpx_ep_enable_xfers(struct tcpx_ep *ep)
@@ -164,6 +219,7 @@ static int tcpx_ep_enable_xfers(struct tcpx_ep *ep)
 		}
 	}
 
+	tcpx_progress_add_ep(ep);
 	return ret;
 unlock:
 	fastlock_release(&ep->lock);
@@ -171,20 +227,12 @@ unlock:
 }
 
 static int proc_conn_resp(struct tcpx_cm_context *cm_ctx,
-			  struct tcpx_ep *ep)
+			  struct tcpx_ep *ep, struct ofi_ctrl_hdr *conn_resp)
 {
-	struct ofi_ctrl_hdr conn_resp;
 	struct fi_eq_cm_entry *cm_entry;
 	ssize_t len;
 	int ret = FI_SUCCESS;
 
-	ret = rx_cm_data(ep->sock, &conn_resp, ofi_ctrl_connresp, cm_ctx);
-	if (ret) {
-		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
-			"Failed to receive connect response\n");
-		return ret;
-	}
-
 	cm_entry = calloc(1, sizeof(*cm_entry) + cm_ctx->cm_data_sz);
 	if (!cm_entry)
 		return -FI_ENOMEM;
@@ -192,7 +240,7 @@ static int proc_conn_resp(struct tcpx_cm_context *cm_ctx,
 	cm_entry->fid = cm_ctx->fid;
 	memcpy(cm_entry->data, cm_ctx->cm_data, cm_ctx->cm_data_sz);
 
-	ep->hdr_bswap = (conn_resp.conn_data == 1) ?
+	ep->hdr_bswap = (conn_resp->conn_data == 1) ?
 			tcpx_hdr_none : tcpx_hdr_bswap;
 
 	ret = tcpx_ep_enable_xfers(ep);
@@ -218,21 +266,34 @@ static void client_recv_connresp(struct util_wait *wait,
 				 struct tcpx_cm_context *cm_ctx)
 {
 	struct fi_eq_err_entry err_entry;
+	struct ofi_ctrl_hdr conn_resp;
 	struct tcpx_ep *ep;
 	ssize_t ret;
+	int del_ret;
 
 	FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL, "Handling accept from server\n");
 	assert(cm_ctx->fid->fclass == FI_CLASS_EP);
 	ep = container_of(cm_ctx->fid, struct tcpx_ep, util_ep.ep_fid.fid);
 
-	ret = ofi_wait_del_fd(wait, ep->sock);
-	if (ret) {
+	ret = rx_cm_data(ep->sock, &conn_resp, ofi_ctrl_connresp, cm_ctx);
+	if (ret == -FI_EAGAIN)
+		return;
+
+	del_ret = ofi_wait_del_fd(wait, ep->sock);
+	if (del_ret) {
 		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
 			"Could not remove fd from wait\n");
+		ret = ret ? ret : del_ret;
+		goto err;
+	}
+
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"Failed to receive connect response\n");
 		goto err;
 	}
 
-	ret = proc_conn_resp(cm_ctx, ep);
+	ret = proc_conn_resp(cm_ctx, ep, &conn_resp);
 	if (ret)
 		goto err;
 
@@ -276,6 +337,8 @@ static void server_send_cm_accept(struct util_wait *wait,
 
 	FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL, "Send connect (accept) response\n");
 	ret = tx_cm_data(ep->sock, ofi_ctrl_connresp, cm_ctx);
+	if (ret == -FI_EAGAIN)
+		return;
 	if (ret) {
 		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
 			"Failed to send connect (accept) response\n");
@@ -339,6 +402,8 @@ static void server_recv_connreq(struct util_wait *wait,
 
 	FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL, "Server receive connect request\n");
 	ret = rx_cm_data(handle->sock, &conn_req, ofi_ctrl_connreq, cm_ctx);
+	if (ret == -FI_EAGAIN)
+		return;
 	if (ret)
 		goto err1;
 
@@ -411,6 +476,8 @@ static void client_send_connreq(struct util_wait *wait,
 	}
 
 	ret = tx_cm_data(ep->sock, ofi_ctrl_connreq, cm_ctx);
+	if (ret == -FI_EAGAIN)
+		return;
 	if (ret)
 		goto err_del;
 
@@ -423,6 +490,7 @@ static void client_send_connreq(struct util_wait *wait,
 	}
 
 	cm_ctx->type = CLIENT_RECV_CONNRESP;
+	cm_ctx->cm_data_sz = 0;
 	ret = ofi_wait_add_fd(wait, ep->sock, POLLIN,
 			      tcpx_eq_wait_try_func, NULL, cm_ctx);
 	if (ret)
@@ -455,36 +523,45 @@ err_report:
 		    &err_entry, sizeof(err_entry), UTIL_FLAG_ERROR);
 }
 
-static void server_sock_accept(struct util_wait *wait,
-			       struct tcpx_cm_context *cm_ctx)
+static int server_sock_accept_one(struct util_wait *wait,
+				  struct tcpx_pep *pep)
 {
 	struct tcpx_conn_handle *handle;
 	struct tcpx_cm_context *rx_req_cm_ctx;
-	struct tcpx_pep *pep;
 	SOCKET sock;
 	int ret;
 
-	FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL, "Received Connreq\n");
-	assert(cm_ctx->fid->fclass == FI_CLASS_PEP);
-	pep = container_of(cm_ctx->fid, struct tcpx_pep, util_pep.pep_fid.fid);
-
 	sock = accept(pep->sock, NULL, 0);
-	if (sock < 0) {
+	if (sock == INVALID_SOCKET) {
+		ret = ofi_sockerr();
+		if (OFI_SOCK_TRY_SND_RCV_AGAIN(ret))
+			return -FI_EAGAIN;
+
 		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
-			"accept error: %d\n", ofi_sockerr());
-		return;
+			"accept error: %d\n", ret);
+		return -ret;
+	}
+
+	ret = fi_fd_nonblock(sock);
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"failed to set socket to nonblocking\n");
+		goto err1;
 	}
 
 	handle = calloc(1, sizeof(*handle));
 	if (!handle) {
 		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
 			"cannot allocate memory \n");
+		ret = -FI_ENOMEM;
 		goto err1;
 	}
 
 	rx_req_cm_ctx = calloc(1, sizeof(*rx_req_cm_ctx));
-	if (!rx_req_cm_ctx)
+	if (!rx_req_cm_ctx) {
+		ret = -FI_ENOMEM;
 		goto err2;
+	}
 
 	handle->sock = sock;
 	handle->handle.fclass = FI_CLASS_CONNREQ;
@@ -498,13 +575,33 @@ static void server_sock_accept(struct util_wait *wait,
 	if (ret)
 		goto err3;
 
-	return;
+	return FI_SUCCESS;
 err3:
 	free(rx_req_cm_ctx);
 err2:
 	free(handle);
 err1:
 	ofi_close_socket(sock);
+	return ret;
+}
+
+/* The listening socket is nonblocking, so drain the whole backlog here
+ * rather than taking one connection per wait set event.  Each accepted
+ * socket then advances through its own handshake state independently.
+ */
+static void server_sock_accept(struct util_wait *wait,
+			       struct tcpx_cm_context *cm_ctx)
+{
+	struct tcpx_pep *pep;
+	int ret;
+
+	FI_DBG(&tcpx_prov, FI_LOG_EP_CTRL, "Received Connreq\n");
+	assert(cm_ctx->fid->fclass == FI_CLASS_PEP);
+	pep = container_of(cm_ctx->fid, struct tcpx_pep, util_pep.pep_fid.fid);
+
+	do {
+		ret = server_sock_accept_one(wait, pep);
+	} while (!ret);
 }
 
 static void process_cm_ctx(struct util_wait *wait,
@@ -38,17 +38,41 @@
 #define TCPX_DEF_CQ_SIZE (1024)
 
 
+/* With a progress thread running, the application only drives endpoints
+ * that the thread is not already working on.  This hands the ep lock over
+ * instead of making fi_cq_read wait behind the thread.
+ */
+static int tcpx_cq_ep_lock(struct tcpx_ep *ep, bool auto_progress)
+{
+	if (auto_progress)
+		return fastlock_tryacquire(&ep->lock);
+
+	fastlock_acquire(&ep->lock);
+	return 0;
+}
+
+static void tcpx_cq_ep_unlock(struct tcpx_ep *ep, bool auto_progress)
+{
+	if (auto_progress)
+		tcpx_progress_update_events(ep);
+	fastlock_release(&ep->lock);
+}
+
 void tcpx_cq_progress(struct util_cq *cq)
 {
 	void *wait_contexts[MAX_POLL_EVENTS];
 	struct fid_list_entry *fid_entry;
 	struct util_wait_fd *wait_fd;
 	struct dlist_entry *item;
+	struct tcpx_domain *domain;
 	struct tcpx_ep *ep;
 	struct fid *fid;
+	bool auto_progress;
 	int nfds, i;
 
 	wait_fd = container_of(cq->wait, struct util_wait_fd, util_wait);
+	domain = container_of(cq->domain, struct tcpx_domain, util_domain);
+	auto_progress = (domain->progress != NULL);
 
 	cq->cq_fastlock_acquire(&cq->ep_list_lock);
 	dlist_foreach(&cq->ep_list, item) {
@@ -56,11 +80,12 @@ void tcpx_cq_progress(struct util_cq *cq)
 		ep = container_of(fid_entry->fid, struct tcpx_ep,
 				  util_ep.ep_fid.fid);
 		tcpx_try_func(&ep->util_ep);
-		fastlock_acquire(&ep->lock);
+		if (tcpx_cq_ep_lock(ep, auto_progress))
+			continue;
 		tcpx_progress_tx(ep);
 		if (ep->stage_buf.cur_pos < ep->stage_buf.bytes_avail)
 			tcpx_progress_rx(ep);
-		fastlock_release(&ep->lock);
+		tcpx_cq_ep_unlock(ep, auto_progress);
 	}
 
 	nfds = (wait_fd->util_wait.wait_obj == FI_WAIT_FD) ?
@@ -79,9 +104,10 @@ void tcpx_cq_progress(struct util_cq *cq)
 		}
 
 		ep = container_of(fid, struct tcpx_ep, util_ep.ep_fid.fid);
-		fastlock_acquire(&ep->lock);
+		if (tcpx_cq_ep_lock(ep, auto_progress))
+			continue;
 		tcpx_progress_rx(ep);
-		fastlock_release(&ep->lock);
+		tcpx_cq_ep_unlock(ep, auto_progress);
 	}
 unlock:
 	cq->cq_fastlock_release(&cq->ep_list_lock);
@@ -131,6 +157,11 @@ void tcpx_xfer_entry_release(struct tcpx_cq *tcpx_cq,
 	if (xfer_entry->ep->cur_rx_entry == xfer_entry)
 		xfer_entry->ep->cur_rx_entry = NULL;
 
+	if (xfer_entry->inject_buf) {
+		ofi_buf_free(xfer_entry->inject_buf);
+		xfer_entry->inject_buf = NULL;
+	}
+
 	xfer_entry->hdr.base_hdr.flags = 0;
 
 	xfer_entry->flags = 0;
@@ -158,6 +189,9 @@ void tcpx_cq_report_success(struct util_cq *cq,
 	len = xfer_entry->hdr.base_hdr.size -
 	      xfer_entry->hdr.base_hdr.payload_off;
 
+	if (tcpx_xfer_is_mrecv(xfer_entry))
+		buf = xfer_entry->mrecv_msg_start;
+
 	if (xfer_entry->hdr.base_hdr.flags & OFI_REMOTE_CQ_DATA) {
 		flags |= FI_REMOTE_CQ_DATA;
 		data = xfer_entry->hdr.cq_data_hdr.cq_data;
@@ -233,6 +267,7 @@ static void tcpx_buf_pool_init(struct ofi_bufpool_region *region, void *buf)
 
 	xfer_entry->hdr.base_hdr.version = TCPX_HDR_VERSION;
 	xfer_entry->hdr.base_hdr.op_data = pool->op_type;
+	xfer_entry->inject_buf = NULL;
 
 	switch (pool->op_type) {
 	case TCPX_OP_MSG_RECV:
@@ -35,6 +35,7 @@
 
 #include "tcpx.h"
 extern struct fi_ops_msg tcpx_srx_msg_ops;
+extern struct fi_ops_ep tcpx_srx_ep_ops;
 
 static int tcpx_srx_ctx_close(struct fid *fid)
 {
@@ -79,8 +80,12 @@ static int tcpx_srx_ctx(struct fid_domain *domain, struct fi_rx_attr *attr,
 	srx_ctx->rx_fid.fid.context = context;
 	srx_ctx->rx_fid.fid.ops = &fi_ops_srx_ctx;
 
+	srx_ctx->rx_fid.ops = &tcpx_srx_ep_ops;
 	srx_ctx->rx_fid.msg = &tcpx_srx_msg_ops;
+	srx_ctx->progress = container_of(domain, struct tcpx_domain,
+					 util_domain.domain_fid)->progress;
 	slist_init(&srx_ctx->rx_queue);
+	srx_ctx->min_multi_recv_size = TCPX_MIN_MULTI_RECV;
 
 	ret = fastlock_init(&srx_ctx->lock);
 	if (ret)
@@ -118,6 +123,46 @@ static struct fi_ops_domain tcpx_domain_ops = {
 	.query_collective = fi_no_query_collective,
 };
 
+static void
+tcpx_set_rbuf_handler(struct fid_domain *domain_fid, size_t hdr_size,
+		      size_t (*get_rbuf)(void *context, size_t msg_len,
+					 struct iovec *iov, size_t max_count))
+{
+	struct tcpx_domain *domain;
+
+	domain = container_of(domain_fid, struct tcpx_domain,
+			      util_domain.domain_fid);
+	domain->rbuf_hdr_size = hdr_size;
+	domain->get_rbuf = get_rbuf;
+}
+
+static struct ofi_ops_dynamic_rbuf tcpx_dynamic_rbuf_ops = {
+	.size = sizeof(struct ofi_ops_dynamic_rbuf),
+	.set_rbuf_handler = tcpx_set_rbuf_handler,
+};
+
+static int tcpx_domain_ops_open(struct fid *fid, const char *name,
+				uint64_t flags, void **ops, void *context)
+{
+	struct tcpx_domain *domain;
+
+	if (flags)
+		return -FI_EBADFLAGS;
+
+	domain = container_of(fid, struct tcpx_domain,
+			      util_domain.domain_fid.fid);
+
+	/* The handler must run from the caller's progress calls, so it is
+	 * not offered when the progress thread receives data.
+	 */
+	if (!strcasecmp(name, OFI_OPS_DYNAMIC_RBUF) && !domain->progress) {
+		*ops = &tcpx_dynamic_rbuf_ops;
+		return 0;
+	}
+
+	return -FI_ENOSYS;
+}
+
 static int tcpx_domain_close(fid_t fid)
 {
 	struct tcpx_domain *tcpx_domain;
@@ -130,6 +175,7 @@ static int tcpx_domain_close(fid_t fid)
 	if (ret)
 		return ret;
 
+	tcpx_progress_close(tcpx_domain);
 	free(tcpx_domain);
 	return FI_SUCCESS;
 }
@@ -139,7 +185,7 @@ static struct fi_ops tcpx_domain_fi_ops = {
 	.close = tcpx_domain_close,
 	.bind = fi_no_bind,
 	.control = fi_no_control,
-	.ops_open = fi_no_ops_open,
+	.ops_open = tcpx_domain_ops_open,
 };
 
 static struct fi_ops_mr tcpx_domain_fi_ops_mr = {
@@ -167,6 +213,18 @@ int tcpx_domain_open(struct fid_fabric *fabric, struct fi_info *info,
 	if (ret)
 		goto err;
 
+	if (info->domain_attr->data_progress == FI_PROGRESS_AUTO) {
+		/* The progress thread completes transfers concurrently
+		 * with the application, so CQs need real locking.
+		 */
+		tcpx_domain->util_domain.threading = FI_THREAD_SAFE;
+		ret = tcpx_progress_init(tcpx_domain);
+		if (ret) {
+			ofi_domain_close(&tcpx_domain->util_domain);
+			goto err;
+		}
+	}
+
 	*domain = &tcpx_domain->util_domain.domain_fid;
 	(*domain)->fid.ops = &tcpx_domain_fi_ops;
 	(*domain)->ops = &tcpx_domain_ops;
@@ -90,6 +90,38 @@ static int tcpx_setup_socket(SOCKET sock)
 	return ret;
 }
 
+/* TCP Fast Open is best effort.  If the platform or kernel does not
+ * support it, connection setup falls back to the regular handshake.
+ */
+static void tcpx_set_fastopen(SOCKET sock, bool listener)
+{
+	int optname, optval;
+
+	if (!tcpx_env.fastopen)
+		return;
+
+	if (listener) {
+#ifdef TCP_FASTOPEN
+		optname = TCP_FASTOPEN;
+		optval = SOMAXCONN;
+#else
+		return;
+#endif
+	} else {
+#ifdef TCP_FASTOPEN_CONNECT
+		optname = TCP_FASTOPEN_CONNECT;
+		optval = 1;
+#else
+		return;
+#endif
+	}
+
+	if (setsockopt(sock, IPPROTO_TCP, optname, (char *) &optval,
+		       sizeof(optval)))
+		FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL,
+			"TCP fast open not available: %d\n", ofi_sockerr());
+}
+
 static int tcpx_ep_connect(struct fid_ep *ep, const void *addr,
 			   const void *param, size_t paramlen)
 {
@@ -107,6 +139,15 @@ static int tcpx_ep_connect(struct fid_ep *ep, const void *addr,
 		return -FI_ENOMEM;
 	}
 
+	/* The handshake is driven by the EQ, so never block here */
+	ret = fi_fd_nonblock(tcpx_ep->sock);
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"failed to set socket to nonblocking\n");
+		goto err;
+	}
+	tcpx_set_fastopen(tcpx_ep->sock, false);
+
 	ret = connect(tcpx_ep->sock, (struct sockaddr *) addr,
 		      (socklen_t) ofi_sizeofaddr(addr));
 	if (ret && ofi_sockerr() != FI_EINPROGRESS) {
@@ -311,11 +352,17 @@ void tcpx_rx_msg_release(struct tcpx_xfer_entry *rx_entry)
 
 	if (rx_entry->ep->srx_ctx) {
 		tcpx_srx_xfer_release(rx_entry->ep->srx_ctx, rx_entry);
-	} else {
-		tcpx_cq = container_of(rx_entry->ep->util_ep.rx_cq,
-				       struct tcpx_cq, util_cq);
-		tcpx_xfer_entry_release(tcpx_cq, rx_entry);
+		return;
 	}
+
+	tcpx_cq = container_of(rx_entry->ep->util_ep.rx_cq,
+			       struct tcpx_cq, util_cq);
+	if (tcpx_xfer_is_mrecv(rx_entry)) {
+		rx_entry = tcpx_mrecv_piece_done(rx_entry);
+		if (!rx_entry)
+			return;
+	}
+	tcpx_xfer_entry_release(tcpx_cq, rx_entry);
 }
 
 static void tcpx_ep_release_queue(struct slist *queue,
@@ -339,9 +386,18 @@ static void tcpx_ep_tx_rx_queues_release(struct tcpx_ep *ep)
 	fastlock_acquire(&ep->lock);
 	tcpx_cq = container_of(ep->util_ep.tx_cq, struct tcpx_cq, util_cq);
 	tcpx_ep_release_queue(&ep->tx_queue, tcpx_cq);
+	tcpx_ep_release_queue(&ep->tx_priority_queue, tcpx_cq);
 	tcpx_ep_release_queue(&ep->rma_read_queue, tcpx_cq);
 	tcpx_ep_release_queue(&ep->tx_rsp_pend_queue, tcpx_cq);
 
+	/* A multi-recv piece still being received holds a reference on its
+	 * buffer, which may be queued here or on a shared receive context */
+	if (ep->cur_mrecv) {
+		tcpx_cq_report_error(ep->util_ep.rx_cq, &ep->mrecv_entry,
+				     FI_ECANCELED);
+		tcpx_rx_msg_release(&ep->mrecv_entry);
+	}
+
 	tcpx_cq = container_of(ep->util_ep.rx_cq, struct tcpx_cq, util_cq);
 	tcpx_ep_release_queue(&ep->rx_queue, tcpx_cq);
 	fastlock_release(&ep->lock);
@@ -378,6 +434,7 @@ static int tcpx_ep_close(struct fid *fid)
 	struct tcpx_ep *ep = container_of(fid, struct tcpx_ep,
 					  util_ep.ep_fid.fid);
 
+	tcpx_progress_del_ep(ep);
 	tcpx_ep_tx_rx_queues_release(ep);
 
 	tcpx_ep_wait_fd_del(ep); /* ensure that everything is really released */
@@ -385,6 +442,7 @@ static int tcpx_ep_close(struct fid *fid)
 	ofi_eq_remove_fid_events(ep->util_ep.eq, &ep->util_ep.ep_fid.fid);
 	ofi_close_socket(ep->sock);
 	ofi_endpoint_close(&ep->util_ep);
+	ofi_bufpool_destroy(ep->inject_pool);
 	fastlock_destroy(&ep->lock);
 
 	free(ep);
@@ -544,18 +602,27 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 	}
 
 	ep->cm_state = TCPX_EP_CONNECTING;
-	ret = fastlock_init(&ep->lock);
+	ret = ofi_bufpool_create(&ep->inject_pool, TCPX_INJECT_BUF_SZ, 16,
+				 0, TCPX_INJECT_CHUNK_CNT, 0);
 	if (ret)
 		goto err3;
 
+	ret = fastlock_init(&ep->lock);
+	if (ret)
+		goto err4;
+
 	slist_init(&ep->rx_queue);
 	slist_init(&ep->tx_queue);
+	slist_init(&ep->tx_priority_queue);
 	slist_init(&ep->rma_read_queue);
 	slist_init(&ep->tx_rsp_pend_queue);
+	dlist_init(&ep->progress_entry);
 
 	ep->cur_rx_msg.done_len = 0;
 	ep->cur_rx_msg.hdr_len = sizeof(ep->cur_rx_msg.hdr.base_hdr);
 	ep->min_multi_recv_size = TCPX_MIN_MULTI_RECV;
+	ep->mrecv_entry.ep = ep;
+	ep->mrecv_entry.hdr.base_hdr.version = TCPX_HDR_VERSION;
 
 	*ep_fid = &ep->util_ep.ep_fid;
 	(*ep_fid)->fid.ops = &tcpx_ep_fi_ops;
@@ -570,6 +637,8 @@ int tcpx_endpoint(struct fid_domain *domain, struct fi_info *info,
 	ep->start_op[ofi_op_read_rsp] = tcpx_op_read_rsp;
 	ep->start_op[ofi_op_write] = tcpx_op_write;
 	return 0;
+err4:
+	ofi_bufpool_destroy(ep->inject_pool);
 err3:
 	ofi_close_socket(ep->sock);
 err2:
@@ -669,6 +738,14 @@ static int tcpx_pep_listen(struct fid_pep *pep)
 
 	tcpx_pep = container_of(pep,struct tcpx_pep, util_pep.pep_fid);
 
+	ret = fi_fd_nonblock(tcpx_pep->sock);
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+			"failed to set socket to nonblocking\n");
+		return ret;
+	}
+	tcpx_set_fastopen(tcpx_pep->sock, true);
+
 	if (listen(tcpx_pep->sock, SOMAXCONN)) {
 		FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
 			"socket listen failed\n");
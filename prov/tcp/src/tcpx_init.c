@@ -43,8 +43,26 @@ static int tcpx_getinfo(uint32_t version, const char *node, const char *service,
 			uint64_t flags, const struct fi_info *hints,
 			struct fi_info **info)
 {
-	return ofi_ip_getinfo(&tcpx_util_prov, version, node, service, flags,
-			      hints, info);
+	struct fi_info *cur;
+	int ret;
+
+	ret = ofi_ip_getinfo(&tcpx_util_prov, version, node, service, flags,
+			     hints, info);
+	if (ret)
+		return ret;
+
+	/* Data progress is driven by the application unless it explicitly
+	 * asks for FI_PROGRESS_AUTO, which starts a progress thread per
+	 * domain.
+	 */
+	for (cur = *info; cur; cur = cur->next) {
+		if (!hints || !hints->domain_attr ||
+		    hints->domain_attr->data_progress != FI_PROGRESS_AUTO)
+			cur->domain_attr->data_progress = FI_PROGRESS_MANUAL;
+		else
+			cur->domain_attr->threading = FI_THREAD_SAFE;
+	}
+	return 0;
 }
 
 struct tcpx_port_range port_range = {
@@ -52,6 +70,11 @@ struct tcpx_port_range port_range = {
 	.high = 0,
 };
 
+struct tcpx_env tcpx_env = {
+	.progress_affinity = NULL,
+	.fastopen = 1,
+};
+
 static void tcpx_init_env(void)
 {
 	srand(getpid());
@@ -69,6 +92,10 @@ static void tcpx_init_env(void)
 		port_range.low  = 0;
 		port_range.high = 0;
 	}
+
+	fi_param_get_str(&tcpx_prov, "progress_affinity",
+			 &tcpx_env.progress_affinity);
+	fi_param_get_bool(&tcpx_prov, "fastopen", &tcpx_env.fastopen);
 }
 
 static void fi_tcp_fini(void)
@@ -99,6 +126,17 @@ TCP_INI
 	fi_param_define(&tcpx_prov,"port_high_range", FI_PARAM_INT,
 			"define port high range");
 
+	fi_param_define(&tcpx_prov, "progress_affinity", FI_PARAM_STRING,
+			"If specified, bind the progress thread of "
+			"FI_PROGRESS_AUTO domains to the indicated range(s) of "
+			"Linux virtual processor ID(s). Usage: "
+			"id_start[-id_end[:stride]][,]");
+
+	fi_param_define(&tcpx_prov, "fastopen", FI_PARAM_BOOL,
+			"Use TCP Fast Open for connection setup where the "
+			"platform supports it, carrying the connection "
+			"request in the SYN (default: yes)");
+
 	tcpx_init_env();
 	return &tcpx_prov;
 }
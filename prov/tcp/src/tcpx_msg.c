@@ -78,12 +78,41 @@ tcpx_alloc_send_entry(struct tcpx_ep *tcpx_ep)
 	return send_entry;
 }
 
-static inline void tcpx_queue_recv(struct tcpx_ep *tcpx_ep,
-				   struct tcpx_xfer_entry *recv_entry)
+static inline void tcpx_free_send_entry(struct tcpx_ep *tcpx_ep,
+					struct tcpx_xfer_entry *send_entry)
 {
+	struct tcpx_cq *tcpx_cq;
+
+	tcpx_cq = container_of(tcpx_ep->util_ep.tx_cq, struct tcpx_cq, util_cq);
+	tcpx_xfer_entry_release(tcpx_cq, send_entry);
+}
+
+static inline ssize_t tcpx_queue_recv(struct tcpx_ep *tcpx_ep,
+				      struct tcpx_xfer_entry *recv_entry)
+{
+	struct tcpx_cq *tcpx_cq;
+	uint64_t more;
+	int ret;
+
+	/* More receives follow, wake the progress thread after the last */
+	more = recv_entry->flags & FI_MORE;
+	recv_entry->flags &= ~FI_MORE;
+
+	ret = tcpx_mrecv_init(recv_entry);
+	if (ret) {
+		tcpx_cq = container_of(tcpx_ep->util_ep.rx_cq,
+				       struct tcpx_cq, util_cq);
+		tcpx_xfer_entry_release(tcpx_cq, recv_entry);
+		return ret;
+	}
+
 	fastlock_acquire(&tcpx_ep->lock);
 	slist_insert_tail(&recv_entry->entry, &tcpx_ep->rx_queue);
 	fastlock_release(&tcpx_ep->lock);
+
+	if (!more)
+		tcpx_progress_signal_rx(tcpx_ep_progress(tcpx_ep));
+	return FI_SUCCESS;
 }
 
 static ssize_t tcpx_recvmsg(struct fid_ep *ep, const struct fi_msg *msg,
@@ -108,8 +137,7 @@ static ssize_t tcpx_recvmsg(struct fid_ep *ep, const struct fi_msg *msg,
 			    FI_MSG | FI_RECV;
 	recv_entry->context = msg->context;
 
-	tcpx_queue_recv(tcpx_ep, recv_entry);
-	return FI_SUCCESS;
+	return tcpx_queue_recv(tcpx_ep, recv_entry);
 }
 
 static ssize_t tcpx_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
@@ -128,12 +156,12 @@ static ssize_t tcpx_recv(struct fid_ep *ep, void *buf, size_t len, void *desc,
 	recv_entry->iov[0].iov_base = buf;
 	recv_entry->iov[0].iov_len = len;
 
-	recv_entry->flags = (tcpx_ep->util_ep.rx_op_flags & FI_COMPLETION) |
+	recv_entry->flags = (tcpx_ep->util_ep.rx_op_flags &
+			     (FI_COMPLETION | FI_MULTI_RECV)) |
 			    FI_MSG | FI_RECV;
 	recv_entry->context = context;
 
-	tcpx_queue_recv(tcpx_ep, recv_entry);
-	return FI_SUCCESS;
+	return tcpx_queue_recv(tcpx_ep, recv_entry);
 }
 
 static ssize_t tcpx_recvv(struct fid_ep *ep, const struct iovec *iov, void **desc,
@@ -153,12 +181,12 @@ static ssize_t tcpx_recvv(struct fid_ep *ep, const struct iovec *iov, void **des
 	recv_entry->iov_cnt = count;
 	memcpy(recv_entry->iov, iov, count * sizeof(*iov));
 
-	recv_entry->flags = (tcpx_ep->util_ep.rx_op_flags & FI_COMPLETION) |
+	recv_entry->flags = (tcpx_ep->util_ep.rx_op_flags &
+			     (FI_COMPLETION | FI_MULTI_RECV)) |
 			    FI_MSG | FI_RECV;
 	recv_entry->context = context;
 
-	tcpx_queue_recv(tcpx_ep, recv_entry);
-	return FI_SUCCESS;
+	return tcpx_queue_recv(tcpx_ep, recv_entry);
 }
 
 static ssize_t tcpx_sendmsg(struct fid_ep *ep, const struct fi_msg *msg,
@@ -170,19 +198,21 @@ static ssize_t tcpx_sendmsg(struct fid_ep *ep, const struct fi_msg *msg,
 	uint64_t data_len;
 	size_t offset = 0;
 	uint64_t *cq_data;
+	ssize_t ret = FI_SUCCESS;
 
 	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
 	tcpx_cq = container_of(tcpx_ep->util_ep.tx_cq, struct tcpx_cq,
 			       util_cq);
 
+	assert(msg->iov_count <= TCPX_IOV_LIMIT);
+	data_len = ofi_total_iov_len(msg->msg_iov, msg->iov_count);
+	if ((flags & FI_INJECT) && data_len > TCPX_MAX_INJECT_SZ)
+		return -FI_EINVAL;
+
 	tx_entry = tcpx_xfer_entry_alloc(tcpx_cq, TCPX_OP_MSG_SEND);
 	if (!tx_entry)
 		return -FI_EAGAIN;
 
-	assert(msg->iov_count <= TCPX_IOV_LIMIT);
-	data_len = ofi_total_iov_len(msg->msg_iov, msg->iov_count);
-	assert(!(flags & FI_INJECT) || (data_len <= TCPX_MAX_INJECT_SZ));
-
 	offset = sizeof(tx_entry->hdr.base_hdr);
 
 	if (flags & FI_REMOTE_CQ_DATA) {
@@ -194,14 +224,7 @@ static ssize_t tcpx_sendmsg(struct fid_ep *ep, const struct fi_msg *msg,
 
 	tx_entry->hdr.base_hdr.payload_off = (uint8_t)offset;
 	tx_entry->hdr.base_hdr.size = offset + data_len;
-	if (flags & FI_INJECT) {
-		ofi_copy_iov_buf(msg->msg_iov, msg->iov_count, 0,
-				 (uint8_t *)&tx_entry->hdr + offset,
-				 data_len,
-				 OFI_COPY_IOV_TO_BUF);
-		tx_entry->iov_cnt = 1;
-		offset += data_len;
-	} else {
+	if (!(flags & FI_INJECT)) {
 		memcpy(&tx_entry->iov[1], &msg->msg_iov[0],
 		       msg->iov_count * sizeof(struct iovec));
 
@@ -222,9 +245,16 @@ static ssize_t tcpx_sendmsg(struct fid_ep *ep, const struct fi_msg *msg,
 
 	tcpx_ep->hdr_bswap(&tx_entry->hdr.base_hdr);
 	fastlock_acquire(&tcpx_ep->lock);
-	tcpx_tx_queue_insert(tcpx_ep, tx_entry);
+	if (flags & FI_INJECT)
+		ret = tcpx_tx_queue_inject(tcpx_ep, tx_entry, msg->msg_iov,
+					   msg->iov_count, offset);
+	else
+		tcpx_tx_queue_insert(tcpx_ep, tx_entry);
 	fastlock_release(&tcpx_ep->lock);
-	return FI_SUCCESS;
+
+	if (ret)
+		tcpx_xfer_entry_release(tcpx_cq, tx_entry);
+	return ret;
 }
 
 static ssize_t tcpx_send(struct fid_ep *ep, const void *buf, size_t len,
@@ -312,32 +342,37 @@ static ssize_t tcpx_inject(struct fid_ep *ep, const void *buf, size_t len,
 {
 	struct tcpx_ep *tcpx_ep;
 	struct tcpx_xfer_entry *tx_entry;
-	size_t offset;
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+	ssize_t ret;
 
 	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
 
+	if (len > TCPX_MAX_INJECT_SZ)
+		return -FI_EINVAL;
+
 	tx_entry = tcpx_alloc_send_entry(tcpx_ep);
 	if (!tx_entry)
 		return -FI_EAGAIN;
 
-	assert(len <= TCPX_MAX_INJECT_SZ);
 	tx_entry->hdr.base_hdr.size = len + sizeof(tx_entry->hdr.base_hdr);
+	tx_entry->hdr.base_hdr.payload_off = (uint8_t)
+					     sizeof(tx_entry->hdr.base_hdr);
 
-	offset = sizeof(tx_entry->hdr.base_hdr);
-	tx_entry->hdr.base_hdr.payload_off = (uint8_t) offset;
-	memcpy((uint8_t *)&tx_entry->hdr + offset, (uint8_t *) buf, len);
-
-	tx_entry->iov[0].iov_base = (void *) &tx_entry->hdr;
-	tx_entry->iov[0].iov_len = len + sizeof(tx_entry->hdr.base_hdr);
-	tx_entry->iov_cnt = 1;
 	tx_entry->rem_len = tx_entry->hdr.base_hdr.size;
 	tx_entry->flags = FI_MSG | FI_SEND;
 
 	tcpx_ep->hdr_bswap(&tx_entry->hdr.base_hdr);
 	fastlock_acquire(&tcpx_ep->lock);
-	tcpx_tx_queue_insert(tcpx_ep, tx_entry);
+	ret = tcpx_tx_queue_inject(tcpx_ep, tx_entry, &iov, 1,
+				   sizeof(tx_entry->hdr.base_hdr));
 	fastlock_release(&tcpx_ep->lock);
-	return FI_SUCCESS;
+
+	if (ret)
+		tcpx_free_send_entry(tcpx_ep, tx_entry);
+	return ret;
 }
 
 static ssize_t tcpx_senddata(struct fid_ep *ep, const void *buf, size_t len,
@@ -391,15 +426,21 @@ static ssize_t tcpx_injectdata(struct fid_ep *ep, const void *buf, size_t len,
 {
 	struct tcpx_ep *tcpx_ep;
 	struct tcpx_xfer_entry *tx_entry;
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+	ssize_t ret;
 
 	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
 
+	if (len > TCPX_MAX_INJECT_SZ)
+		return -FI_EINVAL;
+
 	tx_entry = tcpx_alloc_send_entry(tcpx_ep);
 	if (!tx_entry)
 		return -FI_EAGAIN;
 
-	assert(len <= TCPX_MAX_INJECT_SZ);
-
 	tx_entry->hdr.cq_data_hdr.base_hdr.flags = OFI_REMOTE_CQ_DATA;
 	tx_entry->hdr.cq_data_hdr.cq_data = data;
 
@@ -407,20 +448,18 @@ static ssize_t tcpx_injectdata(struct fid_ep *ep, const void *buf, size_t len,
 	tx_entry->hdr.base_hdr.payload_off = (uint8_t)
 					     sizeof(tx_entry->hdr.cq_data_hdr);
 
-	memcpy((uint8_t *) &tx_entry->hdr + sizeof(tx_entry->hdr.cq_data_hdr),
-	       (uint8_t *) buf, len);
-
-	tx_entry->iov[0].iov_base = (void *) &tx_entry->hdr;
-	tx_entry->iov[0].iov_len = len + sizeof(tx_entry->hdr.cq_data_hdr);
-	tx_entry->iov_cnt = 1;
 	tx_entry->rem_len = tx_entry->hdr.base_hdr.size;
 	tx_entry->flags = FI_MSG | FI_SEND;
 
 	tcpx_ep->hdr_bswap(&tx_entry->hdr.base_hdr);
 	fastlock_acquire(&tcpx_ep->lock);
-	tcpx_tx_queue_insert(tcpx_ep, tx_entry);
+	ret = tcpx_tx_queue_inject(tcpx_ep, tx_entry, &iov, 1,
+				   sizeof(tx_entry->hdr.cq_data_hdr));
 	fastlock_release(&tcpx_ep->lock);
-	return FI_SUCCESS;
+
+	if (ret)
+		tcpx_free_send_entry(tcpx_ep, tx_entry);
+	return ret;
 }
 
 struct fi_ops_msg tcpx_msg_ops = {
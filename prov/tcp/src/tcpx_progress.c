@@ -92,18 +92,22 @@ int tcpx_ep_shutdown_report(struct tcpx_ep *ep, fid_t fid)
 	return FI_SUCCESS;
 }
 
-static void process_tx_entry(struct tcpx_xfer_entry *tx_entry)
+/* Responses to the peer: acks for delivery complete and RMA read data.
+ * They carry no ordering with respect to our own transfers.
+ */
+static bool tcpx_tx_is_priority(struct tcpx_xfer_entry *tx_entry)
 {
-	struct tcpx_cq *tcpx_cq;
-	int ret;
+	return tx_entry->hdr.base_hdr.op_data == TCPX_OP_MSG_RESP ||
+	       tx_entry->hdr.base_hdr.op_data == TCPX_OP_REMOTE_READ;
+}
 
-	ret = tcpx_send_msg(tx_entry);
-	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
-		return;
+/* Called once tx_entry has been removed from its queue */
+static void tcpx_tx_entry_done(struct tcpx_xfer_entry *tx_entry, int ret)
+{
+	struct tcpx_cq *tcpx_cq;
 
 	/* Keep this path below as a single pass path.*/
 	tx_entry->ep->hdr_bswap(&tx_entry->hdr.base_hdr);
-	slist_remove_head(&tx_entry->ep->tx_queue);
 
 	if (ret) {
 		FI_WARN(&tcpx_prov, FI_LOG_DOMAIN, "msg send failed\n");
@@ -126,6 +130,85 @@ static void process_tx_entry(struct tcpx_xfer_entry *tx_entry)
 	tcpx_xfer_entry_release(tcpx_cq, tx_entry);
 }
 
+static int process_tx_entry(struct tcpx_xfer_entry *tx_entry)
+{
+	struct tcpx_ep *ep = tx_entry->ep;
+	size_t rem_len = tx_entry->rem_len;
+	int ret;
+
+	ret = tcpx_send_msg(tx_entry);
+	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret)) {
+		/* Once started, a message must finish before any other */
+		if (tx_entry->rem_len != rem_len)
+			ep->cur_tx_entry = tx_entry;
+		return ret;
+	}
+
+	ep->cur_tx_entry = NULL;
+	slist_remove_head(&ep->tx_queue);
+	tcpx_tx_entry_done(tx_entry, ret);
+	return ret;
+}
+
+/* Gather as many queued responses as fit into a single sendmsg, so a
+ * burst of small read responses or acks costs one system call.
+ */
+static int tcpx_send_priority(struct tcpx_ep *ep)
+{
+	struct iovec iov[TCPX_TX_COALESCE_IOV];
+	struct msghdr msg = {0};
+	struct tcpx_xfer_entry *tx_entry;
+	struct slist_entry *item, *prev;
+	size_t iov_cnt = 0, len;
+	ssize_t bytes_sent;
+	int ret;
+
+	slist_foreach(&ep->tx_priority_queue, item, prev) {
+		(void) prev;
+		tx_entry = container_of(item, struct tcpx_xfer_entry, entry);
+		if (iov_cnt + tx_entry->iov_cnt > TCPX_TX_COALESCE_IOV)
+			break;
+
+		memcpy(&iov[iov_cnt], tx_entry->iov,
+		       tx_entry->iov_cnt * sizeof(*iov));
+		iov_cnt += tx_entry->iov_cnt;
+	}
+
+	msg.msg_iov = iov;
+	msg.msg_iovlen = iov_cnt;
+	bytes_sent = ofi_sendmsg_tcp(ep->sock, &msg, MSG_NOSIGNAL);
+	if (bytes_sent < 0) {
+		ret = ofi_sockerr() == EPIPE ? -FI_ENOTCONN : -ofi_sockerr();
+		if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+			return ret;
+
+		FI_WARN(&tcpx_prov, FI_LOG_DOMAIN, "response send failed\n");
+		tx_entry = container_of(slist_remove_head(&ep->tx_priority_queue),
+					struct tcpx_xfer_entry, entry);
+		ep->cur_tx_entry = NULL;
+		tcpx_tx_entry_done(tx_entry, ret);
+		return ret;
+	}
+
+	while (bytes_sent) {
+		tx_entry = container_of(ep->tx_priority_queue.head,
+					struct tcpx_xfer_entry, entry);
+		len = MIN((size_t) bytes_sent, tx_entry->rem_len);
+		tx_entry->rem_len -= len;
+		bytes_sent -= len;
+		if (tx_entry->rem_len) {
+			ofi_consume_iov(tx_entry->iov, &tx_entry->iov_cnt, len);
+			ep->cur_tx_entry = tx_entry;
+			return -FI_EAGAIN;
+		}
+
+		slist_remove_head(&ep->tx_priority_queue);
+		ep->cur_tx_entry = NULL;
+		tcpx_tx_entry_done(tx_entry, FI_SUCCESS);
+	}
+	return FI_SUCCESS;
+}
+
 static int tcpx_prepare_rx_entry_resp(struct tcpx_xfer_entry *rx_entry)
 {
 	struct tcpx_cq *tcpx_tx_cq;
@@ -186,6 +269,63 @@ static int process_rx_entry(struct tcpx_xfer_entry *rx_entry)
 	return ret;
 }
 
+/*
+ * The header of the message is in the posted buffer.  Let the owner of the
+ * buffer pick where the rest of the message goes.
+ */
+static int process_rx_hdr(struct tcpx_xfer_entry *rx_entry)
+{
+	struct tcpx_domain *domain;
+	size_t msg_len, hdr_size;
+	int ret;
+
+	ret = tcpx_recv_msg_data(rx_entry);
+	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+		return ret;
+
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
+			"msg recv Failed ret = %d\n", ret);
+		goto err;
+	}
+
+	domain = container_of(rx_entry->ep->util_ep.domain,
+			      struct tcpx_domain, util_domain);
+	hdr_size = domain->rbuf_hdr_size;
+	msg_len = rx_entry->hdr.base_hdr.size -
+		  rx_entry->hdr.base_hdr.payload_off;
+	assert(msg_len >= hdr_size);
+
+	rx_entry->iov_cnt = domain->get_rbuf(rx_entry->context, msg_len,
+					     rx_entry->iov, TCPX_IOV_LIMIT);
+	if (rx_entry->iov_cnt) {
+		/* The handler should only return buffers that fit, but
+		 * msg_len came off the wire */
+		ret = ofi_truncate_iov(rx_entry->iov, &rx_entry->iov_cnt,
+				       msg_len - hdr_size);
+		if (ret)
+			goto trunc;
+	} else {
+		rx_entry->iov[0].iov_base = (uint8_t *) rx_entry->mrecv_msg_start +
+					    hdr_size;
+		rx_entry->iov[0].iov_len = msg_len - hdr_size;
+		rx_entry->iov_cnt = 1;
+	}
+
+	rx_entry->ep->cur_rx_proc_fn = process_rx_entry;
+	return process_rx_entry(rx_entry);
+
+trunc:
+	FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
+		"received message does not fit its buffer\n");
+err:
+	tcpx_ep_shutdown_report(rx_entry->ep,
+				&rx_entry->ep->util_ep.ep_fid.fid);
+	tcpx_cq_report_error(rx_entry->ep->util_ep.rx_cq, rx_entry, -ret);
+	tcpx_rx_msg_release(rx_entry);
+	return ret;
+}
+
 static int tcpx_prepare_rx_write_resp(struct tcpx_xfer_entry *rx_entry)
 {
 	struct tcpx_cq *tcpx_rx_cq, *tcpx_tx_cq;
@@ -407,8 +547,110 @@ static void tcpx_rx_setup(struct tcpx_ep *ep, struct tcpx_xfer_entry *rx_entry,
 	ep->cur_rx_msg.done_len = 0;
 }
 
+/*
+ * FI_MULTI_RECV buffers are carved into one piece per message.  Only one
+ * message is received at a time on a connection, so the piece is the
+ * xfer entry embedded in the ep and carving never allocates.  The posted
+ * buffer holds a reference while it is queued and each piece holds one
+ * until its completion is written.  Whoever drops the last reference
+ * writes the FI_MULTI_RECV completion, which can happen on any
+ * connection without holding the lock of the queue the buffer came from.
+ */
+struct tcpx_xfer_entry *tcpx_mrecv_carve(struct tcpx_ep *ep,
+					 struct slist *queue, size_t len,
+					 size_t min_size)
+{
+	struct tcpx_xfer_entry *mrecv, *piece;
+
+	mrecv = container_of(queue->head, struct tcpx_xfer_entry, entry);
+	assert(len <= mrecv->iov[0].iov_len);
+
+	piece = &ep->mrecv_entry;
+	piece->iov[0].iov_base = mrecv->iov[0].iov_base;
+	piece->iov[0].iov_len = len;
+	piece->iov_cnt = 1;
+	piece->context = mrecv->context;
+	piece->flags = mrecv->flags & ~FI_MULTI_RECV;
+	piece->rem_len = 0;
+
+	ofi_atomic_inc32(&mrecv->mrecv_ref);
+	ep->cur_mrecv = mrecv;
+
+	mrecv->iov[0].iov_base = (uint8_t *) mrecv->iov[0].iov_base + len;
+	mrecv->iov[0].iov_len -= len;
+	if (mrecv->iov[0].iov_len < min_size) {
+		slist_remove_head(queue);
+		/* the piece still holds a reference */
+		(void) tcpx_mrecv_put(ep, mrecv);
+	}
+	return piece;
+}
+
+bool tcpx_mrecv_put(struct tcpx_ep *ep, struct tcpx_xfer_entry *mrecv)
+{
+	struct util_cq *cq = ep->util_ep.rx_cq;
+
+	if (ofi_atomic_dec32(&mrecv->mrecv_ref))
+		return false;
+
+	ofi_cq_write(cq, mrecv->context, FI_MULTI_RECV, 0, NULL, 0, 0);
+	if (cq->wait)
+		ofi_cq_signal(&cq->cq_fid);
+	return true;
+}
+
+/* Returns the multi-recv buffer if it must be freed by the caller */
+struct tcpx_xfer_entry *tcpx_mrecv_piece_done(struct tcpx_xfer_entry *piece)
+{
+	struct tcpx_ep *ep = piece->ep;
+	struct tcpx_xfer_entry *mrecv = ep->cur_mrecv;
+
+	if (ep->cur_rx_entry == piece)
+		ep->cur_rx_entry = NULL;
+
+	piece->hdr.base_hdr.flags = 0;
+	piece->flags = 0;
+	piece->context = NULL;
+	ep->cur_mrecv = NULL;
+
+	return tcpx_mrecv_put(ep, mrecv) ? mrecv : NULL;
+}
+
+static struct tcpx_xfer_entry *
+tcpx_next_rx_entry(struct tcpx_ep *ep, size_t msg_len)
+{
+	struct tcpx_xfer_entry *rx_entry;
+	struct tcpx_cq *tcpx_cq;
+
+	while (!slist_empty(&ep->rx_queue)) {
+		rx_entry = container_of(ep->rx_queue.head,
+					struct tcpx_xfer_entry, entry);
+
+		if (!(rx_entry->flags & FI_MULTI_RECV)) {
+			rx_entry->rem_len = ofi_total_iov_len(rx_entry->iov,
+						rx_entry->iov_cnt) - msg_len;
+			slist_remove_head(&ep->rx_queue);
+			return rx_entry;
+		}
+
+		if (msg_len <= rx_entry->iov[0].iov_len)
+			return tcpx_mrecv_carve(ep, &ep->rx_queue, msg_len,
+						ep->min_multi_recv_size);
+
+		/* message does not fit in what is left, release the buffer */
+		slist_remove_head(&ep->rx_queue);
+		if (tcpx_mrecv_put(ep, rx_entry)) {
+			tcpx_cq = container_of(ep->util_ep.rx_cq,
+					       struct tcpx_cq, util_cq);
+			tcpx_xfer_entry_release(tcpx_cq, rx_entry);
+		}
+	}
+	return NULL;
+}
+
 int tcpx_op_msg(struct tcpx_ep *tcpx_ep)
 {
+	struct tcpx_domain *domain;
 	struct tcpx_xfer_entry *rx_entry;
 	struct tcpx_xfer_entry *tx_entry;
 	struct tcpx_cq *tcpx_cq;
@@ -442,15 +684,9 @@ int tcpx_op_msg(struct tcpx_ep *tcpx_ep)
 
 		rx_entry->flags |= tcpx_ep->util_ep.rx_op_flags & FI_COMPLETION;
 	} else {
-		if (slist_empty(&tcpx_ep->rx_queue))
+		rx_entry = tcpx_next_rx_entry(tcpx_ep, msg_len);
+		if (!rx_entry)
 			return -FI_EAGAIN;
-
-		rx_entry = container_of(tcpx_ep->rx_queue.head,
-					struct tcpx_xfer_entry, entry);
-
-		rx_entry->rem_len = ofi_total_iov_len(rx_entry->iov,
-						      rx_entry->iov_cnt) - msg_len;
-		slist_remove_head(&tcpx_ep->rx_queue);
 	}
 
 	memcpy(&rx_entry->hdr, &tcpx_ep->cur_rx_msg.hdr,
@@ -472,6 +708,15 @@ int tcpx_op_msg(struct tcpx_ep *tcpx_ep)
 	if (cur_rx_msg->hdr.base_hdr.flags & OFI_REMOTE_CQ_DATA)
 		rx_entry->flags |= FI_REMOTE_CQ_DATA;
 
+	domain = container_of(tcpx_ep->util_ep.domain, struct tcpx_domain,
+			      util_domain);
+	if (domain->get_rbuf && rx_entry->iov_cnt == 1 &&
+	    !tcpx_xfer_is_mrecv(rx_entry) && msg_len >= domain->rbuf_hdr_size) {
+		rx_entry->iov[0].iov_len = domain->rbuf_hdr_size;
+		tcpx_rx_setup(tcpx_ep, rx_entry, process_rx_hdr);
+		return FI_SUCCESS;
+	}
+
 	tcpx_rx_setup(tcpx_ep, rx_entry, process_rx_entry);
 	return FI_SUCCESS;
 }
@@ -609,6 +854,25 @@ static int tcpx_get_next_rx_hdr(struct tcpx_ep *ep)
 	return FI_SUCCESS;
 }
 
+/* Responses queued while handling received messages go out together
+ * once the staged input has been consumed.
+ */
+static void tcpx_tx_flush_priority(struct tcpx_ep *ep)
+{
+	struct util_wait *wait = ep->util_ep.tx_cq->wait;
+
+	if (slist_empty(&ep->tx_priority_queue) ||
+	    ep->cm_state != TCPX_EP_CONNECTED)
+		return;
+
+	tcpx_progress_tx(ep);
+	if (tcpx_tx_pending(ep)) {
+		if (wait)
+			wait->signal(wait);
+		tcpx_progress_update_events(ep);
+	}
+}
+
 /* Must hold ep lock */
 void tcpx_progress_rx(struct tcpx_ep *ep)
 {
@@ -636,10 +900,13 @@ void tcpx_progress_rx(struct tcpx_ep *ep)
 
 	} while (ep->stage_buf.cur_pos < ep->stage_buf.bytes_avail);
 
+	tcpx_tx_flush_priority(ep);
 	return;
 err:
-	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret))
+	if (OFI_SOCK_TRY_SND_RCV_AGAIN(-ret)) {
+		tcpx_tx_flush_priority(ep);
 		return;
+	}
 
 	/* Failed current RX entry should clean itself */
 	assert(!ep->cur_rx_entry);
@@ -648,16 +915,33 @@ err:
 		tcpx_ep_shutdown_report(ep, &ep->util_ep.ep_fid.fid);
 }
 
-/* Must hold ep lock */
+/* Responses always go ahead of tx_queue.  The peer processes its input
+ * in order, so a response must never fall behind a send that was posted
+ * after it was generated: that send may have no matching receive yet, and
+ * the peer would block on it while waiting for the response.  A message
+ * that has started on the wire is always finished first.
+ * Must hold ep lock
+ */
 void tcpx_progress_tx(struct tcpx_ep *ep)
 {
 	struct tcpx_xfer_entry *tx_entry;
-	struct slist_entry *entry;
+	bool priority;
+	int ret;
 
-	if (!slist_empty(&ep->tx_queue)) {
-		entry = ep->tx_queue.head;
-		tx_entry = container_of(entry, struct tcpx_xfer_entry, entry);
-		process_tx_entry(tx_entry);
+	while (tcpx_tx_pending(ep)) {
+		priority = ep->cur_tx_entry ?
+			   tcpx_tx_is_priority(ep->cur_tx_entry) :
+			   !slist_empty(&ep->tx_priority_queue);
+
+		if (priority) {
+			ret = tcpx_send_priority(ep);
+		} else {
+			tx_entry = container_of(ep->tx_queue.head,
+						struct tcpx_xfer_entry, entry);
+			ret = process_tx_entry(tx_entry);
+		}
+		if (ret)
+			break;
 	}
 }
 
@@ -673,12 +957,12 @@ int tcpx_try_func(void *util_ep)
 			       struct util_wait_fd, util_wait);
 
 	fastlock_acquire(&ep->lock);
-	if (!slist_empty(&ep->tx_queue) && !ep->pollout_set) {
+	if (tcpx_tx_pending(ep) && !ep->pollout_set) {
 		ep->pollout_set = true;
 		events = (wait_fd->util_wait.wait_obj == FI_WAIT_FD) ?
 			 (OFI_EPOLL_IN | OFI_EPOLL_OUT) : (POLLIN | POLLOUT);
 		goto epoll_mod;
-	} else if (slist_empty(&ep->tx_queue) && ep->pollout_set) {
+	} else if (!tcpx_tx_pending(ep) && ep->pollout_set) {
 		ep->pollout_set = false;
 		events = (wait_fd->util_wait.wait_obj == FI_WAIT_FD) ?
 			 OFI_EPOLL_IN : POLLIN;
@@ -703,16 +987,345 @@ epoll_mod:
 void tcpx_tx_queue_insert(struct tcpx_ep *tcpx_ep,
 			  struct tcpx_xfer_entry *tx_entry)
 {
-	int empty;
+	bool idle;
 	struct util_wait *wait = tcpx_ep->util_ep.tx_cq->wait;
 
-	empty = slist_empty(&tcpx_ep->tx_queue);
+	/* Responses are only generated from the rx path, which flushes
+	 * them in one batch, see tcpx_tx_flush_priority.
+	 */
+	if (tcpx_tx_is_priority(tx_entry)) {
+		slist_insert_tail(&tx_entry->entry,
+				  &tcpx_ep->tx_priority_queue);
+		return;
+	}
+
+	idle = !tcpx_tx_pending(tcpx_ep);
 	slist_insert_tail(&tx_entry->entry, &tcpx_ep->tx_queue);
 
-	if (empty) {
-		process_tx_entry(tx_entry);
+	if (idle) {
+		tcpx_progress_tx(tcpx_ep);
 
-		if (!slist_empty(&tcpx_ep->tx_queue) && wait)
-			wait->signal(wait);
+		if (tcpx_tx_pending(tcpx_ep)) {
+			if (wait)
+				wait->signal(wait);
+			tcpx_progress_update_events(tcpx_ep);
+		}
+	}
+}
+
+/*
+ * Inject path: the (already byte swapped) header and the payload are
+ * packed into a buffer from the ep's inject arena so that the user buffer
+ * can be reused immediately and the message goes out in a single write.
+ * Caller must hold the ep lock.
+ */
+int tcpx_tx_queue_inject(struct tcpx_ep *tcpx_ep,
+			 struct tcpx_xfer_entry *tx_entry,
+			 const struct iovec *iov, size_t iov_cnt,
+			 size_t hdr_len)
+{
+	uint8_t *inject_buf;
+	size_t data_len;
+
+	inject_buf = ofi_buf_alloc(tcpx_ep->inject_pool);
+	if (!inject_buf)
+		return -FI_EAGAIN;
+
+	memcpy(inject_buf, &tx_entry->hdr, hdr_len);
+	data_len = ofi_copy_from_iov(inject_buf + hdr_len, TCPX_MAX_INJECT_SZ,
+				     iov, iov_cnt, 0);
+
+	tx_entry->inject_buf = inject_buf;
+	tx_entry->iov[0].iov_base = inject_buf;
+	tx_entry->iov[0].iov_len = hdr_len + data_len;
+	tx_entry->iov_cnt = 1;
+
+	tcpx_tx_queue_insert(tcpx_ep, tx_entry);
+	return FI_SUCCESS;
+}
+
+static void tcpx_progress_set_stalled(struct tcpx_progress *progress,
+				      struct tcpx_ep *ep, bool stalled)
+{
+	if (stalled == ep->progress_stalled)
+		return;
+
+	ep->progress_stalled = stalled;
+	if (stalled)
+		ofi_atomic_inc32(&progress->stalled_cnt);
+	else
+		ofi_atomic_dec32(&progress->stalled_cnt);
+}
+
+/* Must hold ep lock */
+void tcpx_progress_update_events(struct tcpx_ep *ep)
+{
+	struct tcpx_progress *progress = tcpx_ep_progress(ep);
+	uint32_t events;
+	bool stalled;
+	int ret;
+
+	if (!progress || !ep->progress_active)
+		return;
+
+	if (ep->cm_state != TCPX_EP_CONNECTED) {
+		(void) ofi_epoll_del(progress->epoll_fd, ep->sock);
+		tcpx_progress_set_stalled(progress, ep, false);
+		ep->progress_active = false;
+		return;
 	}
+
+	/* A completely received header without an rx entry is waiting for
+	 * the application to post a buffer.  Stop polling the socket for
+	 * input until then, otherwise the thread spins on data it cannot
+	 * consume.
+	 */
+	stalled = !ep->cur_rx_entry && ep->cur_rx_msg.done_len &&
+		  (ep->cur_rx_msg.done_len >= ep->cur_rx_msg.hdr_len);
+	tcpx_progress_set_stalled(progress, ep, stalled);
+
+	events = stalled ? 0 : OFI_EPOLL_IN;
+	if (tcpx_tx_pending(ep))
+		events |= OFI_EPOLL_OUT;
+
+	if (events == ep->progress_events)
+		return;
+
+	ret = ofi_epoll_mod(progress->epoll_fd, ep->sock, events,
+			    &ep->util_ep.ep_fid.fid);
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_EP_DATA,
+			"epoll modify failed\n");
+		return;
+	}
+	ep->progress_events = events;
+}
+
+static void tcpx_progress_ep(struct tcpx_ep *ep)
+{
+	fastlock_acquire(&ep->lock);
+	if (ep->cm_state == TCPX_EP_CONNECTED) {
+		tcpx_progress_rx(ep);
+		tcpx_progress_tx(ep);
+	}
+	tcpx_progress_update_events(ep);
+	fastlock_release(&ep->lock);
+}
+
+/* Must hold progress lock */
+static void tcpx_progress_insert_eps(struct tcpx_progress *progress)
+{
+	struct tcpx_ep *ep;
+	int ret;
+
+	fastlock_acquire(&progress->add_lock);
+	while (!dlist_empty(&progress->add_list)) {
+		dlist_pop_front(&progress->add_list, struct tcpx_ep,
+				ep, progress_entry);
+
+		fastlock_acquire(&ep->lock);
+		ep->progress_events = OFI_EPOLL_IN;
+		if (tcpx_tx_pending(ep))
+			ep->progress_events |= OFI_EPOLL_OUT;
+
+		ret = ofi_epoll_add(progress->epoll_fd, ep->sock,
+				    ep->progress_events,
+				    &ep->util_ep.ep_fid.fid);
+		if (ret) {
+			FI_WARN(&tcpx_prov, FI_LOG_EP_CTRL,
+				"Failed to add fd to progress thread\n");
+			dlist_init(&ep->progress_entry);
+		} else {
+			dlist_insert_tail(&ep->progress_entry,
+					  &progress->ep_list);
+			ep->progress_active = true;
+		}
+		fastlock_release(&ep->lock);
+	}
+	fastlock_release(&progress->add_lock);
+}
+
+/* Must hold progress lock */
+static void tcpx_progress_stalled_eps(struct tcpx_progress *progress)
+{
+	struct tcpx_ep *ep;
+
+	if (!ofi_atomic_get32(&progress->stalled_cnt))
+		return;
+
+	dlist_foreach_container(&progress->ep_list, struct tcpx_ep,
+				ep, progress_entry) {
+		if (ep->progress_stalled)
+			tcpx_progress_ep(ep);
+	}
+}
+
+static void *tcpx_progress_thread(void *arg)
+{
+	struct tcpx_progress *progress = arg;
+	void *wait_contexts[MAX_POLL_EVENTS];
+	uint64_t del_cnt;
+	int nfds, i, ret;
+
+	if (tcpx_env.progress_affinity) {
+		ret = ofi_set_thread_affinity(tcpx_env.progress_affinity);
+		if (ret)
+			FI_WARN(&tcpx_prov, FI_LOG_DOMAIN,
+				"unable to set progress thread affinity: %s\n",
+				fi_strerror(-ret));
+	}
+
+	fastlock_acquire(&progress->lock);
+	while (progress->run) {
+		del_cnt = progress->del_cnt;
+		fastlock_release(&progress->lock);
+
+		nfds = ofi_epoll_wait(progress->epoll_fd, wait_contexts,
+				      MAX_POLL_EVENTS, -1);
+
+		fastlock_acquire(&progress->lock);
+		/* An endpoint closed while we were waiting may still be
+		 * referenced by the returned contexts; poll again now that
+		 * closes are blocked.
+		 */
+		if (nfds > 0 && del_cnt != progress->del_cnt)
+			nfds = ofi_epoll_wait(progress->epoll_fd, wait_contexts,
+					      MAX_POLL_EVENTS, 0);
+
+		for (i = 0; i < nfds; i++) {
+			if (wait_contexts[i] == &progress->signal) {
+				fd_signal_reset(&progress->signal);
+				tcpx_progress_insert_eps(progress);
+				tcpx_progress_stalled_eps(progress);
+				continue;
+			}
+
+			tcpx_progress_ep(container_of(wait_contexts[i],
+						      struct tcpx_ep,
+						      util_ep.ep_fid.fid));
+		}
+	}
+	fastlock_release(&progress->lock);
+	return NULL;
+}
+
+/* Connection setup may hold the EQ close_lock, which the progress thread
+ * can acquire while dispatching (shutdown reporting).  Hand the ep over
+ * through add_list so that we never wait for the dispatch lock here.
+ */
+void tcpx_progress_add_ep(struct tcpx_ep *ep)
+{
+	struct tcpx_progress *progress = tcpx_ep_progress(ep);
+
+	if (!progress)
+		return;
+
+	fastlock_acquire(&progress->add_lock);
+	dlist_insert_tail(&ep->progress_entry, &progress->add_list);
+	fastlock_release(&progress->add_lock);
+	fd_signal_set(&progress->signal);
+}
+
+/* Once this returns the progress thread no longer references the ep */
+void tcpx_progress_del_ep(struct tcpx_ep *ep)
+{
+	struct tcpx_progress *progress = tcpx_ep_progress(ep);
+
+	if (!progress)
+		return;
+
+	fastlock_acquire(&progress->lock);
+	fastlock_acquire(&progress->add_lock);
+	if (!dlist_empty(&ep->progress_entry)) {
+		if (ep->progress_active)
+			(void) ofi_epoll_del(progress->epoll_fd, ep->sock);
+		dlist_remove_init(&ep->progress_entry);
+		tcpx_progress_set_stalled(progress, ep, false);
+		ep->progress_active = false;
+		progress->del_cnt++;
+	}
+	fastlock_release(&progress->add_lock);
+	fastlock_release(&progress->lock);
+}
+
+int tcpx_progress_init(struct tcpx_domain *domain)
+{
+	struct tcpx_progress *progress;
+	int ret;
+
+	progress = calloc(1, sizeof(*progress));
+	if (!progress)
+		return -FI_ENOMEM;
+
+	ret = ofi_epoll_create(&progress->epoll_fd);
+	if (ret)
+		goto err1;
+
+	ret = fd_signal_init(&progress->signal);
+	if (ret)
+		goto err2;
+
+	ret = ofi_epoll_add(progress->epoll_fd,
+			    fd_signal_get(&progress->signal),
+			    OFI_EPOLL_IN, &progress->signal);
+	if (ret)
+		goto err3;
+
+	ret = fastlock_init(&progress->lock);
+	if (ret)
+		goto err3;
+
+	ret = fastlock_init(&progress->add_lock);
+	if (ret)
+		goto err4;
+
+	dlist_init(&progress->ep_list);
+	dlist_init(&progress->add_list);
+	ofi_atomic_initialize32(&progress->stalled_cnt, 0);
+	progress->run = 1;
+
+	ret = pthread_create(&progress->thread, NULL,
+			     tcpx_progress_thread, progress);
+	if (ret) {
+		FI_WARN(&tcpx_prov, FI_LOG_DOMAIN,
+			"unable to start progress thread\n");
+		ret = -ret;
+		goto err5;
+	}
+
+	domain->progress = progress;
+	return FI_SUCCESS;
+err5:
+	fastlock_destroy(&progress->add_lock);
+err4:
+	fastlock_destroy(&progress->lock);
+err3:
+	fd_signal_free(&progress->signal);
+err2:
+	ofi_epoll_close(progress->epoll_fd);
+err1:
+	free(progress);
+	return ret;
+}
+
+void tcpx_progress_close(struct tcpx_domain *domain)
+{
+	struct tcpx_progress *progress = domain->progress;
+
+	if (!progress)
+		return;
+
+	fastlock_acquire(&progress->lock);
+	progress->run = 0;
+	fastlock_release(&progress->lock);
+
+	fd_signal_set(&progress->signal);
+	pthread_join(progress->thread, NULL);
+
+	fastlock_destroy(&progress->add_lock);
+	fastlock_destroy(&progress->lock);
+	fd_signal_free(&progress->signal);
+	ofi_epoll_close(progress->epoll_fd);
+	free(progress);
+	domain->progress = NULL;
 }
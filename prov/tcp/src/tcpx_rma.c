@@ -184,21 +184,22 @@ static ssize_t tcpx_rma_writemsg(struct fid_ep *ep, const struct fi_msg_rma *msg
 	uint64_t data_len;
 	uint64_t *cq_data;
 	size_t offset;
+	ssize_t ret = FI_SUCCESS;
 
 	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
 	tcpx_cq = container_of(tcpx_ep->util_ep.tx_cq, struct tcpx_cq,
 			       util_cq);
 
-	send_entry = tcpx_xfer_entry_alloc(tcpx_cq, TCPX_OP_WRITE);
-	if (!send_entry)
-		return -FI_EAGAIN;
-
 	assert(msg->iov_count <= TCPX_IOV_LIMIT);
 	assert(msg->rma_iov_count <= TCPX_IOV_LIMIT);
-
 	data_len = ofi_total_iov_len(msg->msg_iov, msg->iov_count);
+	if ((flags & FI_INJECT) && data_len > TCPX_MAX_INJECT_SZ)
+		return -FI_EINVAL;
+
+	send_entry = tcpx_xfer_entry_alloc(tcpx_cq, TCPX_OP_WRITE);
+	if (!send_entry)
+		return -FI_EAGAIN;
 
-	assert(!(flags & FI_INJECT) || (data_len <= TCPX_MAX_INJECT_SZ));
 	offset = sizeof(send_entry->hdr.base_hdr);
 
 	if (flags & FI_REMOTE_CQ_DATA) {
@@ -217,14 +218,7 @@ static ssize_t tcpx_rma_writemsg(struct fid_ep *ep, const struct fi_msg_rma *msg
 
 	send_entry->hdr.base_hdr.payload_off = (uint8_t)offset;
 	send_entry->hdr.base_hdr.size = data_len + offset;
-	if (flags & FI_INJECT) {
-		ofi_copy_iov_buf(msg->msg_iov, msg->iov_count, 0,
-				 (uint8_t *)&send_entry->hdr + offset,
-				 data_len,
-				 OFI_COPY_IOV_TO_BUF);
-		send_entry->iov_cnt = 1;
-		offset += data_len;
-	} else {
+	if (!(flags & FI_INJECT)) {
 		memcpy(&send_entry->iov[1], &msg->msg_iov[0],
 		       msg->iov_count * sizeof(struct iovec));
 		send_entry->iov_cnt = msg->iov_count + 1;
@@ -248,9 +242,16 @@ static ssize_t tcpx_rma_writemsg(struct fid_ep *ep, const struct fi_msg_rma *msg
 
 	tcpx_ep->hdr_bswap(&send_entry->hdr.base_hdr);
 	fastlock_acquire(&tcpx_ep->lock);
-	tcpx_tx_queue_insert(tcpx_ep, send_entry);
+	if (flags & FI_INJECT)
+		ret = tcpx_tx_queue_inject(tcpx_ep, send_entry, msg->msg_iov,
+					   msg->iov_count, offset);
+	else
+		tcpx_tx_queue_insert(tcpx_ep, send_entry);
 	fastlock_release(&tcpx_ep->lock);
-	return FI_SUCCESS;
+
+	if (ret)
+		tcpx_xfer_entry_release(tcpx_cq, send_entry);
+	return ret;
 }
 
 static ssize_t tcpx_rma_write(struct fid_ep *ep, const void *buf, size_t len, void *desc,
@@ -341,16 +342,23 @@ static ssize_t tcpx_rma_inject_common(struct fid_ep *ep, const void *buf,
 	struct ofi_rma_iov *rma_iov;
 	uint64_t *cq_data;
 	size_t offset;
+	struct iovec iov = {
+		.iov_base = (void *) buf,
+		.iov_len = len,
+	};
+	ssize_t ret;
 
 	tcpx_ep = container_of(ep, struct tcpx_ep, util_ep.ep_fid);
 	tcpx_cq = container_of(tcpx_ep->util_ep.tx_cq, struct tcpx_cq,
 			       util_cq);
 
+	if (len > TCPX_MAX_INJECT_SZ)
+		return -FI_EINVAL;
+
 	send_entry = tcpx_xfer_entry_alloc(tcpx_cq, TCPX_OP_WRITE);
 	if (!send_entry)
 		return -FI_EAGAIN;
 
-	assert(len <= TCPX_MAX_INJECT_SZ);
 	offset = sizeof(send_entry->hdr.base_hdr);
 
 	if (flags & FI_REMOTE_CQ_DATA) {
@@ -368,29 +376,25 @@ static ssize_t tcpx_rma_inject_common(struct fid_ep *ep, const void *buf,
 	offset += sizeof(*rma_iov);
 
 	send_entry->hdr.base_hdr.payload_off = (uint8_t)offset;
-	memcpy((uint8_t *)&send_entry->hdr + offset, (uint8_t *)buf, len);
-	offset += len;
-
-	send_entry->iov[0].iov_base = (void *) &send_entry->hdr;
-	send_entry->iov[0].iov_len = offset;
-	send_entry->iov_cnt = 1;
-
-	send_entry->hdr.base_hdr.size = offset;
+	send_entry->hdr.base_hdr.size = offset + len;
 	send_entry->ep = tcpx_ep;
 	send_entry->rem_len = send_entry->hdr.base_hdr.size;
 
 	tcpx_ep->hdr_bswap(&send_entry->hdr.base_hdr);
 	fastlock_acquire(&tcpx_ep->lock);
-	tcpx_tx_queue_insert(tcpx_ep, send_entry);
+	ret = tcpx_tx_queue_inject(tcpx_ep, send_entry, &iov, 1, offset);
 	fastlock_release(&tcpx_ep->lock);
-	return FI_SUCCESS;
+
+	if (ret)
+		tcpx_xfer_entry_release(tcpx_cq, send_entry);
+	return ret;
 }
 
 static ssize_t tcpx_rma_inject(struct fid_ep *ep, const void *buf, size_t len,
 			       fi_addr_t dest_addr, uint64_t addr, uint64_t key)
 {
-	return tcpx_rma_inject_common(ep, buf, len, dest_addr,
-				      0, addr, key, FI_INJECT);
+	return tcpx_rma_inject_common(ep, buf, len, 0, dest_addr,
+				      addr, key, FI_INJECT);
 }
 
 static ssize_t
@@ -398,7 +402,7 @@ tcpx_rma_injectdata(struct fid_ep *ep, const void *buf, size_t len,
 		    uint64_t data, fi_addr_t dest_addr, uint64_t addr,
 		    uint64_t key)
 {
-	return tcpx_rma_inject_common(ep, buf, len, dest_addr, data, addr, key,
+	return tcpx_rma_inject_common(ep, buf, len, data, dest_addr, addr, key,
 				      FI_INJECT | FI_REMOTE_CQ_DATA);
 }
 
@@ -41,8 +41,13 @@
 void tcpx_srx_xfer_release(struct tcpx_rx_ctx *srx_ctx,
 			   struct tcpx_xfer_entry *xfer_entry)
 {
-	if (xfer_entry->ep->cur_rx_entry == xfer_entry)
+	if (tcpx_xfer_is_mrecv(xfer_entry)) {
+		xfer_entry = tcpx_mrecv_piece_done(xfer_entry);
+		if (!xfer_entry)
+			return;
+	} else if (xfer_entry->ep->cur_rx_entry == xfer_entry) {
 		xfer_entry->ep->cur_rx_entry = NULL;
+	}
 
 	fastlock_acquire(&srx_ctx->lock);
 	ofi_buf_free(xfer_entry);
@@ -56,14 +61,30 @@ tcpx_srx_next_xfer_entry(struct tcpx_rx_ctx *srx_ctx,
 	struct tcpx_xfer_entry *xfer_entry = NULL;
 
 	fastlock_acquire(&srx_ctx->lock);
-	if (slist_empty(&srx_ctx->rx_queue))
-		goto out;
+	while (!slist_empty(&srx_ctx->rx_queue)) {
+		xfer_entry = container_of(srx_ctx->rx_queue.head,
+					  struct tcpx_xfer_entry, entry);
 
-	xfer_entry = container_of(srx_ctx->rx_queue.head,
-				  struct tcpx_xfer_entry, entry);
-	xfer_entry->rem_len = ofi_total_iov_len(xfer_entry->iov,
+		if (!(xfer_entry->flags & FI_MULTI_RECV)) {
+			xfer_entry->rem_len = ofi_total_iov_len(xfer_entry->iov,
 						xfer_entry->iov_cnt) - entry_size;
-	slist_remove_head(&srx_ctx->rx_queue);
+			slist_remove_head(&srx_ctx->rx_queue);
+			goto out;
+		}
+
+		if (entry_size <= xfer_entry->iov[0].iov_len) {
+			xfer_entry = tcpx_mrecv_carve(ep, &srx_ctx->rx_queue,
+						      entry_size,
+						      srx_ctx->min_multi_recv_size);
+			goto out;
+		}
+
+		/* message does not fit in what is left, release the buffer */
+		slist_remove_head(&srx_ctx->rx_queue);
+		if (tcpx_mrecv_put(ep, xfer_entry))
+			ofi_buf_free(xfer_entry);
+	}
+	xfer_entry = NULL;
 out:
 	fastlock_release(&srx_ctx->lock);
 	return xfer_entry;
@@ -86,15 +107,24 @@ static ssize_t tcpx_srx_recvmsg(struct fid_ep *ep, const struct fi_msg *msg,
 		goto unlock;
 	}
 
-	recv_entry->flags = flags | FI_MSG | FI_RECV;
+	recv_entry->flags = (flags & ~FI_MORE) | FI_MSG | FI_RECV;
 	recv_entry->context = msg->context;
 	recv_entry->iov_cnt = msg->iov_count;
 	memcpy(&recv_entry->iov[0], msg->msg_iov,
 	       msg->iov_count * sizeof(*msg->msg_iov));
 
+	ret = tcpx_mrecv_init(recv_entry);
+	if (ret) {
+		ofi_buf_free(recv_entry);
+		goto unlock;
+	}
+
 	slist_insert_tail(&recv_entry->entry, &srx_ctx->rx_queue);
 unlock:
 	fastlock_release(&srx_ctx->lock);
+	/* More receives follow, wake the progress thread after the last */
+	if (!ret && !(flags & FI_MORE))
+		tcpx_progress_signal_rx(srx_ctx->progress);
 	return ret;
 }
 
@@ -114,16 +144,25 @@ static ssize_t tcpx_srx_recv(struct fid_ep *ep, void *buf, size_t len, void *des
 		goto unlock;
 	}
 
-	recv_entry->flags = FI_MSG | FI_RECV;
+	recv_entry->flags = (srx_ctx->op_flags & FI_MULTI_RECV) |
+			    FI_MSG | FI_RECV;
 	recv_entry->context = context;
 	recv_entry->iov_cnt = 1;
 	recv_entry->iov[0].iov_base = buf;
 	recv_entry->iov[0].iov_len = len;
 	recv_entry->rem_len = len;
 
+	ret = tcpx_mrecv_init(recv_entry);
+	if (ret) {
+		ofi_buf_free(recv_entry);
+		goto unlock;
+	}
+
 	slist_insert_tail(&recv_entry->entry, &srx_ctx->rx_queue);
 unlock:
 	fastlock_release(&srx_ctx->lock);
+	if (!ret)
+		tcpx_progress_signal_rx(srx_ctx->progress);
 	return ret;
 }
 
@@ -144,14 +183,23 @@ static ssize_t tcpx_srx_recvv(struct fid_ep *ep, const struct iovec *iov, void *
 		goto unlock;
 	}
 
-	recv_entry->flags = FI_MSG | FI_RECV;
+	recv_entry->flags = (srx_ctx->op_flags & FI_MULTI_RECV) |
+			    FI_MSG | FI_RECV;
 	recv_entry->context = context;
 	recv_entry->iov_cnt = count;
 	memcpy(&recv_entry->iov[0], iov, count * sizeof(*iov));
 
+	ret = tcpx_mrecv_init(recv_entry);
+	if (ret) {
+		ofi_buf_free(recv_entry);
+		goto unlock;
+	}
+
 	slist_insert_tail(&recv_entry->entry, &srx_ctx->rx_queue);
 unlock:
 	fastlock_release(&srx_ctx->lock);
+	if (!ret)
+		tcpx_progress_signal_rx(srx_ctx->progress);
 	return ret;
 }
 
@@ -167,3 +215,55 @@ struct fi_ops_msg tcpx_srx_msg_ops = {
 	.senddata = fi_no_msg_senddata,
 	.injectdata = fi_no_msg_injectdata,
 };
+
+static int tcpx_srx_getopt(fid_t fid, int level, int optname,
+			   void *optval, size_t *optlen)
+{
+	struct tcpx_rx_ctx *srx_ctx;
+
+	if (level != FI_OPT_ENDPOINT || optname != FI_OPT_MIN_MULTI_RECV)
+		return -FI_ENOPROTOOPT;
+
+	if (*optlen < sizeof(size_t)) {
+		*optlen = sizeof(size_t);
+		return -FI_ETOOSMALL;
+	}
+
+	srx_ctx = container_of(fid, struct tcpx_rx_ctx, rx_fid.fid);
+	*((size_t *) optval) = srx_ctx->min_multi_recv_size;
+	*optlen = sizeof(size_t);
+	return FI_SUCCESS;
+}
+
+static int tcpx_srx_setopt(fid_t fid, int level, int optname,
+			   const void *optval, size_t optlen)
+{
+	struct tcpx_rx_ctx *srx_ctx;
+
+	if (level != FI_OPT_ENDPOINT || optname != FI_OPT_MIN_MULTI_RECV)
+		return -FI_ENOPROTOOPT;
+
+	if (optlen != sizeof(size_t))
+		return -FI_EINVAL;
+
+	srx_ctx = container_of(fid, struct tcpx_rx_ctx, rx_fid.fid);
+	fastlock_acquire(&srx_ctx->lock);
+	srx_ctx->min_multi_recv_size = *(size_t *) optval;
+	fastlock_release(&srx_ctx->lock);
+
+	FI_INFO(&tcpx_prov, FI_LOG_EP_CTRL,
+		"srx FI_OPT_MIN_MULTI_RECV set to %zu\n",
+		srx_ctx->min_multi_recv_size);
+	return FI_SUCCESS;
+}
+
+struct fi_ops_ep tcpx_srx_ep_ops = {
+	.size = sizeof(struct fi_ops_ep),
+	.cancel = fi_no_cancel,
+	.getopt = tcpx_srx_getopt,
+	.setopt = tcpx_srx_setopt,
+	.tx_ctx = fi_no_tx_ctx,
+	.rx_ctx = fi_no_rx_ctx,
+	.rx_size_left = fi_no_rx_size_left,
+	.tx_size_left = fi_no_tx_size_left,
+};
@@ -15,6 +15,8 @@ AC_DEFUN([FI_UDP_CONFIGURE],[
 	      [AC_CHECK_HEADER([sys/socket.h], [udp_h_happy=1],
 	                       [udp_h_happy=0])
 
+	       # batched datagram I/O is optional
+	       AC_CHECK_FUNCS([recvmmsg sendmmsg])
 
 	       # check if shm_open is already present
 	       AC_CHECK_FUNC([shm_open],
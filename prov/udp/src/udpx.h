@@ -41,6 +41,7 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/udp.h>
 
 #include <rdma/fabric.h>
 #include <rdma/fi_atomic.h>
@@ -55,6 +56,7 @@
 
 #include <ofi.h>
 #include <ofi_enosys.h>
+#include <ofi_iov.h>
 #include <ofi_rbuf.h>
 #include <ofi_list.h>
 #include <ofi_signal.h>
@@ -67,6 +69,10 @@
 extern struct fi_provider udpx_prov;
 extern struct util_prov udpx_util_prov;
 extern struct fi_info udpx_info;
+extern int udpx_use_gso;
+extern int udpx_use_gro;
+extern int udpx_drop_rate;
+extern int udpx_reorder_rate;
 
 
 int udpx_fabric(struct fi_fabric_attr *attr, struct fid_fabric **fabric,
@@ -79,6 +85,12 @@ int udpx_eq_open(struct fid_fabric *fabric, struct fi_eq_attr *attr,
 
 #define UDPX_FLAG_MULTI_RECV	1
 #define UDPX_IOV_LIMIT		4
+#define UDPX_MMSG_LIMIT		32
+#define UDPX_TXQ_SIZE		64
+/* Leave room for the IP and UDP headers of a GSO send */
+#define UDPX_GSO_MAX_SIZE	(UINT16_MAX - 512)
+#define UDPX_GRO_BUF_SIZE	(UINT16_MAX + 1)
+#define UDPX_HOLD_BUF_SIZE	(UINT16_MAX + 1)
 
 struct udpx_ep_entry {
 	void			*context;
@@ -90,6 +102,19 @@ struct udpx_ep_entry {
 
 OFI_DECLARE_CIRQUE(struct udpx_ep_entry, udpx_rx_cirq);
 
+/* Send posted with FI_MORE, held until it can go out in one sendmmsg */
+struct udpx_tx_entry {
+	void			*context;
+	struct iovec		iov[UDPX_IOV_LIMIT];
+	size_t			iov_count;
+	size_t			len;
+	union {
+		struct sockaddr_in	sin;
+		struct sockaddr_in6	sin6;
+	} addr;
+	socklen_t		addrlen;
+};
+
 struct udpx_ep;
 typedef void (*udpx_rx_comp_func)(struct udpx_ep *ep, void *context,
 		uint64_t flags, size_t len, void *buf, void *addr);
@@ -100,6 +125,13 @@ struct udpx_ep {
 	udpx_rx_comp_func	rx_comp;
 	udpx_tx_comp_func	tx_comp;
 	struct udpx_rx_cirq	*rxq;    /* protected by rx_cq lock */
+	struct udpx_tx_entry	txq[UDPX_TXQ_SIZE]; /* tx_cq lock */
+	size_t			txq_cnt;
+	int			gso;
+	int			gro;
+	void			*gro_buf;
+	uint32_t		drop_seed; /* tx_cq lock */
+	struct udpx_tx_entry	hold;      /* tx_cq lock, see udpx_hold_tx */
 	SOCKET			sock;
 	int			is_bound;
 	ofi_atomic32_t		ref;
@@ -39,10 +39,23 @@
 static int udpx_setname(fid_t fid, void *addr, size_t addrlen)
 {
 	struct udpx_ep *ep;
-	int ret;
+	int ret, optval = 1;
 
 	ep = container_of(fid, struct udpx_ep, util_ep.ep_fid.fid);
 	ofi_straddr_dbg(&udpx_prov, FI_LOG_EP_CTRL, "bind addr: ", addr);
+
+	/* Endpoints bound to a multicast group receive only the group's
+	 * traffic, and several of them on one host may share the port */
+	if (((struct sockaddr *) addr)->sa_family == AF_INET &&
+	    IN_MULTICAST(ntohl(((struct sockaddr_in *) addr)->sin_addr.s_addr))) {
+		ret = setsockopt(ep->sock, SOL_SOCKET, SO_REUSEADDR,
+				 (const void *) &optval, sizeof(optval));
+		if (ret)
+			FI_WARN(&udpx_prov, FI_LOG_EP_CTRL,
+				"setsockopt SO_REUSEADDR %d (%s)\n",
+				errno, strerror(errno));
+	}
+
 	ret = bind(ep->sock, addr, (socklen_t)addrlen);
 	if (ret) {
 		FI_WARN(&udpx_prov, FI_LOG_EP_CTRL, "bind %d (%s)\n",
@@ -234,6 +247,25 @@ static void udpx_tx_comp_signal(struct udpx_ep *ep, void *context)
 	ep->util_ep.tx_cq->wait->signal(ep->util_ep.tx_cq->wait);
 }
 
+/* Caller holds the tx_cq lock */
+static void udpx_tx_comp_err(struct udpx_ep *ep, void *context, int err)
+{
+	struct fi_cq_err_entry err_entry;
+
+	memset(&err_entry, 0, sizeof(err_entry));
+	err_entry.op_context = context;
+	err_entry.flags = FI_SEND;
+	err_entry.err = err;
+	err_entry.prov_errno = err;
+	if (ofi_cq_write_error_thread_unsafe(ep->util_ep.tx_cq, &err_entry)) {
+		FI_WARN(&udpx_prov, FI_LOG_EP_DATA,
+			"could not write error entry\n");
+		return;
+	}
+	if (ep->util_ep.tx_cq->wait)
+		ep->util_ep.tx_cq->wait->signal(ep->util_ep.tx_cq->wait);
+}
+
 static void udpx_rx_comp(struct udpx_ep *ep, void *context, uint64_t flags,
 			 size_t len, void *buf, void *addr)
 {
@@ -270,25 +302,341 @@ static void udpx_rx_src_comp_signal(struct udpx_ep *ep, void *context,
 	ep->util_ep.rx_cq->wait->signal(ep->util_ep.rx_cq->wait);
 }
 
-static void udpx_ep_progress(struct util_ep *util_ep)
+static void udpx_tx_entry_hdr(struct udpx_tx_entry *entry, struct msghdr *hdr)
+{
+	hdr->msg_name = &entry->addr;
+	hdr->msg_namelen = entry->addrlen;
+	hdr->msg_iov = entry->iov;
+	hdr->msg_iovlen = entry->iov_count;
+	hdr->msg_control = NULL;
+	hdr->msg_controllen = 0;
+	hdr->msg_flags = 0;
+}
+
+#ifdef UDP_SEGMENT
+union udpx_gso_ctrl {
+	char			buf[CMSG_SPACE(sizeof(uint16_t))];
+	struct cmsghdr		align;
+};
+
+/*
+ * Returns how many queued sends, starting at index start, can be handed
+ * to the kernel as one GSO send: a run to the same address in which every
+ * send has the size of the first, except the last, which may be shorter.
+ */
+static size_t udpx_gso_run(struct udpx_ep *ep, size_t start, size_t cnt)
+{
+	struct udpx_tx_entry *first = &ep->txq[start];
+	struct udpx_tx_entry *entry;
+	size_t i, total;
+
+	if (!first->len)
+		return 1;
+
+	for (i = 1, total = first->len; i < cnt; i++) {
+		entry = &ep->txq[start + i];
+		if (entry->len > first->len || !entry->len ||
+		    total + entry->len > UDPX_GSO_MAX_SIZE ||
+		    entry->addrlen != first->addrlen ||
+		    memcmp(&entry->addr, &first->addr, first->addrlen))
+			break;
+
+		total += entry->len;
+		if (entry->len < first->len)
+			return i + 1;
+	}
+	return i;
+}
+
+static void udpx_gso_hdr(struct udpx_ep *ep, size_t start, size_t run,
+			 struct msghdr *hdr, struct iovec *iov,
+			 union udpx_gso_ctrl *ctrl)
+{
+	struct udpx_tx_entry *entry;
+	struct cmsghdr *cmsg;
+	uint16_t seg_size;
+	size_t i;
+
+	hdr->msg_iov = iov;
+	hdr->msg_iovlen = 0;
+	for (i = 0; i < run; i++) {
+		entry = &ep->txq[start + i];
+		memcpy(&iov[hdr->msg_iovlen], entry->iov,
+		       entry->iov_count * sizeof(*iov));
+		hdr->msg_iovlen += entry->iov_count;
+	}
+
+	hdr->msg_control = ctrl->buf;
+	hdr->msg_controllen = sizeof(ctrl->buf);
+	cmsg = CMSG_FIRSTHDR(hdr);
+	cmsg->cmsg_level = SOL_UDP;
+	cmsg->cmsg_type = UDP_SEGMENT;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(seg_size));
+	seg_size = (uint16_t) ep->txq[start].len;
+	memcpy(CMSG_DATA(cmsg), &seg_size, sizeof(seg_size));
+}
+#endif
+
+/*
+ * Returns the number of queued sends, starting at index start, that went
+ * out.  Runs of sends that udpx_gso_run accepts go out as one message.
+ */
+static int udpx_send_txq(struct udpx_ep *ep, size_t start, size_t cnt)
+{
+#if HAVE_SENDMMSG
+	struct mmsghdr msgs[UDPX_TXQ_SIZE];
+#else
+	struct {
+		struct msghdr	msg_hdr;
+	} msgs[1];
+#endif
+#ifdef UDP_SEGMENT
+	struct iovec iov[UDPX_TXQ_SIZE * UDPX_IOV_LIMIT];
+	union udpx_gso_ctrl ctrl[UDPX_TXQ_SIZE];
+	size_t iov_cnt = 0;
+#endif
+	size_t runs[UDPX_TXQ_SIZE];
+	size_t i, n;
+	int ret, sent;
+
+	for (i = 0, n = 0; i < cnt && n < ARRAY_SIZE(msgs); i += runs[n++]) {
+		udpx_tx_entry_hdr(&ep->txq[start + i], &msgs[n].msg_hdr);
+		runs[n] = 1;
+#ifdef UDP_SEGMENT
+		if (ep->gso)
+			runs[n] = udpx_gso_run(ep, start + i, cnt - i);
+		if (runs[n] > 1) {
+			udpx_gso_hdr(ep, start + i, runs[n], &msgs[n].msg_hdr,
+				     &iov[iov_cnt], &ctrl[n]);
+			iov_cnt += msgs[n].msg_hdr.msg_iovlen;
+		}
+#endif
+	}
+
+#if HAVE_SENDMMSG
+	ret = sendmmsg(ep->sock, msgs, (unsigned int) n, 0);
+#else
+	ret = ofi_sendmsg_udp(ep->sock, &msgs[0].msg_hdr, 0) < 0 ? -1 : 1;
+#endif
+	if (ret < 0) {
+#ifdef UDP_SEGMENT
+		if (runs[0] > 1 &&
+		    !OFI_SOCK_TRY_SND_RCV_AGAIN(ofi_sockerr())) {
+			FI_WARN(&udpx_prov, FI_LOG_EP_DATA,
+				"disabling UDP GSO: %s\n",
+				strerror(ofi_sockerr()));
+			ep->gso = 0;
+			return 0;
+		}
+#endif
+		return ret;
+	}
+
+	for (i = 0, sent = 0; i < (size_t) ret; i++)
+		sent += (int) runs[i];
+	return sent;
+}
+
+/*
+ * Emulates a reordering network for the reorder_rate parameter.  The
+ * datagram is copied aside and its send completed; it goes out after the
+ * next datagram, or when the endpoint is progressed.  Caller holds the
+ * tx_cq lock.  Returns 1 if the datagram was held.
+ */
+static int udpx_hold_tx(struct udpx_ep *ep, const struct iovec *iov,
+			size_t iov_count, const void *addr, size_t addrlen,
+			void *context)
+{
+	if (!ep->hold.iov[0].iov_base || ep->hold.iov_count ||
+	    ofi_cirque_isfull(ep->util_ep.tx_cq->cirq))
+		return 0;
+
+	ep->drop_seed = ofi_xorshift_random(ep->drop_seed);
+	if (ep->drop_seed % 100 >= (uint32_t) udpx_reorder_rate)
+		return 0;
+
+	ep->hold.len = ofi_copy_from_iov(ep->hold.iov[0].iov_base,
+					 UDPX_HOLD_BUF_SIZE, iov, iov_count, 0);
+	ep->hold.iov[0].iov_len = ep->hold.len;
+	ep->hold.iov_count = 1;
+	memcpy(&ep->hold.addr, addr, addrlen);
+	ep->hold.addrlen = (socklen_t) addrlen;
+	ep->tx_comp(ep, context);
+	return 1;
+}
+
+/* Caller holds the tx_cq lock.  A failed send counts as a lost datagram. */
+static void udpx_send_hold(struct udpx_ep *ep)
+{
+	struct msghdr hdr;
+
+	if (!ep->hold.iov_count)
+		return;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.msg_name = &ep->hold.addr;
+	hdr.msg_namelen = ep->hold.addrlen;
+	hdr.msg_iov = ep->hold.iov;
+	hdr.msg_iovlen = 1;
+	(void) ofi_sendmsg_udp(ep->sock, &hdr, 0);
+	ep->hold.iov_count = 0;
+}
+
+/*
+ * Caller holds the tx_cq lock.  Sends are only completed while there is
+ * room in the CQ.  A datagram that the kernel refuses for any reason other
+ * than a full socket buffer is completed in error, as an unqueued send
+ * would have failed with it.
+ */
+static void udpx_flush_txq(struct udpx_ep *ep)
+{
+	size_t done, cnt;
+	int i, ret;
+
+	for (done = 0; done < ep->txq_cnt; done += ret) {
+		cnt = MIN(ep->txq_cnt - done,
+			  ofi_cirque_freecnt(ep->util_ep.tx_cq->cirq));
+		if (!cnt)
+			break;
+
+		ret = udpx_send_txq(ep, done, cnt);
+		if (ret < 0) {
+			if (OFI_SOCK_TRY_SND_RCV_AGAIN(ofi_sockerr()))
+				break;
+			FI_WARN(&udpx_prov, FI_LOG_EP_DATA,
+				"send failed: %s\n", strerror(ofi_sockerr()));
+			udpx_tx_comp_err(ep, ep->txq[done].context,
+					 ofi_sockerr());
+			ret = 1;
+			continue;
+		}
+
+		for (i = 0; i < ret; i++)
+			ep->tx_comp(ep, ep->txq[done + i].context);
+	}
+
+	ep->txq_cnt -= done;
+	memmove(ep->txq, &ep->txq[done], ep->txq_cnt * sizeof(*ep->txq));
+	if (done)
+		udpx_send_hold(ep);
+}
+
+/*
+ * Caller holds the tx_cq lock.  Sends posted with FI_MORE are queued and
+ * go out together, in one sendmmsg call where available, once a send
+ * without FI_MORE is posted, the queue fills up, or the endpoint is
+ * progressed.  Later sends queue behind them to keep datagrams in order.
+ */
+static ssize_t udpx_queue_tx(struct udpx_ep *ep, const struct iovec *iov,
+			     size_t iov_count, const void *addr, size_t addrlen,
+			     void *context, uint64_t flags)
+{
+	struct udpx_tx_entry *entry;
+
+	if (iov_count > UDPX_IOV_LIMIT)
+		return -FI_EINVAL;
+
+	if (ep->txq_cnt == UDPX_TXQ_SIZE) {
+		udpx_flush_txq(ep);
+		if (ep->txq_cnt == UDPX_TXQ_SIZE)
+			return -FI_EAGAIN;
+	}
+
+	entry = &ep->txq[ep->txq_cnt++];
+	entry->context = context;
+	memcpy(entry->iov, iov, iov_count * sizeof(*iov));
+	entry->iov_count = iov_count;
+	entry->len = ofi_total_iov_len(iov, iov_count);
+	memcpy(&entry->addr, addr, addrlen);
+	entry->addrlen = (socklen_t) addrlen;
+
+	if (!(flags & FI_MORE) || ep->txq_cnt == UDPX_TXQ_SIZE)
+		udpx_flush_txq(ep);
+	return 0;
+}
+
+/*
+ * Emulates a lossy network for the drop_rate parameter.  Inject calls
+ * this without the tx_cq lock; a racing update only repeats a draw.
+ */
+static int udpx_drop_tx(struct udpx_ep *ep)
+{
+	if (!udpx_drop_rate)
+		return 0;
+
+	ep->drop_seed = ofi_xorshift_random(ep->drop_seed);
+	return ep->drop_seed % 100 < (uint32_t) udpx_drop_rate;
+}
+
+/* Inject data is not kept, so queued sends must go out first */
+static ssize_t udpx_drain_txq(struct udpx_ep *ep)
+{
+	ssize_t ret;
+
+	if (!ep->txq_cnt)
+		return 0;
+
+	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+	udpx_flush_txq(ep);
+	ret = ep->txq_cnt ? -FI_EAGAIN : 0;
+	fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+	return ret;
+}
+
+#if HAVE_RECVMMSG
+/* Caller holds the rx_cq lock.  Fills as many posted buffers as the CQ
+ * has room to complete with a single recvmmsg call. */
+static void udpx_ep_recv(struct udpx_ep *ep)
+{
+	struct mmsghdr msgs[UDPX_MMSG_LIMIT];
+	struct sockaddr_in6 addr[UDPX_MMSG_LIMIT];
+	struct udpx_ep_entry *entry;
+	size_t cnt;
+	int i, ret;
+
+	cnt = MIN(ofi_cirque_usedcnt(ep->rxq),
+		  ofi_cirque_freecnt(ep->util_ep.rx_cq->cirq));
+	cnt = MIN(cnt, UDPX_MMSG_LIMIT);
+	if (!cnt)
+		return;
+
+	for (i = 0; i < (int) cnt; i++) {
+		entry = &ep->rxq->buf[(ep->rxq->rcnt + i) &
+				      ep->rxq->size_mask];
+		msgs[i].msg_hdr.msg_name = &addr[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+		msgs[i].msg_hdr.msg_iov = entry->iov;
+		msgs[i].msg_hdr.msg_iovlen = entry->iov_count;
+		msgs[i].msg_hdr.msg_control = NULL;
+		msgs[i].msg_hdr.msg_controllen = 0;
+		msgs[i].msg_hdr.msg_flags = 0;
+	}
+
+	ret = recvmmsg(ep->sock, msgs, (unsigned int) cnt, 0, NULL);
+	for (i = 0; i < ret; i++) {
+		entry = ofi_cirque_head(ep->rxq);
+		ep->rx_comp(ep, entry->context, 0, msgs[i].msg_len, NULL,
+			    &addr[i]);
+		ofi_cirque_discard(ep->rxq);
+	}
+}
+#else
+static void udpx_ep_recv(struct udpx_ep *ep)
 {
-	struct udpx_ep *ep;
 	struct udpx_ep_entry *entry;
 	struct msghdr hdr;
 	struct sockaddr_in6 addr;
 	ssize_t ret;
 
-	ep = container_of(util_ep, struct udpx_ep, util_ep);
+	if (ofi_cirque_isempty(ep->rxq))
+		return;
+
 	hdr.msg_name = &addr;
 	hdr.msg_namelen = sizeof(addr);
 	hdr.msg_control = NULL;
 	hdr.msg_controllen = 0;
 	hdr.msg_flags = 0;
 
-	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
-	if (ofi_cirque_isempty(ep->rxq))
-		goto out;
-
 	entry = ofi_cirque_head(ep->rxq);
 	hdr.msg_iov = entry->iov;
 	hdr.msg_iovlen = entry->iov_count;
@@ -298,7 +646,101 @@ static void udpx_ep_progress(struct util_ep *util_ep)
 		ep->rx_comp(ep, entry->context, 0, ret, NULL, &addr);
 		ofi_cirque_discard(ep->rxq);
 	}
-out:
+}
+#endif
+
+#ifdef UDP_GRO
+/*
+ * Caller holds the rx_cq lock.  With UDP_GRO enabled the kernel may pass
+ * up several datagrams from one sender as a single buffer, along with
+ * their segment size.  They are received into a bounce buffer and copied
+ * out to posted buffers one datagram each.  Datagrams that find no posted
+ * buffer or no room in the CQ are dropped.
+ */
+static void udpx_ep_recv_gro(struct udpx_ep *ep)
+{
+	union {
+		char			buf[CMSG_SPACE(sizeof(int))];
+		struct cmsghdr		align;
+	} ctrl;
+	struct udpx_ep_entry *entry;
+	struct sockaddr_in6 addr;
+	struct cmsghdr *cmsg;
+	struct msghdr hdr;
+	struct iovec iov;
+	size_t off, len;
+	ssize_t ret;
+	int i, seg_size;
+
+	for (i = 0; i < UDPX_MMSG_LIMIT; i++) {
+		if (ofi_cirque_isempty(ep->rxq) ||
+		    ofi_cirque_isfull(ep->util_ep.rx_cq->cirq))
+			return;
+
+		iov.iov_base = ep->gro_buf;
+		iov.iov_len = UDPX_GRO_BUF_SIZE;
+		hdr.msg_name = &addr;
+		hdr.msg_namelen = sizeof(addr);
+		hdr.msg_iov = &iov;
+		hdr.msg_iovlen = 1;
+		hdr.msg_control = ctrl.buf;
+		hdr.msg_controllen = sizeof(ctrl.buf);
+		hdr.msg_flags = 0;
+
+		ret = ofi_recvmsg_udp(ep->sock, &hdr, 0);
+		if (ret < 0)
+			return;
+
+		seg_size = (int) ret;
+		for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg;
+		     cmsg = CMSG_NXTHDR(&hdr, cmsg)) {
+			if (cmsg->cmsg_level == SOL_UDP &&
+			    cmsg->cmsg_type == UDP_GRO)
+				memcpy(&seg_size, CMSG_DATA(cmsg),
+				       sizeof(seg_size));
+		}
+
+		off = 0;
+		do {
+			if (ofi_cirque_isempty(ep->rxq) ||
+			    ofi_cirque_isfull(ep->util_ep.rx_cq->cirq)) {
+				FI_DBG(&udpx_prov, FI_LOG_EP_DATA,
+				       "dropping %zd bytes of coalesced "
+				       "datagrams\n", ret - off);
+				return;
+			}
+
+			entry = ofi_cirque_head(ep->rxq);
+			len = ofi_copy_to_iov(entry->iov, entry->iov_count, 0,
+					      (char *) ep->gro_buf + off,
+					      MIN((size_t) seg_size, ret - off));
+			ep->rx_comp(ep, entry->context, 0, len, NULL, &addr);
+			ofi_cirque_discard(ep->rxq);
+			off += seg_size;
+		} while (off < (size_t) ret);
+	}
+}
+#endif
+
+static void udpx_ep_progress(struct util_ep *util_ep)
+{
+	struct udpx_ep *ep;
+
+	ep = container_of(util_ep, struct udpx_ep, util_ep);
+	if (ep->txq_cnt || ep->hold.iov_count) {
+		fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+		udpx_flush_txq(ep);
+		udpx_send_hold(ep);
+		fastlock_release(&ep->util_ep.tx_cq->cq_lock);
+	}
+
+	fastlock_acquire(&ep->util_ep.rx_cq->cq_lock);
+#ifdef UDP_GRO
+	if (ep->gro)
+		udpx_ep_recv_gro(ep);
+	else
+#endif
+		udpx_ep_recv(ep);
 	fastlock_release(&ep->util_ep.rx_cq->cq_lock);
 }
 
@@ -390,9 +832,29 @@ udpx_dest_addrlen(struct udpx_ep *ep, fi_addr_t addr, uint64_t flags)
 static ssize_t udpx_sendto(struct udpx_ep *ep, const void *buf, size_t len,
 			   const void *addr, size_t addrlen, void *context)
 {
+	struct iovec iov;
 	ssize_t ret;
 
 	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+	if (udpx_drop_tx(ep)) {
+		ret = ofi_cirque_isfull(ep->util_ep.tx_cq->cirq) ? -FI_EAGAIN : 0;
+		if (!ret)
+			ep->tx_comp(ep, context);
+		goto out;
+	}
+
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+	if (udpx_hold_tx(ep, &iov, 1, addr, addrlen, context)) {
+		ret = 0;
+		goto out;
+	}
+
+	if (ep->txq_cnt) {
+		ret = udpx_queue_tx(ep, &iov, 1, addr, addrlen, context, 0);
+		goto out;
+	}
+
 	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
 		ret = -FI_EAGAIN;
 		goto out;
@@ -402,6 +864,7 @@ static ssize_t udpx_sendto(struct udpx_ep *ep, const void *buf, size_t len,
 				addr, (socklen_t)addrlen);
 	if (ret == (ssize_t)len) {
 		ep->tx_comp(ep, context);
+		udpx_send_hold(ep);
 		ret = 0;
 	} else {
 		ret = -errno;
@@ -449,6 +912,33 @@ static ssize_t udpx_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 	hdr.msg_flags = 0;
 
 	fastlock_acquire(&ep->util_ep.tx_cq->cq_lock);
+	if (udpx_drop_tx(ep)) {
+		ret = ofi_cirque_isfull(ep->util_ep.tx_cq->cirq) ? -FI_EAGAIN : 0;
+		if (!ret)
+			ep->tx_comp(ep, msg->context);
+		goto out;
+	}
+
+	if (udpx_hold_tx(ep, msg->msg_iov, msg->iov_count, hdr.msg_name,
+			 hdr.msg_namelen, msg->context)) {
+		ret = 0;
+		goto out;
+	}
+
+	/* The queue keeps only the iov, and inject data is not kept */
+	if (flags & FI_INJECT) {
+		udpx_flush_txq(ep);
+		if (ep->txq_cnt) {
+			ret = -FI_EAGAIN;
+			goto out;
+		}
+	} else if (ep->txq_cnt || (flags & FI_MORE)) {
+		ret = udpx_queue_tx(ep, msg->msg_iov, msg->iov_count,
+				    hdr.msg_name, hdr.msg_namelen,
+				    msg->context, flags);
+		goto out;
+	}
+
 	if (ofi_cirque_isfull(ep->util_ep.tx_cq->cirq)) {
 		ret = -FI_EAGAIN;
 		goto out;
@@ -457,6 +947,7 @@ static ssize_t udpx_sendmsg(struct fid_ep *ep_fid, const struct fi_msg *msg,
 	ret = ofi_sendmsg_udp(ep->sock, &hdr, 0);
 	if (ret >= 0) {
 		ep->tx_comp(ep, msg->context);
+		udpx_send_hold(ep);
 		ret = 0;
 	} else {
 		ret = -errno;
@@ -501,6 +992,13 @@ static ssize_t udpx_inject(struct fid_ep *ep_fid, const void *buf, size_t len,
 	ssize_t ret;
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
+	ret = udpx_drain_txq(ep);
+	if (ret)
+		return ret;
+
+	if (udpx_drop_tx(ep))
+		return 0;
+
 	ret = ofi_sendto_socket(ep->sock, buf, len, 0,
 				ofi_ip_av_get_addr(ep->util_ep.av, (int)dest_addr),
 				(socklen_t)ep->util_ep.av->addrlen);
@@ -514,6 +1012,13 @@ static ssize_t udpx_inject_mc(struct fid_ep *ep_fid, const void *buf,
 	ssize_t ret;
 
 	ep = container_of(ep_fid, struct udpx_ep, util_ep.ep_fid.fid);
+	ret = udpx_drain_txq(ep);
+	if (ret)
+		return ret;
+
+	if (udpx_drop_tx(ep))
+		return 0;
+
 	ret = ofi_sendto_socket(ep->sock, buf, len, 0,
 				(const void *)(uintptr_t)dest_addr,
 				(socklen_t)ofi_sizeofaddr((const void *)(uintptr_t)dest_addr));
@@ -568,7 +1073,15 @@ static int udpx_ep_close(struct fid *fid)
 				&ep->util_ep.ep_fid.fid);
 	}
 
+	if (ep->util_ep.tx_cq) {
+		fid_list_remove(&ep->util_ep.tx_cq->ep_list,
+				&ep->util_ep.tx_cq->ep_list_lock,
+				&ep->util_ep.ep_fid.fid);
+	}
+
 	udpx_rx_cirq_free(ep->rxq);
+	free(ep->gro_buf);
+	free(ep->hold.iov[0].iov_base);
 	ofi_close_socket(ep->sock);
 	ofi_endpoint_close(&ep->util_ep);
 	free(ep);
@@ -590,6 +1103,13 @@ static int udpx_ep_bind_cq(struct udpx_ep *ep, struct util_cq *cq,
 		ofi_atomic_inc32(&cq->ref);
 		ep->tx_comp = cq->wait ? udpx_tx_comp_signal :
 					 udpx_tx_comp;
+
+		/* Reading the tx CQ flushes queued sends */
+		ret = fid_list_insert(&cq->ep_list,
+				      &cq->ep_list_lock,
+				      &ep->util_ep.ep_fid.fid);
+		if (ret)
+			return ret;
 	}
 
 	if (flags & FI_RECV) {
@@ -720,6 +1240,35 @@ static struct fi_ops udpx_ep_fi_ops = {
 	.ops_open = fi_no_ops_open,
 };
 
+/* Segmentation offloads are used where the kernel supports them */
+static void udpx_ep_init_offload(struct udpx_ep *ep)
+{
+	int val;
+
+#ifdef UDP_SEGMENT
+	val = 0;
+	if (udpx_use_gso &&
+	    !setsockopt(ep->sock, SOL_UDP, UDP_SEGMENT, &val, sizeof(val)))
+		ep->gso = 1;
+#endif
+#ifdef UDP_GRO
+	val = 1;
+	if (udpx_use_gro) {
+		ep->gro_buf = malloc(UDPX_GRO_BUF_SIZE);
+		if (ep->gro_buf && !setsockopt(ep->sock, SOL_UDP, UDP_GRO,
+					       &val, sizeof(val))) {
+			ep->gro = 1;
+		} else {
+			free(ep->gro_buf);
+			ep->gro_buf = NULL;
+		}
+	}
+#endif
+	(void) val;
+	FI_DBG(&udpx_prov, FI_LOG_EP_CTRL, "UDP GSO %s, GRO %s\n",
+	       ep->gso ? "on" : "off", ep->gro ? "on" : "off");
+}
+
 static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 {
 	int family;
@@ -751,6 +1300,10 @@ static int udpx_ep_init(struct udpx_ep *ep, struct fi_info *info)
 	if (ret)
 		goto err2;
 
+	udpx_ep_init_offload(ep);
+	ep->drop_seed = (uint32_t) ofi_gettime_us() | 1;
+	if (udpx_reorder_rate)
+		ep->hold.iov[0].iov_base = malloc(UDPX_HOLD_BUF_SIZE);
 	return 0;
 err2:
 	ofi_close_socket(ep->sock);
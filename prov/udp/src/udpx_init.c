@@ -38,6 +38,11 @@
 #include <sys/types.h>
 
 
+int udpx_use_gso = 1;
+int udpx_use_gro = 0;
+int udpx_drop_rate = 0;
+int udpx_reorder_rate = 0;
+
 static int udpx_getinfo(uint32_t version, const char *node, const char *service,
 			uint64_t flags, const struct fi_info *hints,
 			struct fi_info **info)
@@ -64,6 +69,36 @@ UDP_INI
 {
 	fi_param_define(&udpx_prov, "iface", FI_PARAM_STRING,
 			"Specify interface name");
+	fi_param_define(&udpx_prov, "gso", FI_PARAM_BOOL,
+			"Send runs of equally sized datagrams to the same "
+			"peer with a single UDP GSO send (default: yes)");
+	fi_param_define(&udpx_prov, "gro", FI_PARAM_BOOL,
+			"Accept datagrams coalesced by UDP GRO and split "
+			"them into posted buffers (default: no)");
+	fi_param_define(&udpx_prov, "drop_rate", FI_PARAM_INT,
+			"Percentage of sends to discard at random, to test "
+			"reliability protocols over a lossy network "
+			"(default: 0)");
+	fi_param_define(&udpx_prov, "reorder_rate", FI_PARAM_INT,
+			"Percentage of sends to hold back at random and "
+			"deliver after the next send, to test reliability "
+			"protocols over a reordering network (default: 0)");
+
+	fi_param_get_bool(&udpx_prov, "gso", &udpx_use_gso);
+	fi_param_get_bool(&udpx_prov, "gro", &udpx_use_gro);
+	fi_param_get_int(&udpx_prov, "drop_rate", &udpx_drop_rate);
+	if (udpx_drop_rate < 0 || udpx_drop_rate > 100) {
+		FI_WARN(&udpx_prov, FI_LOG_CORE,
+			"invalid drop_rate %d, ignoring\n", udpx_drop_rate);
+		udpx_drop_rate = 0;
+	}
+	fi_param_get_int(&udpx_prov, "reorder_rate", &udpx_reorder_rate);
+	if (udpx_reorder_rate < 0 || udpx_reorder_rate > 100) {
+		FI_WARN(&udpx_prov, FI_LOG_CORE,
+			"invalid reorder_rate %d, ignoring\n",
+			udpx_reorder_rate);
+		udpx_reorder_rate = 0;
+	}
 
 	return &udpx_prov;
 }
@@ -242,6 +242,19 @@ static inline void util_coll_op_log_work(struct util_coll_operation *coll_op)
 			       xfer_item->count, ofi_datatype_size(xfer_item->datatype),
 			       xfer_item->tag);
 			break;
+		case UTIL_COLL_MCAST_SEND:
+		case UTIL_COLL_MCAST_RECV:
+			xfer_item =
+				container_of(cur_item, struct util_coll_xfer_item, hdr);
+			FI_DBG(coll_op->mc->av_set->av->prov, FI_LOG_CQ,
+			       "\t%ld: { %p [%s] MCAST %s ROOT: 0x%02x LOCAL: 0x%02lx "
+			       "cnt: %d typesize: %ld tag: 0x%02lx }\n",
+			       count, cur_item, log_util_coll_state[cur_item->state],
+			       cur_item->type == UTIL_COLL_MCAST_SEND ? "SEND" : "RECV",
+			       xfer_item->remote_rank, coll_op->mc->local_rank,
+			       xfer_item->count, ofi_datatype_size(xfer_item->datatype),
+			       xfer_item->tag);
+			break;
 		case UTIL_COLL_REDUCE:
 			//reduce_item = container_of(cur_item, struct util_coll_reduce_item, hdr);
 			FI_DBG(coll_op->mc->av_set->av->prov, FI_LOG_CQ,
@@ -390,6 +403,31 @@ static int util_coll_sched_recv(struct util_coll_operation *coll_op, uint32_t sr
 	return FI_SUCCESS;
 }
 
+/* The root sends buf to all other members at once, see coll_mcast */
+static int util_coll_sched_mcast(struct util_coll_operation *coll_op,
+				 enum coll_work_type type, uint32_t root,
+				 void *buf, int count, enum fi_datatype datatype,
+				 int fence)
+{
+	struct util_coll_xfer_item *xfer_item;
+
+	xfer_item = calloc(1, sizeof(*xfer_item));
+	if (!xfer_item)
+		return -FI_ENOMEM;
+
+	xfer_item->hdr.type = type;
+	xfer_item->hdr.state = UTIL_COLL_WAITING;
+	xfer_item->hdr.fence = fence;
+	xfer_item->tag = util_coll_form_tag(coll_op->cid, root);
+	xfer_item->buf = buf;
+	xfer_item->count = count;
+	xfer_item->datatype = datatype;
+	xfer_item->remote_rank = root;
+
+	util_coll_op_bind_work(coll_op, &xfer_item->hdr);
+	return FI_SUCCESS;
+}
+
 static int util_coll_sched_reduce(struct util_coll_operation *coll_op, void *in_buf,
 				  void *inout_buf, int count, enum fi_datatype datatype,
 				  enum fi_op op, int fence)
@@ -550,6 +588,46 @@ static int util_coll_allreduce(struct util_coll_operation *coll_op, const void *
 	return FI_SUCCESS;
 }
 
+static inline int util_coll_use_mcast(struct util_ep *util_ep,
+				      struct util_coll_mc *coll_mc)
+{
+	return util_ep->coll_mcast && coll_mc->local_rank != FI_ADDR_NOTAVAIL &&
+	       coll_mc->av_set->fi_addr_count > 1;
+}
+
+/*
+ * Gather to rank 0, which releases everyone with one multicast.  Rank 0
+ * posts all of its receives at once and fences only the last, so the
+ * release goes out once every member has arrived.
+ */
+static int util_coll_mcast_barrier(struct util_coll_operation *coll_op)
+{
+	uint64_t local, numranks, i;
+	int ret;
+
+	local = coll_op->mc->local_rank;
+	numranks = coll_op->mc->av_set->fi_addr_count;
+
+	if (local) {
+		ret = util_coll_sched_send(coll_op, 0, NULL, 0, FI_UINT8, 0);
+		if (ret)
+			return ret;
+
+		return util_coll_sched_mcast(coll_op, UTIL_COLL_MCAST_RECV, 0,
+					     NULL, 0, FI_UINT8, 1);
+	}
+
+	for (i = 1; i < numranks; i++) {
+		ret = util_coll_sched_recv(coll_op, i, NULL, 0, FI_UINT8,
+					   i == numranks - 1);
+		if (ret)
+			return ret;
+	}
+
+	return util_coll_sched_mcast(coll_op, UTIL_COLL_MCAST_SEND, 0, NULL, 0,
+				     FI_UINT8, 1);
+}
+
 static int util_coll_allgather(struct util_coll_operation *coll_op, const void *send_buf,
 			       void *result, int count, enum fi_datatype datatype)
 {
@@ -772,6 +850,29 @@ static int ofi_av_set_addr(struct fid_av_set *set, fi_addr_t *coll_addr)
 	return FI_SUCCESS;
 }
 
+static void util_coll_lookup_local_rank(struct util_coll_mc *coll_mc,
+					const char *addr, size_t addrlen)
+{
+	char *member;
+	size_t len;
+	int i;
+
+	member = calloc(1, addrlen);
+	if (!member)
+		return;
+
+	for (i = 0; i < coll_mc->av_set->fi_addr_count; i++) {
+		len = addrlen;
+		if (!fi_av_lookup(&coll_mc->av_set->av->av_fid,
+				  coll_mc->av_set->fi_addr_array[i], member, &len) &&
+		    len == addrlen && !memcmp(member, addr, addrlen)) {
+			coll_mc->local_rank = i;
+			break;
+		}
+	}
+	free(member);
+}
+
 /* TODO: Figure out requirements for using collectives.
  * e.g. require local address to be in AV?
  * Determine best way to handle first join request
@@ -807,6 +908,9 @@ static int util_coll_find_local_rank(struct fid_ep *ep, struct util_coll_mc *col
 				coll_mc->local_rank = i;
 				break;
 			}
+	} else {
+		/* The provider keeps its own addresses out of the util AV */
+		util_coll_lookup_local_rank(coll_mc, addr, addrlen);
 	}
 
 	free(addr);
@@ -956,6 +1060,18 @@ int ofi_coll_ep_progress(struct fid_ep *ep)
 			if (ret)
 				goto out;
 			break;
+		case UTIL_COLL_MCAST_SEND:
+		case UTIL_COLL_MCAST_RECV:
+			xfer_item = container_of(work_item, struct util_coll_xfer_item, hdr);
+			ret = util_ep->coll_mcast(util_ep, xfer_item);
+			if (ret == -FI_EAGAIN) {
+				slist_insert_tail(&work_item->ready_entry,
+						  &util_ep->coll_ready_queue);
+				goto out;
+			}
+			if (ret)
+				goto out;
+			break;
 		case UTIL_COLL_REDUCE:
 			reduce_item = container_of(work_item, struct util_coll_reduce_item, hdr);
 			ret = util_coll_proc_reduce_item(reduce_item);
@@ -1231,9 +1347,16 @@ ssize_t ofi_ep_barrier(struct fid_ep *ep, fi_addr_t coll_addr, void *context)
 	if (ret)
 		return ret;
 
-	send = ~barrier_op->mc->local_rank;
-	ret = util_coll_allreduce(barrier_op, &send, &barrier_op->data.barrier.data,
-				  &barrier_op->data.barrier.tmp, 1, FI_UINT64, FI_BAND);
+	util_ep = container_of(ep, struct util_ep, ep_fid);
+	if (util_coll_use_mcast(util_ep, coll_mc)) {
+		ret = util_coll_mcast_barrier(barrier_op);
+	} else {
+		send = ~barrier_op->mc->local_rank;
+		ret = util_coll_allreduce(barrier_op, &send,
+					  &barrier_op->data.barrier.data,
+					  &barrier_op->data.barrier.tmp, 1,
+					  FI_UINT64, FI_BAND);
+	}
 	if (ret)
 		goto err1;
 
@@ -1241,7 +1364,6 @@ ssize_t ofi_ep_barrier(struct fid_ep *ep, fi_addr_t coll_addr, void *context)
 	if (ret)
 		goto err1;
 
-	util_ep = container_of(ep, struct util_ep, ep_fid);
 	util_coll_op_progress_work(util_ep, barrier_op);
 
 	return FI_SUCCESS;
@@ -1372,7 +1494,19 @@ ssize_t ofi_ep_broadcast(struct fid_ep *ep, void *buf, size_t count, void *desc,
 	if (ret)
 		return ret;
 
+	util_ep = container_of(ep, struct util_ep, ep_fid);
 	local = broadcast_op->mc->local_rank;
+	if (util_coll_use_mcast(util_ep, coll_mc)) {
+		ret = util_coll_sched_mcast(broadcast_op,
+					    (fi_addr_t) local == root_addr ?
+					    UTIL_COLL_MCAST_SEND :
+					    UTIL_COLL_MCAST_RECV, root_addr,
+					    buf, count, datatype, 1);
+		if (ret)
+			goto err1;
+		goto comp;
+	}
+
 	numranks = broadcast_op->mc->av_set->fi_addr_count;
 	chunk_cnt = (count + numranks - 1) / numranks;
 	if (chunk_cnt * local > count && chunk_cnt * local - (int) count > chunk_cnt)
@@ -1394,12 +1528,11 @@ ssize_t ofi_ep_broadcast(struct fid_ep *ep, void *buf, size_t count, void *desc,
 				  chunk_cnt, datatype);
 	if (ret)
 		goto err2;
-
+comp:
 	ret = util_coll_sched_comp(broadcast_op);
 	if (ret)
 		goto err2;
 
-	util_ep = container_of(ep, struct util_ep, ep_fid);
 	util_coll_op_progress_work(util_ep, broadcast_op);
 
 	return FI_SUCCESS;
@@ -1418,7 +1551,8 @@ void ofi_coll_handle_xfer_comp(uint64_t tag, void *ctx)
 
 	FI_DBG(xfer_item->hdr.coll_op->mc->av_set->av->prov, FI_LOG_CQ,
 	       "\tXfer complete: { %p %s Remote: 0x%02x Local: 0x%02lx cnt: %d typesize: %ld }\n",
-	       xfer_item, xfer_item->hdr.type == UTIL_COLL_SEND ? "SEND" : "RECV",
+	       xfer_item, xfer_item->hdr.type == UTIL_COLL_SEND ||
+	       xfer_item->hdr.type == UTIL_COLL_MCAST_SEND ? "SEND" : "RECV",
 	       xfer_item->remote_rank, xfer_item->hdr.coll_op->mc->local_rank,
 	       xfer_item->count, ofi_datatype_size(xfer_item->datatype));
 	util_ep = container_of(xfer_item->hdr.coll_op->mc->ep, struct util_ep, ep_fid);